@@ -28,6 +28,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/fault-inject.h>
 #include <linux/list_sort.h>
+#include <linux/percpu.h>
 #include <linux/delay.h>
 #include <linux/ratelimit.h>
 #include <linux/pm_runtime.h>
@@ -289,6 +290,7 @@ void blk_sync_queue(struct request_queue *q)
 {
 	del_timer_sync(&q->timeout);
 	cancel_delayed_work_sync(&q->delay_work);
+	cancel_delayed_work_sync(&q->staging_work);
 }
 EXPORT_SYMBOL(blk_sync_queue);
 
@@ -379,6 +381,8 @@ void blk_drain_queue(struct request_queue *q, bool drain_all)
 		bool drain = false;
 		int i;
 
+		blk_staging_flush(q);
+
 		spin_lock_irq(q->queue_lock);
 
 		elv_drain_elevator(q);
@@ -526,6 +530,7 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	INIT_LIST_HEAD(&q->flush_queue[1]);
 	INIT_LIST_HEAD(&q->flush_data_in_flight);
 	INIT_DELAYED_WORK(&q->delay_work, blk_delay_work);
+	INIT_DELAYED_WORK(&q->staging_work, blk_staging_work);
 
 	kobject_init(&q->kobj, &blk_queue_ktype);
 
@@ -1427,6 +1432,8 @@ EXPORT_SYMBOL(init_request_from_bio);
 void blk_queue_bio(struct request_queue *q, struct bio *bio)
 {
 	const bool sync = !!(bio->bi_rw & REQ_SYNC);
+	/* only async writes may wait for the staging flush */
+	const bool stage = !rw_is_sync(bio->bi_rw);
 	struct blk_plug *plug;
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
@@ -1452,6 +1459,14 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	if (attempt_plug_merge(q, bio, &request_count))
 		return;
 
+	/*
+	 * Unplugged async writes get the same chance against this cpu's
+	 * staged requests.
+	 */
+	if (stage && !current->plug && blk_queue_staging(q) &&
+	    blk_staging_merge(q, bio))
+		return;
+
 	spin_lock_irq(q->queue_lock);
 
 	el_ret = elv_merge(q, &req, bio);
@@ -1527,6 +1542,9 @@ get_rq:
 		}
 		list_add_tail(&req->queuelist, &plug->list);
 		drive_stat_acct(req, 1);
+	} else if (stage && where == ELEVATOR_INSERT_SORT &&
+		   blk_queue_staging(q)) {
+		blk_staging_add(q, req);
 	} else {
 		spin_lock_irq(q->queue_lock);
 		add_acct_request(q, req, where);
@@ -3051,6 +3069,219 @@ void blk_finish_plug(struct blk_plug *plug)
 }
 EXPORT_SYMBOL(blk_finish_plug);
 
+/*
+ * Per-cpu request staging
+ *
+ * An unplugged submitter takes q->queue_lock to try an elevator merge
+ * and allocate a request, and then once more to insert the request and
+ * run the queue.  With writeback, zram and dm all submitting to the
+ * same eMMC queue from several cpus, that lock is heavily contended.
+ *
+ * With queue/rq_staging set, async bios from unplugged submitters are
+ * first merged against a list of requests private to the submitting
+ * cpu, and new requests are parked there instead of being inserted
+ * right away - an implicit per-cpu plug.  A cpu's list is inserted into
+ * the elevator in one queue_lock round trip once it holds
+ * BLK_MAX_REQUEST_COUNT requests, and all lists are flushed from
+ * kblockd a jiffy after the first request was staged.  Reads and sync
+ * writes are never staged.
+ */
+struct blk_staging {
+	spinlock_t		lock;
+	struct list_head	list;
+	unsigned int		count;
+};
+
+/**
+ * blk_staging_merge - try to merge @bio into a request staged on this cpu
+ * @q: request_queue @bio is being queued at
+ * @bio: new bio being queued
+ *
+ * Like attempt_plug_merge(), only basic merge parameters are checked.
+ * As the list is shared by all tasks on the cpu, a bio is only merged
+ * into requests of its own io_context so that elevators still see each
+ * request charged to the right issuer.  A request without an icq can't
+ * be told apart and takes no merges.
+ */
+bool blk_staging_merge(struct request_queue *q, struct bio *bio)
+{
+	struct blk_staging *st;
+	struct request *rq;
+	bool ret = false;
+
+	local_irq_disable();
+	st = this_cpu_ptr(q->staging);
+	spin_lock(&st->lock);
+
+	list_for_each_entry_reverse(rq, &st->list, queuelist) {
+		int el_ret;
+
+		if (!rq->elv.icq || rq->elv.icq->ioc != current->io_context)
+			continue;
+		if (!blk_rq_merge_ok(rq, bio))
+			continue;
+
+		el_ret = blk_try_merge(rq, bio);
+		if (el_ret == ELEVATOR_BACK_MERGE) {
+			ret = bio_attempt_back_merge(q, rq, bio);
+			if (ret)
+				break;
+		} else if (el_ret == ELEVATOR_FRONT_MERGE) {
+			ret = bio_attempt_front_merge(q, rq, bio);
+			if (ret)
+				break;
+		}
+	}
+
+	spin_unlock_irq(&st->lock);
+	return ret;
+}
+
+/*
+ * Insert staged requests into the elevator and run the queue, with one
+ * queue_lock round trip for the whole batch.
+ */
+static void blk_staging_insert(struct request_queue *q,
+			       struct list_head *list)
+{
+	struct request *rq;
+	unsigned int depth = 0;
+
+	local_irq_disable();
+	spin_lock(q->queue_lock);
+	while (!list_empty(list)) {
+		rq = list_entry_rq(list->next);
+		list_del_init(&rq->queuelist);
+
+		if (unlikely(blk_queue_dead(q))) {
+			__blk_end_request_all(rq, -ENODEV);
+			continue;
+		}
+
+		/* rq is already accounted, so use raw insert */
+		__elv_add_request(q, rq, ELEVATOR_INSERT_SORT_MERGE);
+		depth++;
+	}
+
+	/* This drops the queue lock */
+	queue_unplugged(q, depth, false);
+	local_irq_enable();
+}
+
+/**
+ * blk_staging_add - park a new async request on this cpu's staging list
+ * @q: request_queue @rq belongs to
+ * @rq: request initialized from an async bio
+ */
+void blk_staging_add(struct request_queue *q, struct request *rq)
+{
+	struct blk_staging *st;
+	LIST_HEAD(list);
+	bool flush;
+
+	drive_stat_acct(rq, 1);
+
+	local_irq_disable();
+	st = this_cpu_ptr(q->staging);
+	spin_lock(&st->lock);
+	if (list_empty(&st->list))
+		trace_block_plug(q);
+	list_add_tail(&rq->queuelist, &st->list);
+	flush = ++st->count >= BLK_MAX_REQUEST_COUNT;
+	if (flush) {
+		list_splice_init(&st->list, &list);
+		st->count = 0;
+	}
+	spin_unlock_irq(&st->lock);
+
+	if (flush)
+		blk_staging_insert(q, &list);
+	else if (!delayed_work_pending(&q->staging_work))
+		kblockd_schedule_delayed_work(q, &q->staging_work, 1);
+}
+
+/**
+ * blk_staging_flush - insert the requests staged on all cpus
+ * @q: request_queue to flush
+ */
+void blk_staging_flush(struct request_queue *q)
+{
+	struct blk_staging *st;
+	LIST_HEAD(list);
+	int cpu;
+
+	if (!q->staging)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		st = per_cpu_ptr(q->staging, cpu);
+
+		spin_lock_irq(&st->lock);
+		list_splice_init(&st->list, &list);
+		st->count = 0;
+		spin_unlock_irq(&st->lock);
+
+		if (!list_empty(&list))
+			blk_staging_insert(q, &list);
+	}
+}
+
+void blk_staging_work(struct work_struct *work)
+{
+	struct request_queue *q;
+
+	q = container_of(work, struct request_queue, staging_work.work);
+	blk_staging_flush(q);
+}
+
+/**
+ * blk_staging_enable - turn per-cpu request staging on or off
+ * @q: request based queue
+ * @enable: new setting
+ *
+ * The staging lists are allocated on first use and stay around until
+ * the queue is released.  Called with q->sysfs_lock held.
+ */
+int blk_staging_enable(struct request_queue *q, bool enable)
+{
+	struct blk_staging __percpu *staging;
+	struct blk_staging *st;
+	int cpu;
+
+	if (!q->request_fn)
+		return -EINVAL;
+
+	if (enable && !q->staging) {
+		staging = alloc_percpu(struct blk_staging);
+		if (!staging)
+			return -ENOMEM;
+		for_each_possible_cpu(cpu) {
+			st = per_cpu_ptr(staging, cpu);
+			spin_lock_init(&st->lock);
+			INIT_LIST_HEAD(&st->list);
+			st->count = 0;
+		}
+		q->staging = staging;
+	}
+
+	spin_lock_irq(q->queue_lock);
+	if (enable)
+		queue_flag_set(QUEUE_FLAG_STAGING, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_STAGING, q);
+	spin_unlock_irq(q->queue_lock);
+
+	if (!enable)
+		blk_staging_flush(q);
+	return 0;
+}
+
+void blk_staging_exit(struct request_queue *q)
+{
+	free_percpu(q->staging);
+	q->staging = NULL;
+}
+
 #ifdef CONFIG_PM_RUNTIME
 /**
  * blk_pm_runtime_init - Block layer runtime PM initialization routine
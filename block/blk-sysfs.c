@@ -275,6 +275,22 @@ queue_rq_affinity_store(struct request_queue *q, const char *page, size_t count)
 	return ret;
 }
 
+static ssize_t queue_rq_staging_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_staging(q), page);
+}
+
+static ssize_t
+queue_rq_staging_store(struct request_queue *q, const char *page, size_t count)
+{
+	unsigned long val;
+	ssize_t ret = queue_var_store(&val, page, count);
+	int err;
+
+	err = blk_staging_enable(q, !!val);
+	return err ? err : ret;
+}
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -377,6 +393,12 @@ static struct queue_sysfs_entry queue_rq_affinity_entry = {
 	.store = queue_rq_affinity_store,
 };
 
+static struct queue_sysfs_entry queue_rq_staging_entry = {
+	.attr = {.name = "rq_staging", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_rq_staging_show,
+	.store = queue_rq_staging_store,
+};
+
 static struct queue_sysfs_entry queue_iostats_entry = {
 	.attr = {.name = "iostats", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_show_iostats,
@@ -409,6 +431,7 @@ static struct attribute *default_attrs[] = {
 	&queue_nonrot_entry.attr,
 	&queue_nomerges_entry.attr,
 	&queue_rq_affinity_entry.attr,
+	&queue_rq_staging_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
 	NULL,
@@ -480,6 +503,7 @@ static void blk_release_queue(struct kobject *kobj)
 	struct request_list *rl = &q->rq;
 
 	blk_sync_queue(q);
+	blk_staging_exit(q);
 
 	if (q->elevator) {
 		spin_lock_irq(q->queue_lock);
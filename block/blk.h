@@ -24,6 +24,12 @@ void blk_rq_bio_prep(struct request_queue *q, struct request *rq,
 int blk_rq_append_bio(struct request_queue *q, struct request *rq,
 		      struct bio *bio);
 void blk_drain_queue(struct request_queue *q, bool drain_all);
+bool blk_staging_merge(struct request_queue *q, struct bio *bio);
+void blk_staging_add(struct request_queue *q, struct request *rq);
+void blk_staging_flush(struct request_queue *q);
+void blk_staging_work(struct work_struct *work);
+int blk_staging_enable(struct request_queue *q, bool enable);
+void blk_staging_exit(struct request_queue *q);
 void blk_dequeue_request(struct request *rq);
 void __blk_queue_free_tags(struct request_queue *q);
 bool __blk_end_bidi_request(struct request *rq, int error,
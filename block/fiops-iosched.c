@@ -11,6 +11,8 @@
 #include <linux/rbtree.h>
 #include <linux/ioprio.h>
 #include <linux/blktrace_api.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include "blk.h"
 
 #define VIOS_SCALE_SHIFT 10
@@ -23,6 +25,22 @@
 
 #define VIOS_PRIO_SCALE (5)
 
+/*
+ * Latency target mode: with read_lat_target_us set, the number of writes
+ * dispatched to the device is capped at write_depth.  Every
+ * FIOPS_LAT_WINDOW read completions the average read latency of the
+ * window is compared to the target: write_depth is halved if it was
+ * missed and grows by one otherwise.  Without reads completing for
+ * FIOPS_LAT_IDLE, writes are not throttled at all.
+ */
+#define FIOPS_MAX_WRITE_DEPTH	32
+#define FIOPS_LAT_WINDOW	16
+#define FIOPS_LAT_IDLE		(HZ / 10)
+
+/* Completion latency histogram: bucket i counts latencies < 2^(i+6) us */
+#define FIOPS_LAT_HIST_SHIFT	6
+#define FIOPS_LAT_HIST_BUCKETS	16
+
 struct fiops_rb_root {
 	struct rb_root rb;
 	struct rb_node *left;
@@ -53,6 +71,16 @@ struct fiops_data {
 	unsigned int write_scale;
 	unsigned int sync_scale;
 	unsigned int async_scale;
+
+	unsigned int read_lat_target;	/* usecs, 0 disables */
+	unsigned int write_depth;
+	unsigned int write_in_flight;
+	bool write_throttled;
+	unsigned long last_read;	/* jiffies of last read completion */
+	unsigned int window_reads;
+	u64 window_lat;
+
+	unsigned long lat_hist[2][FIOPS_LAT_HIST_BUCKETS];
 };
 
 struct fiops_ioc {
@@ -76,6 +104,8 @@ struct fiops_ioc {
 
 #define ioc_service_tree(ioc) (&((ioc)->fiopsd->service_tree[(ioc)->wl_type]))
 #define RQ_CIC(rq)		icq_to_cic((rq)->elv.icq)
+/* Insertion time in usecs, only compared within a few seconds so u32 will do */
+#define RQ_INSERT_US(rq)	((u32)(unsigned long)(rq)->elv.priv[0])
 
 enum ioc_state_flags {
 	FIOPS_IOC_FLAG_on_rr = 0,	/* on round-robin busy list */
@@ -349,6 +379,8 @@ static u64 fiops_dispatch_request(struct fiops_data *fiopsd,
 	elv_dispatch_add_tail(q, rq);
 
 	fiopsd->in_flight[rq_is_sync(rq)]++;
+	if (rq_data_dir(rq) == WRITE)
+		fiopsd->write_in_flight++;
 	ioc->in_flight++;
 
 	return fiops_scaled_vios(fiopsd, ioc, rq);
@@ -375,6 +407,37 @@ static int fiops_forced_dispatch(struct fiops_data *fiopsd)
 	return dispatched;
 }
 
+static bool fiops_write_throttled(struct fiops_data *fiopsd)
+{
+	if (!fiopsd->read_lat_target)
+		return false;
+	if (time_after(jiffies, fiopsd->last_read + FIOPS_LAT_IDLE))
+		return false;
+	return fiopsd->write_in_flight >= fiopsd->write_depth;
+}
+
+/*
+ * Writes may not be dispatched right now, look for the first ioc in
+ * service order that has a read at the head of its fifo.
+ */
+static struct fiops_ioc *fiops_select_read_ioc(struct fiops_data *fiopsd,
+	struct fiops_rb_root *service_tree)
+{
+	struct fiops_ioc *ioc;
+	struct rb_node *n;
+
+	for (n = rb_first(&service_tree->rb); n; n = rb_next(n)) {
+		ioc = rb_entry(n, struct fiops_ioc, rb_node);
+		if (rq_data_dir(rq_entry_fifo(ioc->fifo.next)) == READ)
+			return ioc;
+	}
+
+	fiops_log(fiopsd, "throttle writes, in_flight %d depth %d",
+		fiopsd->write_in_flight, fiopsd->write_depth);
+	fiopsd->write_throttled = true;
+	return NULL;
+}
+
 static struct fiops_ioc *fiops_select_ioc(struct fiops_data *fiopsd)
 {
 	struct fiops_ioc *ioc;
@@ -395,6 +458,12 @@ static struct fiops_ioc *fiops_select_ioc(struct fiops_data *fiopsd)
 	ioc = fiops_rb_first(service_tree);
 
 	rq = rq_entry_fifo(ioc->fifo.next);
+	if (rq_data_dir(rq) == WRITE && fiops_write_throttled(fiopsd)) {
+		ioc = fiops_select_read_ioc(fiopsd, service_tree);
+		if (!ioc)
+			return NULL;
+		rq = rq_entry_fifo(ioc->fifo.next);
+	}
 	/*
 	 * we are the only async task and sync requests are in flight, delay a
 	 * moment. If there are other tasks coming, sync tasks have no chance
@@ -489,6 +558,7 @@ static void fiops_insert_request(struct request_queue *q, struct request *rq)
 
 	fiops_init_prio_data(ioc);
 
+	rq->elv.priv[0] = (void *)(unsigned long)ktime_to_us(ktime_get());
 	list_add_tail(&rq->queuelist, &ioc->fifo);
 
 	fiops_add_rq_rb(rq);
@@ -504,19 +574,60 @@ static inline void fiops_schedule_dispatch(struct fiops_data *fiopsd)
 		kblockd_schedule_work(fiopsd->queue, &fiopsd->unplug_work);
 }
 
+static void fiops_account_latency(struct fiops_data *fiopsd,
+	struct request *rq)
+{
+	u32 lat = (u32)ktime_to_us(ktime_get()) - RQ_INSERT_US(rq);
+	int dir = rq_data_dir(rq);
+	int bucket;
+
+	bucket = fls(lat >> FIOPS_LAT_HIST_SHIFT);
+	if (bucket >= FIOPS_LAT_HIST_BUCKETS)
+		bucket = FIOPS_LAT_HIST_BUCKETS - 1;
+	fiopsd->lat_hist[dir][bucket]++;
+
+	if (dir != READ || !fiopsd->read_lat_target)
+		return;
+
+	fiopsd->last_read = jiffies;
+	fiopsd->window_lat += lat;
+	if (++fiopsd->window_reads < FIOPS_LAT_WINDOW)
+		return;
+
+	if (div_u64(fiopsd->window_lat, fiopsd->window_reads) >
+	    fiopsd->read_lat_target)
+		fiopsd->write_depth = max(fiopsd->write_depth / 2, 1U);
+	else if (fiopsd->write_depth < FIOPS_MAX_WRITE_DEPTH)
+		fiopsd->write_depth++;
+	fiops_log(fiopsd, "read lat %llu, write depth %d",
+		div_u64(fiopsd->window_lat, fiopsd->window_reads),
+		fiopsd->write_depth);
+
+	fiopsd->window_reads = 0;
+	fiopsd->window_lat = 0;
+}
+
 static void fiops_completed_request(struct request_queue *q, struct request *rq)
 {
 	struct fiops_data *fiopsd = q->elevator->elevator_data;
 	struct fiops_ioc *ioc = RQ_CIC(rq);
 
 	fiopsd->in_flight[rq_is_sync(rq)]--;
+	if (rq_data_dir(rq) == WRITE)
+		fiopsd->write_in_flight--;
 	ioc->in_flight--;
 
+	fiops_account_latency(fiopsd, rq);
+
 	fiops_log_ioc(fiopsd, ioc, "in_flight %d, busy queues %d",
 		ioc->in_flight, fiopsd->busy_queues);
 
 	if (fiopsd->in_flight[0] + fiopsd->in_flight[1] == 0)
 		fiops_schedule_dispatch(fiopsd);
+	else if (fiopsd->write_throttled && !fiops_write_throttled(fiopsd)) {
+		fiopsd->write_throttled = false;
+		fiops_schedule_dispatch(fiopsd);
+	}
 }
 
 static struct request *
@@ -634,6 +745,8 @@ static void *fiops_init_queue(struct request_queue *q)
 	fiopsd->write_scale = VIOS_WRITE_SCALE;
 	fiopsd->sync_scale = VIOS_SYNC_SCALE;
 	fiopsd->async_scale = VIOS_ASYNC_SCALE;
+	fiopsd->write_depth = FIOPS_MAX_WRITE_DEPTH;
+	fiopsd->last_read = jiffies - FIOPS_LAT_IDLE - 1;
 
 	return fiopsd;
 }
@@ -681,6 +794,8 @@ SHOW_FUNCTION(fiops_read_scale_show, fiopsd->read_scale);
 SHOW_FUNCTION(fiops_write_scale_show, fiopsd->write_scale);
 SHOW_FUNCTION(fiops_sync_scale_show, fiopsd->sync_scale);
 SHOW_FUNCTION(fiops_async_scale_show, fiopsd->async_scale);
+SHOW_FUNCTION(fiops_read_lat_target_us_show, fiopsd->read_lat_target);
+SHOW_FUNCTION(fiops_write_depth_show, fiopsd->write_depth);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX)				\
@@ -700,8 +815,37 @@ STORE_FUNCTION(fiops_read_scale_store, &fiopsd->read_scale, 1, 100);
 STORE_FUNCTION(fiops_write_scale_store, &fiopsd->write_scale, 1, 100);
 STORE_FUNCTION(fiops_sync_scale_store, &fiopsd->sync_scale, 1, 100);
 STORE_FUNCTION(fiops_async_scale_store, &fiopsd->async_scale, 1, 100);
+STORE_FUNCTION(fiops_read_lat_target_us_store, &fiopsd->read_lat_target,
+	0, USEC_PER_SEC);
 #undef STORE_FUNCTION
 
+static ssize_t fiops_lat_hist_show(struct elevator_queue *e, char *page)
+{
+	struct fiops_data *fiopsd = e->elevator_data;
+	ssize_t len;
+	int i;
+
+	len = sprintf(page, "%10s %10s %10s\n", "<usecs", "read", "write");
+	for (i = 0; i < FIOPS_LAT_HIST_BUCKETS; i++)
+		len += sprintf(page + len, "%10lu %10lu %10lu\n",
+			1UL << (i + FIOPS_LAT_HIST_SHIFT),
+			fiopsd->lat_hist[READ][i], fiopsd->lat_hist[WRITE][i]);
+	return len;
+}
+
+/* Any write clears the histogram */
+static ssize_t fiops_lat_hist_store(struct elevator_queue *e,
+	const char *page, size_t count)
+{
+	struct fiops_data *fiopsd = e->elevator_data;
+	struct request_queue *q = fiopsd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	memset(fiopsd->lat_hist, 0, sizeof(fiopsd->lat_hist));
+	spin_unlock_irq(q->queue_lock);
+	return count;
+}
+
 #define FIOPS_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, fiops_##name##_show, fiops_##name##_store)
 
@@ -710,6 +854,9 @@ static struct elv_fs_entry fiops_attrs[] = {
 	FIOPS_ATTR(write_scale),
 	FIOPS_ATTR(sync_scale),
 	FIOPS_ATTR(async_scale),
+	FIOPS_ATTR(read_lat_target_us),
+	__ATTR(write_depth, S_IRUGO, fiops_write_depth_show, NULL),
+	FIOPS_ATTR(lat_hist),
 	__ATTR_NULL
 };
 
@@ -26,6 +26,8 @@
 #include <linux/compiler.h>
 #include <linux/blktrace_api.h>
 #include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include "blk-cgroup.h"
 
 /*
  * enum row_queue_prio - Priorities of the ROW queues
@@ -111,10 +113,47 @@ struct rowq_idling_data {
 	bool			begin_idling;
 };
 
+/*
+ * Dispatching one request advances a group's virtual dispatch time by
+ * ROW_GROUP_VDISP_SCALE / weight, so a group with twice the blkio weight
+ * gets twice the requests through when both are backlogged.
+ */
+#define ROW_GROUP_VDISP_SCALE	(1 << 20)
+
+/**
+ * struct row_group - per blkio cgroup sub-queue of a ROW queue
+ * @node:		entry in row_queue->groups
+ * @fifo:		fifo of requests issued from this cgroup
+ * @blkcg_id:		css id of the blkio cgroup
+ * @weight:		blkio weight of the cgroup on this device
+ * @vdisp:		virtual dispatch time
+ * @nr_req:		number of requests in fifo
+ * @nr_dispatched:	requests dispatched so far
+ * @nr_completed:	requests completed so far
+ * @wait_total_ns:	summed queueing time of dispatched requests
+ * @lat_total_ns:	summed completion latency of completed requests
+ * @lat_max_ns:		worst completion latency
+ *
+ */
+struct row_group {
+	struct list_head	node;
+	struct list_head	fifo;
+	unsigned short		blkcg_id;
+	unsigned int		weight;
+	u64			vdisp;
+	unsigned int		nr_req;
+
+	unsigned long		nr_dispatched;
+	unsigned long		nr_completed;
+	u64			wait_total_ns;
+	u64			lat_total_ns;
+	u64			lat_max_ns;
+};
+
 /**
  * struct row_queue - requests grouping structure
  * @rdata:		parent row_data structure
- * @fifo:		fifo of requests
+ * @fifo:		fifo of requests not assigned to a group
  * @prio:		queue priority (enum row_queue_prio)
  * @nr_dispatched:	number of requests already dispatched in
  *			the current dispatch cycle
@@ -122,6 +161,8 @@ struct rowq_idling_data {
  * @dispatch quantum:	number of requests this queue may
  *			dispatch in a dispatch cycle
  * @idle_data:		data for idling on queues
+ * @groups:		per cgroup sub-queues (struct row_group)
+ * @min_vdisp:		virtual dispatch time of the last served group
  *
  */
 struct row_queue {
@@ -136,6 +177,9 @@ struct row_queue {
 
 	/* used only for READ queues */
 	struct rowq_idling_data	idle_data;
+
+	struct list_head	groups;
+	u64			min_vdisp;
 };
 
 /**
@@ -187,6 +231,7 @@ struct starvation_data {
  * @reg_prio_starvation: starvation data for REGULAR priority queues
  * @low_prio_starvation: starvation data for LOW priority queues
  * @cycle_flags:	used for marking unserved queueus
+ * @group_sched:	sub-queue requests by blkio cgroup
  *
  */
 struct row_data {
@@ -206,9 +251,12 @@ struct row_data {
 	struct starvation_data		low_prio_starvation;
 
 	unsigned int			cycle_flags;
+
+	int				group_sched;
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elv.priv[0]))
+#define RQ_ROWG(rq) ((struct row_group *) ((rq)->elv.priv[1]))
 
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
@@ -293,7 +341,7 @@ static inline bool row_regular_req_pending(struct row_data *rd)
 	int i;
 
 	for (i = ROWQ_REG_PRIO_IDX; i < ROWQ_LOW_PRIO_IDX; i++)
-		if (!list_empty(&rd->row_queues[i].fifo))
+		if (rd->row_queues[i].nr_req)
 			return true;
 	return false;
 }
@@ -311,11 +359,46 @@ static inline bool row_low_req_pending(struct row_data *rd)
 	int i;
 
 	for (i = ROWQ_LOW_PRIO_IDX; i < ROWQ_MAX_PRIO; i++)
-		if (!list_empty(&rd->row_queues[i].fifo))
+		if (rd->row_queues[i].nr_req)
 			return true;
 	return false;
 }
 
+/*
+ * row_rq_fifo() - Return the fifo a request is queued on: its cgroup
+ *		   sub-queue if it has one, the ROW queue fifo otherwise
+ * @rq:		the request
+ */
+static inline struct list_head *row_rq_fifo(struct request *rq)
+{
+	struct row_group *rgroup = RQ_ROWG(rq);
+
+	return rgroup ? &rgroup->fifo : &RQ_ROWQ(rq)->fifo;
+}
+
+/*
+ * row_rowq_next_rq() - Return the request to dispatch next from a queue
+ * @rqueue:	the ROW queue, must not be empty
+ *
+ * Requests without a group (queued while group scheduling was off) go
+ * first. Otherwise the backlogged group with the smallest virtual
+ * dispatch time is served, oldest request first.
+ */
+static struct request *row_rowq_next_rq(struct row_queue *rqueue)
+{
+	struct row_group *rgroup, *next = NULL;
+
+	if (!list_empty(&rqueue->fifo))
+		return rq_entry_fifo(rqueue->fifo.next);
+
+	list_for_each_entry(rgroup, &rqueue->groups, node) {
+		if (rgroup->nr_req && (!next || rgroup->vdisp < next->vdisp))
+			next = rgroup;
+	}
+	BUG_ON(!next);
+	return rq_entry_fifo(next->fifo.next);
+}
+
 /******************* Elevator callback functions *********************/
 
 /*
@@ -329,10 +412,16 @@ static void row_add_request(struct request_queue *q,
 {
 	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
 	struct row_queue *rqueue = RQ_ROWQ(rq);
+	struct row_group *rgroup = RQ_ROWG(rq);
 	s64 diff_ms;
-	bool queue_was_empty = list_empty(&rqueue->fifo);
+	bool queue_was_empty = !rqueue->nr_req;
 
-	list_add_tail(&rq->queuelist, &rqueue->fifo);
+	if (rgroup && !rgroup->nr_req++) {
+		/* A group coming back from idle gets no saved up credit */
+		if (rgroup->vdisp < rqueue->min_vdisp)
+			rgroup->vdisp = rqueue->min_vdisp;
+	}
+	list_add_tail(&rq->queuelist, row_rq_fifo(rq));
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rqueue->nr_req++;
 	rq_set_fifo_time(rq, jiffies); /* for statistics*/
@@ -416,7 +505,9 @@ static int row_reinsert_req(struct request_queue *q,
 	if (!rqueue || rqueue->prio >= ROWQ_MAX_PRIO)
 		return -EIO;
 
-	list_add(&rq->queuelist, &rqueue->fifo);
+	list_add(&rq->queuelist, row_rq_fifo(rq));
+	if (RQ_ROWG(rq))
+		RQ_ROWG(rq)->nr_req++;
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rqueue->nr_req++;
 
@@ -452,6 +543,16 @@ static int row_reinsert_req(struct request_queue *q,
 static void row_completed_req(struct request_queue *q, struct request *rq)
 {
 	struct row_data *rd = q->elevator->elevator_data;
+	struct row_group *rgroup = RQ_ROWG(rq);
+
+	if (rgroup) {
+		u64 lat = sched_clock() - rq_start_time_ns(rq);
+
+		rgroup->nr_completed++;
+		rgroup->lat_total_ns += lat;
+		if (lat > rgroup->lat_max_ns)
+			rgroup->lat_max_ns = lat;
+	}
 
 	 if (rq->cmd_flags & REQ_URGENT) {
 		if (!rd->urgent_in_flight) {
@@ -507,6 +608,8 @@ static void row_remove_request(struct row_data *rd,
 		rd->pending_urgent_rq = NULL;
 	else
 		BUG_ON(rq->cmd_flags & REQ_URGENT);
+	if (RQ_ROWG(rq))
+		RQ_ROWG(rq)->nr_req--;
 	rqueue->nr_req--;
 	rd->nr_reqs[rq_data_dir(rq)]--;
 }
@@ -522,7 +625,14 @@ static void row_remove_request(struct row_data *rd,
 static void row_dispatch_insert(struct row_data *rd, struct request *rq)
 {
 	struct row_queue *rqueue = RQ_ROWQ(rq);
+	struct row_group *rgroup = RQ_ROWG(rq);
 
+	if (rgroup) {
+		rqueue->min_vdisp = rgroup->vdisp;
+		rgroup->vdisp += ROW_GROUP_VDISP_SCALE / rgroup->weight;
+		rgroup->nr_dispatched++;
+		rgroup->wait_total_ns += sched_clock() - rq_start_time_ns(rq);
+	}
 	row_remove_request(rd, rq);
 	elv_dispatch_sort(rd->dispatch_queue, rq);
 	if (rq->cmd_flags & REQ_URGENT) {
@@ -577,7 +687,7 @@ static int row_get_ioprio_class_to_serve(struct row_data *rd, int force)
 
 	/* First, go over the high priority queues */
 	for (i = 0; i < ROWQ_REG_PRIO_IDX; i++) {
-		if (!list_empty(&rd->row_queues[i].fifo)) {
+		if (rd->row_queues[i].nr_req) {
 			if (hrtimer_active(&rd->rd_idle_data.hr_timer)) {
 				if (hrtimer_try_to_cancel(
 					&rd->rd_idle_data.hr_timer) >= 0) {
@@ -622,7 +732,7 @@ check_idling:
 
 	/* Regular priority queues */
 	for (i = ROWQ_REG_PRIO_IDX; i < ROWQ_LOW_PRIO_IDX; i++) {
-		if (list_empty(&rd->row_queues[i].fifo)) {
+		if (!rd->row_queues[i].nr_req) {
 			/* We can idle only if this is not a forced dispatch */
 			if (rd->row_queues[i].idle_data.begin_idling &&
 			    !force && row_queues_def[i].idling_enabled)
@@ -688,7 +798,7 @@ static int row_get_next_queue(struct request_queue *q, struct row_data *rd,
 	int ret = -EIO;
 
 	do {
-		if (list_empty(&rd->row_queues[i].fifo) ||
+		if (!rd->row_queues[i].nr_req ||
 		    rd->row_queues[i].nr_dispatched >=
 		    rd->row_queues[i].disp_quantum) {
 			i++;
@@ -767,7 +877,7 @@ static int row_dispatch_requests(struct request_queue *q, int force)
 	/* Dispatch */
 	if (currq >= 0) {
 		row_dispatch_insert(rd,
-			rq_entry_fifo(rd->row_queues[currq].fifo.next));
+			row_rowq_next_rq(&rd->row_queues[currq]));
 		ret = 1;
 	}
 done:
@@ -796,6 +906,7 @@ static void *row_init_queue(struct request_queue *q)
 	memset(rdata, 0, sizeof(*rdata));
 	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
 		INIT_LIST_HEAD(&rdata->row_queues[i].fifo);
+		INIT_LIST_HEAD(&rdata->row_queues[i].groups);
 		rdata->row_queues[i].disp_quantum = row_queues_def[i].quantum;
 		rdata->row_queues[i].rdata = rdata;
 		rdata->row_queues[i].prio = i;
@@ -835,10 +946,18 @@ static void *row_init_queue(struct request_queue *q)
 static void row_exit_queue(struct elevator_queue *e)
 {
 	struct row_data *rd = (struct row_data *)e->elevator_data;
+	struct row_group *rgroup, *tmp;
 	int i;
 
-	for (i = 0; i < ROWQ_MAX_PRIO; i++)
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
 		BUG_ON(!list_empty(&rd->row_queues[i].fifo));
+		list_for_each_entry_safe(rgroup, tmp,
+					 &rd->row_queues[i].groups, node) {
+			BUG_ON(rgroup->nr_req);
+			list_del(&rgroup->node);
+			kfree(rgroup);
+		}
+	}
 	if (hrtimer_cancel(&rd->rd_idle_data.hr_timer))
 		pr_err("%s(): idle timer was active!", __func__);
 	rd->rd_idle_data.idling_queue_idx = ROWQ_MAX_PRIO;
@@ -857,6 +976,8 @@ static void row_merged_requests(struct request_queue *q, struct request *rq,
 	struct row_queue   *rqueue = RQ_ROWQ(next);
 
 	list_del_init(&next->queuelist);
+	if (RQ_ROWG(next))
+		RQ_ROWG(next)->nr_req--;
 	rqueue->nr_req--;
 	if (rqueue->rdata->pending_urgent_rq == next) {
 		pr_err("\n\nROW_WARNING: merging pending urgent!");
@@ -922,6 +1043,63 @@ static enum row_queue_prio row_get_queue_prio(struct request *rq,
 	return q_type;
 }
 
+#ifdef CONFIG_BLK_CGROUP
+/*
+ * row_get_group() - Get the sub-queue of the current task's blkio cgroup
+ * @rd:		pointer to struct row_data
+ * @rqueue:	the ROW queue the request goes to
+ *
+ * Called with the queue lock held. Returns NULL if a new group could not
+ * be allocated, in which case the request is queued on @rqueue itself.
+ */
+static struct row_group *row_get_group(struct row_data *rd,
+				       struct row_queue *rqueue)
+{
+	struct backing_dev_info *bdi = &rd->dispatch_queue->backing_dev_info;
+	struct blkio_cgroup *blkcg;
+	struct row_group *rgroup;
+	unsigned int major, minor;
+	unsigned short id;
+	dev_t dev = 0;
+
+	rcu_read_lock();
+	blkcg = task_blkio_cgroup(current);
+	id = css_id(&blkcg->css);
+
+	list_for_each_entry(rgroup, &rqueue->groups, node)
+		if (rgroup->blkcg_id == id)
+			goto found;
+
+	rgroup = kzalloc_node(sizeof(*rgroup), GFP_ATOMIC,
+			      rd->dispatch_queue->node);
+	if (!rgroup)
+		goto out;
+	INIT_LIST_HEAD(&rgroup->fifo);
+	rgroup->blkcg_id = id;
+	rgroup->vdisp = rqueue->min_vdisp;
+	list_add_tail(&rgroup->node, &rqueue->groups);
+	row_log_rowq(rd, rqueue->prio, "new group for cgroup %u", id);
+found:
+	/* Pick up blkio weight changes whenever the group goes active */
+	if (!rgroup->nr_req) {
+		if (bdi->dev && dev_name(bdi->dev)) {
+			sscanf(dev_name(bdi->dev), "%u:%u", &major, &minor);
+			dev = MKDEV(major, minor);
+		}
+		rgroup->weight = max(blkcg_get_weight(blkcg, dev), 1U);
+	}
+out:
+	rcu_read_unlock();
+	return rgroup;
+}
+#else
+static inline struct row_group *row_get_group(struct row_data *rd,
+					      struct row_queue *rqueue)
+{
+	return NULL;
+}
+#endif
+
 /*
  * row_set_request() - Set ROW data structures associated with this request.
  * @q:		requests queue
@@ -933,11 +1111,13 @@ static int
 row_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
 {
 	struct row_data *rd = (struct row_data *)q->elevator->elevator_data;
+	struct row_queue *rqueue;
 	unsigned long flags;
 
 	spin_lock_irqsave(q->queue_lock, flags);
-	rq->elv.priv[0] =
-		(void *)(&rd->row_queues[row_get_queue_prio(rq, rd)]);
+	rqueue = &rd->row_queues[row_get_queue_prio(rq, rd)];
+	rq->elv.priv[0] = (void *)rqueue;
+	rq->elv.priv[1] = rd->group_sched ? row_get_group(rd, rqueue) : NULL;
 	spin_unlock_irqrestore(q->queue_lock, flags);
 
 	return 0;
@@ -984,6 +1164,7 @@ SHOW_FUNCTION(row_reg_starv_limit_show,
 	rowd->reg_prio_starvation.starvation_limit);
 SHOW_FUNCTION(row_low_starv_limit_show,
 	rowd->low_prio_starvation.starvation_limit);
+SHOW_FUNCTION(row_group_sched_show, rowd->group_sched);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX)			\
@@ -1030,6 +1211,11 @@ STORE_FUNCTION(row_reg_starv_limit_store,
 STORE_FUNCTION(row_low_starv_limit_store,
 			&rowd->low_prio_starvation.starvation_limit,
 			1, INT_MAX);
+#ifdef CONFIG_BLK_CGROUP
+STORE_FUNCTION(row_group_sched_store, &rowd->group_sched, 0, 1);
+#else
+STORE_FUNCTION(row_group_sched_store, &rowd->group_sched, 0, 0);
+#endif
 
 #undef STORE_FUNCTION
 
@@ -1037,6 +1223,43 @@ STORE_FUNCTION(row_low_starv_limit_store,
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
 
+static u64 row_avg_us(u64 total_ns, unsigned long nr)
+{
+	return nr ? div_u64(div64_u64(total_ns, nr), NSEC_PER_USEC) : 0;
+}
+
+/* One line per cgroup sub-queue: dispatch counts and latencies */
+static ssize_t row_group_stats_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rd = e->elevator_data;
+	struct request_queue *q = rd->dispatch_queue;
+	struct row_group *rgroup;
+	ssize_t len = 0;
+	int i;
+
+	spin_lock_irq(q->queue_lock);
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		list_for_each_entry(rgroup, &rd->row_queues[i].groups, node) {
+			len += scnprintf(page + len, PAGE_SIZE - len,
+				"rowq%d cgroup %u weight %u queued %u "
+				"dispatched %lu completed %lu "
+				"avg_wait_us %llu avg_lat_us %llu "
+				"max_lat_us %llu\n",
+				i, rgroup->blkcg_id, rgroup->weight,
+				rgroup->nr_req, rgroup->nr_dispatched,
+				rgroup->nr_completed,
+				row_avg_us(rgroup->wait_total_ns,
+					   rgroup->nr_dispatched),
+				row_avg_us(rgroup->lat_total_ns,
+					   rgroup->nr_completed),
+				div_u64(rgroup->lat_max_ns, NSEC_PER_USEC));
+		}
+	}
+	spin_unlock_irq(q->queue_lock);
+
+	return len;
+}
+
 static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(hp_read_quantum),
 	ROW_ATTR(rp_read_quantum),
@@ -1049,6 +1272,8 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(rd_idle_data_freq),
 	ROW_ATTR(reg_starv_limit),
 	ROW_ATTR(low_starv_limit),
+	ROW_ATTR(group_sched),
+	__ATTR(group_stats, S_IRUGO, row_group_stats_show, NULL),
 	__ATTR_NULL
 };
 
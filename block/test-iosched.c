@@ -27,6 +27,13 @@
 #include <linux/debugfs.h>
 #include <linux/test-iosched.h>
 #include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/cgroup.h>
+#include <linux/random.h>
+#include <linux/sort.h>
+#include <linux/fs.h>
+#include <linux/cpu.h>
+#include <linux/math64.h>
 #include "blk.h"
 
 #define MODULE_NAME "test-iosched"
@@ -1005,6 +1012,516 @@ static void test_exit_queue(struct elevator_queue *e)
 	kfree(td);
 }
 
+/*
+ * Block device benchmarks
+ *
+ * Unlike the test cases above, which run with test-iosched as the
+ * elevator, the benchmarks submit bios through the regular block layer
+ * path of any block device and so measure whatever elevator that device
+ * is using.  They are configured and started through the files in
+ * <debugfs>/test-iosched-bench/ and overwrite the device contents from
+ * start_sector on.
+ *
+ * fg_read_bg_write: a foreground thread issues nr_reads synchronous 4K
+ * reads, one at a time, while a background thread keeps the device
+ * busy with 128K writes.  If fg_pid/bg_pid are set, the threads join
+ * all cgroups of those tasks first.  The foreground read latency is
+ * reported in the result file.  If p95_limit_us is set, the run also
+ * fails with -ETIME when the 95th percentile read latency exceeds it,
+ * e.g. to validate the FIOPS read_lat_target_us setting.
+ *
+ * mt_write: one thread per online cpu, bound to it, writes nr_ios
+ * sequential 4K blocks without plugging, keeping up to
+ * BENCH_MT_INFLIGHT of them in flight.  This is the submission pattern
+ * of dm and zram writeback, and stresses q->queue_lock; compare the
+ * reported IOPS with queue/rq_staging off and on.
+ */
+#define BENCH_RD_AREA_SECTORS	(8 * 1024 * 2)	/* 8M */
+#define BENCH_WR_AREA_SECTORS	(64 * 1024 * 2)	/* 64M */
+#define BENCH_WR_PAGES		32
+#define BENCH_WR_INFLIGHT	8
+#define BENCH_RD_THINK_MS	5
+#define BENCH_MT_INFLIGHT	32
+#define BENCH_RESULT_LEN	256
+
+struct bench_data {
+	struct mutex lock;
+	struct dentry *root;
+	u32 major;
+	u32 minor;
+	u32 start_sector;
+	u32 nr_reads;
+	u32 fg_pid;
+	u32 bg_pid;
+	u32 p95_limit_us;
+	u32 nr_ios;
+	char result[BENCH_RESULT_LEN];
+};
+
+static struct bench_data bench = {
+	.lock = __MUTEX_INITIALIZER(bench.lock),
+	.nr_reads = 256,
+	.nr_ios = 4096,
+};
+
+struct bench_ctx {
+	struct block_device *bdev;
+	struct task_struct *fg_from;
+	struct task_struct *bg_from;
+	struct page *pages[BENCH_WR_PAGES];
+	atomic_t wr_inflight;
+	atomic_long_t wr_done;
+	wait_queue_head_t wr_wait;
+	u32 *lat_us;
+	int rd_err;
+	struct completion fg_done;
+};
+
+static struct task_struct *bench_get_task(u32 pid)
+{
+	struct task_struct *task = NULL;
+
+	if (!pid)
+		return NULL;
+	rcu_read_lock();
+	task = pid_task(find_vpid(pid), PIDTYPE_PID);
+	if (task)
+		get_task_struct(task);
+	rcu_read_unlock();
+	return task;
+}
+
+static void bench_join_cgroups(struct task_struct *from)
+{
+	if (from && cgroup_attach_task_all(from, current))
+		test_pr_err("%s: failed to join cgroups of pid %d",
+			    __func__, task_pid_nr(from));
+}
+
+static void bench_write_end_io(struct bio *bio, int err)
+{
+	struct bench_ctx *ctx = bio->bi_private;
+
+	atomic_long_inc(&ctx->wr_done);
+	atomic_dec(&ctx->wr_inflight);
+	wake_up(&ctx->wr_wait);
+	bio_put(bio);
+}
+
+static int bench_bg_writer(void *data)
+{
+	struct bench_ctx *ctx = data;
+	sector_t first = bench.start_sector + BENCH_RD_AREA_SECTORS;
+	sector_t sector = first;
+	struct bio *bio;
+	int i;
+
+	bench_join_cgroups(ctx->bg_from);
+
+	while (!kthread_should_stop()) {
+		wait_event(ctx->wr_wait,
+			   atomic_read(&ctx->wr_inflight) < BENCH_WR_INFLIGHT ||
+			   kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+
+		bio = bio_alloc(GFP_KERNEL, BENCH_WR_PAGES);
+		if (!bio) {
+			msleep(1);
+			continue;
+		}
+		bio->bi_bdev = ctx->bdev;
+		bio->bi_sector = sector;
+		bio->bi_end_io = bench_write_end_io;
+		bio->bi_private = ctx;
+		for (i = 0; i < BENCH_WR_PAGES; i++)
+			bio_add_page(bio, ctx->pages[i], PAGE_SIZE, 0);
+
+		sector += bio_sectors(bio);
+		if (sector + bio_sectors(bio) > first + BENCH_WR_AREA_SECTORS)
+			sector = first;
+
+		atomic_inc(&ctx->wr_inflight);
+		submit_bio(WRITE, bio);
+	}
+
+	wait_event(ctx->wr_wait, !atomic_read(&ctx->wr_inflight));
+	return 0;
+}
+
+static void bench_read_end_io(struct bio *bio, int err)
+{
+	struct completion *done = bio->bi_private;
+
+	if (err)
+		clear_bit(BIO_UPTODATE, &bio->bi_flags);
+	complete(done);
+}
+
+static int bench_fg_reader(void *data)
+{
+	struct bench_ctx *ctx = data;
+	struct completion done;
+	struct bio *bio;
+	ktime_t start;
+	u32 i;
+
+	bench_join_cgroups(ctx->fg_from);
+
+	for (i = 0; i < bench.nr_reads; i++) {
+		bio = bio_alloc(GFP_KERNEL, 1);
+		if (!bio) {
+			ctx->rd_err = -ENOMEM;
+			break;
+		}
+		init_completion(&done);
+		bio->bi_bdev = ctx->bdev;
+		bio->bi_sector = bench.start_sector +
+			((random32() % (BENCH_RD_AREA_SECTORS >>
+					(PAGE_SHIFT - 9))) << (PAGE_SHIFT - 9));
+		bio->bi_end_io = bench_read_end_io;
+		bio->bi_private = &done;
+		bio_add_page(bio, ctx->pages[0], PAGE_SIZE, 0);
+
+		start = ktime_get();
+		submit_bio(READ_SYNC, bio);
+		wait_for_completion(&done);
+		ctx->lat_us[i] = ktime_us_delta(ktime_get(), start);
+
+		if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+			ctx->rd_err = -EIO;
+		bio_put(bio);
+		if (ctx->rd_err)
+			break;
+
+		msleep(BENCH_RD_THINK_MS);
+	}
+
+	complete_and_exit(&ctx->fg_done, 0);
+}
+
+static int bench_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int bench_report_latency(const char *name, struct block_device *bdev,
+				u32 *lat_us, u32 nr, unsigned long bg_writes)
+{
+	struct request_queue *q = bdev_get_queue(bdev);
+	u32 p95;
+	u64 total = 0;
+	u32 i;
+	int ret = 0;
+
+	sort(lat_us, nr, sizeof(*lat_us), bench_cmp_u32, NULL);
+	for (i = 0; i < nr; i++)
+		total += lat_us[i];
+	p95 = lat_us[nr * 95 / 100];
+	if (bench.p95_limit_us && p95 > bench.p95_limit_us)
+		ret = -ETIME;
+
+	scnprintf(bench.result, BENCH_RESULT_LEN,
+		  "%s(%s): reads %u avg_us %llu p95_us %u max_us %u "
+		  "bg_writes %lu%s\n",
+		  name, q->elevator ? q->elevator->type->elevator_name : "none",
+		  nr, div_u64(total, nr), p95, lat_us[nr - 1], bg_writes,
+		  !bench.p95_limit_us ? "" : ret ? " FAIL" : " PASS");
+	pr_info("%s: %s", MODULE_NAME, bench.result);
+
+	return ret;
+}
+
+static int bench_fg_read_bg_write(void)
+{
+	struct task_struct *fg, *bg;
+	struct bench_ctx *ctx;
+	int i, ret = 0;
+
+	if (!bench.nr_reads)
+		return -EINVAL;
+
+	ctx = kzalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->lat_us = kcalloc(bench.nr_reads, sizeof(u32), GFP_KERNEL);
+	if (!ctx->lat_us) {
+		ret = -ENOMEM;
+		goto free_ctx;
+	}
+	for (i = 0; i < BENCH_WR_PAGES; i++) {
+		ctx->pages[i] = alloc_page(GFP_KERNEL);
+		if (!ctx->pages[i]) {
+			ret = -ENOMEM;
+			goto free_pages;
+		}
+	}
+	atomic_set(&ctx->wr_inflight, 0);
+	atomic_long_set(&ctx->wr_done, 0);
+	init_waitqueue_head(&ctx->wr_wait);
+	init_completion(&ctx->fg_done);
+
+	ctx->bdev = blkdev_get_by_dev(MKDEV(bench.major, bench.minor),
+				      FMODE_READ | FMODE_WRITE, NULL);
+	if (IS_ERR(ctx->bdev)) {
+		ret = PTR_ERR(ctx->bdev);
+		test_pr_err("%s: cannot open %u:%u, err=%d", __func__,
+			    bench.major, bench.minor, ret);
+		goto free_pages;
+	}
+	ctx->fg_from = bench_get_task(bench.fg_pid);
+	ctx->bg_from = bench_get_task(bench.bg_pid);
+
+	bg = kthread_run(bench_bg_writer, ctx, "bench-bg-write");
+	if (IS_ERR(bg)) {
+		ret = PTR_ERR(bg);
+		goto put_dev;
+	}
+	/* Let the background load build up before measuring */
+	msleep(100);
+
+	fg = kthread_run(bench_fg_reader, ctx, "bench-fg-read");
+	if (IS_ERR(fg))
+		ret = PTR_ERR(fg);
+	else
+		wait_for_completion(&ctx->fg_done);
+	kthread_stop(bg);
+
+	if (!ret)
+		ret = ctx->rd_err;
+	if (!ret)
+		ret = bench_report_latency("fg_read_bg_write", ctx->bdev,
+					   ctx->lat_us, bench.nr_reads,
+					   atomic_long_read(&ctx->wr_done));
+
+put_dev:
+	if (ctx->fg_from)
+		put_task_struct(ctx->fg_from);
+	if (ctx->bg_from)
+		put_task_struct(ctx->bg_from);
+	blkdev_put(ctx->bdev, FMODE_READ | FMODE_WRITE);
+free_pages:
+	for (i = 0; i < BENCH_WR_PAGES && ctx->pages[i]; i++)
+		__free_page(ctx->pages[i]);
+	kfree(ctx->lat_us);
+free_ctx:
+	kfree(ctx);
+	return ret;
+}
+
+static ssize_t bench_fg_read_bg_write_write(struct file *file,
+					    const char __user *buf,
+					    size_t count, loff_t *ppos)
+{
+	int ret;
+
+	mutex_lock(&bench.lock);
+	ret = bench_fg_read_bg_write();
+	mutex_unlock(&bench.lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations bench_fg_read_bg_write_ops = {
+	.open = simple_open,
+	.write = bench_fg_read_bg_write_write,
+};
+
+struct bench_mt_worker {
+	struct block_device *bdev;
+	struct page *page;
+	sector_t first;
+	atomic_t inflight;
+	wait_queue_head_t wait;
+	struct completion done;
+};
+
+static void bench_mt_end_io(struct bio *bio, int err)
+{
+	struct bench_mt_worker *w = bio->bi_private;
+
+	atomic_dec(&w->inflight);
+	wake_up(&w->wait);
+	bio_put(bio);
+}
+
+static int bench_mt_writer(void *data)
+{
+	struct bench_mt_worker *w = data;
+	struct bio *bio;
+	u32 i;
+
+	for (i = 0; i < bench.nr_ios; i++) {
+		wait_event(w->wait,
+			   atomic_read(&w->inflight) < BENCH_MT_INFLIGHT);
+
+		bio = bio_alloc(GFP_KERNEL, 1);
+		if (!bio)
+			break;
+		bio->bi_bdev = w->bdev;
+		bio->bi_sector = w->first + ((sector_t)i << (PAGE_SHIFT - 9));
+		bio->bi_end_io = bench_mt_end_io;
+		bio->bi_private = w;
+		bio_add_page(bio, w->page, PAGE_SIZE, 0);
+
+		atomic_inc(&w->inflight);
+		submit_bio(WRITE, bio);
+	}
+
+	wait_event(w->wait, !atomic_read(&w->inflight));
+	complete_and_exit(&w->done, 0);
+}
+
+static int bench_mt_write(void)
+{
+	struct block_device *bdev;
+	struct bench_mt_worker *workers;
+	struct task_struct *task;
+	struct page *page;
+	unsigned int nr = 0, cpu, i;
+	ktime_t start;
+	u64 elapsed, ios;
+	int ret = 0;
+
+	if (!bench.nr_ios)
+		return -EINVAL;
+
+	workers = kcalloc(nr_cpu_ids, sizeof(*workers), GFP_KERNEL);
+	page = alloc_page(GFP_KERNEL);
+	if (!workers || !page) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	bdev = blkdev_get_by_dev(MKDEV(bench.major, bench.minor),
+				 FMODE_READ | FMODE_WRITE, NULL);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		test_pr_err("%s: cannot open %u:%u, err=%d", __func__,
+			    bench.major, bench.minor, ret);
+		goto out_free;
+	}
+
+	get_online_cpus();
+	start = ktime_get();
+	for_each_online_cpu(cpu) {
+		struct bench_mt_worker *w = &workers[nr];
+
+		w->bdev = bdev;
+		w->page = page;
+		w->first = bench.start_sector +
+			(sector_t)nr * bench.nr_ios * (PAGE_SIZE >> 9);
+		atomic_set(&w->inflight, 0);
+		init_waitqueue_head(&w->wait);
+		init_completion(&w->done);
+
+		task = kthread_create(bench_mt_writer, w, "bench-mt-write/%u",
+				      cpu);
+		if (IS_ERR(task)) {
+			ret = PTR_ERR(task);
+			break;
+		}
+		kthread_bind(task, cpu);
+		wake_up_process(task);
+		nr++;
+	}
+	put_online_cpus();
+
+	for (i = 0; i < nr; i++)
+		wait_for_completion(&workers[i].done);
+	elapsed = ktime_us_delta(ktime_get(), start);
+
+	if (!ret) {
+		struct request_queue *q = bdev_get_queue(bdev);
+
+		ios = (u64)nr * bench.nr_ios;
+		scnprintf(bench.result, BENCH_RESULT_LEN,
+			  "mt_write(%s): threads %u ios %llu elapsed_us %llu "
+			  "iops %llu rq_staging %d\n",
+			  q->elevator ?
+				q->elevator->type->elevator_name : "none",
+			  nr, ios, elapsed,
+			  div64_u64(ios * USEC_PER_SEC, max(elapsed, 1ULL)),
+			  blk_queue_staging(q));
+		pr_info("%s: %s", MODULE_NAME, bench.result);
+	}
+
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE);
+out_free:
+	if (page)
+		__free_page(page);
+	kfree(workers);
+	return ret;
+}
+
+static ssize_t bench_mt_write_write(struct file *file,
+				    const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	int ret;
+
+	mutex_lock(&bench.lock);
+	ret = bench_mt_write();
+	mutex_unlock(&bench.lock);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations bench_mt_write_ops = {
+	.open = simple_open,
+	.write = bench_mt_write_write,
+};
+
+static ssize_t bench_result_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	ssize_t ret;
+
+	mutex_lock(&bench.lock);
+	ret = simple_read_from_buffer(buf, count, ppos, bench.result,
+				      strlen(bench.result));
+	mutex_unlock(&bench.lock);
+
+	return ret;
+}
+
+static const struct file_operations bench_result_ops = {
+	.open = simple_open,
+	.read = bench_result_read,
+};
+
+static void bench_debugfs_init(void)
+{
+	bench.root = debugfs_create_dir("test-iosched-bench", NULL);
+	if (!bench.root)
+		return;
+
+	debugfs_create_u32("major", S_IRUGO | S_IWUSR, bench.root,
+			   &bench.major);
+	debugfs_create_u32("minor", S_IRUGO | S_IWUSR, bench.root,
+			   &bench.minor);
+	debugfs_create_u32("start_sector", S_IRUGO | S_IWUSR, bench.root,
+			   &bench.start_sector);
+	debugfs_create_u32("nr_reads", S_IRUGO | S_IWUSR, bench.root,
+			   &bench.nr_reads);
+	debugfs_create_u32("fg_pid", S_IRUGO | S_IWUSR, bench.root,
+			   &bench.fg_pid);
+	debugfs_create_u32("bg_pid", S_IRUGO | S_IWUSR, bench.root,
+			   &bench.bg_pid);
+	debugfs_create_u32("p95_limit_us", S_IRUGO | S_IWUSR, bench.root,
+			   &bench.p95_limit_us);
+	debugfs_create_u32("nr_ios", S_IRUGO | S_IWUSR, bench.root,
+			   &bench.nr_ios);
+	debugfs_create_file("result", S_IRUGO, bench.root, NULL,
+			    &bench_result_ops);
+	debugfs_create_file("fg_read_bg_write", S_IWUSR, bench.root, NULL,
+			    &bench_fg_read_bg_write_ops);
+	debugfs_create_file("mt_write", S_IWUSR, bench.root, NULL,
+			    &bench_mt_write_ops);
+}
+
 static struct elevator_type elevator_test_iosched = {
 	.ops = {
 		.elevator_merge_req_fn = test_merged_requests,
@@ -1022,12 +1539,14 @@ static struct elevator_type elevator_test_iosched = {
 static int __init test_init(void)
 {
 	elv_register(&elevator_test_iosched);
+	bench_debugfs_init();
 
 	return 0;
 }
 
 static void __exit test_exit(void)
 {
+	debugfs_remove_recursive(bench.root);
 	elv_unregister(&elevator_test_iosched);
 }
 
@@ -61,6 +61,7 @@
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/nsproxy.h>
+#include <linux/percpu.h>
 #include <linux/poll.h>
 #include <linux/debugfs.h>
 #include <linux/rbtree.h>
@@ -215,6 +216,34 @@ static inline void binder_stats_created(enum binder_stat_types type)
 	atomic_inc(&binder_stats.obj_created[type]);
 }
 
+static inline u64 binder_clock(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+
+/*
+ * Transaction latency histograms. Bucket 0 counts latencies below 1us,
+ * bucket n counts [2^(n-1), 2^n) us and the last bucket everything above.
+ */
+enum binder_lat_types {
+	BINDER_LAT_QUEUE,	/* sent until dequeued by the target thread */
+	BINDER_LAT_SERVICE,	/* dequeued until BC_REPLY */
+	BINDER_LAT_REPLY,	/* BC_REPLY until dequeued by the caller */
+	BINDER_LAT_COUNT
+};
+
+#define BINDER_LAT_BUCKETS 20
+
+struct binder_lat_stats {
+	unsigned long hist[BINDER_LAT_COUNT][BINDER_LAT_BUCKETS];
+};
+
+static const char * const binder_lat_strings[] = {
+	"queue",
+	"service",
+	"reply"
+};
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int debug_id_done;
@@ -266,6 +295,7 @@ struct binder_context {
 
 	kuid_t binder_context_mgr_uid;
 	const char *name;
+	struct binder_lat_stats __percpu *lat;
 };
 
 struct binder_device {
@@ -517,6 +547,8 @@ struct binder_priority {
  *                        (protected by @inner_lock)
  * @stats:                per-process binder statistics
  *                        (atomics, no lock needed)
+ * @lat:                  per-cpu transaction latency histograms
+ *                        (per-cpu, no lock needed)
  * @delivered_death:      list of delivered death notification
  *                        (protected by @inner_lock)
  * @max_threads:          cap on number of binder threads
@@ -558,6 +590,7 @@ struct binder_proc {
 
 	struct list_head todo;
 	struct binder_stats stats;
+	struct binder_lat_stats __percpu *lat;
 	struct list_head delivered_death;
 	int max_threads;
 	int requested_threads;
@@ -655,6 +688,8 @@ struct binder_transaction {
 	bool    set_priority_called;
 	kuid_t	sender_euid;
 	binder_uintptr_t security_ctx;
+	u64	start_ns;	/* when the transaction was queued */
+	u64	dequeue_ns;	/* when the target thread picked it up */
 	/**
 	 * @lock:  protects @from, @to_proc, and @to_thread
 	 *
@@ -684,6 +719,30 @@ struct binder_object {
 	};
 };
 
+/**
+ * binder_lat_record() - account a transaction latency sample
+ * @proc:         binder_proc to charge the sample to
+ * @type:         which phase of the transaction is being measured
+ * @start_ns:     start of the interval, from binder_clock()
+ * @now:          end of the interval, from binder_clock()
+ *
+ * The sample is added to both @proc and its context.
+ */
+static void binder_lat_record(struct binder_proc *proc,
+			      enum binder_lat_types type, u64 start_ns, u64 now)
+{
+	u64 usecs;
+	int bucket = 0;
+
+	if (!start_ns || now < start_ns)
+		return;
+	usecs = div_u64(now - start_ns, NSEC_PER_USEC);
+	if (usecs)
+		bucket = min_t(int, fls64(usecs), BINDER_LAT_BUCKETS - 1);
+	this_cpu_inc(proc->lat->hist[type][bucket]);
+	this_cpu_inc(proc->context->lat->hist[type][bucket]);
+}
+
 /**
  * binder_proc_lock() - Acquire outer lock for given binder_proc
  * @proc:         struct binder_proc to acquire
@@ -3181,6 +3240,7 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	binder_stats_created(BINDER_STAT_TRANSACTION);
 	spin_lock_init(&t->lock);
+	t->start_ns = binder_clock();
 
 	tcomplete = kzalloc(sizeof(*tcomplete), GFP_KERNEL);
 	if (tcomplete == NULL) {
@@ -3536,6 +3596,8 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_dead_proc_or_thread;
 		}
 		BUG_ON(t->buffer->async_transaction != 0);
+		binder_lat_record(proc, BINDER_LAT_SERVICE,
+				  in_reply_to->dequeue_ns, t->start_ns);
 		binder_pop_transaction_ilocked(target_thread, in_reply_to);
 		binder_enqueue_thread_work_ilocked(target_thread, &t->work);
 		binder_inner_proc_unlock(target_proc);
@@ -4265,6 +4327,7 @@ retry:
 		struct list_head *list = NULL;
 		struct binder_transaction *t = NULL;
 		struct binder_thread *t_from;
+		u64 now;
 		size_t trsize = sizeof(*trd);
 
 		binder_inner_proc_lock(proc);
@@ -4521,6 +4584,16 @@ retry:
 		}
 		ptr += trsize;
 
+		now = binder_clock();
+		if (cmd == BR_REPLY) {
+			binder_lat_record(proc, BINDER_LAT_REPLY,
+					  t->start_ns, now);
+		} else {
+			binder_lat_record(proc, BINDER_LAT_QUEUE,
+					  t->start_ns, now);
+			t->dequeue_ns = now;
+		}
+
 		trace_binder_transaction_received(t);
 		binder_stat_br(proc, thread, cmd);
 		binder_debug(BINDER_DEBUG_TRANSACTION,
@@ -4700,6 +4773,7 @@ static void binder_free_proc(struct binder_proc *proc)
 	binder_alloc_deferred_release(&proc->alloc);
 	put_task_struct(proc->tsk);
 	binder_stats_deleted(BINDER_STAT_PROC);
+	free_percpu(proc->lat);
 	kfree(proc);
 }
 
@@ -5221,6 +5295,11 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	proc = kzalloc(sizeof(*proc), GFP_KERNEL);
 	if (proc == NULL)
 		return -ENOMEM;
+	proc->lat = alloc_percpu(struct binder_lat_stats);
+	if (proc->lat == NULL) {
+		kfree(proc);
+		return -ENOMEM;
+	}
 	spin_lock_init(&proc->inner_lock);
 	spin_lock_init(&proc->outer_lock);
 	get_task_struct(current->group_leader);
@@ -5971,6 +6050,58 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	return 0;
 }
 
+static void print_binder_lat_stats(struct seq_file *m, const char *prefix,
+				   struct binder_lat_stats __percpu *lat)
+{
+	unsigned long hist[BINDER_LAT_BUCKETS];
+	int type, cpu, i, last;
+
+	BUILD_BUG_ON(ARRAY_SIZE(binder_lat_strings) != BINDER_LAT_COUNT);
+	for (type = 0; type < BINDER_LAT_COUNT; type++) {
+		memset(hist, 0, sizeof(hist));
+		last = -1;
+		for_each_possible_cpu(cpu) {
+			struct binder_lat_stats *l = per_cpu_ptr(lat, cpu);
+
+			for (i = 0; i < BINDER_LAT_BUCKETS; i++)
+				hist[i] += l->hist[type][i];
+		}
+		for (i = 0; i < BINDER_LAT_BUCKETS; i++)
+			if (hist[i])
+				last = i;
+		if (last < 0)
+			continue;
+		seq_printf(m, "%s%s:", prefix, binder_lat_strings[type]);
+		for (i = 0; i <= last; i++)
+			seq_printf(m, " %lu", hist[i]);
+		seq_puts(m, "\n");
+	}
+}
+
+static int binder_latency_show(struct seq_file *m, void *unused)
+{
+	struct binder_device *device;
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+
+	seq_puts(m, "binder latency (log2 usec buckets):\n");
+	hlist_for_each_entry(device, pos, &binder_devices, hlist) {
+		seq_printf(m, "context %s\n", device->context.name);
+		print_binder_lat_stats(m, "  ", device->context.lat);
+	}
+
+	mutex_lock(&binder_procs_lock);
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		seq_printf(m, "proc %d\n", proc->pid);
+		seq_printf(m, "context %s\n", proc->context->name);
+		print_binder_lat_stats(m, "  ", proc->lat);
+		binder_alloc_print_async(m, &proc->alloc);
+	}
+	mutex_unlock(&binder_procs_lock);
+
+	return 0;
+}
+
 static int binder_transactions_show(struct seq_file *m, void *unused)
 {
 	struct binder_proc *proc;
@@ -6063,6 +6194,7 @@ static const struct file_operations binder_fops = {
 
 BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
+BINDER_DEBUG_ENTRY(latency);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
 
@@ -6075,6 +6207,12 @@ static int __init init_binder_device(const char *name)
 	if (!binder_device)
 		return -ENOMEM;
 
+	binder_device->context.lat = alloc_percpu(struct binder_lat_stats);
+	if (!binder_device->context.lat) {
+		kfree(binder_device);
+		return -ENOMEM;
+	}
+
 	binder_device->miscdev.fops = &binder_fops;
 	binder_device->miscdev.minor = MISC_DYNAMIC_MINOR;
 	binder_device->miscdev.name = name;
@@ -6085,6 +6223,7 @@ static int __init init_binder_device(const char *name)
 
 	ret = misc_register(&binder_device->miscdev);
 	if (ret < 0) {
+		free_percpu(binder_device->context.lat);
 		kfree(binder_device);
 		return ret;
 	}
@@ -6122,6 +6261,11 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    NULL,
 				    &binder_stats_fops);
+		debugfs_create_file("latency",
+				    0444,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_latency_fops);
 		debugfs_create_file("transactions",
 				    0444,
 				    binder_debugfs_dir_entry_root,
@@ -6163,6 +6307,7 @@ err_init_binder_device_failed:
 	hlist_for_each_entry_safe(device, node, tmp, &binder_devices, hlist) {
 		misc_deregister(&device->miscdev);
 		hlist_del(&device->hlist);
+		free_percpu(device->context.lat);
 		kfree(device);
 	}
 
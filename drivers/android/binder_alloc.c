@@ -49,6 +49,23 @@ static uint32_t binder_alloc_debug_mask = BINDER_DEBUG_USER_ERROR;
 module_param_named(debug_mask, binder_alloc_debug_mask,
 		   uint, 0644);
 
+/*
+ * Number of pages each proc keeps allocated but unmapped, so that growing
+ * a buffer only has to map pages instead of calling into the page
+ * allocator on the transaction path. 0 disables the reserve.  The
+ * reserves of all procs are given back first when the binder shrinker
+ * runs.
+ */
+static uint binder_alloc_reserve_pages = 8;
+
+/* All mapped procs, for the shrinker to drain their reserves */
+static LIST_HEAD(binder_alloc_reserve_list);
+static DEFINE_SPINLOCK(binder_alloc_reserve_lock);
+static atomic_t binder_alloc_reserve_total = ATOMIC_INIT(0);
+
+module_param_named(reserve_pages, binder_alloc_reserve_pages,
+		   uint, 0644);
+
 #define binder_alloc_debug(mask, x...) \
 	do { \
 		if (binder_alloc_debug_mask & mask) \
@@ -186,6 +203,101 @@ struct binder_buffer *binder_alloc_prepare_to_free(struct binder_alloc *alloc,
 	return buffer;
 }
 
+/**
+ * binder_alloc_reserve_fill() - top up the per-proc page reserve
+ * @alloc:	binder_alloc for this proc
+ * @gfp:	allocation flags for the new pages
+ *
+ * Must be called with alloc->mutex held.
+ */
+static void binder_alloc_reserve_fill(struct binder_alloc *alloc, gfp_t gfp)
+{
+	struct page *page;
+
+	while (alloc->reserve_count < binder_alloc_reserve_pages) {
+		page = alloc_page(gfp | __GFP_HIGHMEM | __GFP_ZERO);
+		if (!page)
+			break;
+		list_add(&page->lru, &alloc->reserve);
+		alloc->reserve_count++;
+		atomic_inc(&binder_alloc_reserve_total);
+	}
+}
+
+/**
+ * binder_alloc_reserve_drain() - free the per-proc page reserve
+ * @alloc:	binder_alloc for this proc
+ *
+ * Must be called with alloc->mutex held.
+ */
+static void binder_alloc_reserve_drain(struct binder_alloc *alloc)
+{
+	struct page *page, *tmp;
+
+	list_for_each_entry_safe(page, tmp, &alloc->reserve, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+	}
+	atomic_sub(alloc->reserve_count, &binder_alloc_reserve_total);
+	alloc->reserve_count = 0;
+}
+
+static struct page *binder_alloc_reserve_get(struct binder_alloc *alloc)
+{
+	struct page *page;
+
+	if (list_empty(&alloc->reserve))
+		return alloc_page(GFP_KERNEL | __GFP_HIGHMEM | __GFP_ZERO);
+
+	page = list_first_entry(&alloc->reserve, struct page, lru);
+	list_del(&page->lru);
+	alloc->reserve_count--;
+	atomic_dec(&binder_alloc_reserve_total);
+	return page;
+}
+
+/* @page was never mapped, so it is still zeroed */
+static void binder_alloc_reserve_put(struct binder_alloc *alloc,
+				     struct page *page)
+{
+	if (alloc->reserve_count < binder_alloc_reserve_pages) {
+		list_add(&page->lru, &alloc->reserve);
+		alloc->reserve_count++;
+		atomic_inc(&binder_alloc_reserve_total);
+	} else {
+		__free_page(page);
+	}
+}
+
+/*
+ * A page that binder_update_page_range() allocated but has not inserted
+ * into the vma yet: it is neither on the lru nor mapped.
+ */
+static bool binder_page_unmapped(struct binder_lru_page *page)
+{
+	return page->page_ptr && list_empty(&page->lru) &&
+	       !page_mapped(page->page_ptr);
+}
+
+/*
+ * Give back the pages in [start, end) that were allocated by
+ * binder_update_page_range() but not mapped yet.
+ */
+static void binder_alloc_put_unmapped(struct binder_alloc *alloc,
+				      void __user *start, void __user *end)
+{
+	void __user *page_addr;
+	struct binder_lru_page *page;
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = &alloc->pages[(page_addr - alloc->buffer) / PAGE_SIZE];
+		if (!binder_page_unmapped(page))
+			continue;
+		binder_alloc_reserve_put(alloc, page->page_ptr);
+		page->page_ptr = NULL;
+	}
+}
+
 static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 				    void __user *start, void __user *end)
 {
@@ -208,12 +320,29 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 	if (allocate == 0)
 		goto free_range;
 
+	/*
+	 * Allocate all missing pages of the range before taking mmap_sem,
+	 * so that it is only held for the vm_insert_page() calls below.
+	 */
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		page = &alloc->pages[(page_addr - alloc->buffer) / PAGE_SIZE];
+		size_t index;
+
+		index = (page_addr - alloc->buffer) / PAGE_SIZE;
+		page = &alloc->pages[index];
+		if (page->page_ptr)
+			continue;
+
+		trace_binder_alloc_page_start(alloc, index);
+		page->page_ptr = binder_alloc_reserve_get(alloc);
 		if (!page->page_ptr) {
-			need_mm = true;
-			break;
+			pr_err("%d: binder_alloc_buf failed for page at %pK\n",
+				alloc->pid, page_addr);
+			binder_alloc_put_unmapped(alloc, start, page_addr);
+			return -ENOMEM;
 		}
+		page->alloc = alloc;
+		INIT_LIST_HEAD(&page->lru);
+		need_mm = true;
 	}
 
 	/* Same as mmget_not_zero() in later kernel versions */
@@ -229,6 +358,7 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		binder_alloc_debug(BINDER_DEBUG_USER_ERROR,
 				   "%d: binder_alloc_buf failed to map pages in userspace, no vma\n",
 				   alloc->pid);
+		binder_alloc_put_unmapped(alloc, start, end);
 		goto err_no_vma;
 	}
 
@@ -240,7 +370,7 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 		index = (page_addr - alloc->buffer) / PAGE_SIZE;
 		page = &alloc->pages[index];
 
-		if (page->page_ptr) {
+		if (!list_empty(&page->lru)) {
 			trace_binder_alloc_lru_start(alloc, index);
 
 			on_lru = list_lru_del(&binder_alloc_lru, &page->lru);
@@ -249,21 +379,8 @@ static int binder_update_page_range(struct binder_alloc *alloc, int allocate,
 			trace_binder_alloc_lru_end(alloc, index);
 			continue;
 		}
-
-		if (WARN_ON(!vma))
-			goto err_page_ptr_cleared;
-
-		trace_binder_alloc_page_start(alloc, index);
-		page->page_ptr = alloc_page(GFP_KERNEL |
-					    __GFP_HIGHMEM |
-					    __GFP_ZERO);
-		if (!page->page_ptr) {
-			pr_err("%d: binder_alloc_buf failed for page at %pK\n",
-				alloc->pid, page_addr);
-			goto err_alloc_page_failed;
-		}
-		page->alloc = alloc;
-		INIT_LIST_HEAD(&page->lru);
+		if (WARN_ON(!binder_page_unmapped(page)))
+			continue;
 
 		user_page_addr = (uintptr_t)page_addr;
 		ret = vm_insert_page(vma, user_page_addr, page[0].page_ptr);
@@ -304,10 +421,7 @@ free_range:
 		continue;
 
 err_vm_insert_page_failed:
-		__free_page(page->page_ptr);
-		page->page_ptr = NULL;
-err_alloc_page_failed:
-err_page_ptr_cleared:
+		binder_alloc_put_unmapped(alloc, page_addr, end);
 		if (page_addr == start)
 			break;
 	}
@@ -389,6 +503,7 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	}
 	if (is_async &&
 	    alloc->free_async_space < size + sizeof(struct binder_buffer)) {
+		alloc->async_failed++;
 		binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC,
 			     "%d: binder_alloc_buf size %zd failed, no async space left\n",
 			      alloc->pid, size);
@@ -497,7 +612,13 @@ static struct binder_buffer *binder_alloc_new_buf_locked(
 	buffer->async_transaction = is_async;
 	buffer->extra_buffers_size = extra_buffers_size;
 	if (is_async) {
+		size_t async_used;
+
 		alloc->free_async_space -= size + sizeof(struct binder_buffer);
+		alloc->async_allocs++;
+		async_used = alloc->buffer_size / 2 - alloc->free_async_space;
+		if (async_used > alloc->async_peak)
+			alloc->async_peak = async_used;
 		binder_alloc_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
 			     "%d: binder_alloc_buf size %zd async free %zd\n",
 			      alloc->pid, size, alloc->free_async_space);
@@ -668,6 +789,13 @@ void binder_alloc_free_buf(struct binder_alloc *alloc,
 {
 	mutex_lock(&alloc->mutex);
 	binder_free_buf_locked(alloc, buffer);
+	/*
+	 * Refill the reserve off the allocation path, but never try hard:
+	 * under memory pressure we would rather go without it.
+	 */
+	if (alloc->reserve_count < binder_alloc_reserve_pages / 2)
+		binder_alloc_reserve_fill(alloc, GFP_KERNEL | __GFP_NORETRY |
+					  __GFP_NOWARN);
 	mutex_unlock(&alloc->mutex);
 }
 
@@ -727,6 +855,15 @@ int binder_alloc_mmap_handler(struct binder_alloc *alloc,
 	/* Same as mmgrab() in later kernel versions */
 	atomic_inc(&alloc->vma_vm_mm->mm_count);
 
+	mutex_lock(&alloc->mutex);
+	binder_alloc_reserve_fill(alloc, GFP_KERNEL | __GFP_NORETRY |
+				  __GFP_NOWARN);
+	mutex_unlock(&alloc->mutex);
+
+	spin_lock(&binder_alloc_reserve_lock);
+	list_add_tail(&alloc->reserve_entry, &binder_alloc_reserve_list);
+	spin_unlock(&binder_alloc_reserve_lock);
+
 	return 0;
 
 err_alloc_buf_struct_failed:
@@ -751,6 +888,10 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 	int buffers, page_count;
 	struct binder_buffer *buffer;
 
+	spin_lock(&binder_alloc_reserve_lock);
+	list_del_init(&alloc->reserve_entry);
+	spin_unlock(&binder_alloc_reserve_lock);
+
 	buffers = 0;
 	mutex_lock(&alloc->mutex);
 	BUG_ON(alloc->vma);
@@ -798,6 +939,7 @@ void binder_alloc_deferred_release(struct binder_alloc *alloc)
 		}
 		kfree(alloc->pages);
 	}
+	binder_alloc_reserve_drain(alloc);
 	mutex_unlock(&alloc->mutex);
 	if (alloc->vma_vm_mm)
 		mmdrop(alloc->vma_vm_mm);
@@ -869,9 +1011,31 @@ void binder_alloc_print_pages(struct seq_file *m,
 	}
 	mutex_unlock(&alloc->mutex);
 	seq_printf(m, "  pages: %d:%d:%d\n", active, lru, free);
+	seq_printf(m, "  reserve pages: %d\n", alloc->reserve_count);
 	seq_printf(m, "  pages high watermark: %zu\n", alloc->pages_high);
 }
 
+/**
+ * binder_alloc_print_async() - print async buffer usage
+ * @m:     seq_file for output via seq_printf()
+ * @alloc: binder_alloc for this proc
+ */
+void binder_alloc_print_async(struct seq_file *m,
+			      struct binder_alloc *alloc)
+{
+	unsigned long allocs, failed;
+	size_t free_space, peak;
+
+	mutex_lock(&alloc->mutex);
+	allocs = alloc->async_allocs;
+	failed = alloc->async_failed;
+	free_space = alloc->free_async_space;
+	peak = alloc->async_peak;
+	mutex_unlock(&alloc->mutex);
+	seq_printf(m, "  async: allocs %lu failed %lu free %zu peak %zu\n",
+		   allocs, failed, free_space, peak);
+}
+
 /**
  * binder_alloc_get_allocated_count() - return count of buffers
  * @alloc: binder_alloc for this proc
@@ -977,11 +1141,36 @@ err_get_alloc_mutex_failed:
 	return LRU_SKIP;
 }
 
+/*
+ * Free the page reserves of the procs, up to @nr_to_scan pages.  They
+ * are unmapped and cheaper to give back than the pages on the lru.
+ */
+static unsigned long binder_alloc_shrink_reserves(unsigned long nr_to_scan)
+{
+	struct binder_alloc *alloc;
+	unsigned long freed = 0;
+
+	spin_lock(&binder_alloc_reserve_lock);
+	list_for_each_entry(alloc, &binder_alloc_reserve_list, reserve_entry) {
+		if (freed >= nr_to_scan)
+			break;
+		if (!alloc->reserve_count || !mutex_trylock(&alloc->mutex))
+			continue;
+		freed += alloc->reserve_count;
+		binder_alloc_reserve_drain(alloc);
+		mutex_unlock(&alloc->mutex);
+	}
+	spin_unlock(&binder_alloc_reserve_lock);
+
+	return freed;
+}
+
 static unsigned long
 binder_shrink_count(struct shrinker *shrink, struct shrink_control *sc)
 {
 	unsigned long ret = list_lru_count(&binder_alloc_lru);
-	return ret;
+
+	return ret + atomic_read(&binder_alloc_reserve_total);
 }
 
 static unsigned long
@@ -989,8 +1178,12 @@ binder_shrink_scan(struct shrinker *shrink, struct shrink_control *sc)
 {
 	unsigned long ret;
 
-	ret = list_lru_walk(&binder_alloc_lru, binder_alloc_free_page,
-			    NULL, sc->nr_to_scan);
+	ret = binder_alloc_shrink_reserves(sc->nr_to_scan);
+	if (ret >= sc->nr_to_scan)
+		return ret;
+
+	ret += list_lru_walk(&binder_alloc_lru, binder_alloc_free_page,
+			     NULL, sc->nr_to_scan - ret);
 	return ret;
 }
 
@@ -1012,6 +1205,8 @@ void binder_alloc_init(struct binder_alloc *alloc)
 	alloc->pid = current->group_leader->pid;
 	mutex_init(&alloc->mutex);
 	INIT_LIST_HEAD(&alloc->buffers);
+	INIT_LIST_HEAD(&alloc->reserve);
+	INIT_LIST_HEAD(&alloc->reserve_entry);
 }
 
 void binder_alloc_shrinker_init(void)
@@ -88,10 +88,19 @@ struct binder_lru_page {
  * @allocated_buffers:  rb tree of allocated buffers sorted by address
  * @free_async_space:   VA space available for async buffers. This is
  *                      initialized at mmap time to 1/2 the full VA space
+ * @async_allocs:       number of async buffers handed out
+ * @async_failed:       number of async allocations refused for lack of
+ *                      async space
+ * @async_peak:         high watermark of VA space used by async buffers
  * @pages:              array of binder_lru_page
  * @buffer_size:        size of address space specified via mmap
  * @pid:                pid for associated binder_proc (invariant after init)
  * @pages_high:         high watermark of offset in @pages
+ * @reserve:            zeroed, not yet mapped pages kept ready for
+ *                      binder_update_page_range()
+ * @reserve_count:      number of pages on @reserve
+ * @reserve_entry:      entry in the list of procs whose reserve the
+ *                      shrinker may drain
  *
  * Bookkeeping structure for per-proc address space management for binder
  * buffers. It is normally initialized during binder_init() and binder_mmap()
@@ -107,11 +116,17 @@ struct binder_alloc {
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
+	unsigned long async_allocs;
+	unsigned long async_failed;
+	size_t async_peak;
 	struct binder_lru_page *pages;
 	size_t buffer_size;
 	uint32_t buffer_free;
 	int pid;
 	size_t pages_high;
+	struct list_head reserve;
+	int reserve_count;
+	struct list_head reserve_entry;
 };
 
 #ifdef CONFIG_ANDROID_BINDER_IPC_SELFTEST
@@ -142,6 +157,8 @@ extern void binder_alloc_print_allocated(struct seq_file *m,
 					 struct binder_alloc *alloc);
 void binder_alloc_print_pages(struct seq_file *m,
 			      struct binder_alloc *alloc);
+void binder_alloc_print_async(struct seq_file *m,
+			      struct binder_alloc *alloc);
 
 /**
  * binder_alloc_get_free_async_space() - get free space available for async
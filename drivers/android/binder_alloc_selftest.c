@@ -19,10 +19,13 @@
 
 #include <linux/mm_types.h>
 #include <linux/err.h>
+#include <linux/ktime.h>
 #include "binder_alloc.h"
 
 #define BUFFER_NUM 5
 #define BUFFER_MIN_SIZE (PAGE_SIZE / 8)
+#define LARGE_PARCEL_SIZE (256 * 1024)
+#define LARGE_PARCEL_ITERS 64
 
 static bool binder_selftest_run = true;
 static int binder_selftest_failures;
@@ -280,6 +283,63 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
 	}
 }
 
+/**
+ * binder_selftest_large_parcel() - Measure throughput for large parcels.
+ * @alloc: Pointer to alloc struct.
+ * @cold:  Reclaim all pages before each transaction.
+ *
+ * Allocate, fill and free a large buffer LARGE_PARCEL_ITERS times, the
+ * way a transaction carrying a bitmap or cursor window would. With @cold
+ * every iteration has to allocate and map all pages of the buffer,
+ * otherwise they are taken back from the lru. Only the alloc, copy and
+ * free are timed.
+ */
+static void binder_selftest_large_parcel(struct binder_alloc *alloc,
+					 bool cold)
+{
+	struct binder_buffer *buffer;
+	size_t size, offset;
+	void *src;
+	ktime_t start;
+	u64 ns = 0;
+	int i;
+
+	size = min_t(size_t, LARGE_PARCEL_SIZE, alloc->buffer_size / 4);
+	src = (void *)__get_free_page(GFP_KERNEL);
+	if (!src)
+		return;
+	memset(src, 0x5a, PAGE_SIZE);
+
+	for (i = 0; i < LARGE_PARCEL_ITERS; i++) {
+		if (cold)
+			binder_selftest_free_page(alloc);
+
+		start = ktime_get();
+		buffer = binder_alloc_new_buf(alloc, size, 0, 0, 0);
+		if (IS_ERR(buffer)) {
+			pr_err("large parcel alloc of %zu failed\n", size);
+			binder_selftest_failures++;
+			break;
+		}
+		for (offset = 0; offset < size; offset += PAGE_SIZE)
+			binder_alloc_copy_to_buffer(alloc, buffer, offset, src,
+						    min_t(size_t, PAGE_SIZE,
+							  size - offset));
+		if (!check_buffer_pages_allocated(alloc, buffer, size))
+			binder_selftest_failures++;
+		binder_alloc_free_buf(alloc, buffer);
+		ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	}
+	binder_selftest_free_page(alloc);
+	free_page((unsigned long)src);
+
+	if (i == LARGE_PARCEL_ITERS && ns)
+		pr_info("%s large parcel: %d x %zu bytes in %llu us, %llu MB/s\n",
+			cold ? "cold" : "warm", i, size,
+			div_u64(ns, NSEC_PER_USEC),
+			div64_u64((u64)size * i * NSEC_PER_USEC, ns));
+}
+
 /**
  * binder_selftest_alloc() - Test alloc and free of buffer pages.
  * @alloc: Pointer to alloc struct.
@@ -287,7 +347,8 @@ static void binder_selftest_alloc_offset(struct binder_alloc *alloc,
  * Allocate BUFFER_NUM buffers to cover all page alignment cases,
  * then free them in all orders possible. Check that pages are
  * correctly allocated, put onto lru when buffers are freed, and
- * are freed when binder_alloc_free_page is called.
+ * are freed when binder_alloc_free_page is called. Finally report
+ * the throughput for large parcels with and without pages on the lru.
  */
 void binder_selftest_alloc(struct binder_alloc *alloc)
 {
@@ -300,6 +361,8 @@ void binder_selftest_alloc(struct binder_alloc *alloc)
 		goto done;
 	pr_info("STARTED\n");
 	binder_selftest_alloc_offset(alloc, end_offset, 0);
+	binder_selftest_large_parcel(alloc, true);
+	binder_selftest_large_parcel(alloc, false);
 	binder_selftest_run = false;
 	if (binder_selftest_failures > 0)
 		pr_info("%d tests FAILED\n", binder_selftest_failures);
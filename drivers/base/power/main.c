@@ -30,6 +30,10 @@
 #include <linux/suspend.h>
 #include <linux/timer.h>
 #include <linux/wakeup_reason.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/seq_file.h>
+#include <linux/debugfs.h>
 
 #include "../base.h"
 #include "power.h"
@@ -64,6 +68,10 @@ struct dpm_watchdog {
 
 static int async_error;
 
+/* Duration of the last dpm_resume() and devices resumed asynchronously. */
+static s64 dpm_resume_usecs;
+static unsigned int dpm_resume_async_cnt;
+
 /**
  * device_pm_init - Initialize the PM-related part of a device object.
  * @dev: Device object being initialized.
@@ -409,6 +417,34 @@ static int dpm_run_callback(pm_callback_t cb, struct device *dev,
 	return error;
 }
 
+/**
+ * dpm_run_resume_callback - Run a resume callback and account for its time.
+ * @cb: Resume callback to run.
+ * @dev: Device to run the callback for.
+ * @state: PM transition of the system being carried out.
+ * @info: Callback type for debug messages.
+ *
+ * The time spent in the noirq, early and regular resume callbacks of @dev is
+ * summed up in dev->power.resume_usecs, which is cleared by device_prepare().
+ * Time spent waiting for the parent is not included.
+ */
+static int dpm_run_resume_callback(pm_callback_t cb, struct device *dev,
+				   pm_message_t state, char *info)
+{
+	ktime_t starttime;
+	int error;
+
+	if (!cb)
+		return 0;
+
+	starttime = ktime_get();
+	error = dpm_run_callback(cb, dev, state, info);
+	dev->power.resume_usecs += ktime_to_us(ktime_sub(ktime_get(),
+							 starttime));
+
+	return error;
+}
+
 /**
  * dpm_wd_handler - Driver suspend / resume watchdog handler.
  *
@@ -497,7 +533,7 @@ static int device_resume_noirq(struct device *dev, pm_message_t state)
 		callback = pm_noirq_op(dev->driver->pm, state);
 	}
 
-	error = dpm_run_callback(callback, dev, state, info);
+	error = dpm_run_resume_callback(callback, dev, state, info);
 
 	TRACE_RESUME(error);
 	return error;
@@ -574,7 +610,7 @@ static int device_resume_early(struct device *dev, pm_message_t state)
 		callback = pm_late_early_op(dev->driver->pm, state);
 	}
 
-	error = dpm_run_callback(callback, dev, state, info);
+	error = dpm_run_resume_callback(callback, dev, state, info);
 
 	TRACE_RESUME(error);
 
@@ -696,7 +732,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	}
 
  End:
-	error = dpm_run_callback(callback, dev, state, info);
+	error = dpm_run_resume_callback(callback, dev, state, info);
 	dev->power.is_suspended = false;
 
  Unlock:
@@ -743,12 +779,14 @@ void dpm_resume(pm_message_t state)
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 	async_error = 0;
+	dpm_resume_async_cnt = 0;
 
 	list_for_each_entry(dev, &dpm_suspended_list, power.entry) {
 		INIT_COMPLETION(dev->power.completion);
 		if (is_async(dev)) {
 			get_device(dev);
 			async_schedule(async_resume, dev);
+			dpm_resume_async_cnt++;
 		}
 	}
 
@@ -776,6 +814,7 @@ void dpm_resume(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
+	dpm_resume_usecs = ktime_to_us(ktime_sub(ktime_get(), starttime));
 	dpm_show_time(starttime, state, NULL);
 }
 
@@ -1312,6 +1351,8 @@ static int device_prepare(struct device *dev, pm_message_t state)
 	 */
 	pm_runtime_get_noresume(dev);
 
+	dev->power.resume_usecs = 0;
+
 	device_lock(dev);
 
 	dev->power.wakeup_path = device_may_wakeup(dev);
@@ -1449,3 +1490,87 @@ void dpm_for_each_dev(void *data, void (*fn)(struct device *, void *))
 	device_pm_unlock();
 }
 EXPORT_SYMBOL_GPL(dpm_for_each_dev);
+
+#ifdef CONFIG_DEBUG_FS
+static int dpm_resume_usecs_cmp(const void *a, const void *b)
+{
+	const struct device *deva = *(const struct device **)a;
+	const struct device *devb = *(const struct device **)b;
+
+	if (deva->power.resume_usecs < devb->power.resume_usecs)
+		return 1;
+	if (deva->power.resume_usecs > devb->power.resume_usecs)
+		return -1;
+	return 0;
+}
+
+/**
+ * dpm_resume_times_show - Print devices sorted by time spent resuming.
+ * @m: seq_file to print the table into.
+ * @unused: unused.
+ *
+ * The list only covers the last system resume.  Each entry is the sum of the
+ * noirq, early and regular resume callbacks of the device.
+ */
+static int dpm_resume_times_show(struct seq_file *m, void *unused)
+{
+	struct device **devs, *dev;
+	int i, n = 0;
+
+	device_pm_lock();
+
+	list_for_each_entry(dev, &dpm_list, power.entry)
+		n++;
+
+	devs = kmalloc(n * sizeof(*devs), GFP_KERNEL);
+	if (!devs) {
+		device_pm_unlock();
+		return -ENOMEM;
+	}
+
+	n = 0;
+	list_for_each_entry(dev, &dpm_list, power.entry)
+		if (dev->power.resume_usecs)
+			devs[n++] = dev;
+
+	sort(devs, n, sizeof(*devs), dpm_resume_usecs_cmp, NULL);
+
+	seq_printf(m, "resume: %lld usecs, %u async devices\n",
+		   dpm_resume_usecs, dpm_resume_async_cnt);
+	seq_puts(m, "usecs\t\tasync\tdriver\t\tdevice\n");
+	for (i = 0; i < n; i++) {
+		dev = devs[i];
+		seq_printf(m, "%-8lld\t%d\t%-12s\t%s\n",
+			   dev->power.resume_usecs, dev->power.async_suspend,
+			   dev->driver ? dev->driver->name : "-",
+			   dev_name(dev));
+	}
+
+	device_pm_unlock();
+	kfree(devs);
+
+	return 0;
+}
+
+static int dpm_resume_times_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_resume_times_show, NULL);
+}
+
+static const struct file_operations dpm_resume_times_fops = {
+	.owner = THIS_MODULE,
+	.open = dpm_resume_times_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init dpm_resume_times_debugfs_init(void)
+{
+	debugfs_create_file("device_resume_times", S_IRUGO, NULL, NULL,
+			    &dpm_resume_times_fops);
+	return 0;
+}
+
+late_initcall(dpm_resume_times_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
@@ -4185,6 +4185,9 @@ int kgsl_device_platform_probe(struct kgsl_device *device)
 	/* Initialize common sysfs entries */
 	kgsl_pwrctrl_init_sysfs(device);
 
+	/* Nothing else depends on the GPU being resumed first */
+	device_enable_async_suspend(device->parentdev);
+
 	return 0;
 
 error_close_mmu:
@@ -60,16 +60,9 @@ struct evdev_client {
 static struct evdev *evdev_table[EVDEV_MINORS];
 static DEFINE_MUTEX(evdev_table_mutex);
 
-static void evdev_pass_event(struct evdev_client *client,
-			     struct input_event *event,
-			     ktime_t mono, ktime_t real)
+static void __pass_event(struct evdev_client *client,
+			 const struct input_event *event)
 {
-	event->time = ktime_to_timeval(client->clkid == CLOCK_MONOTONIC ?
-					mono : real);
-
-	/* Interrupts are disabled, just acquire the lock. */
-	spin_lock(&client->buffer_lock);
-
 	client->buffer[client->head++] = *event;
 	client->head &= client->bufsize - 1;
 
@@ -96,29 +89,44 @@ static void evdev_pass_event(struct evdev_client *client,
 			wake_lock(&client->wake_lock);
 		kill_fasync(&client->fasync, SIGIO, POLL_IN);
 	}
-
-	spin_unlock(&client->buffer_lock);
 }
 
 /*
- * Pass incoming event to all connected clients.
+ * Copy a run of events sharing one timestamp into the client's buffer
+ * under a single acquisition of its lock.
  */
-static void evdev_event(struct input_handle *handle,
-			unsigned int type, unsigned int code, int value)
+static void evdev_pass_values(struct evdev_client *client,
+			      const struct input_value *vals,
+			      unsigned int count,
+			      ktime_t mono, ktime_t real)
 {
-	struct evdev *evdev = handle->private;
-	struct evdev_client *client;
+	const struct input_value *v;
 	struct input_event event;
-	ktime_t time_mono, time_real;
 
-	if (type == EV_SYN && code == SYN_TIME_SEC) {
-		evdev->hw_ts_sec = value;
-		return;
+	event.time = ktime_to_timeval(client->clkid == CLOCK_MONOTONIC ?
+				      mono : real);
+
+	/* Interrupts are disabled, just acquire the lock. */
+	spin_lock(&client->buffer_lock);
+
+	for (v = vals; v != vals + count; v++) {
+		event.type = v->type;
+		event.code = v->code;
+		event.value = v->value;
+		__pass_event(client, &event);
 	}
-	if (type == EV_SYN && code == SYN_TIME_NSEC) {
-		evdev->hw_ts_nsec = value;
+
+	spin_unlock(&client->buffer_lock);
+}
+
+static void evdev_pass_run(struct evdev *evdev,
+			   const struct input_value *vals, unsigned int count)
+{
+	struct evdev_client *client;
+	ktime_t time_mono, time_real;
+
+	if (!count)
 		return;
-	}
 
 	if (evdev->hw_ts_sec != -1 && evdev->hw_ts_nsec != -1)
 		time_mono = ktime_set(evdev->hw_ts_sec, evdev->hw_ts_nsec);
@@ -127,27 +135,66 @@ static void evdev_event(struct input_handle *handle,
 
 	time_real = ktime_sub(time_mono, ktime_get_monotonic_offset());
 
-	event.type = type;
-	event.code = code;
-	event.value = value;
-
 	rcu_read_lock();
 
 	client = rcu_dereference(evdev->grab);
 
 	if (client)
-		evdev_pass_event(client, &event, time_mono, time_real);
+		evdev_pass_values(client, vals, count, time_mono, time_real);
 	else
 		list_for_each_entry_rcu(client, &evdev->client_list, node)
-			evdev_pass_event(client, &event, time_mono, time_real);
+			evdev_pass_values(client, vals, count,
+					  time_mono, time_real);
 
 	rcu_read_unlock();
+}
 
-	if (type == EV_SYN && code == SYN_REPORT) {
-		evdev->hw_ts_sec = -1;
-		evdev->hw_ts_nsec = -1;
-		wake_up_interruptible(&evdev->wait);
+/*
+ * Pass a frame of incoming events to all connected clients.  Readers
+ * are woken once per frame.  SYN_TIME_SEC/NSEC are consumed here and
+ * stamp the events that follow them.
+ */
+static void evdev_events(struct input_handle *handle,
+			 const struct input_value *vals, unsigned int count)
+{
+	struct evdev *evdev = handle->private;
+	const struct input_value *v, *run = vals;
+	bool wakeup = false;
+
+	for (v = vals; v != vals + count; v++) {
+		if (v->type != EV_SYN)
+			continue;
+
+		if (v->code == SYN_TIME_SEC || v->code == SYN_TIME_NSEC) {
+			evdev_pass_run(evdev, run, v - run);
+			run = v + 1;
+			if (v->code == SYN_TIME_SEC)
+				evdev->hw_ts_sec = v->value;
+			else
+				evdev->hw_ts_nsec = v->value;
+		} else if (v->code == SYN_REPORT) {
+			evdev_pass_run(evdev, run, v + 1 - run);
+			run = v + 1;
+			evdev->hw_ts_sec = -1;
+			evdev->hw_ts_nsec = -1;
+			wakeup = true;
+		}
 	}
+	evdev_pass_run(evdev, run, vals + count - run);
+
+	if (wakeup)
+		wake_up_interruptible(&evdev->wait);
+}
+
+/*
+ * Pass incoming event to all connected clients.
+ */
+static void evdev_event(struct input_handle *handle,
+			unsigned int type, unsigned int code, int value)
+{
+	struct input_value vals[] = { { type, code, value } };
+
+	evdev_events(handle, vals, 1);
 }
 
 static int evdev_fasync(int fd, struct file *file, int on)
@@ -1105,6 +1152,7 @@ MODULE_DEVICE_TABLE(input, evdev_ids);
 
 static struct input_handler evdev_handler = {
 	.event		= evdev_event,
+	.events		= evdev_events,
 	.connect	= evdev_connect,
 	.disconnect	= evdev_disconnect,
 	.fops		= &evdev_fops,
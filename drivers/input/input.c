@@ -70,43 +70,113 @@ static int input_defuzz_abs_event(int value, int old_val, int fuzz)
 }
 
 /*
- * Pass event first through all filters and then, if event has not been
- * filtered out, through all open handles. This function is called with
- * dev->event_lock held and interrupts disabled.
+ * Pass a frame of events to one handle.  A filter drops the events it
+ * consumes from @vals, so handlers further down the list do not see
+ * them.  Returns the number of events left.
  */
-static void input_pass_event(struct input_dev *dev,
-			     unsigned int type, unsigned int code, int value)
+static unsigned int input_to_handler(struct input_handle *handle,
+				     struct input_value *vals,
+				     unsigned int count)
+{
+	struct input_handler *handler = handle->handler;
+	struct input_value *end = vals;
+	struct input_value *v;
+
+	if (handler->filter) {
+		for (v = vals; v != vals + count; v++) {
+			if (handler->filter(handle, v->type, v->code, v->value))
+				continue;
+			if (end != v)
+				*end = *v;
+			end++;
+		}
+		count = end - vals;
+	}
+
+	if (!count)
+		return 0;
+
+	if (handler->events)
+		handler->events(handle, vals, count);
+	else if (handler->event)
+		for (v = vals; v != vals + count; v++)
+			handler->event(handle, v->type, v->code, v->value);
+
+	return count;
+}
+
+/*
+ * Pass a frame of events first through all filters and then, if not
+ * everything has been filtered out, through all open handles. This
+ * function is called with dev->event_lock held and interrupts disabled.
+ */
+static void input_pass_values(struct input_dev *dev,
+			      struct input_value *vals, unsigned int count)
 {
-	struct input_handler *handler;
 	struct input_handle *handle;
 
 	rcu_read_lock();
 
 	handle = rcu_dereference(dev->grab);
 	if (handle)
-		handle->handler->event(handle, type, code, value);
+		input_to_handler(handle, vals, count);
 	else {
-		bool filtered = false;
-
 		list_for_each_entry_rcu(handle, &dev->h_list, d_node) {
 			if (!handle->open)
 				continue;
 
-			handler = handle->handler;
-			if (!handler->filter) {
-				if (filtered)
-					break;
-
-				handler->event(handle, type, code, value);
-
-			} else if (handler->filter(handle, type, code, value))
-				filtered = true;
+			count = input_to_handler(handle, vals, count);
+			if (!count)
+				break;
 		}
 	}
 
 	rcu_read_unlock();
 }
 
+/*
+ * Pass a single event, bypassing the frame being collected. Used for
+ * events the core generates itself (autorepeat, key release).
+ */
+static void input_pass_event(struct input_dev *dev,
+			     unsigned int type, unsigned int code, int value)
+{
+	struct input_value v = { type, code, value };
+
+	input_pass_values(dev, &v, 1);
+}
+
+/*
+ * Add an event to the frame in dev->vals.  The frame is handed over
+ * on SYN_REPORT, or early with a SYN_REPORT of its own if the buffer
+ * fills up.  Called with dev->event_lock held.
+ */
+static void input_queue_value(struct input_dev *dev,
+			      unsigned int type, unsigned int code, int value)
+{
+	struct input_value *v;
+
+	if (!dev->vals)
+		return;
+
+	v = &dev->vals[dev->num_vals++];
+	v->type = type;
+	v->code = code;
+	v->value = value;
+
+	if (type == EV_SYN && code == SYN_REPORT) {
+		input_pass_values(dev, dev->vals, dev->num_vals);
+		dev->num_vals = 0;
+	} else if (dev->num_vals >= dev->max_vals - 1) {
+		v = &dev->vals[dev->num_vals++];
+		v->type = EV_SYN;
+		v->code = SYN_REPORT;
+		v->value = 1;
+		input_pass_values(dev, dev->vals, dev->num_vals);
+		dev->num_vals = 0;
+	}
+}
+
 /*
  * Generate software autorepeat event. Note that we take
  * dev->event_lock here to avoid racing with input_event
@@ -207,7 +277,7 @@ static int input_handle_abs_event(struct input_dev *dev,
 	/* Flush pending "slot" event */
 	if (is_mt_event && dev->slot != input_abs_get_val(dev, ABS_MT_SLOT)) {
 		input_abs_set_val(dev, ABS_MT_SLOT, dev->slot);
-		input_pass_event(dev, EV_ABS, ABS_MT_SLOT, dev->slot);
+		input_queue_value(dev, EV_ABS, ABS_MT_SLOT, dev->slot);
 	}
 
 	return INPUT_PASS_TO_HANDLERS;
@@ -328,7 +398,7 @@ static void input_handle_event(struct input_dev *dev,
 		dev->event(dev, type, code, value);
 
 	if (disposition & INPUT_PASS_TO_HANDLERS)
-		input_pass_event(dev, type, code, value);
+		input_queue_value(dev, type, code, value);
 }
 
 /**
@@ -1420,6 +1490,7 @@ static void input_dev_release(struct device *device)
 	input_ff_destroy(dev);
 	input_mt_destroy_slots(dev);
 	kfree(dev->absinfo);
+	kfree(dev->vals);
 	kfree(dev);
 
 	module_put(THIS_MODULE);
@@ -1797,6 +1868,9 @@ static unsigned int input_estimate_events_per_packet(struct input_dev *dev)
 				events++;
 	}
 
+	/* Make room for KEY and MSC events */
+	events += 7;
+
 	return events;
 }
 
@@ -1851,6 +1925,13 @@ int input_register_device(struct input_dev *dev)
 		dev->hint_events_per_packet =
 				input_estimate_events_per_packet(dev);
 
+	/* room for a frame plus the SYN_REPORT closing it */
+	dev->max_vals = max(dev->hint_events_per_packet, 2U) + 1;
+	dev->vals = kcalloc(dev->max_vals, sizeof(*dev->vals), GFP_KERNEL);
+	if (!dev->vals)
+		return -ENOMEM;
+	dev->num_vals = 0;
+
 	/*
 	 * If delay and period are pre-set by the driver, then autorepeating
 	 * is handled by the driver itself and we don't do it in input.c.
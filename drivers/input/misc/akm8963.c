@@ -1076,6 +1076,7 @@ int akm8963_probe(struct i2c_client *client, const struct i2c_device_id *id)
 
 	i2c_set_clientdata(client, akm);
 
+	device_enable_async_suspend(&client->dev);
 	dev_info(&client->dev, "successfully probed.");
 	return 0;
 
@@ -918,6 +918,7 @@ static int __devinit bma250_probe(struct i2c_client *ic_dev,
 	if (rc)
 		goto probe_err_sysfs;
 
+	device_enable_async_suspend(&ic_dev->dev);
 	return rc;
 
 probe_err_sysfs:
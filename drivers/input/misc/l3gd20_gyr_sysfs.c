@@ -711,6 +711,7 @@ static int __devinit l3gd20_probe(struct i2c_client *client,
 	}
 
 	l3gd20_device_power_off(gyro);
+	device_enable_async_suspend(&client->dev);
 
 	dev_info(&client->dev, "%s completed.\n", __func__);
 	return 0;
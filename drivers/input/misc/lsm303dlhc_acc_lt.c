@@ -677,6 +677,7 @@ static int __devinit lsm303dlhc_acc_lt_probe(struct i2c_client *client,
 	pm_runtime_set_autosuspend_delay(&client->dev, AUTOSUSPEND_MS);
 	pm_runtime_use_autosuspend(&client->dev);
 	pm_runtime_mark_last_busy(&client->dev);
+	device_enable_async_suspend(&client->dev);
 
 	dev_info(&client->dev, "%s completed.\n", __func__);
 
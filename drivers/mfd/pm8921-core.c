@@ -892,6 +892,17 @@ static const char * const pm8917_rev_names[] = {
 	[PM8XXX_REVISION_8917_1p0]	= "1.0",
 };
 
+/*
+ * The PMIC children only talk to the PMIC over SSBI, which is ordered by
+ * the parent/child relationship, so they can resume in parallel.
+ */
+static int __devinit pm8921_child_async_suspend(struct device *dev,
+						void *data)
+{
+	device_enable_async_suspend(dev);
+	return 0;
+}
+
 static int __devinit pm8921_probe(struct platform_device *pdev)
 {
 	const struct pm8921_platform_data *pdata = pdev->dev.platform_data;
@@ -973,6 +984,8 @@ static int __devinit pm8921_probe(struct platform_device *pdev)
 		goto err;
 	}
 
+	device_for_each_child(pmic->dev, NULL, pm8921_child_async_suspend);
+
 	/* gpio might not work if no irq device is found */
 	WARN_ON(pmic->irq_chip == NULL);
 
@@ -13,34 +13,57 @@
  *
  */
 
-#include <linux/atomic.h>
+#include <linux/cache.h>
+#include <linux/cpufreq.h>
 #include <linux/err.h>
 #include <linux/hashtable.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
-#include <linux/profile.h>
+#include <linux/rculist.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/uaccess.h>
+#include <linux/uid_cputime.h>
 
 #define UID_HASH_BITS	10
-DECLARE_HASHTABLE(hash_table, UID_HASH_BITS);
+static DEFINE_HASHTABLE(hash_table, UID_HASH_BITS);
 
-static DEFINE_MUTEX(uid_lock);
+/* protects hash_table and uid_freqs updates, readers use RCU */
+static DEFINE_SPINLOCK(uid_lock);
 static struct proc_dir_entry *parent;
 
-struct uid_entry {
-	uid_t uid;
+/*
+ * Frequency columns of the time_in_state matrix. Frequencies are only
+ * ever appended, so a column index stays valid once handed out.
+ */
+#define UID_FREQ_MAX	24
+
+static unsigned int uid_freqs[UID_FREQ_MAX];
+static int uid_nr_freqs;
+
+/* column of the current frequency of each cpu, -1 if unknown */
+static DEFINE_PER_CPU(int, uid_freq_index) = -1;
+
+/*
+ * Times charged to a uid on one cpu. Only written by that cpu from the
+ * cputime accounting path, summed up on read.
+ */
+struct uid_cpu_stat {
 	cputime_t utime;
 	cputime_t stime;
-	cputime_t active_utime;
-	cputime_t active_stime;
-	unsigned long long active_power;
-	unsigned long long power;
+	cputime_t time_in_state[UID_FREQ_MAX];
+} ____cacheline_aligned_in_smp;
+
+struct uid_entry {
+	uid_t uid;
+	struct uid_cpu_stat *cpu;	/* nr_cpu_ids entries */
 	struct hlist_node hash;
+	struct rcu_head rcu;
 };
 
 static struct uid_entry *find_uid_entry(uid_t uid)
@@ -48,90 +71,118 @@ static struct uid_entry *find_uid_entry(uid_t uid)
 	struct uid_entry *uid_entry;
 	struct hlist_node *node;
 
-	hash_for_each_possible(hash_table, uid_entry, node, hash, uid) {
+	hash_for_each_possible_rcu(hash_table, uid_entry, node, hash, uid) {
 		if (uid_entry->uid == uid)
 			return uid_entry;
 	}
 	return NULL;
 }
 
+/*
+ * Called from the tick with interrupts disabled, so allocations must be
+ * atomic and the per-cpu stats can't come from alloc_percpu().
+ */
 static struct uid_entry *find_or_register_uid(uid_t uid)
 {
 	struct uid_entry *uid_entry;
+	unsigned long flags;
 
 	uid_entry = find_uid_entry(uid);
 	if (uid_entry)
 		return uid_entry;
 
+	spin_lock_irqsave(&uid_lock, flags);
+	uid_entry = find_uid_entry(uid);
+	if (uid_entry)
+		goto out;
+
 	uid_entry = kzalloc(sizeof(struct uid_entry), GFP_ATOMIC);
 	if (!uid_entry)
-		return NULL;
+		goto out;
+	uid_entry->cpu = kzalloc(nr_cpu_ids * sizeof(struct uid_cpu_stat),
+				 GFP_ATOMIC);
+	if (!uid_entry->cpu) {
+		kfree(uid_entry);
+		uid_entry = NULL;
+		goto out;
+	}
 
 	uid_entry->uid = uid;
 
-	hash_add(hash_table, &uid_entry->hash, uid);
-
+	hash_add_rcu(hash_table, &uid_entry->hash, uid);
+out:
+	spin_unlock_irqrestore(&uid_lock, flags);
 	return uid_entry;
 }
 
+static void free_uid_entry_rcu(struct rcu_head *rcu)
+{
+	struct uid_entry *uid_entry = container_of(rcu, struct uid_entry, rcu);
+
+	kfree(uid_entry->cpu);
+	kfree(uid_entry);
+}
+
+/**
+ * uid_cputime_account() - charge cpu time to the uid of a task
+ * @p:		task the time was spent by
+ * @cputime:	time spent since the last update
+ * @user:	true for user time, false for system time
+ *
+ * Called from the scheduler's cputime accounting on the cpu that ran @p.
+ */
+void uid_cputime_account(struct task_struct *p, cputime_t cputime, bool user)
+{
+	struct uid_entry *uid_entry;
+	struct uid_cpu_stat *stat;
+	unsigned long flags;
+	int index;
+
+	local_irq_save(flags);
+	rcu_read_lock();
+	uid_entry = find_or_register_uid(task_uid(p));
+	if (!uid_entry)
+		goto out;
+
+	stat = &uid_entry->cpu[smp_processor_id()];
+	if (user)
+		stat->utime += cputime;
+	else
+		stat->stime += cputime;
+
+	index = __this_cpu_read(uid_freq_index);
+	if (index >= 0)
+		stat->time_in_state[index] += cputime;
+out:
+	rcu_read_unlock();
+	local_irq_restore(flags);
+}
+
 static int uid_stat_show(struct seq_file *m, void *v)
 {
 	struct uid_entry *uid_entry;
-	struct task_struct *task, *temp;
 	struct hlist_node *node;
-	cputime_t utime;
-	cputime_t stime;
 	unsigned long bkt;
+	int cpu;
 
-	mutex_lock(&uid_lock);
-
-	hash_for_each(hash_table, bkt, node, uid_entry, hash) {
-		uid_entry->active_stime = 0;
-		uid_entry->active_utime = 0;
-		uid_entry->active_power = 0;
-	}
+	rcu_read_lock();
+	hash_for_each_rcu(hash_table, bkt, node, uid_entry, hash) {
+		cputime_t total_utime = 0;
+		cputime_t total_stime = 0;
 
-	read_lock(&tasklist_lock);
-	do_each_thread(temp, task) {
-		uid_entry = find_or_register_uid(task_uid(task));
-		if (!uid_entry) {
-			read_unlock(&tasklist_lock);
-			mutex_unlock(&uid_lock);
-			pr_err("%s: failed to find the uid_entry for uid %d\n",
-						__func__, task_uid(task));
-			return -ENOMEM;
+		for_each_possible_cpu(cpu) {
+			total_utime += uid_entry->cpu[cpu].utime;
+			total_stime += uid_entry->cpu[cpu].stime;
 		}
-		/* if this task is exiting, we have already accounted for the
-		 * time and power. */
-#if 0 /* 3.0 fix */
-		if (task->cpu_power == ULLONG_MAX)
-			continue;
-#endif
-		task_times(task, &utime, &stime);
-		uid_entry->active_utime += utime;
-		uid_entry->active_stime += stime;
-#if 0 /* 3.0 fix */
-		uid_entry->active_power += task->cpu_power;
-#endif
-	} while_each_thread(temp, task);
-	read_unlock(&tasklist_lock);
-
-	hash_for_each(hash_table, bkt, node, uid_entry, hash) {
-		cputime_t total_utime = uid_entry->utime +
-							uid_entry->active_utime;
-		cputime_t total_stime = uid_entry->stime +
-							uid_entry->active_stime;
-		unsigned long long total_power = uid_entry->power +
-							uid_entry->active_power;
 		seq_printf(m, "%d: %llu %llu %llu\n", uid_entry->uid,
 			(unsigned long long)jiffies_to_msecs(
 				cputime_to_jiffies(total_utime)) * USEC_PER_MSEC,
 			(unsigned long long)jiffies_to_msecs(
 				cputime_to_jiffies(total_stime)) * USEC_PER_MSEC,
-			total_power);
+			0ULL);
 	}
+	rcu_read_unlock();
 
-	mutex_unlock(&uid_lock);
 	return 0;
 }
 
@@ -157,6 +208,7 @@ static ssize_t uid_remove_write(struct file *file,
 {
 	struct uid_entry *uid_entry;
 	struct hlist_node *node, *tmp;
+	unsigned long bkt;
 	char uids[128];
 	char *start_uid, *end_uid = NULL;
 	long int uid_start = 0, uid_end = 0;
@@ -178,19 +230,18 @@ static ssize_t uid_remove_write(struct file *file,
 		kstrtol(end_uid, 10, &uid_end) != 0) {
 		return -EINVAL;
 	}
-	mutex_lock(&uid_lock);
-
-	for (; uid_start <= uid_end; uid_start++) {
-		hash_for_each_possible_safe(hash_table, uid_entry, node, tmp,
-							hash, (uid_t)uid_start) {
-			if (uid_start == uid_entry->uid) {
-				hash_del(&uid_entry->hash);
-				kfree(uid_entry);
-			}
+	/*
+	 * The range comes from userspace and may be huge: walk the table
+	 * once rather than looking up every uid in the range.
+	 */
+	spin_lock_irq(&uid_lock);
+	hash_for_each_safe(hash_table, bkt, node, tmp, uid_entry, hash) {
+		if (uid_entry->uid >= uid_start && uid_entry->uid <= uid_end) {
+			hash_del_rcu(&uid_entry->hash);
+			call_rcu(&uid_entry->rcu, free_uid_entry_rcu);
 		}
 	}
-
-	mutex_unlock(&uid_lock);
+	spin_unlock_irq(&uid_lock);
 	return count;
 }
 
@@ -200,46 +251,147 @@ static const struct file_operations uid_remove_fops = {
 	.write		= uid_remove_write,
 };
 
-static int process_notifier(struct notifier_block *self,
-			unsigned long cmd, void *v)
+static int uid_time_in_state_show(struct seq_file *m, void *v)
 {
-	struct task_struct *task = v;
 	struct uid_entry *uid_entry;
-	cputime_t utime, stime;
-	uid_t uid;
+	struct hlist_node *node;
+	unsigned long bkt;
+	int order[UID_FREQ_MAX];
+	int nr_freqs;
+	int i, j, cpu;
+
+	/* print the columns sorted by frequency */
+	nr_freqs = ACCESS_ONCE(uid_nr_freqs);
+	smp_rmb();
+	for (i = 0; i < nr_freqs; i++) {
+		for (j = i; j > 0 && uid_freqs[order[j - 1]] > uid_freqs[i]; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+
+	seq_puts(m, "uid:");
+	for (i = 0; i < nr_freqs; i++)
+		seq_printf(m, " %u", uid_freqs[order[i]]);
+	seq_putc(m, '\n');
+
+	rcu_read_lock();
+	hash_for_each_rcu(hash_table, bkt, node, uid_entry, hash) {
+		seq_printf(m, "%d:", uid_entry->uid);
+		for (i = 0; i < nr_freqs; i++) {
+			cputime_t time = 0;
+
+			for_each_possible_cpu(cpu)
+				time += uid_entry->cpu[cpu].time_in_state[order[i]];
+			seq_printf(m, " %llu", (unsigned long long)
+				   cputime64_to_clock_t(time));
+		}
+		seq_putc(m, '\n');
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+
+static int uid_time_in_state_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, uid_time_in_state_show, PDE(inode)->data);
+}
+
+static const struct file_operations uid_time_in_state_fops = {
+	.open		= uid_time_in_state_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-	if (!task)
-		return NOTIFY_OK;
+#ifdef CONFIG_CPU_FREQ
+/* Return the column for @freq, adding one if there is still room. */
+static int uid_freq_column(unsigned int freq)
+{
+	unsigned long flags;
+	int nr_freqs = ACCESS_ONCE(uid_nr_freqs);
+	int i;
+
+	smp_rmb();
+	for (i = 0; i < nr_freqs; i++)
+		if (uid_freqs[i] == freq)
+			return i;
+
+	spin_lock_irqsave(&uid_lock, flags);
+	for (i = 0; i < uid_nr_freqs; i++)
+		if (uid_freqs[i] == freq)
+			goto out;
+	if (uid_nr_freqs == UID_FREQ_MAX) {
+		pr_warn_once("%s: more than %d frequencies\n", __func__,
+			     UID_FREQ_MAX);
+		i = -1;
+		goto out;
+	}
+	uid_freqs[i] = freq;
+	smp_wmb();
+	uid_nr_freqs++;
+out:
+	spin_unlock_irqrestore(&uid_lock, flags);
+	return i;
+}
 
-	mutex_lock(&uid_lock);
-	uid = task_uid(task);
-	uid_entry = find_or_register_uid(uid);
-	if (!uid_entry) {
-		pr_err("%s: failed to find uid %d\n", __func__, uid);
-		goto exit;
+static int uid_cpufreq_policy_notifier(struct notifier_block *nb,
+				       unsigned long val, void *data)
+{
+	struct cpufreq_policy *policy = data;
+	struct cpufreq_frequency_table *table;
+	int i, cpu, index;
+
+	if (val != CPUFREQ_NOTIFY)
+		return 0;
+
+	/* use the same frequencies as cpufreq_stats does */
+	table = cpufreq_frequency_get_table(policy->cpu);
+	if (table) {
+		for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++)
+			if (table[i].frequency != CPUFREQ_ENTRY_INVALID)
+				uid_freq_column(table[i].frequency);
 	}
 
-	task_times(task, &utime, &stime);
-	uid_entry->utime += utime;
-	uid_entry->stime += stime;
-#if 0 /* 3.0 fix */
-	uid_entry->power += task->cpu_power;
-	task->cpu_power = ULLONG_MAX;
-#endif
+	index = uid_freq_column(policy->cur);
+	for_each_cpu(cpu, policy->cpus)
+		per_cpu(uid_freq_index, cpu) = index;
+	return 0;
+}
+
+static int uid_cpufreq_trans_notifier(struct notifier_block *nb,
+				      unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freq = data;
 
-exit:
-	mutex_unlock(&uid_lock);
-	return NOTIFY_OK;
+	if (val == CPUFREQ_POSTCHANGE)
+		per_cpu(uid_freq_index, freq->cpu) =
+			uid_freq_column(freq->new);
+	return 0;
 }
 
-static struct notifier_block process_notifier_block = {
-	.notifier_call	= process_notifier,
+static struct notifier_block uid_cpufreq_policy_block = {
+	.notifier_call	= uid_cpufreq_policy_notifier,
 };
 
-static int __init proc_uid_cputime_init(void)
+static struct notifier_block uid_cpufreq_trans_block = {
+	.notifier_call	= uid_cpufreq_trans_notifier,
+};
+
+/* the cpufreq notifier lists are not ready at early_initcall time */
+static int __init uid_cpufreq_init(void)
 {
-	hash_init(hash_table);
+	cpufreq_register_notifier(&uid_cpufreq_policy_block,
+				  CPUFREQ_POLICY_NOTIFIER);
+	cpufreq_register_notifier(&uid_cpufreq_trans_block,
+				  CPUFREQ_TRANSITION_NOTIFIER);
+	return 0;
+}
+core_initcall(uid_cpufreq_init);
+#endif
 
+static int __init proc_uid_cputime_init(void)
+{
 	parent = proc_mkdir("uid_cputime", NULL);
 	if (!parent) {
 		pr_err("%s: failed to create proc entry\n", __func__);
@@ -252,7 +404,8 @@ static int __init proc_uid_cputime_init(void)
 	proc_create_data("show_uid_stat", S_IRUGO, parent, &uid_stat_fops,
 					NULL);
 
-	profile_event_register(PROFILE_TASK_EXIT, &process_notifier_block);
+	proc_create_data("time_in_state", S_IRUGO, parent,
+					&uid_time_in_state_fops, NULL);
 
 	return 0;
 }
@@ -13,34 +13,49 @@
  *
  */
 
-#include <asm/atomic.h>
+#include <asm/local.h>
 
+#include <linux/cache.h>
 #include <linux/err.h>
+#include <linux/hashtable.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
-#include <linux/list.h>
 #include <linux/proc_fs.h>
+#include <linux/rculist.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/stat.h>
 #include <linux/uid_stat.h>
 #include <net/activity_stats.h>
+#include <net/sock.h>
+
+#define UID_HASH_BITS	8
 
 static DEFINE_SPINLOCK(uid_lock);
-static LIST_HEAD(uid_list);
+static DEFINE_HASHTABLE(uid_hash_table, UID_HASH_BITS);
 static struct proc_dir_entry *parent;
 
+/*
+ * Byte counters of one cpu. They are only modified by their own cpu,
+ * with preemption disabled, and summed up when /proc/uid_stat is read.
+ */
+struct uid_stat_cpu {
+	local_t tcp_rcv;
+	local_t tcp_snd;
+} ____cacheline_aligned_in_smp;
+
+/* Entries are never freed, so a pointer to one stays valid forever. */
 struct uid_stat {
-	struct list_head link;
+	struct hlist_node link;
 	uid_t uid;
-	atomic_t tcp_rcv;
-	atomic_t tcp_snd;
+	struct uid_stat_cpu *cpu;	/* nr_cpu_ids entries */
 };
 
 static struct uid_stat *find_uid_stat(uid_t uid) {
 	struct uid_stat *entry;
+	struct hlist_node *node;
 
-	list_for_each_entry(entry, &uid_list, link) {
+	hash_for_each_possible_rcu(uid_hash_table, entry, node, link, uid) {
 		if (entry->uid == uid) {
 			return entry;
 		}
@@ -48,6 +63,22 @@ static struct uid_stat *find_uid_stat(uid_t uid) {
 	return NULL;
 }
 
+/*
+ * The counters used to be 32 bit and wrap, keep reporting them that way.
+ */
+static unsigned int uid_stat_sum(struct uid_stat *uid_entry, bool snd)
+{
+	unsigned long bytes = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct uid_stat_cpu *c = &uid_entry->cpu[cpu];
+
+		bytes += local_read(snd ? &c->tcp_snd : &c->tcp_rcv);
+	}
+	return (unsigned int) bytes;
+}
+
 static int tcp_snd_read_proc(char *page, char **start, off_t off,
 				int count, int *eof, void *data)
 {
@@ -58,7 +89,7 @@ static int tcp_snd_read_proc(char *page, char **start, off_t off,
 	if (!data)
 		return 0;
 
-	bytes = (unsigned int) (atomic_read(&uid_entry->tcp_snd) + INT_MIN);
+	bytes = uid_stat_sum(uid_entry, true);
 	p += sprintf(p, "%u\n", bytes);
 	len = (p - page) - off;
 	*eof = (len <= count) ? 1 : 0;
@@ -76,7 +107,7 @@ static int tcp_rcv_read_proc(char *page, char **start, off_t off,
 	if (!data)
 		return 0;
 
-	bytes = (unsigned int) (atomic_read(&uid_entry->tcp_rcv) + INT_MIN);
+	bytes = uid_stat_sum(uid_entry, false);
 	p += sprintf(p, "%u\n", bytes);
 	len = (p - page) - off;
 	*eof = (len <= count) ? 1 : 0;
@@ -84,20 +115,27 @@ static int tcp_rcv_read_proc(char *page, char **start, off_t off,
 	return len;
 }
 
-/* Create a new entry for tracking the specified uid. */
+/*
+ * Create a new entry for tracking the specified uid. This can be reached
+ * from softirq context through tcp_read_sock(), hence GFP_ATOMIC and a
+ * plain array instead of alloc_percpu() for the counters.
+ */
 static struct uid_stat *create_stat(uid_t uid) {
 	struct uid_stat *new_uid;
-	/* Create the uid stat struct and append it to the list. */
+	/* Create the uid stat struct and add it to the hash table. */
 	new_uid = kmalloc(sizeof(struct uid_stat), GFP_ATOMIC);
 	if (!new_uid)
 		return NULL;
 
+	new_uid->cpu = kzalloc(nr_cpu_ids * sizeof(struct uid_stat_cpu),
+			       GFP_ATOMIC);
+	if (!new_uid->cpu) {
+		kfree(new_uid);
+		return NULL;
+	}
 	new_uid->uid = uid;
-	/* Counters start at INT_MIN, so we can track 4GB of network traffic. */
-	atomic_set(&new_uid->tcp_rcv, INT_MIN);
-	atomic_set(&new_uid->tcp_snd, INT_MIN);
 
-	list_add_tail(&new_uid->link, &uid_list);
+	hash_add_rcu(uid_hash_table, &new_uid->link, uid);
 	return new_uid;
 }
 
@@ -120,6 +158,13 @@ static struct uid_stat *find_or_create_uid_stat(uid_t uid)
 {
 	struct uid_stat *entry;
 	unsigned long flags;
+
+	rcu_read_lock();
+	entry = find_uid_stat(uid);
+	rcu_read_unlock();
+	if (entry)
+		return entry;
+
 	spin_lock_irqsave(&uid_lock, flags);
 	entry = find_uid_stat(uid);
 	if (entry) {
@@ -133,23 +178,41 @@ static struct uid_stat *find_or_create_uid_stat(uid_t uid)
 	return entry;
 }
 
-int uid_stat_tcp_snd(uid_t uid, int size) {
+/*
+ * Look up the entry for @uid, trying the one cached in @sk first. A socket
+ * is nearly always used by a single uid, so this skips the hash lookup.
+ */
+static struct uid_stat *uid_stat_get(struct sock *sk, uid_t uid)
+{
+	struct uid_stat *entry = ACCESS_ONCE(sk->sk_uid_stat);
+
+	if (entry && entry->uid == uid)
+		return entry;
+	entry = find_or_create_uid_stat(uid);
+	if (entry)
+		sk->sk_uid_stat = entry;
+	return entry;
+}
+
+int uid_stat_tcp_snd(struct sock *sk, uid_t uid, int size) {
 	struct uid_stat *entry;
 	activity_stats_update();
-	entry = find_or_create_uid_stat(uid);
+	entry = uid_stat_get(sk, uid);
 	if (!entry)
 		return -1;
-	atomic_add(size, &entry->tcp_snd);
+	local_add(size, &entry->cpu[get_cpu()].tcp_snd);
+	put_cpu();
 	return 0;
 }
 
-int uid_stat_tcp_rcv(uid_t uid, int size) {
+int uid_stat_tcp_rcv(struct sock *sk, uid_t uid, int size) {
 	struct uid_stat *entry;
 	activity_stats_update();
-	entry = find_or_create_uid_stat(uid);
+	entry = uid_stat_get(sk, uid);
 	if (!entry)
 		return -1;
-	atomic_add(size, &entry->tcp_rcv);
+	local_add(size, &entry->cpu[get_cpu()].tcp_rcv);
+	put_cpu();
 	return 0;
 }
 
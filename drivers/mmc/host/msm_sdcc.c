@@ -6067,6 +6067,14 @@ msmsdcc_probe(struct platform_device *pdev)
 	setup_timer(&host->req_tout_timer, msmsdcc_req_tout_timer_hdlr,
 			(unsigned long)host);
 
+	/*
+	 * Card re-init on resume is slow, let the host and the card
+	 * resume in parallel with the rest of the system; the card
+	 * still waits for its host as it is a child of it.
+	 */
+	device_enable_async_suspend(&pdev->dev);
+	device_enable_async_suspend(&mmc->class_dev);
+
 	mmc_add_host(mmc);
 
 	mmc->clk_scaling.up_threshold = 35;
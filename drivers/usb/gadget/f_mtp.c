@@ -27,6 +27,8 @@
 #include <linux/wait.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
 
 #include <linux/types.h>
 #include <linux/file.h>
@@ -39,6 +41,7 @@
 #include <linux/usb/f_mtp.h>
 
 #define MTP_BULK_BUFFER_SIZE       16384
+#define MTP_FILE_BUFFER_SIZE       65536
 #define INTR_BUFFER_SIZE           28
 
 /* String IDs */
@@ -52,9 +55,11 @@
 #define STATE_ERROR                 4   /* error from completion routine */
 #define STATE_RESET                 5   /* reset the device */
 
-/* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+/* number of tx and rx requests to allocate, defaults and upper bounds */
+#define TX_REQ_DEFAULT 8
+#define RX_REQ_DEFAULT 4
+#define TX_REQ_MAX 32
+#define RX_REQ_MAX 32
 #define INTR_REQ_MAX 5
 
 /* vendor code */
@@ -74,11 +79,38 @@
 #define MTP_RESPONSE_OK             0x2001
 #define MTP_RESPONSE_DEVICE_BUSY    0x2019
 
-unsigned int mtp_rx_req_len = MTP_BULK_BUFFER_SIZE;
+/*
+ * Size and number of the bulk requests, picked up when the function is
+ * bound.  File transfers keep all rx requests queued on the endpoint and
+ * fill or drain the oldest one while the controller works on the rest,
+ * so USB and storage run at the same time.  Buffers that cannot be
+ * allocated fall back to MTP_BULK_BUFFER_SIZE.
+ */
+unsigned int mtp_rx_req_len = MTP_FILE_BUFFER_SIZE;
 module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
 
+static unsigned int mtp_tx_req_len = MTP_FILE_BUFFER_SIZE;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+
+static unsigned int mtp_rx_reqs = RX_REQ_DEFAULT;
+module_param(mtp_rx_reqs, uint, S_IRUGO | S_IWUSR);
+
+static unsigned int mtp_tx_reqs = TX_REQ_DEFAULT;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+
 static const char mtp_shortname[] = "mtp_usb";
 
+/* per direction file transfer statistics, see debugfs usb_mtp/status */
+struct mtp_xfer_stats {
+	unsigned long	transfers;
+	u64		bytes;
+	u64		total_ns;	/* ioctl start to end */
+	u64		file_ns;	/* in vfs_read()/vfs_write() */
+	u64		last_bytes;
+	u64		last_ns;
+	unsigned int	max_queued;	/* deepest rx request queue seen */
+};
+
 struct mtp_dev {
 	struct usb_function function;
 	struct usb_composite_dev *cdev;
@@ -103,6 +135,20 @@ struct mtp_dev {
 	wait_queue_head_t intr_wq;
 	struct usb_request *rx_req[RX_REQ_MAX];
 	int rx_done;
+	/* rx completions, and rx requests on the endpoint */
+	atomic_t rx_completed;
+	atomic_t rx_queued;
+	/* rx requests holding data received past the end of a file */
+	struct list_head rx_pending;
+
+	/* request geometry chosen at bind time */
+	unsigned int tx_req_len;
+	unsigned int rx_req_len;
+	unsigned int tx_reqs;
+	unsigned int rx_reqs;
+
+	struct mtp_xfer_stats send_stats;
+	struct mtp_xfer_stats receive_stats;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -293,6 +339,14 @@ static void mtp_request_free(struct usb_request *req, struct usb_ep *ep)
 	}
 }
 
+/* bulk OUT requests must be a multiple of the packet size */
+static unsigned int mtp_req_len(unsigned int len)
+{
+	if (len <= MTP_BULK_BUFFER_SIZE)
+		return MTP_BULK_BUFFER_SIZE;
+	return ALIGN(len, 512);
+}
+
 static inline int mtp_lock(atomic_t *excl)
 {
 	if (atomic_inc_return(excl) == 1) {
@@ -354,7 +408,11 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 	struct mtp_dev *dev = _mtp_dev;
 
 	dev->rx_done = 1;
-	if (req->status != 0 && dev->state == STATE_BUSY)
+	atomic_inc(&dev->rx_completed);
+	atomic_dec(&dev->rx_queued);
+	/* -ECONNRESET: dequeued by mtp_rx_cancel() */
+	if (req->status != 0 && req->status != -ECONNRESET &&
+			dev->state == STATE_BUSY)
 		dev->state = STATE_ERROR;
 
 	wake_up(&dev->read_wq);
@@ -412,27 +470,43 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	dev->ep_intr = ep;
 
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+	dev->tx_req_len = mtp_req_len(mtp_tx_req_len);
+	dev->tx_reqs = clamp_t(unsigned int, mtp_tx_reqs, 2, TX_REQ_MAX);
+retry_tx_alloc:
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
+		if (!req) {
+			if (dev->tx_req_len <= MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			while ((req = mtp_req_get(dev, &dev->tx_idle)))
+				mtp_request_free(req, dev->ep_in);
+			dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+			goto retry_tx_alloc;
+		}
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
+
+	dev->rx_req_len = mtp_req_len(mtp_rx_req_len);
+	dev->rx_reqs = clamp_t(unsigned int, mtp_rx_reqs, 2, RX_REQ_MAX);
 retry_rx_alloc:
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, mtp_rx_req_len);
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
 		if (!req) {
-			if (mtp_rx_req_len <= MTP_BULK_BUFFER_SIZE)
+			if (dev->rx_req_len <= MTP_BULK_BUFFER_SIZE)
 				goto fail;
-			for (; i > 0; i--)
+			while (--i >= 0) {
 				mtp_request_free(dev->rx_req[i], dev->ep_out);
-			mtp_rx_req_len = MTP_BULK_BUFFER_SIZE;
+				dev->rx_req[i] = NULL;
+			}
+			dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
 			goto retry_rx_alloc;
 		}
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
+	DBG(cdev, "tx %u x %u bytes, rx %u x %u bytes\n", dev->tx_reqs,
+	    dev->tx_req_len, dev->rx_reqs, dev->rx_req_len);
 	for (i = 0; i < INTR_REQ_MAX; i++) {
 		req = mtp_request_new(dev->ep_intr, INTR_BUFFER_SIZE);
 		if (!req)
@@ -459,7 +533,7 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 
 	DBG(cdev, "mtp_read(%d)\n", count);
 
-	if (count > mtp_rx_req_len)
+	if (count > dev->rx_req_len)
 		return -EINVAL;
 
 	/* we will block until we're online */
@@ -486,13 +560,26 @@ static ssize_t mtp_read(struct file *fp, char __user *buf,
 	dev->state = STATE_BUSY;
 	spin_unlock_irq(&dev->lock);
 
+	/* data that came in behind the short packet ending a file */
+	req = mtp_req_get(dev, &dev->rx_pending);
+	if (req) {
+		DBG(cdev, "rx %p %d pending\n", req, req->actual);
+		xfer = (req->actual < count) ? req->actual : count;
+		r = xfer;
+		if (copy_to_user(buf, req->buf, xfer))
+			r = -EFAULT;
+		goto done;
+	}
+
 requeue_req:
 	/* queue a request */
 	req = dev->rx_req[0];
 	req->length = count;
 	dev->rx_done = 0;
+	atomic_inc(&dev->rx_queued);
 	ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 	if (ret < 0) {
+		atomic_dec(&dev->rx_queued);
 		r = -EIO;
 		goto done;
 	} else {
@@ -596,8 +683,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -634,6 +721,19 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+static void mtp_xfer_account(struct mtp_xfer_stats *st, u64 bytes,
+			     ktime_t start, u64 file_ns)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	st->transfers++;
+	st->bytes += bytes;
+	st->total_ns += ns;
+	st->file_ns += file_ns;
+	st->last_bytes = bytes;
+	st->last_ns = ns;
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data)
 {
@@ -648,6 +748,10 @@ static void send_file_work(struct work_struct *data)
 	int xfer, ret, hdr_size;
 	int r = 0;
 	int sendZLP = 0;
+	u64 bytes = 0, file_ns = 0;
+	ktime_t start, t;
+
+	start = ktime_get();
 
 	/* read our parameters */
 	smp_rmb();
@@ -694,8 +798,8 @@ static void send_file_work(struct work_struct *data)
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -712,8 +816,10 @@ static void send_file_work(struct work_struct *data)
 					__cpu_to_le32(dev->xfer_transaction_id);
 		}
 
+		t = ktime_get();
 		ret = vfs_read(filp, req->buf + hdr_size, xfer - hdr_size,
 								&offset);
+		file_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
 		if (ret < 0) {
 			r = ret;
 			break;
@@ -732,6 +838,7 @@ static void send_file_work(struct work_struct *data)
 		}
 
 		count -= xfer;
+		bytes += xfer;
 
 		/* zero this so we don't try to free it on error exit */
 		req = 0;
@@ -740,24 +847,74 @@ static void send_file_work(struct work_struct *data)
 	if (req)
 		mtp_req_put(dev, &dev->tx_idle, req);
 
+	mtp_xfer_account(&dev->send_stats, bytes, start, file_ns);
+
 	DBG(cdev, "send_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
 	smp_wmb();
 }
 
-/* read from USB and write to a local file */
+/*
+ * Stop the rx requests still on the endpoint at the end of a transfer.
+ * When a short packet ends the file early, the requests behind it may
+ * already hold the start of the next container: keep those, in order,
+ * for mtp_read().
+ */
+static void mtp_rx_cancel(struct mtp_dev *dev, unsigned int head,
+			  unsigned int queued)
+{
+	struct usb_request *req;
+	unsigned int i;
+
+	for (i = 0; i < queued; i++)
+		usb_ep_dequeue(dev->ep_out,
+			       dev->rx_req[(head + i) % dev->rx_reqs]);
+	if (!wait_event_timeout(dev->read_wq, !atomic_read(&dev->rx_queued),
+				msecs_to_jiffies(1000)))
+		return;
+
+	for (i = 0; i < queued; i++) {
+		req = dev->rx_req[(head + i) % dev->rx_reqs];
+		if (req->status == 0 && req->actual > 0)
+			mtp_req_put(dev, &dev->rx_pending, req);
+	}
+}
+
+/* drop data left for mtp_read(), e.g. when the host is gone */
+static void mtp_rx_flush(struct mtp_dev *dev)
+{
+	while (mtp_req_get(dev, &dev->rx_pending))
+		;
+}
+
+/*
+ * read from USB and write to a local file
+ *
+ * Up to rx_reqs requests are kept on the endpoint, covering the next
+ * bytes of the file; as the oldest completes it is written out and
+ * queued again for the next chunk.  A transfer of unknown length
+ * (0xFFFFFFFF, ended by a short packet) uses a single request, as data
+ * past its end belongs to the next MTP container.
+ */
 static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev *dev = container_of(data, struct mtp_dev,
 						receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
 	loff_t offset;
 	int64_t count;
-	int ret, cur_buf = 0;
+	unsigned int head = 0, tail = 0, queued = 0, depth;
+	int consumed = 0;
+	int ret;
 	int r = 0;
+	bool eof = false;
+	u64 bytes = 0, file_ns = 0;
+	ktime_t start, t;
+
+	start = ktime_get();
 
 	/* read our parameters */
 	smp_rmb();
@@ -772,87 +929,105 @@ static void receive_file_work(struct work_struct *data)
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+	/*
+	 * Whatever the previous transfer left behind should have been
+	 * read as the command of this one; the requests are reused below.
+	 */
+	if (!list_empty(&dev->rx_pending)) {
+		DBG(cdev, "%s: dropping unread rx data\n", __func__);
+		mtp_rx_flush(dev);
+	}
 
-			read_req->length = (count > mtp_rx_req_len
-					? mtp_rx_req_len : count);
+	depth = count == 0xFFFFFFFF ? 1 : dev->rx_reqs;
+	atomic_set(&dev->rx_completed, 0);
+
+	while (count > 0 || queued) {
+		/* keep the endpoint busy */
+		while (!eof && count > 0 && queued < depth) {
+			req = dev->rx_req[tail];
+			req->length = (count > dev->rx_req_len
+					? dev->rx_req_len : count);
 			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+			atomic_inc(&dev->rx_queued);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
+				atomic_dec(&dev->rx_queued);
 				r = -EIO;
 				if (dev->state != STATE_OFFLINE)
 					dev->state = STATE_ERROR;
-				break;
+				goto out;
 			}
+			tail = (tail + 1) % dev->rx_reqs;
+			queued++;
+			/* if xfer_file_length is 0xFFFFFFFF, then we read
+			 * until we get a zero length packet
+			 */
+			if (count != 0xFFFFFFFF)
+				count -= req->length;
 		}
-
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				if (dev->state != STATE_OFFLINE)
-					dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
+		if (queued > dev->receive_stats.max_queued)
+			dev->receive_stats.max_queued = queued;
+
+		/* wait for the oldest request, they complete in order */
+		req = dev->rx_req[head];
+		ret = wait_event_interruptible(dev->read_wq,
+			atomic_read(&dev->rx_completed) > consumed ||
+			dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED
+				|| dev->state == STATE_OFFLINE) {
+			r = -ECANCELED;
+			goto out;
+		}
+		if (dev->state == STATE_RESET) {
+			DBG(cdev, "%s: DEVICE RESET\n", __func__);
+			r = -ECONNRESET;
+			goto out;
 		}
+		if (atomic_read(&dev->rx_completed) <= consumed) {
+			r = ret ? ret : -EIO;
+			goto out;
+		}
+		consumed++;
+		head = (head + 1) % dev->rx_reqs;
+		queued--;
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED
-					|| dev->state == STATE_OFFLINE) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			if (dev->state == STATE_OFFLINE) {
-				r = -ENODEV;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			if (dev->state == STATE_RESET) {
-				DBG(cdev, "%s: DEVICE RESET\n", __func__);
-				r = -ECONNRESET;
-				if (!dev->rx_done) {
-					DBG(cdev, "dequeue in DEVICE RESET\n");
-					usb_ep_dequeue(dev->ep_out, read_req);
-				}
-				break;
-			}
-			if (read_req->status) {
-				r = read_req->status;
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
+		if (req->status) {
+			r = req->status;
+			goto out;
+		}
+		if (req->actual < req->length) {
+			/*
+			 * short packet is used to signal EOF for
+			 * sizes > 4 gig
 			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/*
-				 * short packet is used to signal EOF for
-				 * sizes > 4 gig
-				 */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+			DBG(cdev, "got short packet\n");
+			count = 0;
+			eof = true;
+		}
 
-			write_req = read_req;
-			read_req = NULL;
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		t = ktime_get();
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		file_ns += ktime_to_ns(ktime_sub(ktime_get(), t));
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			if (dev->state != STATE_OFFLINE)
+				dev->state = STATE_ERROR;
+			goto out;
 		}
+		bytes += ret;
+
+		if (eof)
+			break;
 	}
 
+out:
+	if (queued)
+		mtp_rx_cancel(dev, head, queued);
+
+	mtp_xfer_account(&dev->receive_stats, bytes, start, file_ns);
+
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1243,8 +1418,10 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < dev->rx_reqs; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	dev->state = STATE_OFFLINE;
@@ -1312,6 +1489,7 @@ static void mtp_function_disable(struct usb_function *f)
 	usb_ep_disable(dev->ep_in);
 	usb_ep_disable(dev->ep_out);
 	usb_ep_disable(dev->ep_intr);
+	mtp_rx_flush(dev);
 
 	/* readers may be blocked waiting for us to go online */
 	wake_up(&dev->read_wq);
@@ -1353,6 +1531,111 @@ static int mtp_bind_config(struct usb_configuration *c, bool ptp_config)
 	return usb_add_function(c, &dev->function);
 }
 
+#if defined(CONFIG_DEBUG_FS)
+/* bytes per second, from bytes and nanoseconds */
+static u64 mtp_rate(u64 bytes, u64 ns)
+{
+	if (!ns)
+		return 0;
+	while (bytes > ULLONG_MAX / NSEC_PER_SEC) {
+		bytes >>= 1;
+		ns >>= 1;
+	}
+	return ns ? div64_u64(bytes * NSEC_PER_SEC, ns) : 0;
+}
+
+static int mtp_print_stats(char *buf, int size, const char *name,
+			   struct mtp_xfer_stats *st)
+{
+	return scnprintf(buf, size,
+			"%s:\n"
+			"  transfers:      %lu\n"
+			"  bytes:          %llu\n"
+			"  avg rate:       %llu KB/s\n"
+			"  last rate:      %llu KB/s (%llu bytes)\n"
+			"  file i/o time:  %llu%%\n",
+			name, st->transfers, st->bytes,
+			mtp_rate(st->bytes, st->total_ns) >> 10,
+			mtp_rate(st->last_bytes, st->last_ns) >> 10,
+			st->last_bytes,
+			st->total_ns ?
+				div64_u64(st->file_ns * 100, st->total_ns) : 0);
+}
+
+static ssize_t debug_mtp_read_stats(struct file *file, char __user *ubuf,
+				    size_t count, loff_t *ppos)
+{
+	struct mtp_dev *dev = _mtp_dev;
+	char *buf;
+	int len;
+	ssize_t ret;
+
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len = scnprintf(buf, PAGE_SIZE, "tx requests: %u x %u bytes\n"
+			"rx requests: %u x %u bytes\n",
+			dev->tx_reqs, dev->tx_req_len,
+			dev->rx_reqs, dev->rx_req_len);
+	len += mtp_print_stats(buf + len, PAGE_SIZE - len, "send",
+			       &dev->send_stats);
+	len += mtp_print_stats(buf + len, PAGE_SIZE - len, "receive",
+			       &dev->receive_stats);
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			 "  max queued:     %u\n",
+			 dev->receive_stats.max_queued);
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, buf, len);
+	kfree(buf);
+	return ret;
+}
+
+static ssize_t debug_mtp_reset_stats(struct file *file,
+				     const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	struct mtp_dev *dev = _mtp_dev;
+
+	memset(&dev->send_stats, 0, sizeof(dev->send_stats));
+	memset(&dev->receive_stats, 0, sizeof(dev->receive_stats));
+	return count;
+}
+
+static const struct file_operations debug_mtp_ops = {
+	.open = simple_open,
+	.read = debug_mtp_read_stats,
+	.write = debug_mtp_reset_stats,
+};
+
+static struct dentry *dent_mtp;
+
+static void mtp_debugfs_init(void)
+{
+	struct dentry *dent_mtp_status;
+
+	dent_mtp = debugfs_create_dir("usb_mtp", 0);
+	if (!dent_mtp || IS_ERR(dent_mtp))
+		return;
+
+	dent_mtp_status = debugfs_create_file("status", 0644, dent_mtp, 0,
+					      &debug_mtp_ops);
+	if (!dent_mtp_status || IS_ERR(dent_mtp_status)) {
+		debugfs_remove(dent_mtp);
+		dent_mtp = NULL;
+	}
+}
+
+static void mtp_debugfs_remove(void)
+{
+	debugfs_remove_recursive(dent_mtp);
+	dent_mtp = NULL;
+}
+#else
+static inline void mtp_debugfs_init(void) {}
+static inline void mtp_debugfs_remove(void) {}
+#endif
+
 static int mtp_setup(void)
 {
 	struct mtp_dev *dev;
@@ -1368,8 +1651,11 @@ static int mtp_setup(void)
 	init_waitqueue_head(&dev->intr_wq);
 	atomic_set(&dev->open_excl, 0);
 	atomic_set(&dev->ioctl_excl, 0);
+	atomic_set(&dev->rx_completed, 0);
+	atomic_set(&dev->rx_queued, 0);
 	INIT_LIST_HEAD(&dev->tx_idle);
 	INIT_LIST_HEAD(&dev->intr_idle);
+	INIT_LIST_HEAD(&dev->rx_pending);
 
 	dev->wq = create_singlethread_workqueue("f_mtp");
 	if (!dev->wq) {
@@ -1385,6 +1671,7 @@ static int mtp_setup(void)
 	if (ret)
 		goto err2;
 
+	mtp_debugfs_init();
 	return 0;
 
 err2:
@@ -1403,6 +1690,7 @@ static void mtp_cleanup(void)
 	if (!dev)
 		return;
 
+	mtp_debugfs_remove();
 	misc_deregister(&mtp_device);
 	destroy_workqueue(dev->wq);
 	_mtp_dev = NULL;
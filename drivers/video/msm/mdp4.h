@@ -416,6 +416,10 @@ struct mdp4_statistic {
 	ulong blt_lcdc;	/* blt */
 	ulong blt_dtv;	/* blt */
 	ulong blt_mddi;	/* blt */
+	ulong dsi_cmd_full;	/* full frame pushed */
+	ulong dsi_cmd_partial;	/* dirty roi pushed */
+	ulong dsi_cmd_frame_bytes;	/* bytes of last frame */
+	u64 dsi_cmd_bytes;	/* bytes of all frames */
 	ulong overlay_set[MDP4_MIXER_MAX];
 	ulong overlay_unset[MDP4_MIXER_MAX];
 	ulong overlay_play[MDP4_MIXER_MAX];
@@ -577,6 +581,7 @@ void mdp4_dsi_cmd_overlay(struct msm_fb_data_type *mfd);
 int mdp4_overlay_commit(struct fb_info *info);
 int mdp4_dsi_video_pipe_commit(int cndx, int wait);
 int mdp4_dsi_cmd_pipe_commit(int cndx, int wait);
+void mdp4_dsi_cmd_roi_set(int cndx, struct mdp_display_commit *commit);
 int mdp4_lcdc_pipe_commit(int cndx, int wait);
 int mdp4_dsi_cmd_update_cnt(int cndx);
 void mdp4_dsi_rdptr_init(int cndx);
@@ -619,6 +624,9 @@ struct mdp4_overlay_pipe *mdp4_overlay_pipe_alloc(int ptype, int mixer);
 void mdp4_overlay_dma_commit(int mixer);
 void mdp4_overlay_vsync_commit(struct mdp4_overlay_pipe *pipe);
 void mdp4_mixer_stage_commit(int mixer);
+int mdp4_mixer_roi_check(int mixer);
+void mdp4_mixer_roi_setup(int mixer, struct mdp_rect *roi);
+void mdp4_mixer_roi_restore(int mixer);
 void mdp4_dsi_cmd_do_update(int cndx, struct mdp4_overlay_pipe *pipe);
 void mdp4_lcdc_pipe_queue(int cndx, struct mdp4_overlay_pipe *pipe);
 void mdp4_overlay_pipe_free(struct mdp4_overlay_pipe *pipe, int all);
@@ -1937,6 +1937,148 @@ void mdp4_mixer_stage_down(struct mdp4_overlay_pipe *pipe, int commit)
 	if (commit)
 		mdp4_mixer_stage_commit(mixer);
 }
+/*
+ * mdp4_mixer_roi_check:
+ * a mixer can be cropped to a dirty roi only if none of its staged
+ * pipes scales, rotates or flips, so that cropping a pipe is a plain
+ * shift of its source window
+ */
+int mdp4_mixer_roi_check(int mixer)
+{
+	struct mdp4_overlay_pipe *pipe;
+	int i;
+
+	for (i = MDP4_MIXER_STAGE_BASE; i < MDP4_MIXER_STAGE_MAX; i++) {
+		pipe = ctrl->stage[mixer][i];
+		if (pipe == NULL)
+			continue;
+		if (pipe->src_w != pipe->dst_w || pipe->src_h != pipe->dst_h)
+			return -EINVAL;
+		if (pipe->flags & (MDP_ROT_90 | MDP_FLIP_LR | MDP_FLIP_UD |
+						MDP_DEINTERLACE))
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static struct mdp4_overlay_pipe mdp4_roi_pipe;
+
+/*
+ * mdp4_mixer_roi_setup:
+ * called after mdp4_mixer_stage_commit() and before kickoff.
+ * Every staged pipe is cropped to the roi and shifted to the mixer
+ * origin so that the mixer blends roi->w x roi->h only; pipes out of
+ * the roi are left out of the mixer for this frame.
+ * ctrl->mixer_cfg[] is left with the cropped staging so that the next
+ * stage_commit writes back the full frame one.
+ */
+void mdp4_mixer_roi_setup(int mixer, struct mdp_rect *roi)
+{
+	struct mdp4_overlay_pipe *pipe, *rp;
+	char *overlay_base;
+	u32 data, stage;
+	int i, num, off;
+	int x1, y1, x2, y2;
+	unsigned long flags;
+
+	rp = &mdp4_roi_pipe;
+	data = 0;
+	for (i = MDP4_MIXER_STAGE_BASE; i < MDP4_MIXER_STAGE_MAX; i++) {
+		pipe = ctrl->stage[mixer][i];
+		if (pipe == NULL)
+			continue;
+
+		x1 = max(pipe->dst_x, roi->x);
+		y1 = max(pipe->dst_y, roi->y);
+		x2 = min(pipe->dst_x + pipe->dst_w, roi->x + roi->w);
+		y2 = min(pipe->dst_y + pipe->dst_h, roi->y + roi->h);
+		if (x1 >= x2 || y1 >= y2)
+			continue;	/* out of roi */
+
+		*rp = *pipe;
+		rp->src_x += x1 - pipe->dst_x;
+		rp->src_y += y1 - pipe->dst_y;
+		rp->src_w = x2 - x1;
+		rp->src_h = y2 - y1;
+		rp->dst_w = rp->src_w;
+		rp->dst_h = rp->src_h;
+		rp->dst_x = x1 - roi->x;
+		rp->dst_y = y1 - roi->y;
+
+		if (rp->pipe_type == OVERLAY_TYPE_VIDEO)
+			mdp4_overlay_vg_setup(rp);
+		else
+			mdp4_overlay_rgb_setup(rp);
+		mdp4_overlay_reg_flush(rp, 1);
+
+		stage = pipe->mixer_stage;
+		if (mixer >= MDP4_MIXER1)
+			stage += 8;
+		stage <<= (4 * pipe->pipe_num);
+		data |= stage;
+	}
+
+	if (mixer == MDP4_MIXER2)
+		overlay_base = MDP_BASE + MDP4_OVERLAYPROC2_BASE;
+	else if (mixer == MDP4_MIXER1)
+		overlay_base = MDP_BASE + MDP4_OVERLAYPROC1_BASE;
+	else
+		overlay_base = MDP_BASE + MDP4_OVERLAYPROC0_BASE;
+
+	mdp_pipe_ctrl(MDP_CMD_BLOCK, MDP_BLOCK_POWER_ON, FALSE);
+	mdp_clk_ctrl(1);
+
+	ctrl->mixer_cfg[mixer] = data;
+	if (mixer >= MDP4_MIXER2) {
+		off = 0x100f0;	/* MDP_LAYERMIXER2_IN_CFG */
+	} else {
+		num = mixer + 1;
+		num &= 0x01;
+		data |= ctrl->mixer_cfg[num];
+		off = 0x10100;
+	}
+
+	local_irq_save(flags);
+	outpdw(MDP_BASE + off, data);
+	/* ROI, height + width */
+	outpdw(overlay_base + 0x0008, (roi->h << 16) | roi->w);
+	outpdw(MDP_BASE + 0x18000, ctrl->flush[mixer]);
+	ctrl->flush[mixer] = 0;
+	local_irq_restore(flags);
+
+	mdp_pipe_ctrl(MDP_CMD_BLOCK, MDP_BLOCK_POWER_OFF, FALSE);
+	mdp_clk_ctrl(0);
+
+	pr_debug("%s: mixer=%d roi=%d,%d %dx%d cfg=%x\n", __func__, mixer,
+			roi->x, roi->y, roi->w, roi->h, data);
+}
+
+/*
+ * mdp4_mixer_roi_restore:
+ * reprogram every staged pipe with its full frame geometry after
+ * a partial update; the caller does mdp4_mixer_stage_commit() next
+ */
+void mdp4_mixer_roi_restore(int mixer)
+{
+	struct mdp4_overlay_pipe *pipe;
+	int i;
+
+	for (i = MDP4_MIXER_STAGE_BASE; i < MDP4_MIXER_STAGE_MAX; i++) {
+		pipe = ctrl->stage[mixer][i];
+		if (pipe == NULL)
+			continue;
+		if (pipe->pipe_type == OVERLAY_TYPE_VIDEO)
+			mdp4_overlay_vg_setup(pipe);
+		else
+			mdp4_overlay_rgb_setup(pipe);
+		mdp4_overlay_reg_flush(pipe, 1);
+	}
+
+	/* force stage_commit to write full frame staging */
+	ctrl->mixer_cfg[mixer] = 0;
+}
+
 /*
  * mixer0: rgb3: border color at register 0x15004, 0x15008
  * mixer1:  vg3: border color at register 0x1D004, 0x1D008
@@ -3961,6 +4103,7 @@ int mdp4_overlay_commit(struct fb_info *info)
 {
 	int ret = 0;
 	struct msm_fb_data_type *mfd = (struct msm_fb_data_type *)info->par;
+	struct msm_fb_backup_type *fb_backup;
 	int mixer;
 
 	if (mfd == NULL)
@@ -3979,6 +4122,8 @@ int mdp4_overlay_commit(struct fb_info *info)
 
 	switch (mfd->panel.type) {
 	case MIPI_CMD_PANEL:
+		fb_backup = (struct msm_fb_backup_type *)mfd->msm_fb_backup;
+		mdp4_dsi_cmd_roi_set(0, &fb_backup->disp_commit);
 		mdp4_dsi_cmd_pipe_commit(0, 1);
 		break;
 	case MIPI_VIDEO_PANEL:
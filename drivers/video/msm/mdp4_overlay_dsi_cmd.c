@@ -75,6 +75,9 @@ static struct vsycn_ctrl {
 	u32 last_vsync_ms;
 	struct work_struct clk_work;
 	wait_queue_head_t wait_queue;
+	struct mdp_rect roi;	/* dirty region of next commit */
+	int roi_req;
+	int roi_applied;	/* panel and mixer hold a partial window */
 } vsync_ctrl_db[MAX_CONTROLLER];
 
 static void vsync_irq_enable(int intr, int term)
@@ -269,6 +272,111 @@ static void mdp4_dsi_cmd_pipe_clean(struct vsync_update *vp)
 static void mdp4_dsi_cmd_blt_ov_update(struct mdp4_overlay_pipe *pipe);
 static int mdp4_dsi_cmd_clk_check(struct vsycn_ctrl *vctrl);
 
+/*
+ * mdp4_dsi_cmd_roi_set:
+ * called from mdp4_overlay_commit with ov_mutex held,
+ * latch the dirty region for the following pipe_commit
+ */
+void mdp4_dsi_cmd_roi_set(int cndx, struct mdp_display_commit *commit)
+{
+	struct vsycn_ctrl *vctrl;
+	struct msm_panel_info *pinfo;
+	struct mdp_rect *roi;
+	u32 x2, y2, align;
+
+	if (cndx >= MAX_CONTROLLER) {
+		pr_err("%s: out or range: cndx=%d\n", __func__, cndx);
+		return;
+	}
+
+	vctrl = &vsync_ctrl_db[cndx];
+	vctrl->roi_req = 0;
+
+	if (vctrl->mfd == NULL)
+		return;
+
+	pinfo = &vctrl->mfd->panel_info;
+	if (!pinfo->mipi.partial_update ||
+			!(commit->flags & MDP_DISPLAY_COMMIT_ROI))
+		return;
+
+	roi = &vctrl->roi;
+	*roi = commit->roi;
+	if (roi->w == 0 || roi->h == 0 ||
+			roi->x >= pinfo->xres || roi->y >= pinfo->yres)
+		return;
+
+	x2 = roi->x + min(roi->w, pinfo->xres - roi->x);
+	y2 = roi->y + min(roi->h, pinfo->yres - roi->y);
+
+	align = pinfo->mipi.roi_align;
+	if (align > 1) {
+		roi->x = rounddown(roi->x, align);
+		roi->y = rounddown(roi->y, align);
+		x2 = min(roundup(x2, align), pinfo->xres);
+		y2 = min(roundup(y2, align), pinfo->yres);
+	}
+
+	roi->w = x2 - roi->x;
+	roi->h = y2 - roi->y;
+
+	if (roi->w == pinfo->xres && roi->h == pinfo->yres)
+		return;		/* full frame anyway */
+
+	vctrl->roi_req = 1;
+}
+
+/*
+ * mdp4_dsi_cmd_roi_prepare:
+ * decide between partial and full frame before dcs commands go out,
+ * queue panel address window and restore full frame geometry of the
+ * mixer if previous frame was partial.
+ * return 1 if this frame is partial
+ */
+static int mdp4_dsi_cmd_roi_prepare(struct vsycn_ctrl *vctrl, int mixer)
+{
+	struct msm_panel_info *pinfo = &vctrl->mfd->panel_info;
+	struct mdp4_overlay_pipe *pipe = vctrl->base_pipe;
+	struct mdp_rect *roi = &vctrl->roi;
+	int partial;
+
+	partial = vctrl->roi_req && pipe->ov_blt_addr == 0 &&
+			mdp4_mixer_roi_check(mixer) == 0;
+	vctrl->roi_req = 0;
+
+	if (partial) {
+		mipi_dsi_cmd_roi_set(&pinfo->mipi, roi->x, roi->y,
+					roi->w, roi->h);
+		vctrl->roi_applied = 1;
+	} else if (vctrl->roi_applied) {
+		mdp4_mixer_roi_restore(mixer);
+		mdp4_overlayproc_cfg(pipe);
+		mdp4_overlay_dmap_xy(pipe);
+		mipi_dsi_cmd_roi_set(&pinfo->mipi, 0, 0,
+					pinfo->xres, pinfo->yres);
+		vctrl->roi_applied = 0;
+	}
+
+	return partial;
+}
+
+static void mdp4_dsi_cmd_roi_stat(struct vsycn_ctrl *vctrl, int partial)
+{
+	struct msm_panel_info *pinfo = &vctrl->mfd->panel_info;
+	ulong bytes;
+
+	if (partial) {
+		bytes = vctrl->roi.w * vctrl->roi.h;
+		mdp4_stat.dsi_cmd_partial++;
+	} else {
+		bytes = pinfo->xres * pinfo->yres;
+		mdp4_stat.dsi_cmd_full++;
+	}
+	bytes *= DIV_ROUND_UP(pinfo->bpp, 8);
+	mdp4_stat.dsi_cmd_frame_bytes = bytes;
+	mdp4_stat.dsi_cmd_bytes += bytes;
+}
+
 int mdp4_dsi_cmd_pipe_commit(int cndx, int wait)
 {
 	int  i, undx;
@@ -280,6 +388,7 @@ int mdp4_dsi_cmd_pipe_commit(int cndx, int wait)
 	unsigned long flags;
 	int need_dmap_wait = 0;
 	int need_ov_wait = 0;
+	int partial;
 	int cnt = 0;
 
 	vctrl = &vsync_ctrl_db[0];
@@ -388,12 +497,22 @@ int mdp4_dsi_cmd_pipe_commit(int cndx, int wait)
 		}
 	}
 
+	partial = mdp4_dsi_cmd_roi_prepare(vctrl, mixer);
+
 	/* tx dcs command if had any */
 	mipi_dsi_cmdlist_commit(1);
 
 	mdp4_mixer_stage_commit(mixer);
 
 	pipe = vctrl->base_pipe;
+	if (partial) {
+		mdp4_mixer_roi_setup(mixer, &vctrl->roi);
+		/* dma_p source, height + width */
+		MDP_OUTP(MDP_BASE + 0x90004,
+			(vctrl->roi.h << 16 | vctrl->roi.w));
+	}
+	mdp4_dsi_cmd_roi_stat(vctrl, partial);
+
 	spin_lock_irqsave(&vctrl->spin_lock, flags);
 	if (pipe->ov_blt_addr) {
 		mdp4_dsi_cmd_blt_ov_update(pipe);
@@ -1069,6 +1188,9 @@ int mdp4_dsi_cmd_on(struct platform_device *pdev)
 	vctrl->mfd = mfd;
 	vctrl->dev = mfd->fbi->dev;
 	vctrl->vsync_enabled = 0;
+	/* panel comes up with full address window */
+	vctrl->roi_req = 0;
+	vctrl->roi_applied = 0;
 
 	mdp_clk_ctrl(1);
 	mdp4_overlay_update_dsi_cmd(mfd);
@@ -1254,6 +1376,7 @@ void mdp4_dsi_cmd_overlay(struct msm_fb_data_type *mfd)
 	}
 
 	mdp4_overlay_mdp_perf_upd(mfd, 1);
+	vctrl->roi_req = 0;	/* pan display is always full frame */
 	mdp4_dsi_cmd_pipe_commit(cndx, 0);
 	mdp4_overlay_mdp_perf_upd(mfd, 0);
 	mutex_unlock(&mfd->dma->ov_mutex);
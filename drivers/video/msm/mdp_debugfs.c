@@ -554,6 +554,30 @@ static ssize_t mdp_stat_read(
 	bp += len;
 	dlen -= len;
 
+	len = snprintf(bp, dlen, "dsi_cmd_update:\n");
+	bp += len;
+	dlen -= len;
+
+	len = snprintf(bp, dlen, "full: %08lu\t",
+					mdp4_stat.dsi_cmd_full);
+	bp += len;
+	dlen -= len;
+
+	len = snprintf(bp, dlen, "partial: %08lu\n",
+					mdp4_stat.dsi_cmd_partial);
+	bp += len;
+	dlen -= len;
+
+	len = snprintf(bp, dlen, "frame_bytes: %08lu\t",
+					mdp4_stat.dsi_cmd_frame_bytes);
+	bp += len;
+	dlen -= len;
+
+	len = snprintf(bp, dlen, "total_bytes: %llu\n\n",
+					mdp4_stat.dsi_cmd_bytes);
+	bp += len;
+	dlen -= len;
+
 	tot = (uint32)bp - (uint32)debug_buf;
 	*bp = 0;
 	tot++;
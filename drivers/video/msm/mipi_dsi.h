@@ -382,6 +382,9 @@ void mipi_dsi_clk_cfg(int on);
 int mipi_dsi_cmdlist_put(struct dcs_cmd_req *cmdreq);
 struct dcs_cmd_req *mipi_dsi_cmdlist_get(void);
 void mipi_dsi_cmdlist_commit(int from_mdp);
+int mipi_dsi_cmd_bpp(struct mipi_panel_info *mipi);
+void mipi_dsi_cmd_roi_set(struct mipi_panel_info *mipi,
+			int x, int y, int w, int h);
 void mipi_dsi_cmd_mdp_busy(void);
 void mipi_dsi_configure_fb_divider(u32 fps_level);
 void mipi_dsi_wait4video_done(void);
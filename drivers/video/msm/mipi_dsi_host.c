@@ -68,6 +68,21 @@ enum {
 
 struct dcs_cmd_list	cmdlist;
 
+/*
+ * column/page address window for the next mdp stream,
+ * sent right before the stream is kicked off
+ */
+static char dsi_roi_caset[5] = {0x2a, 0x00, 0x00, 0x00, 0x00};
+static char dsi_roi_paset[5] = {0x2b, 0x00, 0x00, 0x00, 0x00};
+
+static struct dsi_cmd_desc dsi_roi_cmds[] = {
+	{DTYPE_DCS_LWRITE, 1, 0, 0, 0, sizeof(dsi_roi_caset), dsi_roi_caset},
+	{DTYPE_DCS_LWRITE, 1, 0, 0, 0, sizeof(dsi_roi_paset), dsi_roi_paset},
+};
+static u32 dsi_roi_stream_ctrl;	/* DSI_COMMAND_MODE_MDP_STREAM_CTRL */
+static u32 dsi_roi_stream_total;	/* DSI_COMMAND_MODE_MDP_STREAM_TOTAL */
+static int dsi_roi_pending;
+
 #ifdef CONFIG_FB_MSM_MDP40
 void mipi_dsi_mdp_stat_inc(int which)
 {
@@ -1737,12 +1752,66 @@ void mipi_dsi_cmdlist_commit(int from_mdp)
 
 need_lock:
 
+	if (from_mdp && dsi_roi_pending) {
+		mipi_dsi_buf_init(&dsi_tx_buf);
+		mipi_dsi_cmds_tx(&dsi_tx_buf, dsi_roi_cmds,
+					ARRAY_SIZE(dsi_roi_cmds));
+		/* stream0 and stream1 stride + size follow the window */
+		MIPI_OUTP(MIPI_DSI_BASE + 0x5c, dsi_roi_stream_ctrl);
+		MIPI_OUTP(MIPI_DSI_BASE + 0x54, dsi_roi_stream_ctrl);
+		MIPI_OUTP(MIPI_DSI_BASE + 0x60, dsi_roi_stream_total);
+		MIPI_OUTP(MIPI_DSI_BASE + 0x58, dsi_roi_stream_total);
+		wmb();
+		dsi_roi_pending = 0;
+	}
+
 	if (from_mdp) /* from pipe_commit */
 		mipi_dsi_cmd_mdp_start();
 
 	mutex_unlock(&cmd_mutex);
 }
 
+/*
+ * mipi_dsi_cmd_bpp:
+ * bytes per pixel of the command mode stream
+ */
+int mipi_dsi_cmd_bpp(struct mipi_panel_info *mipi)
+{
+	if (mipi->dst_format == DSI_CMD_DST_FORMAT_RGB565)
+		return 2;
+
+	return 3;	/* RGB888, RGB666 and default */
+}
+
+/*
+ * mipi_dsi_cmd_roi_set:
+ * set panel column/page address window and mdp stream size for the
+ * next mdp stream, they are programmed by mipi_dsi_cmdlist_commit(1)
+ * before mdp start
+ */
+void mipi_dsi_cmd_roi_set(struct mipi_panel_info *mipi,
+			int x, int y, int w, int h)
+{
+	int x2 = x + w - 1;
+	int y2 = y + h - 1;
+	int ystride = w * mipi_dsi_cmd_bpp(mipi) + 1;
+
+	mutex_lock(&cmd_mutex);
+	dsi_roi_stream_ctrl = (ystride << 16) | (mipi->vc << 8) |
+					DTYPE_DCS_LWRITE;
+	dsi_roi_stream_total = (h << 16) | w;
+	dsi_roi_caset[1] = (x >> 8) & 0xff;
+	dsi_roi_caset[2] = x & 0xff;
+	dsi_roi_caset[3] = (x2 >> 8) & 0xff;
+	dsi_roi_caset[4] = x2 & 0xff;
+	dsi_roi_paset[1] = (y >> 8) & 0xff;
+	dsi_roi_paset[2] = y & 0xff;
+	dsi_roi_paset[3] = (y2 >> 8) & 0xff;
+	dsi_roi_paset[4] = y2 & 0xff;
+	dsi_roi_pending = 1;
+	mutex_unlock(&cmd_mutex);
+}
+
 int mipi_dsi_cmdlist_put(struct dcs_cmd_req *cmdreq)
 {
 	struct dcs_cmd_req *req;
@@ -73,6 +73,14 @@ int vsync_mode = 1;
 
 #define MAX_BLIT_REQ 256
 
+/*
+ * MSMFB_DISPLAY_COMMIT as issued by userspace built before
+ * struct mdp_display_commit grew the dirty roi
+ */
+#define MSMFB_DISPLAY_COMMIT_V1 _IOW(MSMFB_IOCTL_MAGIC, 164, \
+		struct { uint32_t flags; uint32_t wait_for_finish; \
+			 struct fb_var_screeninfo var; })
+
 #define MAX_FBI_LIST 32
 static struct fb_info *fbi_list[MAX_FBI_LIST];
 static int fbi_list_index;
@@ -549,6 +557,14 @@ static int msm_fb_probe(struct platform_device *pdev)
 	}
 #endif
 
+#ifdef CONFIG_HAS_EARLYSUSPEND
+	/*
+	 * Panel and mdp power are handled from early suspend, the dpm
+	 * callbacks left do not need the rest of the display chain.
+	 */
+	device_enable_async_suspend(&pdev->dev);
+#endif
+
 	pdev_list[pdev_list_cnt++] = pdev;
 	msm_fb_create_sysfs(pdev);
 	if (mfd->timeline == NULL) {
@@ -4045,12 +4061,13 @@ buf_sync_err_1:
 }
 
 static int msmfb_display_commit(struct fb_info *info,
-						unsigned long *argp)
+				unsigned long *argp, size_t size)
 {
 	int ret;
 	struct mdp_display_commit disp_commit;
-	ret = copy_from_user(&disp_commit, argp,
-			sizeof(disp_commit));
+
+	memset(&disp_commit, 0, sizeof(disp_commit));
+	ret = copy_from_user(&disp_commit, argp, size);
 	if (ret) {
 		pr_err("%s:copy_from_user failed", __func__);
 		return ret;
@@ -4400,7 +4417,14 @@ static int msm_fb_ioctl(struct fb_info *info, unsigned int cmd,
 		break;
 
 	case MSMFB_DISPLAY_COMMIT:
-		ret = msmfb_display_commit(info, argp);
+		ret = msmfb_display_commit(info, argp,
+				sizeof(struct mdp_display_commit));
+		break;
+
+	case MSMFB_DISPLAY_COMMIT_V1:
+		/* older layout, roi stays empty and a full frame is pushed */
+		ret = msmfb_display_commit(info, argp,
+				_IOC_SIZE(MSMFB_DISPLAY_COMMIT_V1));
 		break;
 
 	case MSMFB_METADATA_GET:
@@ -136,6 +136,8 @@ struct mipi_panel_info {
 	char stream;	/* 0 or 1 */
 	char mdp_trigger;
 	char dma_trigger;
+	char partial_update;	/* panel honours column/page address set */
+	char roi_align;		/* roi x/y/w/h alignment in pixels */
 	uint32 dsi_pclk_rate;
 	/* byte to esc clk ratio */
 	uint32 esc_byte_ratio;
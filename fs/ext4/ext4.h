@@ -955,6 +955,17 @@ struct ext4_inode_info {
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
 
+	/*
+	 * Fast commit tracking: the logical blocks whose mapping changed
+	 * in transaction i_fc_tid, and the last transaction that changed
+	 * the inode in a way a fast commit cannot log.  [i_fc_lock]
+	 */
+	spinlock_t i_fc_lock;
+	tid_t i_fc_tid;
+	ext4_lblk_t i_fc_lblk_start;
+	ext4_lblk_t i_fc_lblk_end;
+	tid_t i_fc_ineligible_tid;
+
 	/* Precomputed uuid+inum+igen checksum for seeding inode checksums */
 	__u32 i_csum_seed;
 };
@@ -994,6 +1005,7 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_POSIX_ACL		0x08000	/* POSIX Access Control Lists */
 #define EXT4_MOUNT_NO_AUTO_DA_ALLOC	0x10000	/* No auto delalloc mapping */
 #define EXT4_MOUNT_BARRIER		0x20000 /* Use block barriers */
+#define EXT4_MOUNT_FAST_COMMIT		0x40000 /* Log fsyncs as fast commits */
 #define EXT4_MOUNT_QUOTA		0x80000 /* Some quota option set */
 #define EXT4_MOUNT_USRQUOTA		0x100000 /* "old" user quota */
 #define EXT4_MOUNT_GRPQUOTA		0x200000 /* "old" group quota */
@@ -1182,6 +1194,16 @@ struct ext4_super_block {
 /*
  * fourth extended-fs super-block data in memory
  */
+/*
+ * fsync statistics, shown in /proc/fs/ext4/<dev>/fc_info
+ */
+struct ext4_fc_stats {
+	atomic_long_t	fc_commits;	/* fsyncs done with a fast commit */
+	atomic_long_t	full_commits;	/* fsyncs done with a full commit */
+	atomic64_t	fc_time;	/* total latency of those, in ns */
+	atomic64_t	full_time;
+};
+
 struct ext4_sb_info {
 	unsigned long s_desc_size;	/* Size of a group descriptor in bytes */
 	unsigned long s_inodes_per_block;/* Number of inodes per block */
@@ -1324,6 +1346,12 @@ struct ext4_sb_info {
 
 	/* Precomputed FS UUID checksum for seeding other checksums */
 	__u32 s_csum_seed;
+
+	/* Fast commits, see fast_commit.c */
+	struct mutex s_fc_lock;
+	tid_t s_fc_tid;			/* Transaction in the fc area */
+	unsigned long s_fc_off;		/* Next free block in the fc area */
+	struct ext4_fc_stats s_fc_stats;
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1935,6 +1963,17 @@ extern int ext4_htree_store_dirent(struct file *dir_file, __u32 hash,
 				    struct ext4_dir_entry_2 *dirent);
 extern void ext4_htree_free_dir_info(struct dir_private_info *p);
 
+/* fast_commit.c */
+extern void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+				ext4_lblk_t start, ext4_lblk_t end);
+extern void ext4_fc_mark_ineligible(handle_t *handle, struct inode *inode);
+extern void ext4_fc_init_inode(struct inode *inode, tid_t tid);
+extern int ext4_fc_commit(struct inode *inode, tid_t commit_tid);
+extern void ext4_fc_update_stats(struct super_block *sb, int fast,
+				 ktime_t start);
+extern int ext4_fc_replay(struct super_block *sb);
+extern const struct file_operations ext4_fc_info_fops;
+
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 extern int ext4_flush_completed_IO(struct inode *);
@@ -1975,6 +2014,10 @@ extern int ext4_mb_add_groupinfo(struct super_block *sb,
 		ext4_group_t i, struct ext4_group_desc *desc);
 extern int ext4_group_add_blocks(handle_t *handle, struct super_block *sb,
 				ext4_fsblk_t block, unsigned long count);
+extern int ext4_mb_claim_blocks(handle_t *handle, struct super_block *sb,
+				ext4_fsblk_t block, unsigned long count);
+extern int ext4_mb_reserve_blocks(struct super_block *sb, ext4_fsblk_t block,
+				  unsigned long count, int check);
 extern int ext4_trim_fs(struct super_block *, struct fstrim_range *,
 				unsigned long blkdev_flags);
 
@@ -2400,6 +2443,11 @@ extern int ext4_map_blocks(handle_t *handle, struct inode *inode,
 			   struct ext4_map_blocks *map, int flags);
 extern int ext4_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 			__u64 start, __u64 len);
+extern int ext4_ext_replay_del_range(struct inode *inode, ext4_lblk_t start,
+				     ext4_lblk_t end);
+extern int ext4_ext_replay_add_range(struct inode *inode, ext4_lblk_t lblk,
+				     ext4_fsblk_t pblk, unsigned int len,
+				     int uninit);
 /* move_extent.c */
 extern int ext4_move_extents(struct file *o_filp, struct file *d_filp,
 			     __u64 start_orig, __u64 start_donor,
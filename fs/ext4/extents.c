@@ -1870,9 +1870,9 @@ cleanup:
 	return err;
 }
 
-static int ext4_ext_walk_space(struct inode *inode, ext4_lblk_t block,
-			       ext4_lblk_t num, ext_prepare_callback func,
-			       void *cbdata)
+int ext4_ext_walk_space(struct inode *inode, ext4_lblk_t block,
+			ext4_lblk_t num, ext_prepare_callback func,
+			void *cbdata)
 {
 	struct ext4_ext_path *path = NULL;
 	struct ext4_ext_cache cbex;
@@ -4299,6 +4299,7 @@ void ext4_ext_truncate(struct inode *inode)
 		ext4_handle_sync(handle);
 
 	up_write(&EXT4_I(inode)->i_data_sem);
+	ext4_fc_track_range(handle, inode, last_block, EXT_MAX_BLOCKS - 1);
 
 out_stop:
 	/*
@@ -4514,6 +4515,124 @@ int ext4_convert_unwritten_extents(struct inode *inode, loff_t offset,
 	return ret > 0 ? ret2 : ret;
 }
 
+/*
+ * Fast commit replay helpers.  Both are idempotent: replay may be run
+ * again after a crash, on a tree that already has some of the changes.
+ */
+
+/* Unmap blocks @start..@end, freeing them. */
+int ext4_ext_replay_del_range(struct inode *inode, ext4_lblk_t start,
+			      ext4_lblk_t end)
+{
+	int err;
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ext4_ext_invalidate_cache(inode);
+	err = ext4_ext_remove_space(inode, start, end);
+	up_write(&EXT4_I(inode)->i_data_sem);
+	return err;
+}
+
+/*
+ * Map @len blocks at @lblk into the hole they start in, to blocks the
+ * caller has already claimed.  Returns the number of blocks mapped.
+ */
+static int ext4_ext_replay_fill_hole(struct inode *inode, ext4_lblk_t lblk,
+				     ext4_fsblk_t pblk, unsigned int len,
+				     int uninit)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent newex, *ex;
+	ext4_lblk_t end;
+	handle_t *handle;
+	int err, ret;
+
+	handle = ext4_journal_start(inode, ext4_chunk_trans_blocks(inode, 1));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	path = ext4_ext_find_extent(inode, lblk, NULL);
+	if (IS_ERR(path)) {
+		err = PTR_ERR(path);
+		goto out;
+	}
+	ex = path[ext_depth(inode)].p_ext;
+	if (ex && le32_to_cpu(ex->ee_block) > lblk)
+		end = le32_to_cpu(ex->ee_block);
+	else
+		end = ext4_ext_next_allocated_block(path);
+	len = min_t(unsigned int, len, end - lblk);
+	len = min_t(unsigned int, len,
+		    uninit ? EXT_UNINIT_MAX_LEN : EXT_INIT_MAX_LEN);
+
+	err = -EIO;
+	if (len) {
+		newex.ee_block = cpu_to_le32(lblk);
+		ext4_ext_store_pblock(&newex, pblk);
+		newex.ee_len = cpu_to_le16(len);
+		if (uninit)
+			ext4_ext_mark_uninitialized(&newex);
+		err = ext4_ext_insert_extent(handle, inode, path, &newex, 0);
+	}
+	ext4_ext_drop_refs(path);
+	kfree(path);
+	if (!err)
+		dquot_alloc_block_nofail(inode, len);
+out:
+	up_write(&EXT4_I(inode)->i_data_sem);
+	if (!err)
+		err = ext4_mark_inode_dirty(handle, inode);
+	ret = ext4_journal_stop(handle);
+	if (!err)
+		err = ret;
+	return err ? err : len;
+}
+
+/*
+ * Make @lblk..@lblk+@len-1 map to @pblk..@pblk+@len-1, initialized or
+ * not as @uninit says.  Blocks that already map there are left alone,
+ * blocks mapped elsewhere are freed first.
+ */
+int ext4_ext_replay_add_range(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_fsblk_t pblk, unsigned int len, int uninit)
+{
+	struct ext4_map_blocks map;
+	int ret;
+
+	while (len) {
+		map.m_lblk = lblk;
+		map.m_len = len;
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			return ret;
+		if (ret == 0) {
+			ret = ext4_ext_replay_fill_hole(inode, lblk, pblk,
+							len, uninit);
+			if (ret < 0)
+				return ret;
+		} else if (map.m_pblk != pblk) {
+			ret = ext4_ext_replay_del_range(inode, lblk,
+							lblk + ret - 1);
+			if (ret)
+				return ret;
+			continue;
+		} else if (!uninit && (map.m_flags & EXT4_MAP_UNWRITTEN)) {
+			int err;
+
+			err = ext4_convert_unwritten_extents(inode,
+				(loff_t)lblk << inode->i_blkbits,
+				(ssize_t)ret << inode->i_blkbits);
+			if (err)
+				return err;
+		}
+		lblk += ret;
+		pblk += ret;
+		len -= ret;
+	}
+	return 0;
+}
+
 /*
  * Callback function called for each extent to gather FIEMAP information.
  */
@@ -4909,6 +5028,7 @@ int ext4_ext_punch_hole(struct file *file, loff_t offset, loff_t length)
 		ext4_handle_sync(handle);
 
 	up_write(&EXT4_I(inode)->i_data_sem);
+	ext4_fc_track_range(handle, inode, first_block, stop_block - 1);
 
 out:
 	ext4_orphan_del(handle, inode);
@@ -0,0 +1,839 @@
+/*
+ *  linux/fs/ext4/fast_commit.c
+ *
+ * ext4 fast commits
+ *
+ * fsync() normally has to commit the whole running transaction, which
+ * writes every metadata block it dirtied to the journal.  With the
+ * fast_commit mount option, fsync() of a regular extent-mapped file
+ * instead writes a fast commit to a small area at the end of the
+ * journal: a compact record of where the file's changed blocks are now
+ * mapped, its size and its times.  The running transaction is left to
+ * commit on its own schedule.
+ *
+ * A fast commit is a delta against the state of the previous
+ * transaction, so it only counts once that one is on disk.  After a
+ * crash, jbd2 recovery brings the filesystem to the last complete
+ * transaction and flags the fast commits written while the next one
+ * was running; ext4_fc_replay() then re-applies them at mount.
+ *
+ * Only changes that do not touch other inodes or directories can be
+ * logged.  Anything else (namespace changes, xattrs, permissions,
+ * swapping extents...) marks the inode ineligible for the running
+ * transaction, and fsync() falls back to a full commit, as it does
+ * while the filesystem is being resized.
+ *
+ * Each fast commit snapshots the whole range of blocks whose mapping
+ * changed during the transaction, so the last fast commit of an inode
+ * supersedes its earlier ones and replay is idempotent.
+ */
+
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/blkdev.h>
+#include <linux/buffer_head.h>
+#include <linux/crc32.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+#include "fast_commit.h"
+
+/* Walks redone because of concurrent writeback before giving up */
+#define EXT4_FC_MAX_TRIES	3
+
+/*
+ * Transaction a change made under @handle, or just made outside of one,
+ * belongs to.  Returns 0 if there is no running transaction.
+ */
+static int ext4_fc_change_tid(handle_t *handle, struct super_block *sb,
+			      tid_t *tid)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	int ret = 0;
+
+	if (ext4_handle_valid(handle)) {
+		*tid = handle->h_transaction->t_tid;
+		return 1;
+	}
+	if (!journal)
+		return 0;
+	read_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction) {
+		*tid = journal->j_running_transaction->t_tid;
+		ret = 1;
+	}
+	read_unlock(&journal->j_state_lock);
+	return ret;
+}
+
+/*
+ * Called for inodes read in or created during transaction @tid.  They
+ * may have been changed and evicted earlier in it, so assume the worst.
+ */
+void ext4_fc_init_inode(struct inode *inode, tid_t tid)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+
+	ei->i_fc_tid = tid;
+	ei->i_fc_lblk_start = 1;
+	ei->i_fc_lblk_end = 0;
+	ei->i_fc_ineligible_tid = tid;
+}
+
+/*
+ * Record that the mapping of blocks @start..@end changed under @handle.
+ */
+void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+			 ext4_lblk_t start, ext4_lblk_t end)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	tid_t tid;
+
+	if (!test_opt(inode->i_sb, FAST_COMMIT) || !ext4_handle_valid(handle))
+		return;
+
+	tid = handle->h_transaction->t_tid;
+	spin_lock(&ei->i_fc_lock);
+	if (ei->i_fc_tid != tid || ei->i_fc_lblk_start > ei->i_fc_lblk_end) {
+		ei->i_fc_tid = tid;
+		ei->i_fc_lblk_start = start;
+		ei->i_fc_lblk_end = end;
+	} else {
+		ei->i_fc_lblk_start = min(ei->i_fc_lblk_start, start);
+		ei->i_fc_lblk_end = max(ei->i_fc_lblk_end, end);
+	}
+	spin_unlock(&ei->i_fc_lock);
+}
+
+/*
+ * Record that @inode was changed in a way a fast commit cannot log.
+ * @handle may be NULL if the change was made and its handle stopped.
+ */
+void ext4_fc_mark_ineligible(handle_t *handle, struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	tid_t tid;
+
+	if (!test_opt(inode->i_sb, FAST_COMMIT) ||
+	    !ext4_fc_change_tid(handle, inode->i_sb, &tid))
+		return;
+
+	spin_lock(&ei->i_fc_lock);
+	ei->i_fc_ineligible_tid = tid;
+	spin_unlock(&ei->i_fc_lock);
+}
+
+struct ext4_fc_write {
+	struct super_block *sb;
+	ext4_lblk_t start;		/* Tracked range */
+	ext4_lblk_t end;
+	unsigned long off;		/* First block in the fc area */
+	struct buffer_head *bh[EXT4_FC_MAX_BLOCKS];
+	int nr_bh;
+	int count;			/* Ranges in the last block */
+};
+
+static int ext4_fc_get_block(struct ext4_fc_write *fcw)
+{
+	journal_t *journal = EXT4_SB(fcw->sb)->s_journal;
+	struct buffer_head *bh;
+	int err;
+
+	if (fcw->nr_bh == EXT4_FC_MAX_BLOCKS ||
+	    fcw->off + fcw->nr_bh >= journal->j_fc_blocks)
+		return -ENOSPC;
+	err = jbd2_fc_get_buf(journal, fcw->off + fcw->nr_bh, &bh);
+	if (err)
+		return err;
+	memset(bh->b_data, 0, bh->b_size);
+	fcw->bh[fcw->nr_bh++] = bh;
+	fcw->count = 0;
+	return 0;
+}
+
+static struct ext4_fc_range *ext4_fc_next_range(struct ext4_fc_write *fcw)
+{
+	struct ext4_fc_range *range;
+	int err;
+
+	if (!fcw->nr_bh || fcw->count == EXT4_FC_RANGES_PER_BLOCK(fcw->sb)) {
+		err = ext4_fc_get_block(fcw);
+		if (err)
+			return ERR_PTR(err);
+	}
+	range = (struct ext4_fc_range *)(fcw->bh[fcw->nr_bh - 1]->b_data +
+					 sizeof(struct ext4_fc_head) +
+					 sizeof(struct ext4_fc_inode));
+	return range + fcw->count++;
+}
+
+/* ext4_ext_walk_space() callback logging each extent and hole */
+static int ext4_fc_walk_cb(struct inode *inode, ext4_lblk_t next,
+			   struct ext4_ext_cache *cbex, struct ext4_extent *ex,
+			   void *data)
+{
+	struct ext4_fc_write *fcw = data;
+	struct ext4_fc_range *range;
+	ext4_lblk_t start, end;
+
+	start = max(cbex->ec_block, fcw->start);
+	end = min(cbex->ec_block + cbex->ec_len - 1, fcw->end);
+
+	range = ext4_fc_next_range(fcw);
+	if (IS_ERR(range))
+		return PTR_ERR(range);
+	range->fr_lblk = cpu_to_le32(start);
+	range->fr_len = cpu_to_le32(end - start + 1);
+	if (!cbex->ec_start) {
+		range->fr_flags = cpu_to_le32(EXT4_FC_RANGE_HOLE);
+	} else {
+		range->fr_pblk = cpu_to_le64(cbex->ec_start +
+					     start - cbex->ec_block);
+		if (ext4_ext_is_uninitialized(ex))
+			range->fr_flags = cpu_to_le32(EXT4_FC_RANGE_UNINIT);
+	}
+	return EXT_CONTINUE;
+}
+
+static void ext4_fc_fill_inode(struct inode *inode, struct ext4_fc_inode *fi)
+{
+	fi->fi_size = cpu_to_le64(EXT4_I(inode)->i_disksize);
+	fi->fi_mtime = cpu_to_le32(inode->i_mtime.tv_sec);
+	fi->fi_mtime_nsec = cpu_to_le32(inode->i_mtime.tv_nsec);
+	fi->fi_ctime = cpu_to_le32(inode->i_ctime.tv_sec);
+	fi->fi_ctime_nsec = cpu_to_le32(inode->i_ctime.tv_nsec);
+	if (ext4_test_inode_flag(inode, EXT4_INODE_EOFBLOCKS))
+		fi->fi_flags = cpu_to_le32(EXT4_EOFBLOCKS_FL);
+}
+
+static u32 ext4_fc_csum_seed(struct super_block *sb)
+{
+	struct ext4_super_block *es = EXT4_SB(sb)->s_es;
+
+	return crc32_le(~0, es->s_uuid, sizeof(es->s_uuid));
+}
+
+static void ext4_fc_submit(struct buffer_head *bh, int rw)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(rw, bh);
+}
+
+static int ext4_fc_wait(struct buffer_head *bh)
+{
+	wait_on_buffer(bh);
+	return buffer_uptodate(bh) ? 0 : -EIO;
+}
+
+/*
+ * Write out the blocks of a fast commit.  The last one goes out after
+ * the others have completed, with a cache flush ahead of it, so the
+ * fast commit is valid only once all of it and the file data it maps
+ * are on stable storage.
+ */
+static int ext4_fc_write_blocks(struct inode *inode, struct ext4_fc_write *fcw,
+				tid_t tid)
+{
+	struct super_block *sb = inode->i_sb;
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	int barrier = journal->j_flags & JBD2_BARRIER;
+	int i, last = fcw->nr_bh - 1, err = 0;
+	struct ext4_fc_head *head;
+	struct buffer_head *bh;
+	u32 seed = ext4_fc_csum_seed(sb);
+
+	for (i = 0; i <= last; i++) {
+		bh = fcw->bh[i];
+		head = (struct ext4_fc_head *)bh->b_data;
+		head->fh_magic = cpu_to_le32(EXT4_FC_MAGIC);
+		head->fh_tid = cpu_to_le32(tid);
+		head->fh_ino = cpu_to_le32(inode->i_ino);
+		head->fh_index = cpu_to_le16(i);
+		if (i == last) {
+			head->fh_flags = cpu_to_le16(EXT4_FC_LAST);
+			head->fh_count = cpu_to_le16(fcw->count);
+		} else {
+			head->fh_count =
+				cpu_to_le16(EXT4_FC_RANGES_PER_BLOCK(sb));
+		}
+		ext4_fc_fill_inode(inode, (struct ext4_fc_inode *)(head + 1));
+		head->fh_checksum = cpu_to_le32(crc32_le(seed, bh->b_data,
+							 bh->b_size));
+		if (i < last)
+			ext4_fc_submit(bh, WRITE_SYNC);
+	}
+	for (i = 0; i < last; i++)
+		if (ext4_fc_wait(fcw->bh[i]))
+			err = -EIO;
+	if (err)
+		return err;
+
+	if (barrier && journal->j_fs_dev != journal->j_dev)
+		blkdev_issue_flush(sb->s_bdev, GFP_NOFS, NULL);
+	ext4_fc_submit(fcw->bh[last], barrier ? WRITE_FLUSH_FUA : WRITE_SYNC);
+	return ext4_fc_wait(fcw->bh[last]);
+}
+
+/*
+ * Writeback and page faults go on mapping blocks while the extent tree
+ * is walked, and a fast commit must not map a block before its data is
+ * on disk.  Wait for the writeback under way, then check that the walk
+ * still covers the tracked range and that no page is left dirty: its
+ * block may already be mapped with the data not written yet.  Returns 1
+ * if the walk can be logged, 0 if it has to be redone.
+ */
+static int ext4_fc_data_stable(struct inode *inode, struct ext4_fc_write *fcw,
+			       tid_t tid)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	int err, ret;
+
+	err = filemap_fdatawait(mapping);
+	if (err)
+		return err;
+
+	spin_lock(&ei->i_fc_lock);
+	ret = ei->i_fc_tid != tid ||
+	      ei->i_fc_lblk_start > ei->i_fc_lblk_end ||
+	      (fcw->start <= ei->i_fc_lblk_start &&
+	       ei->i_fc_lblk_end <= fcw->end);
+	spin_unlock(&ei->i_fc_lock);
+
+	if (mapping_tagged(mapping, PAGECACHE_TAG_DIRTY) ||
+	    mapping_tagged(mapping, PAGECACHE_TAG_WRITEBACK))
+		ret = 0;
+	return ret;
+}
+
+/**
+ * ext4_fc_commit() - Make an inode's changes durable with a fast commit
+ * @inode: Inode being synced.
+ * @commit_tid: Transaction holding the changes fsync() needs on disk.
+ *
+ * Returns 0 once the changes are durable.  -EALREADY or -ENOSPC mean
+ * the caller has to wait for a full commit of @commit_tid instead;
+ * other errors are fsync() errors.
+ */
+int ext4_fc_commit(struct inode *inode, tid_t commit_tid)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_fc_write fcw;
+	int err, i, tries = 0;
+
+	if (!test_opt(sb, FAST_COMMIT) || !journal->j_fc_blocks ||
+	    !S_ISREG(inode->i_mode) ||
+	    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+	    ei->i_fc_ineligible_tid == commit_tid)
+		return -EALREADY;
+
+retry:
+	/*
+	 * Like data=ordered does for a full commit, write out all of the
+	 * file's data, not just the range being synced: the fast commit
+	 * must only map blocks that have been written.
+	 */
+	err = filemap_write_and_wait(inode->i_mapping);
+	if (err)
+		return err;
+	err = ext4_flush_completed_IO(inode);
+	if (err < 0)
+		return err;
+
+	mutex_lock(&sbi->s_fc_lock);
+	err = jbd2_fc_begin_commit(journal, commit_tid);
+	if (err)
+		goto out_unlock;
+
+	/*
+	 * Nothing in here may start a handle: the commit of the running
+	 * transaction waits for us, and so would the handle.
+	 *
+	 * Replay applies fast commits on top of the previous transaction,
+	 * and that is also when the fast commit area can be reused.
+	 */
+	err = jbd2_log_wait_commit(journal, commit_tid - 1);
+	if (err)
+		goto out_end;
+	if (sbi->s_fc_tid != commit_tid) {
+		sbi->s_fc_tid = commit_tid;
+		sbi->s_fc_off = 0;
+	}
+
+	memset(&fcw, 0, sizeof(fcw));
+	fcw.sb = sb;
+	fcw.off = sbi->s_fc_off;
+	spin_lock(&ei->i_fc_lock);
+	if (ei->i_fc_ineligible_tid == commit_tid)
+		err = -EALREADY;
+	if (ei->i_fc_tid == commit_tid) {
+		fcw.start = ei->i_fc_lblk_start;
+		fcw.end = ei->i_fc_lblk_end;
+	} else {
+		fcw.start = 1;
+		fcw.end = 0;
+	}
+	spin_unlock(&ei->i_fc_lock);
+	if (err)
+		goto out_end;
+
+	if (fcw.start <= fcw.end)
+		err = ext4_ext_walk_space(inode, fcw.start,
+					  fcw.end - fcw.start + 1,
+					  ext4_fc_walk_cb, &fcw);
+	if (!err) {
+		err = ext4_fc_data_stable(inode, &fcw, commit_tid);
+		if (err > 0)
+			err = 0;
+		else if (!err)
+			err = -EAGAIN;
+	}
+	/*
+	 * Replay cannot map blocks in groups an online resize is adding.
+	 * Resizing ends with a full commit, which waits for us, so the
+	 * flag covers everything the walk may have seen.
+	 */
+	if (!err && test_bit(EXT4_RESIZING, &sbi->s_resize_flags))
+		err = -EALREADY;
+	if (!err && !fcw.nr_bh)
+		err = ext4_fc_get_block(&fcw);
+	if (!err) {
+		/* Leave it to the full commit to find out about a bad journal */
+		if (ext4_fc_write_blocks(inode, &fcw, commit_tid))
+			err = -EALREADY;
+		else
+			sbi->s_fc_off += fcw.nr_bh;
+	}
+	for (i = 0; i < fcw.nr_bh; i++)
+		brelse(fcw.bh[i]);
+out_end:
+	jbd2_fc_end_commit(journal);
+out_unlock:
+	mutex_unlock(&sbi->s_fc_lock);
+	/* Write the new dirty pages out, which may need a handle, and redo */
+	if (err == -EAGAIN) {
+		if (++tries < EXT4_FC_MAX_TRIES)
+			goto retry;
+		err = -EALREADY;
+	}
+	return err;
+}
+
+void ext4_fc_update_stats(struct super_block *sb, int fast, ktime_t start)
+{
+	struct ext4_fc_stats *stats = &EXT4_SB(sb)->s_fc_stats;
+	s64 delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (fast) {
+		atomic_long_inc(&stats->fc_commits);
+		atomic64_add(delta, &stats->fc_time);
+	} else {
+		atomic_long_inc(&stats->full_commits);
+		atomic64_add(delta, &stats->full_time);
+	}
+}
+
+/*
+ * Replay
+ */
+
+struct ext4_fc_replay_entry {
+	unsigned long ino;
+	unsigned long off;		/* First block in the fc area */
+	int nr_blocks;
+	struct inode *inode;
+};
+
+static int ext4_fc_read_block(struct super_block *sb, unsigned long off,
+			      struct buffer_head **bhp)
+{
+	struct buffer_head *bh;
+	int err;
+
+	err = jbd2_fc_get_buf(EXT4_SB(sb)->s_journal, off, &bh);
+	if (err)
+		return err;
+	if (!bh_uptodate_or_lock(bh) && bh_submit_read(bh)) {
+		brelse(bh);
+		return -EIO;
+	}
+	*bhp = bh;
+	return 0;
+}
+
+/* Does @bh hold block @index of a fast commit of transaction @tid? */
+static int ext4_fc_block_valid(struct super_block *sb, struct buffer_head *bh,
+			       tid_t tid, int index, u32 seed)
+{
+	struct ext4_fc_head *head = (struct ext4_fc_head *)bh->b_data;
+	__le32 csum = head->fh_checksum;
+	int valid;
+
+	if (le32_to_cpu(head->fh_magic) != EXT4_FC_MAGIC ||
+	    le32_to_cpu(head->fh_tid) != tid ||
+	    le16_to_cpu(head->fh_index) != index ||
+	    le16_to_cpu(head->fh_count) > EXT4_FC_RANGES_PER_BLOCK(sb))
+		return 0;
+	head->fh_checksum = 0;
+	valid = crc32_le(seed, bh->b_data, bh->b_size) == le32_to_cpu(csum);
+	head->fh_checksum = csum;
+	return valid;
+}
+
+/*
+ * Find the complete fast commits of transaction @tid, in the order they
+ * were written.  The area is filled from its start, so the first block
+ * that is not part of one ends the scan.
+ */
+static int ext4_fc_scan(struct super_block *sb, tid_t tid,
+			struct ext4_fc_replay_entry *fc, int *nr)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct ext4_fc_head *head;
+	struct buffer_head *bh;
+	unsigned long off, start = 0;
+	u32 seed = ext4_fc_csum_seed(sb);
+	int err, index = 0;
+
+	*nr = 0;
+	for (off = 0; off < journal->j_fc_blocks; off++) {
+		err = ext4_fc_read_block(sb, off, &bh);
+		if (err)
+			return err;
+		if (!ext4_fc_block_valid(sb, bh, tid, index, seed)) {
+			brelse(bh);
+			break;
+		}
+		head = (struct ext4_fc_head *)bh->b_data;
+		if (!index)
+			start = off;
+		if (le16_to_cpu(head->fh_flags) & EXT4_FC_LAST) {
+			fc[*nr].ino = le32_to_cpu(head->fh_ino);
+			fc[*nr].off = start;
+			fc[*nr].nr_blocks = index + 1;
+			fc[*nr].inode = NULL;
+			(*nr)++;
+			index = 0;
+		} else {
+			index++;
+		}
+		brelse(bh);
+	}
+	return 0;
+}
+
+/*
+ * Call @fn for each range of a fast commit, and for its inode record.
+ */
+static int ext4_fc_for_each_range(struct super_block *sb,
+				  struct ext4_fc_replay_entry *fc,
+				  int (*fn)(struct super_block *,
+					    struct ext4_fc_replay_entry *,
+					    struct ext4_fc_range *),
+				  int (*fn_inode)(struct ext4_fc_replay_entry *,
+						  struct ext4_fc_inode *))
+{
+	struct ext4_fc_head *head;
+	struct ext4_fc_range *range;
+	struct buffer_head *bh;
+	int i, j, err = 0;
+
+	for (i = 0; i < fc->nr_blocks && !err; i++) {
+		err = ext4_fc_read_block(sb, fc->off + i, &bh);
+		if (err)
+			break;
+		head = (struct ext4_fc_head *)bh->b_data;
+		range = (struct ext4_fc_range *)((char *)(head + 1) +
+						 sizeof(struct ext4_fc_inode));
+		for (j = 0; j < le16_to_cpu(head->fh_count) && !err; j++)
+			err = fn(sb, fc, range + j);
+		if (!err && fn_inode && i == fc->nr_blocks - 1)
+			err = fn_inode(fc, (struct ext4_fc_inode *)(head + 1));
+		brelse(bh);
+	}
+	return err;
+}
+
+struct ext4_fc_reserve {
+	ext4_lblk_t lblk;		/* Logged range */
+	ext4_lblk_t end;
+	ext4_fsblk_t pblk;
+	int check;
+};
+
+/* ext4_ext_walk_space() callback reserving the blocks not mapped yet */
+static int ext4_fc_reserve_cb(struct inode *inode, ext4_lblk_t next,
+			      struct ext4_ext_cache *cbex,
+			      struct ext4_extent *ex, void *data)
+{
+	struct ext4_fc_reserve *fr = data;
+	ext4_lblk_t start, end;
+	ext4_fsblk_t pblk;
+	int err;
+
+	start = max(cbex->ec_block, fr->lblk);
+	end = min(cbex->ec_block + cbex->ec_len - 1, fr->end);
+	pblk = fr->pblk + start - fr->lblk;
+
+	/* The inode already owned them before the crash */
+	if (cbex->ec_start && cbex->ec_start + start - cbex->ec_block == pblk)
+		return EXT_CONTINUE;
+
+	err = ext4_mb_reserve_blocks(inode->i_sb, pblk, end - start + 1,
+				     fr->check);
+	return err ? err : EXT_CONTINUE;
+}
+
+/*
+ * Make sure no one else owns the blocks a range maps that the inode did
+ * not already map there, and keep them from being allocated until they
+ * are claimed.  Returns -EBUSY if someone does.
+ */
+static int ext4_fc_reserve_range(struct ext4_fc_replay_entry *fc,
+				 struct ext4_fc_range *range, int check)
+{
+	struct ext4_fc_reserve fr;
+	ext4_lblk_t len = le32_to_cpu(range->fr_len);
+
+	if (le32_to_cpu(range->fr_flags) & EXT4_FC_RANGE_HOLE)
+		return 0;
+
+	fr.lblk = le32_to_cpu(range->fr_lblk);
+	fr.end = fr.lblk + len - 1;
+	fr.pblk = le64_to_cpu(range->fr_pblk);
+	fr.check = check;
+	if (!len || fr.end < fr.lblk || fr.end >= EXT_MAX_BLOCKS)
+		return -EIO;
+	return ext4_ext_walk_space(fc->inode, fr.lblk, len,
+				   ext4_fc_reserve_cb, &fr);
+}
+
+static int ext4_fc_check_range(struct super_block *sb,
+			       struct ext4_fc_replay_entry *fc,
+			       struct ext4_fc_range *range)
+{
+	return ext4_fc_reserve_range(fc, range, 1);
+}
+
+static int ext4_fc_keep_range(struct super_block *sb,
+			      struct ext4_fc_replay_entry *fc,
+			      struct ext4_fc_range *range)
+{
+	return ext4_fc_reserve_range(fc, range, 0);
+}
+
+static int ext4_fc_claim_range(struct super_block *sb,
+			       struct ext4_fc_replay_entry *fc,
+			       struct ext4_fc_range *range)
+{
+	unsigned long len = le32_to_cpu(range->fr_len);
+	handle_t *handle;
+	int err, ret;
+
+	if (le32_to_cpu(range->fr_flags) & EXT4_FC_RANGE_HOLE)
+		return 0;
+	if (!len)
+		return -EIO;
+
+	/* bitmap and descriptor of each group the range may span */
+	handle = ext4_journal_start_sb(sb, 2 * (DIV_ROUND_UP(len,
+					EXT4_BLOCKS_PER_GROUP(sb)) + 1) + 1);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+	err = ext4_mb_claim_blocks(handle, sb, le64_to_cpu(range->fr_pblk),
+				   len);
+	ret = ext4_journal_stop(handle);
+	return err ? err : ret;
+}
+
+static int ext4_fc_apply_range(struct super_block *sb,
+			       struct ext4_fc_replay_entry *fc,
+			       struct ext4_fc_range *range)
+{
+	ext4_lblk_t lblk = le32_to_cpu(range->fr_lblk);
+	ext4_lblk_t len = le32_to_cpu(range->fr_len);
+	u32 flags = le32_to_cpu(range->fr_flags);
+
+	if (!len || lblk + len - 1 < lblk || lblk + len - 1 >= EXT_MAX_BLOCKS)
+		return -EIO;
+	if (flags & EXT4_FC_RANGE_HOLE)
+		return ext4_ext_replay_del_range(fc->inode, lblk,
+						 lblk + len - 1);
+	return ext4_ext_replay_add_range(fc->inode, lblk,
+					 le64_to_cpu(range->fr_pblk), len,
+					 flags & EXT4_FC_RANGE_UNINIT);
+}
+
+static int ext4_fc_apply_inode(struct ext4_fc_replay_entry *fc,
+			       struct ext4_fc_inode *fi)
+{
+	struct inode *inode = fc->inode;
+	handle_t *handle;
+	int err, ret;
+
+	handle = ext4_journal_start(inode, 3);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+	down_write(&EXT4_I(inode)->i_data_sem);
+	EXT4_I(inode)->i_disksize = le64_to_cpu(fi->fi_size);
+	i_size_write(inode, le64_to_cpu(fi->fi_size));
+	up_write(&EXT4_I(inode)->i_data_sem);
+	inode->i_mtime.tv_sec = (signed)le32_to_cpu(fi->fi_mtime);
+	inode->i_mtime.tv_nsec = le32_to_cpu(fi->fi_mtime_nsec);
+	inode->i_ctime.tv_sec = (signed)le32_to_cpu(fi->fi_ctime);
+	inode->i_ctime.tv_nsec = le32_to_cpu(fi->fi_ctime_nsec);
+	if (le32_to_cpu(fi->fi_flags) & EXT4_EOFBLOCKS_FL)
+		ext4_set_inode_flag(inode, EXT4_INODE_EOFBLOCKS);
+	else
+		ext4_clear_inode_flag(inode, EXT4_INODE_EOFBLOCKS);
+	err = ext4_mark_inode_dirty(handle, inode);
+	ret = ext4_journal_stop(handle);
+	return err ? err : ret;
+}
+
+/**
+ * ext4_fc_replay() - Re-apply the fast commits found by journal recovery
+ * @sb: Filesystem being mounted, writable.
+ *
+ * Only the last fast commit of each inode counts.  The blocks its
+ * extents point at that the inode did not map there yet must be free;
+ * a fast commit mapping blocks some other inode owns is not replayed.
+ * They are reserved in the buddy, for all inodes, so that extent tree
+ * blocks allocated while applying the fast commits cannot land there.
+ * Once the ranges are applied and the blocks they unmapped released by
+ * a commit, the bitmaps are brought in line with all mapped ranges.
+ * Each step is a transaction of its own and can be redone, so the fast
+ * commits are only dropped once the result is committed.
+ */
+int ext4_fc_replay(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct ext4_fc_replay_entry *fc;
+	struct inode *inode;
+	int i, j, nr, nr_replayed = 0, err;
+
+	if (!journal || !(journal->j_flags & JBD2_FC_REPLAY))
+		return 0;
+
+	fc = kcalloc(journal->j_fc_blocks, sizeof(*fc), GFP_KERNEL);
+	if (!fc)
+		return -ENOMEM;
+	err = ext4_fc_scan(sb, journal->j_fc_replay_tid, fc, &nr);
+	if (err)
+		goto out;
+
+	for (i = 0; i < nr && !err; i++) {
+		for (j = i + 1; j < nr; j++)
+			if (fc[j].ino == fc[i].ino)
+				break;
+		if (j < nr)
+			continue;
+		inode = ext4_iget(sb, fc[i].ino);
+		if (IS_ERR(inode))
+			continue;
+		if (!S_ISREG(inode->i_mode) ||
+		    !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+			iput(inode);
+			continue;
+		}
+		fc[i].inode = inode;
+		err = ext4_fc_for_each_range(sb, &fc[i], ext4_fc_check_range,
+					     NULL);
+		if (err == -EBUSY) {
+			ext4_msg(sb, KERN_ERR, "fast commit of inode %lu maps "
+				 "blocks in use, not replayed", fc[i].ino);
+			fc[i].inode = NULL;
+			iput(inode);
+			err = 0;
+			continue;
+		}
+		if (!err)
+			err = ext4_fc_for_each_range(sb, &fc[i],
+						     ext4_fc_keep_range, NULL);
+	}
+
+	for (i = 0; i < nr && !err; i++) {
+		if (!fc[i].inode)
+			continue;
+		err = ext4_fc_for_each_range(sb, &fc[i], ext4_fc_apply_range,
+					     ext4_fc_apply_inode);
+		nr_replayed++;
+	}
+
+	/* Release the blocks the applied ranges unmapped */
+	if (!err)
+		err = ext4_force_commit(sb);
+
+	for (i = 0; i < nr && !err; i++) {
+		if (fc[i].inode)
+			err = ext4_fc_for_each_range(sb, &fc[i],
+						     ext4_fc_claim_range, NULL);
+	}
+
+	if (!err)
+		err = ext4_force_commit(sb);
+	if (!err)
+		err = jbd2_fc_end_replay(journal);
+	if (!err && nr_replayed)
+		ext4_msg(sb, KERN_INFO, "replayed fast commits of %d inode%s",
+			 nr_replayed, nr_replayed == 1 ? "" : "s");
+out:
+	for (i = 0; i < nr; i++)
+		if (fc[i].inode)
+			iput(fc[i].inode);
+	kfree(fc);
+	return err;
+}
+
+/*
+ * /proc/fs/ext4/<dev>/fc_info
+ */
+
+static u64 ext4_fc_avg_us(atomic64_t *time, atomic_long_t *count)
+{
+	unsigned long n = atomic_long_read(count);
+
+	return n ? div64_u64(atomic64_read(time), (u64)n * NSEC_PER_USEC) : 0;
+}
+
+static int ext4_fc_info_show(struct seq_file *seq, void *offset)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_fc_stats *stats = &EXT4_SB(sb)->s_fc_stats;
+
+	seq_printf(seq, "fast commits:\t%lu\n",
+		   atomic_long_read(&stats->fc_commits));
+	seq_printf(seq, "full commits:\t%lu\n",
+		   atomic_long_read(&stats->full_commits));
+	seq_printf(seq, "fast commit avg fsync latency (us):\t%llu\n",
+		   ext4_fc_avg_us(&stats->fc_time, &stats->fc_commits));
+	seq_printf(seq, "full commit avg fsync latency (us):\t%llu\n",
+		   ext4_fc_avg_us(&stats->full_time, &stats->full_commits));
+	return 0;
+}
+
+static int ext4_fc_info_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_fc_info_show, PDE(inode)->data);
+}
+
+const struct file_operations ext4_fc_info_fops = {
+	.owner = THIS_MODULE,
+	.open = ext4_fc_info_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
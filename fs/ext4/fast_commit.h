@@ -0,0 +1,77 @@
+/*
+ *  linux/fs/ext4/fast_commit.h
+ *
+ * On-disk format of ext4 fast commits.
+ *
+ * A fast commit logs, for one inode, where the logical blocks changed by
+ * the running transaction are now mapped plus the inode's size and
+ * times.  It takes one or more blocks of the fast commit area that jbd2
+ * reserves at the end of the journal.  Each block starts with a header
+ * and the inode record, followed by the ranges.  Only the record in the
+ * block flagged EXT4_FC_LAST is meaningful, and a fast commit is only
+ * valid if all of its blocks, up to and including that one, are.
+ *
+ * The area is announced by JBD2_FEATURE_INCOMPAT_FC_AREA (0x00010000).
+ * It takes the last s_fc_area_blks blocks of the journal (superblock
+ * offset 0x00F0), so the circular log wraps before it.  When recovery
+ * runs, it sets s_fc_replay (0x00F4) and records in s_fc_replay_tid
+ * (0x00F8) the tid of the transaction that was running when the log
+ * ended.  At mount, ext4 replays the fast commits whose fh_tid is that
+ * tid, then clears s_fc_replay.  This is not upstream's fast commit
+ * format, which uses incompat bit 0x20.
+ *
+ * The checksum is crc32_le over the whole block, with fh_checksum zeroed
+ * and the filesystem uuid as the seed.
+ *
+ * All fields are little-endian.
+ */
+
+#ifndef _EXT4_FAST_COMMIT_H
+#define _EXT4_FAST_COMMIT_H
+
+#define EXT4_FC_MAGIC		0xEF4FC0DE
+
+/* fh_flags */
+#define EXT4_FC_LAST		0x0001	/* Last block of the fast commit */
+
+struct ext4_fc_head {
+	__le32	fh_magic;
+	__le32	fh_tid;		/* Transaction the changes belong to */
+	__le32	fh_ino;		/* Inode the fast commit is for */
+	__le16	fh_index;	/* Block number inside the fast commit */
+	__le16	fh_flags;
+	__le16	fh_count;	/* Number of ranges in this block */
+	__le16	fh_reserved;
+	__le32	fh_checksum;	/* crc32 of the block, seeded with the uuid */
+};
+
+struct ext4_fc_inode {
+	__le64	fi_size;	/* i_disksize */
+	__le32	fi_mtime;
+	__le32	fi_mtime_nsec;
+	__le32	fi_ctime;
+	__le32	fi_ctime_nsec;
+	__le32	fi_flags;	/* EXT4_EOFBLOCKS_FL of i_flags */
+	__le32	fi_reserved;
+};
+
+/* fr_flags */
+#define EXT4_FC_RANGE_HOLE	0x0001	/* Range is not mapped */
+#define EXT4_FC_RANGE_UNINIT	0x0002	/* Mapped to an uninitialized extent */
+
+struct ext4_fc_range {
+	__le32	fr_lblk;
+	__le32	fr_len;
+	__le64	fr_pblk;
+	__le32	fr_flags;
+	__le32	fr_reserved;
+};
+
+/* Most blocks a single fast commit may take */
+#define EXT4_FC_MAX_BLOCKS	16
+
+#define EXT4_FC_RANGES_PER_BLOCK(sb)					\
+	(((sb)->s_blocksize - sizeof(struct ext4_fc_head) -		\
+	  sizeof(struct ext4_fc_inode)) / sizeof(struct ext4_fc_range))
+
+#endif	/* _EXT4_FAST_COMMIT_H */
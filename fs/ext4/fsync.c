@@ -210,6 +210,7 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	struct inode *inode = file->f_mapping->host;
 	struct ext4_inode_info *ei = EXT4_I(inode);
 	journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
+	ktime_t start_time = ktime_get();
 	int ret;
 	tid_t commit_tid;
 	bool needs_barrier = false;
@@ -257,12 +258,27 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	}
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+
+	/*
+	 * A fast commit logs just this inode's changes, instead of
+	 * committing everything in the running transaction.
+	 */
+	ret = ext4_fc_commit(inode, commit_tid);
+	if (!ret) {
+		ext4_fc_update_stats(inode->i_sb, 1, start_time);
+		goto out;
+	}
+	if (ret != -EALREADY && ret != -ENOSPC)
+		goto out;
+
 	if (journal->j_flags & JBD2_BARRIER &&
 	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
 		needs_barrier = true;
 	ret = jbd2_complete_transaction(journal, commit_tid);
 	if (needs_barrier)
 		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
+	if (!ret)
+		ext4_fc_update_stats(inode->i_sb, 0, start_time);
  out:
 	mutex_unlock(&inode->i_mutex);
 	trace_ext4_sync_file_exit(inode, ret);
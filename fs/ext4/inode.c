@@ -650,6 +650,9 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 	}
 
 	up_write((&EXT4_I(inode)->i_data_sem));
+	if (retval > 0 && ext4_handle_valid(handle))
+		ext4_fc_track_range(handle, inode, map->m_lblk,
+				    map->m_lblk + retval - 1);
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
 		int ret = check_block_validity(inode, map);
 		if (ret != 0)
@@ -3885,6 +3888,7 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 		read_unlock(&journal->j_state_lock);
 		ei->i_sync_tid = tid;
 		ei->i_datasync_tid = tid;
+		ext4_fc_init_inode(inode, tid);
 	}
 
 	if (EXT4_INODE_SIZE(inode->i_sb) > EXT4_GOOD_OLD_INODE_SIZE) {
@@ -4342,6 +4346,8 @@ int ext4_setattr(struct dentry *dentry, struct iattr *attr)
 	if (!rc) {
 		setattr_copy(inode, attr);
 		mark_inode_dirty(inode);
+		if (ia_valid & (ATTR_MODE | ATTR_UID | ATTR_GID))
+			ext4_fc_mark_ineligible(NULL, inode);
 	}
 
 	/*
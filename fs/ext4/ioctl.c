@@ -140,6 +140,7 @@ flags_err:
 		if (migrate)
 			err = ext4_ext_migrate(inode);
 flags_out:
+		ext4_fc_mark_ineligible(NULL, inode);
 		mutex_unlock(&inode->i_mutex);
 		mnt_drop_write_file(filp);
 		return err;
@@ -183,6 +184,7 @@ flags_out:
 			inode->i_ctime = ext4_current_time(inode);
 			inode->i_generation = generation;
 			err = ext4_mark_iloc_dirty(handle, inode, &iloc);
+			ext4_fc_mark_ineligible(handle, inode);
 		}
 		ext4_journal_stop(handle);
 
@@ -4639,12 +4639,19 @@ do_more:
 	if (err)
 		goto error_return;
 
-	if ((flags & EXT4_FREE_BLOCKS_METADATA) && ext4_handle_valid(handle)) {
+	if (ext4_handle_valid(handle) &&
+	    ((flags & EXT4_FREE_BLOCKS_METADATA) ||
+	     test_opt(sb, FAST_COMMIT))) {
 		struct ext4_free_data *new_entry;
 		/*
 		 * blocks being freed are metadata. these blocks shouldn't
 		 * be used until this transaction is committed
 		 *
+		 * With fast commits the same goes for data blocks: the
+		 * previous transaction, which replay starts from, still
+		 * has them mapped by this inode, so a fast commit of this
+		 * one must not map them anywhere else.
+		 *
 		 * We use __GFP_NOFAIL because ext4_free_blocks() is not allowed
 		 * to fail.
 		 */
@@ -4843,6 +4850,203 @@ error_return:
 	return err;
 }
 
+static int ext4_mb_claim_group_blocks(handle_t *handle, struct super_block *sb,
+				      ext4_group_t group, ext4_grpblk_t bit,
+				      ext4_grpblk_t count)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct buffer_head *bitmap_bh;
+	struct buffer_head *gd_bh;
+	struct ext4_group_desc *desc;
+	struct ext4_free_extent ex;
+	struct ext4_buddy e4b;
+	ext4_grpblk_t i, j, k, next = bit, end = bit + count;
+	int claimed = 0, err;
+
+	bitmap_bh = ext4_read_block_bitmap(sb, group);
+	if (!bitmap_bh)
+		return -EIO;
+
+	err = -EIO;
+	desc = ext4_get_group_desc(sb, group, &gd_bh);
+	if (!desc)
+		goto error_return;
+
+	err = ext4_journal_get_write_access(handle, bitmap_bh);
+	if (err)
+		goto error_return;
+	err = ext4_journal_get_write_access(handle, gd_bh);
+	if (err)
+		goto error_return;
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err)
+		goto error_return;
+
+	ext4_lock_group(sb, group);
+	for (i = bit; i < end; i = next) {
+		i = mb_find_next_zero_bit(bitmap_bh->b_data, end, i);
+		if (i >= end)
+			break;
+		next = mb_find_next_bit(bitmap_bh->b_data, end, i);
+		/* the buddy already has what ext4_mb_reserve_blocks() kept */
+		for (j = i; j < next; j = k) {
+			j = mb_find_next_zero_bit(e4b.bd_bitmap, next, j);
+			if (j >= next)
+				break;
+			k = mb_find_next_bit(e4b.bd_bitmap, next, j);
+			ex.fe_logical = 0;
+			ex.fe_group = group;
+			ex.fe_start = j;
+			ex.fe_len = k - j;
+			mb_mark_used(&e4b, &ex);
+		}
+		ext4_set_bits(bitmap_bh->b_data, i, next - i);
+		claimed += next - i;
+	}
+	if (claimed) {
+		if (desc->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+			desc->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
+			ext4_free_group_clusters_set(sb, desc,
+				ext4_free_clusters_after_init(sb, group, desc));
+		}
+		ext4_free_group_clusters_set(sb, desc,
+			ext4_free_group_clusters(sb, desc) - claimed);
+		desc->bg_checksum = ext4_group_desc_csum(sbi, group, desc);
+	}
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+	if (!claimed)
+		goto error_return;
+
+	percpu_counter_sub(&sbi->s_freeclusters_counter, claimed);
+	if (sbi->s_log_groups_per_flex) {
+		ext4_group_t flex_group = ext4_flex_group(sbi, group);
+		atomic64_sub(claimed,
+			     &sbi->s_flex_groups[flex_group].free_clusters);
+	}
+
+	err = ext4_handle_dirty_metadata(handle, NULL, bitmap_bh);
+	if (!err)
+		err = ext4_handle_dirty_metadata(handle, NULL, gd_bh);
+	ext4_mark_super_dirty(sb);
+
+error_return:
+	brelse(bitmap_bh);
+	return err;
+}
+
+/**
+ * ext4_mb_claim_blocks() -- Mark blocks in use without allocating them
+ * @handle:			handle to this transaction
+ * @sb:				super block
+ * @block:			start physical block to claim
+ * @count:			number of blocks to claim
+ *
+ * Used by fast commit replay, once the logged extents are in place, to
+ * make the on-disk bitmaps agree with them.  Blocks already in use in
+ * the on-disk bitmap are skipped, so claiming the same blocks again is
+ * harmless; ext4_mb_reserve_blocks() is what checks that nobody else
+ * owns them.  No freed blocks may be waiting for a commit to be
+ * released, or the buddy would lose them again.  The range may span
+ * several groups.
+ */
+int ext4_mb_claim_blocks(handle_t *handle, struct super_block *sb,
+			 ext4_fsblk_t block, unsigned long count)
+{
+	ext4_group_t group;
+	ext4_grpblk_t bit, len;
+	int err = 0;
+
+	if (!ext4_data_block_valid(EXT4_SB(sb), block, count)) {
+		ext4_error(sb, "Claiming blocks %llu-%llu which overlap "
+			   "fs metadata", block, block + count - 1);
+		return -EIO;
+	}
+
+	while (count && !err) {
+		ext4_get_group_no_and_offset(sb, block, &group, &bit);
+		len = min_t(unsigned long, count,
+			    EXT4_BLOCKS_PER_GROUP(sb) - bit);
+		err = ext4_mb_claim_group_blocks(handle, sb, group, bit, len);
+		block += len;
+		count -= len;
+	}
+	ext4_std_error(sb, err);
+	return err;
+}
+
+static int ext4_mb_reserve_group_blocks(struct super_block *sb,
+					ext4_group_t group, ext4_grpblk_t bit,
+					ext4_grpblk_t count, int check)
+{
+	struct buffer_head *bitmap_bh;
+	struct ext4_free_extent ex;
+	struct ext4_buddy e4b;
+	int err;
+
+	bitmap_bh = ext4_read_block_bitmap(sb, group);
+	if (!bitmap_bh)
+		return -EIO;
+
+	err = ext4_mb_load_buddy(sb, group, &e4b);
+	if (err)
+		goto error_return;
+
+	ext4_lock_group(sb, group);
+	if (mb_find_next_bit(bitmap_bh->b_data, bit + count, bit) <
+							bit + count ||
+	    mb_find_next_bit(e4b.bd_bitmap, bit + count, bit) < bit + count) {
+		err = -EBUSY;
+	} else if (!check) {
+		ex.fe_logical = 0;
+		ex.fe_group = group;
+		ex.fe_start = bit;
+		ex.fe_len = count;
+		mb_mark_used(&e4b, &ex);
+	}
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+
+error_return:
+	brelse(bitmap_bh);
+	return err;
+}
+
+/**
+ * ext4_mb_reserve_blocks() -- Keep free blocks from being allocated
+ * @sb:				super block
+ * @block:			start physical block
+ * @count:			number of blocks
+ * @check:			only check that the blocks are free
+ *
+ * Used by fast commit replay for the blocks the logged extents point
+ * at, before it starts changing extent trees.  The blocks are marked in
+ * use in the buddy only; ext4_mb_claim_blocks() updates the on-disk
+ * bitmaps afterwards.  Returns -EBUSY if any of the blocks is in use or
+ * holds fs metadata.  The range may span several groups.
+ */
+int ext4_mb_reserve_blocks(struct super_block *sb, ext4_fsblk_t block,
+			   unsigned long count, int check)
+{
+	ext4_group_t group;
+	ext4_grpblk_t bit, len;
+	int err = 0;
+
+	if (!ext4_data_block_valid(EXT4_SB(sb), block, count))
+		return -EBUSY;
+
+	while (count && !err) {
+		ext4_get_group_no_and_offset(sb, block, &group, &bit);
+		len = min_t(unsigned long, count,
+			    EXT4_BLOCKS_PER_GROUP(sb) - bit);
+		err = ext4_mb_reserve_group_blocks(sb, group, bit, len, check);
+		block += len;
+		count -= len;
+	}
+	return err;
+}
+
 /**
  * ext4_trim_extent -- function to TRIM one single free extent in the group
  * @sb:		super block for the file system
@@ -597,6 +597,7 @@ err_out:
 	ext4_ext_tree_init(handle, tmp_inode);
 	ext4_journal_stop(handle);
 out:
+	ext4_fc_mark_ineligible(NULL, inode);
 	unlock_new_inode(tmp_inode);
 	iput(tmp_inode);
 
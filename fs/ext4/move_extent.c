@@ -1339,6 +1339,8 @@ out:
 		ext4_discard_preallocations(orig_inode);
 		ext4_discard_preallocations(donor_inode);
 	}
+	ext4_fc_mark_ineligible(NULL, orig_inode);
+	ext4_fc_mark_ineligible(NULL, donor_inode);
 
 	if (orig_path) {
 		ext4_ext_drop_refs(orig_path);
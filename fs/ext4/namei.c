@@ -1520,8 +1520,10 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	retval = add_dirent_to_buf(handle, dentry, inode, de, bh);
 out:
 	brelse(bh);
-	if (retval == 0)
+	if (retval == 0) {
 		ext4_set_inode_state(inode, EXT4_STATE_NEWENTRY);
+		ext4_fc_mark_ineligible(handle, inode);
+	}
 	return retval;
 }
 
@@ -2295,6 +2297,7 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 	ext4_update_dx_flag(dir);
 	ext4_mark_inode_dirty(handle, dir);
 	drop_nlink(inode);
+	ext4_fc_mark_ineligible(handle, inode);
 	if (!inode->i_nlink)
 		ext4_orphan_add(handle, inode);
 	inode->i_ctime = ext4_current_time(inode);
@@ -2575,6 +2578,7 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 	 */
 	old_inode->i_ctime = ext4_current_time(old_inode);
 	ext4_mark_inode_dirty(handle, old_inode);
+	ext4_fc_mark_ineligible(handle, old_inode);
 
 	/*
 	 * ok, that's it
@@ -2609,6 +2613,7 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 	if (new_inode) {
 		ext4_dec_count(handle, new_inode);
 		new_inode->i_ctime = ext4_current_time(new_inode);
+		ext4_fc_mark_ineligible(handle, new_inode);
 	}
 	old_dir->i_ctime = old_dir->i_mtime = ext4_current_time(old_dir);
 	ext4_update_dx_flag(old_dir);
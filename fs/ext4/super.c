@@ -904,6 +904,7 @@ static void ext4_put_super(struct super_block *sb)
 		ext4_commit_super(sb, 1);
 
 	if (sbi->s_proc) {
+		remove_proc_entry("fc_info", sbi->s_proc);
 		remove_proc_entry("options", sbi->s_proc);
 		remove_proc_entry(sb->s_id, ext4_proc_root);
 	}
@@ -992,6 +993,8 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	ei->cur_aio_dio = NULL;
 	ei->i_sync_tid = 0;
 	ei->i_datasync_tid = 0;
+	spin_lock_init(&ei->i_fc_lock);
+	ext4_fc_init_inode(&ei->vfs_inode, 0);
 	atomic_set(&ei->i_ioend_count, 0);
 	atomic_set(&ei->i_aiodio_unwritten, 0);
 
@@ -1237,6 +1240,7 @@ enum {
 	Opt_inode_readahead_blks, Opt_journal_ioprio,
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
+	Opt_fast_commit, Opt_nofast_commit,
 };
 
 static const match_table_t tokens = {
@@ -1310,6 +1314,8 @@ static const match_table_t tokens = {
 	{Opt_init_itable, "init_itable=%u"},
 	{Opt_init_itable, "init_itable"},
 	{Opt_noinit_itable, "noinit_itable"},
+	{Opt_fast_commit, "fast_commit"},
+	{Opt_nofast_commit, "nofast_commit"},
 	{Opt_removed, "check=none"},	/* mount option from ext2/3 */
 	{Opt_removed, "nocheck"},	/* mount option from ext2/3 */
 	{Opt_removed, "reservation"},	/* mount option from ext2/3 */
@@ -1451,6 +1457,8 @@ static const struct mount_opts {
 	{Opt_noauto_da_alloc, EXT4_MOUNT_NO_AUTO_DA_ALLOC, MOPT_SET},
 	{Opt_auto_da_alloc, EXT4_MOUNT_NO_AUTO_DA_ALLOC, MOPT_CLEAR},
 	{Opt_noinit_itable, EXT4_MOUNT_INIT_INODE_TABLE, MOPT_CLEAR},
+	{Opt_fast_commit, EXT4_MOUNT_FAST_COMMIT, MOPT_SET},
+	{Opt_nofast_commit, EXT4_MOUNT_FAST_COMMIT, MOPT_CLEAR},
 	{Opt_commit, 0, MOPT_GTE0},
 	{Opt_max_batch_time, 0, MOPT_GTE0},
 	{Opt_min_batch_time, 0, MOPT_GTE0},
@@ -2195,6 +2203,41 @@ static void ext4_orphan_cleanup(struct super_block *sb,
 	sb->s_flags = s_flags; /* Restore MS_RDONLY status */
 }
 
+/*
+ * Replay the fast commits journal recovery found, then give the fast
+ * commit area back to the log if we are not mounted with fast_commit.
+ */
+static int ext4_fc_mount(struct super_block *sb)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned int s_flags = sb->s_flags;
+	int err;
+
+	if (!journal || !(journal->j_flags & JBD2_FC_REPLAY))
+		return 0;
+
+	if (bdev_read_only(sb->s_bdev)) {
+		ext4_msg(sb, KERN_ERR, "write access "
+			"unavailable, skipping fast commit replay");
+		return 0;
+	}
+
+	if (s_flags & MS_RDONLY) {
+		ext4_msg(sb, KERN_INFO, "replaying fast commits on readonly fs");
+		sb->s_flags &= ~MS_RDONLY;
+	}
+	err = ext4_fc_replay(sb);
+	if (!err && !test_opt(sb, FAST_COMMIT) && !(s_flags & MS_RDONLY)) {
+		err = jbd2_journal_flush(journal);
+		if (!err)
+			err = jbd2_fc_release(journal);
+	}
+	sb->s_flags = s_flags; /* Restore MS_RDONLY status */
+	if (err)
+		ext4_msg(sb, KERN_ERR, "fast commit replay failed (%d)", err);
+	return err;
+}
+
 /*
  * Maximal extent format file size.
  * Resulting logical blkno at s_maxbytes must fit in our on-disk
@@ -3589,9 +3632,12 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	if (ext4_proc_root)
 		sbi->s_proc = proc_mkdir(sb->s_id, ext4_proc_root);
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		proc_create_data("options", S_IRUGO, sbi->s_proc,
 				 &ext4_seq_options_fops, sb);
+		proc_create_data("fc_info", S_IRUGO, sbi->s_proc,
+				 &ext4_fc_info_fops, sb);
+	}
 
 	bgl_lock_init(sbi->s_blockgroup_lock);
 
@@ -3664,6 +3710,7 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 
 	INIT_LIST_HEAD(&sbi->s_orphan); /* unlinked but open files */
 	mutex_init(&sbi->s_orphan_lock);
+	mutex_init(&sbi->s_fc_lock);
 	sbi->s_resize_flags = 0;
 
 	sb->s_root = NULL;
@@ -3749,6 +3796,30 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 
 	sbi->s_journal->j_commit_callback = ext4_journal_commit_callback;
 
+	if (test_opt(sb, FAST_COMMIT) &&
+	    (test_opt(sb, DATA_FLAGS) != EXT4_MOUNT_ORDERED_DATA ||
+	     EXT4_HAS_RO_COMPAT_FEATURE(sb, EXT4_FEATURE_RO_COMPAT_BIGALLOC))) {
+		ext4_msg(sb, KERN_WARNING, "fast_commit needs data=ordered "
+			 "and no bigalloc, disabling it");
+		clear_opt(sb, FAST_COMMIT);
+	}
+	/*
+	 * The fast commit area can only be added or removed while the
+	 * journal is empty, as it is now, and not before its fast
+	 * commits have been replayed.
+	 */
+	if (!(sb->s_flags & MS_RDONLY) &&
+	    !(sbi->s_journal->j_flags & JBD2_FC_REPLAY)) {
+		if (!test_opt(sb, FAST_COMMIT)) {
+			jbd2_fc_release(sbi->s_journal);
+		} else if (jbd2_fc_init(sbi->s_journal,
+					JBD2_DEFAULT_FAST_COMMIT_BLOCKS)) {
+			ext4_msg(sb, KERN_WARNING, "can't reserve fast commit "
+				 "area in journal, disabling fast_commit");
+			clear_opt(sb, FAST_COMMIT);
+		}
+	}
+
 	/*
 	 * The journal may have updated the bg summary counts, so we
 	 * need to update the global counters.
@@ -3852,6 +3923,10 @@ no_journal:
 		goto failed_mount5;
 	}
 
+	err = ext4_fc_mount(sb);
+	if (err)
+		goto failed_mount6;
+
 	err = ext4_register_li_request(sb, first_not_zeroed);
 	if (err)
 		goto failed_mount6;
@@ -3931,6 +4006,7 @@ failed_mount:
 	if (sbi->s_chksum_driver)
 		crypto_free_shash(sbi->s_chksum_driver);
 	if (sbi->s_proc) {
+		remove_proc_entry("fc_info", sbi->s_proc);
 		remove_proc_entry("options", sbi->s_proc);
 		remove_proc_entry(sb->s_id, ext4_proc_root);
 	}
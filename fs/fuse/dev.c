@@ -22,6 +22,7 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/freezer.h>
+#include <linux/hash.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -230,28 +231,91 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+/* The queue of the CPU we are running on */
+static struct fuse_queue *fuse_cpu_queue(struct fuse_conn *fc)
 {
-	fc->reqctr++;
+	return fc->queues[raw_smp_processor_id() % fc->nr_queues];
+}
+
+/* The queue a unique ID was handed out by */
+static struct fuse_queue *fuse_unique_queue(struct fuse_conn *fc, u64 unique)
+{
+	unsigned id = (unique >> FUSE_QID_SHIFT) & (FUSE_MAX_QUEUES - 1);
+
+	return id < fc->nr_queues ? fc->queues[id] : NULL;
+}
+
+static unsigned fuse_req_hash(u64 unique)
+{
+	return hash_64(unique & ~FUSE_INT_REQ_BIT, FUSE_PQ_HASH_BITS);
+}
+
+/*
+ * Called with q->lock held
+ *
+ * The queue index goes into the ID, so that the reply can be matched
+ * without a search through all queues.  Bit 0 is left clear for the
+ * INTERRUPT of the request.
+ */
+static u64 fuse_get_unique(struct fuse_queue *q)
+{
+	q->reqctr++;
 	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	if ((q->reqctr << FUSE_REQ_ID_SHIFT) == 0)
+		q->reqctr = 1;
+
+	return (q->reqctr << FUSE_REQ_ID_SHIFT) |
+		((u64)q->id << FUSE_QID_SHIFT);
+}
+
+/*
+ * Wake up a reader for new work on queue q.  Readers sleep on the queue
+ * of their CPU, so if none is waiting there hand the work to an idle
+ * reader of another queue, which will steal it.  Pollers all wait on
+ * the connection.
+ */
+static void wake_up_reader(struct fuse_conn *fc, struct fuse_queue *q)
+{
+	unsigned i;
+
+	/* Pairs with the barrier in prepare_to_wait() of request_wait() */
+	smp_mb();
+	for (i = 0; i < fc->nr_queues; i++) {
+		struct fuse_queue *r = fc->queues[(q->id + i) % fc->nr_queues];
 
-	return fc->reqctr;
+		if (waitqueue_active(&r->waitq)) {
+			wake_up(&r->waitq);
+			break;
+		}
+	}
+	if (waitqueue_active(&fc->waitq))
+		wake_up(&fc->waitq);
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
-static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
+void fuse_dev_wake_up_all(struct fuse_conn *fc)
+{
+	unsigned i;
+
+	for (i = 0; i < fc->nr_queues; i++)
+		wake_up_all(&fc->queues[i]->waitq);
+	wake_up_all(&fc->waitq);
+}
+
+/* Called with q->lock held */
+static void queue_request(struct fuse_conn *fc, struct fuse_queue *q,
+			  struct fuse_req *req)
 {
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	req->queue = q;
+	list_add_tail(&req->list, &q->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	wake_up_reader(fc, q);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
@@ -264,8 +328,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	if (fc->connected) {
 		fc->forget_list_tail->next = forget;
 		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+		wake_up_reader(fc, fuse_cpu_queue(fc));
 	} else {
 		kfree(forget);
 	}
@@ -276,13 +339,16 @@ static void flush_bg_queue(struct fuse_conn *fc)
 {
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
+		struct fuse_queue *q = fuse_cpu_queue(fc);
 		struct fuse_req *req;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		spin_lock(&q->lock);
+		req->in.h.unique = fuse_get_unique(q);
+		queue_request(fc, q, req);
+		spin_unlock(&q->lock);
 	}
 }
 
@@ -294,17 +360,20 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with the lock of the request's queue, unlocks it.  The
+ * background accounting is done under fc->lock afterwards.
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->queue->lock)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
+	spin_unlock(&req->queue->lock);
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -317,8 +386,8 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
@@ -327,27 +396,27 @@ __releases(fc->lock)
 
 static void wait_answer_interruptible(struct fuse_conn *fc,
 				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->queue->lock)
+__acquires(req->queue->lock)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->queue->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&req->queue->lock);
 }
 
+/* Called with the lock of the request's queue */
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &req->queue->interrupts);
+	wake_up_reader(fc, req->queue);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->queue->lock)
+__acquires(req->queue->lock)
 {
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
@@ -389,12 +458,12 @@ __acquires(fc->lock)
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->queue->lock);
 
 	while (req->state != FUSE_REQ_FINISHED)
 		wait_event_freezable(req->waitq,
 				     req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&req->queue->lock);
 
 	if (!req->aborted)
 		return;
@@ -407,30 +476,37 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->queue->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		spin_lock(&req->queue->lock);
 	}
 }
 
+/*
+ * fc->lock is not taken here: fc->connected is checked under the queue
+ * lock, and disconnecting takes every queue lock after clearing it
+ * before the queued requests are ended.
+ */
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_queue *q = fuse_cpu_queue(fc);
+
 	req->isreply = 1;
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	if (!fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		req->in.h.unique = fuse_get_unique(fc);
-		queue_request(fc, req);
+		req->in.h.unique = fuse_get_unique(q);
+		queue_request(fc, q, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
 		__fuse_get_request(req);
 
 		request_wait_answer(fc, req);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_request_send);
 
@@ -457,7 +533,10 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
+		req->queue = fuse_cpu_queue(fc);
+		spin_lock(&req->queue->lock);
 		request_end(fc, req);
 	}
 }
@@ -472,16 +551,17 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_queue *q = fuse_cpu_queue(fc);
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	if (fc->connected) {
-		queue_request(fc, req);
+		queue_request(fc, q, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 
 	return err;
 }
@@ -507,12 +587,12 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->queue->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->queue->lock);
 	}
 	return err;
 }
@@ -525,11 +605,11 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->queue->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->queue->lock);
 	}
 }
 
@@ -917,44 +997,97 @@ static int forget_pending(struct fuse_conn *fc)
 	return fc->forget_list_head.next != NULL;
 }
 
+static int queue_pending(struct fuse_queue *q)
+{
+	return !list_empty(&q->pending) || !list_empty(&q->interrupts);
+}
+
 static int request_pending(struct fuse_conn *fc)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
+	unsigned i;
+	int pending;
+
+	spin_lock(&fc->lock);
+	pending = forget_pending(fc);
+	spin_unlock(&fc->lock);
+
+	for (i = 0; !pending && i < fc->nr_queues; i++) {
+		struct fuse_queue *q = fc->queues[i];
+
+		spin_lock(&q->lock);
+		pending = queue_pending(q);
+		spin_unlock(&q->lock);
+	}
+	return pending;
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+/*
+ * Find a queue with something to read, starting with the reader's own
+ * queue and then stealing from the others.  Returns it locked.
+ */
+static struct fuse_queue *grab_queue(struct fuse_conn *fc,
+				     struct fuse_queue *home)
+{
+	unsigned i;
+
+	for (i = 0; i < fc->nr_queues; i++) {
+		struct fuse_queue *q;
+
+		q = fc->queues[(home->id + i) % fc->nr_queues];
+		if (!queue_pending(q))
+			continue;
+		spin_lock(&q->lock);
+		if (queue_pending(q))
+			return q;
+		spin_unlock(&q->lock);
+	}
+	return NULL;
+}
+
+/*
+ * Wait until a request, interrupt or forget is available.  Returns the
+ * queue to read from with its lock held, NULL if only forgets are
+ * pending, or an error.
+ */
+static struct fuse_queue *request_wait(struct fuse_conn *fc, struct file *file)
 {
-	DECLARE_WAITQUEUE(wait, current);
+	struct fuse_queue *home = fuse_cpu_queue(fc);
+	struct fuse_queue *q;
+	DEFINE_WAIT(wait);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
-		set_current_state(TASK_INTERRUPTIBLE);
+	for (;;) {
+		prepare_to_wait_exclusive(&home->waitq, &wait,
+					  TASK_INTERRUPTIBLE);
+		q = ERR_PTR(-ENODEV);
+		if (!fc->connected)
+			break;
+		q = grab_queue(fc, home);
+		if (q || forget_pending(fc))
+			break;
+		q = ERR_PTR(-EAGAIN);
+		if (file->f_flags & O_NONBLOCK)
+			break;
+		q = ERR_PTR(-ERESTARTSYS);
 		if (signal_pending(current))
 			break;
-
-		spin_unlock(&fc->lock);
 		schedule();
-		spin_lock(&fc->lock);
 	}
-	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	finish_wait(&home->waitq, &wait);
+	return q;
 }
 
 /*
  * Transfer an interrupt request to userspace
  *
  * Unlike other requests this is assembled on demand, without a need
- * to allocate a separate fuse_req structure.
+ * to allocate a separate fuse_req structure.  Its unique ID is that of
+ * the interrupted request with FUSE_INT_REQ_BIT set.
  *
- * Called with fc->lock held, releases it
+ * Called with the lock of the request's queue held, releases it
  */
 static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->queue->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -962,7 +1095,7 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = req->in.h.unique | FUSE_INT_REQ_BIT;
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -970,7 +1103,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->queue->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -1004,6 +1137,19 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 	return head;
 }
 
+/* Called with fc->lock held, which nests outside the queue locks */
+static u64 fuse_get_forget_unique(struct fuse_conn *fc)
+{
+	struct fuse_queue *q = fuse_cpu_queue(fc);
+	u64 unique;
+
+	spin_lock(&q->lock);
+	unique = fuse_get_unique(q);
+	spin_unlock(&q->lock);
+
+	return unique;
+}
+
 static int fuse_read_single_forget(struct fuse_conn *fc,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
@@ -1017,7 +1163,7 @@ __releases(fc->lock)
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_forget_unique(fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1048,7 +1194,7 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_forget_unique(fc),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
@@ -1109,42 +1255,50 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_queue *q;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
-	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
-		goto err_unlock;
-
-	request_wait(fc);
-	err = -ENODEV;
-	if (!fc->connected)
-		goto err_unlock;
-	err = -ERESTARTSYS;
-	if (!request_pending(fc))
-		goto err_unlock;
+	q = request_wait(fc, file);
+	if (IS_ERR(q))
+		return PTR_ERR(q);
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (q && !list_empty(&q->interrupts)) {
+		req = list_entry(q->interrupts.next, struct fuse_req,
 				 intr_entry);
 		return fuse_read_interrupt(fc, cs, nbytes, req);
 	}
 
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
+		/* Forgets are under fc->lock, which nests outside q->lock */
+		if (q)
+			spin_unlock(&q->lock);
+		spin_lock(&fc->lock);
+		if (forget_pending(fc) && (!q || fc->forget_batch-- > 0))
 			return fuse_read_forget(fc, cs, nbytes);
 
 		if (fc->forget_batch <= -8)
 			fc->forget_batch = 16;
+		spin_unlock(&fc->lock);
+		if (!q)
+			goto restart;
+		spin_lock(&q->lock);
+		if (list_empty(&q->pending)) {
+			spin_unlock(&q->lock);
+			goto restart;
+		}
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	/* Checked under q->lock, see fuse_request_send() */
+	err = -ENODEV;
+	if (!fc->connected)
+		goto err_unlock;
+
+	req = list_entry(q->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &q->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1157,14 +1311,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1179,15 +1333,16 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		list_move_tail(&req->list,
+			       &q->processing[fuse_req_hash(req->in.h.unique)]);
 		if (req->interrupted)
 			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 	return err;
 }
 
@@ -1668,14 +1823,16 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 	}
 }
 
-/* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+/*
+ * Look up request on processing list by unique ID.  An interrupt has
+ * the ID of its request with FUSE_INT_REQ_BIT set, so both hash to the
+ * same bucket.
+ */
+static struct fuse_req *request_find(struct fuse_queue *q, u64 unique)
 {
-	struct list_head *entry;
+	struct fuse_req *req;
 
-	list_for_each(entry, &fc->processing) {
-		struct fuse_req *req;
-		req = list_entry(entry, struct fuse_req, list);
+	list_for_each_entry(req, &q->processing[fuse_req_hash(unique)], list) {
 		if (req->in.h.unique == unique || req->intr_unique == unique)
 			return req;
 	}
@@ -1708,14 +1865,15 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 /*
  * Write a single reply to a request.  First the header is copied from
  * the write buffer.  The request is then searched on the processing
- * list by the unique ID found in the header.  If found, then remove
- * it from the list and copy the rest of the buffer to the request.
- * The request is finished by calling request_end()
+ * list of its queue by the unique ID found in the header.  If found,
+ * then remove it from the list and copy the rest of the buffer to the
+ * request.  The request is finished by calling request_end()
  */
 static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_queue *q;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
 
@@ -1743,24 +1901,28 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
 	err = -ENOENT;
+	q = fuse_unique_queue(fc, oh.unique);
+	if (!q)
+		goto err_finish;
+
+	spin_lock(&q->lock);
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(q, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&q->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
 	/* Is it an interrupt reply? */
-	if (req->intr_unique == oh.unique) {
+	if (oh.unique & FUSE_INT_REQ_BIT) {
 		err = -EINVAL;
 		if (nbytes != sizeof(struct fuse_out_header))
 			goto err_unlock;
@@ -1770,19 +1932,19 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		else if (oh.error == -EAGAIN)
 			queue_interrupt(fc, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&q->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &q->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	if (req->in.h.opcode == FUSE_CANONICAL_PATH) {
@@ -1795,7 +1957,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 
 	fuse_setup_shortcircuit(fc, req);
 
-	spin_lock(&fc->lock);
+	spin_lock(&q->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1807,7 +1969,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&q->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1913,12 +2075,10 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &fc->waitq, wait);
 
-	spin_lock(&fc->lock);
 	if (!fc->connected)
 		mask = POLLERR;
 	else if (request_pending(fc))
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
 
 	return mask;
 }
@@ -1926,18 +2086,19 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires q->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_queue *q,
+			 struct list_head *head)
+__releases(q->lock)
+__acquires(q->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
 		request_end(fc, req);
-		spin_lock(&fc->lock);
+		spin_lock(&q->lock);
 	}
 }
 
@@ -1952,13 +2113,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_queue *q)
+__releases(q->lock)
+__acquires(q->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&q->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(q->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1969,25 +2130,51 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&q->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&q->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
+static void end_queued_requests(struct fuse_conn *fc, struct fuse_queue *q)
+__releases(q->lock)
+__acquires(q->lock)
+{
+	unsigned i;
+
+	end_requests(fc, q, &q->pending);
+	for (i = 0; i < FUSE_PQ_HASH_SIZE; i++)
+		end_requests(fc, q, &q->processing[i]);
+}
+
+/*
+ * Called with fc->lock held, after fc->connected was cleared.  Move the
+ * background requests onto the queues and release the lock, so that the
+ * requests can be ended queue by queue.
+ */
+static void end_all_requests(struct fuse_conn *fc, int io)
 __releases(fc->lock)
-__acquires(fc->lock)
 {
+	unsigned i;
+
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
+	spin_unlock(&fc->lock);
+
+	for (i = 0; i < fc->nr_queues; i++) {
+		struct fuse_queue *q = fc->queues[i];
+
+		spin_lock(&q->lock);
+		if (io)
+			end_io_requests(fc, q);
+		end_queued_requests(fc, q);
+		spin_unlock(&q->lock);
+	}
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -2018,11 +2205,14 @@ static void end_polls(struct fuse_conn *fc)
  *
  * During the aborting, progression of requests from the pending and
  * processing lists onto the io list, and progression of new requests
- * onto the pending list is prevented by req->connected being false.
+ * onto the pending list is prevented by fc->connected being false.
+ * It is tested under the queue lock, so once a queue has been locked
+ * here nothing new can enter it.
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
- * For this reason requests on the io list must be aborted first.
+ * For this reason requests on the io list of a queue must be aborted
+ * first.
  */
 void fuse_abort_conn(struct fuse_conn *fc)
 {
@@ -2030,14 +2220,16 @@ void fuse_abort_conn(struct fuse_conn *fc)
 	if (fc->connected) {
 		fc->connected = 0;
 		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
+		end_all_requests(fc, 1);
+		spin_lock(&fc->lock);
 		end_polls(fc);
-		wake_up_all(&fc->waitq);
+		spin_unlock(&fc->lock);
+		fuse_dev_wake_up_all(fc);
 		wake_up_all(&fc->blocked_waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	} else {
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_abort_conn);
 
@@ -2048,7 +2240,8 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 		spin_lock(&fc->lock);
 		fc->connected = 0;
 		fc->blocked = 0;
-		end_queued_requests(fc);
+		end_all_requests(fc, 0);
+		spin_lock(&fc->lock);
 		end_polls(fc);
 		wake_up_all(&fc->blocked_waitq);
 		spin_unlock(&fc->lock);
@@ -36,6 +36,21 @@
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
+/** Bits of a request's unique ID holding the index of its queue */
+#define FUSE_QID_BITS 6
+
+/** Maximum number of request queues per connection */
+#define FUSE_MAX_QUEUES (1 << FUSE_QID_BITS)
+
+/** Bit 0 of the unique ID marks the INTERRUPT for a request */
+#define FUSE_INT_REQ_BIT 1ULL
+#define FUSE_QID_SHIFT 1
+#define FUSE_REQ_ID_SHIFT (FUSE_QID_SHIFT + FUSE_QID_BITS)
+
+/** Number of hash buckets for the requests being processed */
+#define FUSE_PQ_HASH_BITS 6
+#define FUSE_PQ_HASH_SIZE (1 << FUSE_PQ_HASH_BITS)
+
 /** If the FUSE_DEFAULT_PERMISSIONS flag is given, the filesystem
     module will check permissions based on the file mode.  Otherwise no
     permission checking is done in the kernel */
@@ -58,6 +73,7 @@ extern struct mutex fuse_mutex;
 
 /** Module parameters */
 extern unsigned max_user_bgreq;
+extern bool per_cpu_queues;
 extern unsigned max_user_congthresh;
 
 /* One forget request */
@@ -233,9 +249,12 @@ enum fuse_req_state {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_queue */
 	struct list_head list;
 
+	/** The queue the request was sent on */
+	struct fuse_queue *queue;
+
 	/** Entry on the interrupts list  */
 	struct list_head intr_entry;
 
@@ -248,7 +267,7 @@ struct fuse_req {
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * fuse_queue->lock of the request's queue
 	 */
 
 	/** True if the request has reply */
@@ -339,6 +358,41 @@ struct fuse_req {
 	struct file *private_lower_rw_file;
 };
 
+/**
+ * A request queue of a connection.
+ *
+ * There is one per connection, or one per CPU if the per_cpu_queues
+ * module parameter was set when the connection was made.  Requests are
+ * queued on the queue of the submitting CPU and a daemon thread reads
+ * the queue of the CPU it runs on, so threads pinned to a CPU are bound
+ * to its queue.  An idle reader steals from the other queues.
+ */
+struct fuse_queue {
+	/** Lock protecting the lists and the requests on them */
+	spinlock_t lock;
+
+	/** Index of this queue, encoded in the unique IDs it hands out */
+	unsigned id;
+
+	/** The next unique request id */
+	u64 reqctr;
+
+	/** Readers bound to this queue are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** The requests being processed, hashed by unique ID */
+	struct list_head processing[FUSE_PQ_HASH_SIZE];
+} ____cacheline_aligned_in_smp;
+
 /**
  * A Fuse connection.
  *
@@ -371,17 +425,14 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
+	/** Pollers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The list of pending requests */
-	struct list_head pending;
-
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Request queues */
+	struct fuse_queue **queues;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Number of request queues */
+	unsigned nr_queues;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -404,9 +455,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
 	/** Queue of pending forgets */
 	struct fuse_forget_link forget_list_head;
 	struct fuse_forget_link *forget_list_tail;
@@ -425,9 +473,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -720,6 +765,11 @@ void fuse_request_send_background_locked(struct fuse_conn *fc,
 /* Abort all requests */
 void fuse_abort_conn(struct fuse_conn *fc);
 
+/**
+ * Wake up all readers and pollers of the connection
+ */
+void fuse_dev_wake_up_all(struct fuse_conn *fc);
+
 /**
  * Invalidate inode attributes
  */
@@ -737,7 +787,7 @@ void fuse_conn_kill(struct fuse_conn *fc);
 /**
  * Initialize fuse_conn
  */
-void fuse_conn_init(struct fuse_conn *fc);
+int fuse_conn_init(struct fuse_conn *fc);
 
 /**
  * Release reference to fuse_conn
@@ -48,6 +48,11 @@ MODULE_PARM_DESC(max_user_congthresh,
  "Global limit for the maximum congestion threshold an "
  "unprivileged user can set");
 
+bool per_cpu_queues;
+module_param(per_cpu_queues, bool, 0644);
+MODULE_PARM_DESC(per_cpu_queues,
+ "Give new connections a request queue per CPU instead of a single one");
+
 #define FUSE_SUPER_MAGIC 0x65735546
 
 #define FUSE_DEFAULT_BLKSIZE 512
@@ -347,7 +352,7 @@ void fuse_conn_kill(struct fuse_conn *fc)
 	spin_unlock(&fc->lock);
 	/* Flush all readers on this fs */
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
-	wake_up_all(&fc->waitq);
+	fuse_dev_wake_up_all(fc);
 	wake_up_all(&fc->blocked_waitq);
 	wake_up_all(&fc->reserved_req_waitq);
 	mutex_lock(&fuse_mutex);
@@ -542,7 +547,48 @@ static int fuse_show_options(struct seq_file *m, struct dentry *root)
 	return 0;
 }
 
-void fuse_conn_init(struct fuse_conn *fc)
+static void fuse_free_queues(struct fuse_conn *fc)
+{
+	unsigned i;
+
+	for (i = 0; i < fc->nr_queues; i++)
+		kfree(fc->queues[i]);
+	kfree(fc->queues);
+}
+
+static int fuse_alloc_queues(struct fuse_conn *fc)
+{
+	unsigned nr = per_cpu_queues ? min(nr_cpu_ids, FUSE_MAX_QUEUES) : 1;
+	unsigned i, j;
+
+	fc->queues = kcalloc(nr, sizeof(fc->queues[0]), GFP_KERNEL);
+	if (!fc->queues)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		struct fuse_queue *q = kzalloc(sizeof(*q), GFP_KERNEL);
+
+		if (!q)
+			goto err;
+		spin_lock_init(&q->lock);
+		q->id = i;
+		init_waitqueue_head(&q->waitq);
+		INIT_LIST_HEAD(&q->pending);
+		INIT_LIST_HEAD(&q->interrupts);
+		INIT_LIST_HEAD(&q->io);
+		for (j = 0; j < FUSE_PQ_HASH_SIZE; j++)
+			INIT_LIST_HEAD(&q->processing[j]);
+		fc->queues[i] = q;
+		fc->nr_queues++;
+	}
+	return 0;
+
+ err:
+	fuse_free_queues(fc);
+	return -ENOMEM;
+}
+
+int fuse_conn_init(struct fuse_conn *fc)
 {
 	memset(fc, 0, sizeof(*fc));
 	spin_lock_init(&fc->lock);
@@ -552,10 +598,6 @@ void fuse_conn_init(struct fuse_conn *fc)
 	init_waitqueue_head(&fc->waitq);
 	init_waitqueue_head(&fc->blocked_waitq);
 	init_waitqueue_head(&fc->reserved_req_waitq);
-	INIT_LIST_HEAD(&fc->pending);
-	INIT_LIST_HEAD(&fc->processing);
-	INIT_LIST_HEAD(&fc->io);
-	INIT_LIST_HEAD(&fc->interrupts);
 	INIT_LIST_HEAD(&fc->bg_queue);
 	INIT_LIST_HEAD(&fc->entry);
 	fc->forget_list_tail = &fc->forget_list_head;
@@ -564,10 +606,11 @@ void fuse_conn_init(struct fuse_conn *fc)
 	fc->congestion_threshold = FUSE_DEFAULT_CONGESTION_THRESHOLD;
 	fc->khctr = 0;
 	fc->polled_files = RB_ROOT;
-	fc->reqctr = 0;
 	fc->blocked = 1;
 	fc->attr_version = 1;
 	get_random_bytes(&fc->scramble_key, sizeof(fc->scramble_key));
+
+	return fuse_alloc_queues(fc);
 }
 EXPORT_SYMBOL_GPL(fuse_conn_init);
 
@@ -577,6 +620,7 @@ void fuse_conn_put(struct fuse_conn *fc)
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
 		mutex_destroy(&fc->inst_mutex);
+		fuse_free_queues(fc);
 		fc->release(fc);
 	}
 }
@@ -996,7 +1040,11 @@ static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 	if (!fc)
 		goto err_fput;
 
-	fuse_conn_init(fc);
+	err = fuse_conn_init(fc);
+	if (err) {
+		kfree(fc);
+		goto err_fput;
+	}
 	fc->release = fuse_free_conn;
 
 	fc->dev = sb->s_dev;
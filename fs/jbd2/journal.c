@@ -1023,6 +1023,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_checkpoint);
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1220,7 +1221,7 @@ static int journal_reset(journal_t *journal)
 	unsigned long long first, last;
 
 	first = be32_to_cpu(sb->s_first);
-	last = be32_to_cpu(sb->s_maxlen);
+	last = be32_to_cpu(sb->s_maxlen) - journal->j_fc_blocks;
 	if (first + JBD2_MIN_JOURNAL_BLOCKS > last + 1) {
 		printk(KERN_ERR "JBD2: Journal too short (blocks %llu-%llu).\n",
 		       first, last);
@@ -1474,6 +1475,17 @@ static int journal_get_superblock(journal_t *journal)
 		goto out;
 	}
 
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FC_AREA) &&
+	    (sb->s_fc_area_blks == 0 ||
+	     be32_to_cpu(sb->s_first) + JBD2_MIN_JOURNAL_BLOCKS +
+	     be32_to_cpu(sb->s_fc_area_blks) > journal->j_maxlen)) {
+		printk(KERN_WARNING
+			"JBD2: Invalid fast commit area size: %u\n",
+			be32_to_cpu(sb->s_fc_area_blks));
+		goto out;
+	}
+
 	return 0;
 
 out:
@@ -1503,6 +1515,13 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FC_AREA)) {
+		journal->j_fc_blocks = be32_to_cpu(sb->s_fc_area_blks);
+		journal->j_last -= journal->j_fc_blocks;
+		journal->j_fc_first = journal->j_last;
+	}
+
 	return 0;
 }
 
@@ -1770,6 +1789,205 @@ void jbd2_journal_clear_features(journal_t *journal, unsigned long compat,
 }
 EXPORT_SYMBOL(jbd2_journal_clear_features);
 
+/*
+ * The fast commit area can only be resized while the log is empty: the
+ * circular log wraps at j_last, and a log written with one wrap point
+ * cannot be recovered with another.
+ */
+static int jbd2_fc_resize_area(journal_t *journal, unsigned long num_fc_blks)
+{
+	unsigned long last;
+
+	last = be32_to_cpu(journal->j_superblock->s_maxlen) - num_fc_blks;
+	write_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction ||
+	    journal->j_committing_transaction ||
+	    journal->j_head != journal->j_tail || journal->j_head >= last) {
+		write_unlock(&journal->j_state_lock);
+		return -EBUSY;
+	}
+	journal->j_last = last;
+	journal->j_free = last - journal->j_first;
+	journal->j_fc_first = last;
+	journal->j_fc_blocks = num_fc_blks;
+	write_unlock(&journal->j_state_lock);
+	return 0;
+}
+
+/**
+ * int jbd2_fc_init() - Reserve a fast commit area in the journal
+ * @journal: Journal to act on.
+ * @num_fc_blks: Number of blocks to reserve at the end of the journal.
+ *
+ * Sets the fast commit feature and carves @num_fc_blks blocks off the
+ * end of the log for fast commits.  The journal must be empty, which
+ * it is right after jbd2_journal_load().  The superblock is written
+ * synchronously so recovery knows about the area before it is used.
+ */
+int jbd2_fc_init(journal_t *journal, unsigned long num_fc_blks)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err;
+
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FC_AREA))
+		return 0;
+	if (!jbd2_journal_check_available_features(journal, 0, 0,
+					JBD2_FEATURE_INCOMPAT_FC_AREA))
+		return -EOPNOTSUPP;
+	if (!num_fc_blks || journal->j_first + JBD2_MIN_JOURNAL_BLOCKS +
+	    num_fc_blks > be32_to_cpu(sb->s_maxlen))
+		return -EINVAL;
+
+	err = jbd2_fc_resize_area(journal, num_fc_blks);
+	if (err)
+		return err;
+
+	mutex_lock(&journal->j_checkpoint_mutex);
+	sb->s_fc_area_blks = cpu_to_be32(num_fc_blks);
+	sb->s_fc_replay = 0;
+	sb->s_feature_incompat |=
+		cpu_to_be32(JBD2_FEATURE_INCOMPAT_FC_AREA);
+	err = jbd2_write_superblock(journal, WRITE_FUA);
+	mutex_unlock(&journal->j_checkpoint_mutex);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_init);
+
+/**
+ * int jbd2_fc_release() - Give the fast commit area back to the log
+ * @journal: Journal to act on.
+ *
+ * Clears the fast commit feature.  The journal must be empty, so
+ * callers normally jbd2_journal_flush() it first.
+ */
+int jbd2_fc_release(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	int err;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FC_AREA))
+		return 0;
+
+	err = jbd2_fc_resize_area(journal, 0);
+	if (err)
+		return err;
+
+	mutex_lock(&journal->j_checkpoint_mutex);
+	sb->s_fc_area_blks = 0;
+	sb->s_fc_replay = 0;
+	sb->s_feature_incompat &=
+		~cpu_to_be32(JBD2_FEATURE_INCOMPAT_FC_AREA);
+	err = jbd2_write_superblock(journal, WRITE_FUA);
+	mutex_unlock(&journal->j_checkpoint_mutex);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_release);
+
+/**
+ * int jbd2_fc_get_buf() - Get a buffer for a fast commit area block
+ * @journal: Journal to act on.
+ * @index: Block index inside the fast commit area.
+ * @bhp: Where to return the buffer.
+ *
+ * The buffer is not read in; callers reading the area must do that.
+ */
+int jbd2_fc_get_buf(journal_t *journal, unsigned long index,
+		    struct buffer_head **bhp)
+{
+	unsigned long long blocknr;
+	struct buffer_head *bh;
+	int err;
+
+	if (index >= journal->j_fc_blocks)
+		return -EINVAL;
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + index,
+				&blocknr);
+	if (err)
+		return err;
+	bh = __getblk(journal->j_dev, blocknr, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	*bhp = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+/**
+ * int jbd2_fc_begin_commit() - Start a fast commit of a transaction
+ * @journal: Journal to act on.
+ * @tid: Transaction the fast commit logs changes of.
+ *
+ * Fast commits are only valid for the running transaction: once a
+ * full commit of @tid has been asked for, the caller must wait for it
+ * instead.  While a fast commit is in progress, the commit of the
+ * running transaction waits for it to finish.  Returns -EALREADY if
+ * the caller has to fall back to a full commit.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	transaction_t *transaction;
+
+	if (!journal->j_fc_blocks)
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	transaction = journal->j_running_transaction;
+	if ((journal->j_flags &
+	     (JBD2_ABORT | JBD2_FLUSHED | JBD2_UNMOUNT | JBD2_FC_REPLAY)) ||
+	    !transaction || transaction->t_tid != tid ||
+	    tid_geq(journal->j_commit_request, tid)) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+	WARN_ON(journal->j_flags & JBD2_FAST_COMMIT_ONGOING);
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+/**
+ * void jbd2_fc_end_commit() - Finish a fast commit
+ * @journal: Journal to act on.
+ */
+void jbd2_fc_end_commit(journal_t *journal)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/**
+ * int jbd2_fc_end_replay() - Mark the fast commit area as replayed
+ * @journal: Journal to act on.
+ *
+ * Called once the changes recorded in the fast commit area have been
+ * committed to the journal.  Until then, recovery after a crash replays
+ * the area again.
+ */
+int jbd2_fc_end_replay(journal_t *journal)
+{
+	int err;
+
+	if (!(journal->j_flags & JBD2_FC_REPLAY))
+		return 0;
+
+	mutex_lock(&journal->j_checkpoint_mutex);
+	journal->j_superblock->s_fc_replay = 0;
+	err = jbd2_write_superblock(journal, WRITE_FUA);
+	mutex_unlock(&journal->j_checkpoint_mutex);
+
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FC_REPLAY;
+	write_unlock(&journal->j_state_lock);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_end_replay);
+
 /**
  * int jbd2_journal_flush () - Flush journal
  * @journal: Journal to act on.
@@ -211,6 +211,27 @@ do {									\
 		var -= ((journal)->j_last - (journal)->j_first);	\
 } while (0)
 
+/*
+ * Flag the fast commit area for replay.  The pending replay is recorded
+ * in the superblock, which journal_reset() writes out, so that a crash
+ * before the filesystem has committed the replayed changes replays the
+ * same fast commits again rather than whatever the new tid matches.
+ */
+static void fc_mark_replay(journal_t *journal, tid_t tid)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FC_AREA))
+		return;
+	if (!sb->s_fc_replay) {
+		sb->s_fc_replay = cpu_to_be32(1);
+		sb->s_fc_replay_tid = cpu_to_be32(tid);
+	}
+	journal->j_fc_replay_tid = be32_to_cpu(sb->s_fc_replay_tid);
+	journal->j_flags |= JBD2_FC_REPLAY;
+}
+
 /**
  * jbd2_journal_recover - recovers a on-disk journal
  * @journal: the journal to recover
@@ -243,6 +264,8 @@ int jbd2_journal_recover(journal_t *journal)
 		jbd_debug(1, "No recovery required, last transaction %d\n",
 			  be32_to_cpu(sb->s_sequence));
 		journal->j_transaction_sequence = be32_to_cpu(sb->s_sequence) + 1;
+		if (sb->s_fc_replay)
+			fc_mark_replay(journal, 0);
 		return 0;
 	}
 
@@ -258,6 +281,13 @@ int jbd2_journal_recover(journal_t *journal)
 	jbd_debug(1, "JBD2: Replayed %d and revoked %d/%d blocks\n",
 		  info.nr_replays, info.nr_revoke_hits, info.nr_revokes);
 
+	/*
+	 * Fast commits written while the transaction after the last one
+	 * we found was running are for the filesystem to replay.
+	 */
+	if (!err)
+		fc_mark_replay(journal, info.end_transaction);
+
 	/* Restart the log at the next transaction ID, thus invalidating
 	 * any existing commit records in the log. */
 	journal->j_transaction_sequence = ++info.end_transaction;
@@ -295,6 +295,8 @@ typedef struct __FS_INFO_T {
 
 	s32       reserved_clusters;  // # of reserved clusters (DA)
 	void        *amap;                  // AU Allocation Map
+	void        *dindex;                // index of large directories (exFAT)
+	void        *fext;                  // free extent tree (exFAT)
 
 	/* fat cache */
 	struct {
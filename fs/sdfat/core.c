@@ -1280,6 +1280,9 @@ static s32 create_dir(struct inode *inode, CHAIN_T *p_dir, UNI_NAME_T *p_uniname
 	if (ret)
 		return ret;
 
+	/* the cluster may have started a directory removed by rename */
+	dindex_forget(sb, clu.dir);
+
 	size = fsi->cluster_size;
 	if (fsi->vol_type != EXFAT) {
 		/* initialize the . and .. entry
@@ -1626,13 +1629,32 @@ s32 fscore_init(void)
 	if (ret)
 		return ret;
 
-	return extent_cache_init();
+	ret = dindex_init();
+	if (ret)
+		return ret;
+
+	ret = fext_init();
+	if (ret)
+		goto out_dindex;
+
+	ret = extent_cache_init();
+	if (ret)
+		goto out_fext;
+	return 0;
+
+out_fext:
+	fext_shutdown();
+out_dindex:
+	dindex_shutdown();
+	return ret;
 }
 
 /* make free all memory-alloced global buffers */
 s32 fscore_shutdown(void)
 {
 	extent_cache_shutdown();
+	fext_shutdown();
+	dindex_shutdown();
 	return 0;
 }
 
@@ -1846,6 +1868,10 @@ free_bh:
 		goto free_upcase;
 	}
 
+	/* allocation falls back to bitmap scans without it */
+	if (fext_build(sb))
+		sdfat_log_msg(sb, KERN_WARNING, "failed to build free extent tree");
+
 update_used_clus:
 	if (fsi->used_clusters == (u32) ~0) {
 		ret = fsi->fs_func->count_used_clusters(sb, &fsi->used_clusters);
@@ -1890,6 +1916,7 @@ s32 fscore_umount(struct super_block *sb)
 		ret = -EIO;
 
 	amap_destroy(sb);
+	dindex_destroy(sb);
 
 	if (fsi->prev_eio)
 		ret = -EIO;
@@ -3684,6 +3711,7 @@ s32 fscore_rmdir(struct inode *inode, FILE_ID_T *fid)
 	}
 
 	fid->dir.dir = DIR_DELETED;
+	dindex_forget(sb, fid->start_clu);
 
 	fs_sync(sb, 0);
 	fs_set_vol_flags(sb, VOL_CLEAN);
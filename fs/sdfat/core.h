@@ -200,6 +200,27 @@ s32 write_msect_zero(struct super_block *sb, u64 sec, u64 num_secs);
 u8  calc_chksum_1byte(void *data, s32 len, u8 chksum);
 u16 calc_chksum_2byte(void *data, s32 len, u16 chksum, s32 type);
 
+/* dirindex.c : in-memory index of large exFAT directories */
+s32 dindex_init(void);
+void dindex_shutdown(void);
+s32 dindex_find_dir_entry(struct super_block *sb, FILE_ID_T *fid,
+		CHAIN_T *p_dir, UNI_NAME_T *p_uniname, s32 num_entries, u32 type);
+void dindex_set_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entry,
+		s32 num_entries, u16 old_hash, u16 name_hash);
+void dindex_del_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entry,
+		s32 order, s32 num_entries, u16 name_hash);
+void dindex_forget(struct super_block *sb, u32 dir);
+void dindex_destroy(struct super_block *sb);
+
+/* fextent.c : free extent tree for exFAT allocation */
+s32 fext_init(void);
+void fext_shutdown(void);
+s32 fext_build(struct super_block *sb);
+void fext_destroy(struct super_block *sb);
+void fext_mark_used(struct super_block *sb, u32 clu);
+void fext_mark_free(struct super_block *sb, u32 clu);
+u32 fext_alloc_goal(struct super_block *sb, u32 hint, u32 num_alloc, u32 *src);
+
 /* extent.c */
 s32 extent_cache_init(void);
 void extent_cache_shutdown(void);
@@ -32,6 +32,7 @@
 #include <linux/workqueue.h>
 #include <linux/kernel.h>
 #include <linux/log2.h>
+#include <linux/ktime.h>
 
 #include "sdfat.h"
 #include "core.h"
@@ -388,21 +389,23 @@ static s32 exfat_init_ext_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entr
 	s32 i;
 	u64 sector;
 	u16 *uniname = p_uniname->name;
+	u16 old_hash;
 	FILE_DENTRY_T *file_ep;
 	STRM_DENTRY_T *strm_ep;
 	NAME_DENTRY_T *name_ep;
 
 	file_ep = (FILE_DENTRY_T *)get_dentry_in_dir(sb, p_dir, entry, &sector);
 	if (!file_ep)
-		return -EIO;
+		goto err_out;
 
 	file_ep->num_ext = (u8)(num_entries - 1);
 	dcache_modify(sb, sector);
 
 	strm_ep = (STRM_DENTRY_T *)get_dentry_in_dir(sb, p_dir, entry+1, &sector);
 	if (!strm_ep)
-		return -EIO;
+		goto err_out;
 
+	old_hash = le16_to_cpu(strm_ep->name_hash);
 	strm_ep->name_len = p_uniname->name_len;
 	strm_ep->name_hash = cpu_to_le16(p_uniname->name_hash);
 	dcache_modify(sb, sector);
@@ -410,7 +413,7 @@ static s32 exfat_init_ext_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entr
 	for (i = 2; i < num_entries; i++) {
 		name_ep = (NAME_DENTRY_T *)get_dentry_in_dir(sb, p_dir, entry+i, &sector);
 		if (!name_ep)
-			return -EIO;
+			goto err_out;
 
 		__init_name_entry(name_ep, uniname);
 		dcache_modify(sb, sector);
@@ -418,8 +421,12 @@ static s32 exfat_init_ext_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entr
 	}
 
 	update_dir_chksum(sb, p_dir, entry);
+	dindex_set_entry(sb, p_dir, entry, num_entries, old_hash, p_uniname->name_hash);
 
 	return 0;
+err_out:
+	dindex_forget(sb, p_dir->dir);
+	return -EIO;
 } /* end of exfat_init_ext_entry */
 
 
@@ -427,19 +434,27 @@ static s32 exfat_delete_dir_entry(struct super_block *sb, CHAIN_T *p_dir, s32 en
 {
 	s32 i;
 	u64 sector;
+	u16 name_hash = 0;
 	DENTRY_T *ep;
 
 	for (i = order; i < num_entries; i++) {
 		ep = get_dentry_in_dir(sb, p_dir, entry+i, &sector);
 		if (!ep)
-			return -EIO;
+			goto err_out;
+
+		if (i == 1)
+			name_hash = le16_to_cpu(((STRM_DENTRY_T *)ep)->name_hash);
 
 		exfat_set_entry_type(ep, TYPE_DELETED);
 		if (dcache_modify(sb, sector))
-			return -EIO;
+			goto err_out;
 	}
 
+	dindex_del_entry(sb, p_dir, entry, order, num_entries, name_hash);
 	return 0;
+err_out:
+	dindex_forget(sb, p_dir->dir);
+	return -EIO;
 }
 
 static s32 __write_partial_entries_in_entry_set(struct super_block *sb,
@@ -761,6 +776,12 @@ static s32 exfat_find_dir_entry(struct super_block *sb, FILE_ID_T *fid,
 	if (IS_CLUS_FREE(p_dir->dir))
 		return -EIO;
 
+	/* large directories are looked up through their index */
+	dentry = dindex_find_dir_entry(sb, fid, p_dir, p_uniname, num_entries, type);
+	if (dentry != -EAGAIN)
+		return dentry;
+	dentry = 0;
+
 	dentries_per_clu = fsi->dentries_per_clu;
 
 	clu.dir = p_dir->dir;
@@ -1112,6 +1133,7 @@ void free_alloc_bmp(struct super_block *sb)
 	s32 i;
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 
+	fext_destroy(sb);
 	brelse(fsi->pbr_bh);
 
 	for (i = 0; i < fsi->map_sectors; i++)
@@ -1137,6 +1159,7 @@ static s32 set_alloc_bitmap(struct super_block *sb, u32 clu)
 
 	sector = CLUS_TO_SECT(fsi, fsi->map_clu) + i;
 	bitmap_set((unsigned long *)(fsi->vol_amap[i]->b_data), b, 1);
+	fext_mark_used(sb, clu + CLUS_BASE);
 
 	return write_sect(sb, sector, fsi->vol_amap[i], 0);
 } /* end of set_alloc_bitmap */
@@ -1160,6 +1183,7 @@ static s32 clr_alloc_bitmap(struct super_block *sb, u32 clu)
 	sector = CLUS_TO_SECT(fsi, fsi->map_clu) + i;
 
 	bitmap_clear((unsigned long *)(fsi->vol_amap[i]->b_data), b, 1);
+	fext_mark_free(sb, clu + CLUS_BASE);
 
 	ret = write_sect(sb, sector, fsi->vol_amap[i], 0);
 
@@ -1332,11 +1356,12 @@ out:
 	return ret;
 } /* end of exfat_free_cluster */
 
-static s32 exfat_alloc_cluster(struct super_block *sb, u32 num_alloc, CHAIN_T *p_chain, s32 dest)
+static s32 __exfat_alloc_cluster(struct super_block *sb, u32 num_alloc, CHAIN_T *p_chain, s32 dest,
+		u32 *src, u32 *num_frags)
 {
 	s32 ret = -ENOSPC;
 	u32 num_clusters = 0, total_cnt;
-	u32 hint_clu, new_clu, last_clu = CLUS_EOF;
+	u32 hint_clu, new_clu, goal, last_clu = CLUS_EOF;
 	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
 
 	total_cnt = fsi->num_clusters - CLUS_BASE;
@@ -1352,6 +1377,20 @@ static s32 exfat_alloc_cluster(struct super_block *sb, u32 num_alloc, CHAIN_T *p
 		return -ENOSPC;
 
 	hint_clu = p_chain->dir;
+
+	/* file data goes where the free extent tree suggests */
+	if (dest == ALLOC_COLD) {
+		goal = fext_alloc_goal(sb, hint_clu, num_alloc, src);
+		if (!IS_CLUS_EOF(goal) && (goal != hint_clu)) {
+			/* moved away from the end of the chain */
+			if (!IS_CLUS_EOF(hint_clu)) {
+				p_chain->flags = 0x01;
+				(*num_frags)++;
+			}
+			hint_clu = goal;
+		}
+	}
+
 	/* find new cluster */
 	if (IS_CLUS_EOF(hint_clu)) {
 		if (fsi->clu_srch_ptr < CLUS_BASE) {
@@ -1383,6 +1422,9 @@ static s32 exfat_alloc_cluster(struct super_block *sb, u32 num_alloc, CHAIN_T *p
 	p_chain->dir = CLUS_EOF;
 
 	while ((new_clu = test_alloc_bitmap(sb, hint_clu - CLUS_BASE)) != CLUS_EOF) {
+		if (new_clu != hint_clu)
+			(*num_frags)++;
+
 		if ((new_clu != hint_clu) && (p_chain->flags == 0x03)) {
 			if (exfat_chain_cont_cluster(sb, p_chain->dir, num_clusters)) {
 				ret = -EIO;
@@ -1442,6 +1484,19 @@ error:
 	if (num_clusters)
 		exfat_free_cluster(sb, p_chain, 0);
 	return ret;
+}
+
+static s32 exfat_alloc_cluster(struct super_block *sb, u32 num_alloc, CHAIN_T *p_chain, s32 dest)
+{
+	s32 ret;
+	u32 src = SDFAT_ALLOC_SCAN, num_frags = 0;
+	ktime_t start = ktime_get();
+
+	ret = __exfat_alloc_cluster(sb, num_alloc, p_chain, dest, &src, &num_frags);
+	if (!ret)
+		sdfat_statistics_set_alloc(src, num_alloc, num_frags,
+				ktime_us_delta(ktime_get(), start));
+	return ret;
 } /* end of exfat_alloc_cluster */
 
 static s32 exfat_count_used_clusters(struct super_block *sb, u32 *ret_count)
@@ -0,0 +1,544 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/************************************************************************/
+/*                                                                      */
+/*  PROJECT : exFAT & FAT12/16/32 File System                           */
+/*  FILE    : dirindex.c                                                */
+/*  PURPOSE : In-memory dentry index of large exFAT directories         */
+/*                                                                      */
+/*----------------------------------------------------------------------*/
+/*  NOTES                                                               */
+/*                                                                      */
+/*  A directory that holds at least DINDEX_MIN_DENTRIES dentries is     */
+/*  scanned once on lookup and gets an index of                          */
+/*   - the file dentries hashed by the name_hash of their stream entry  */
+/*   - a bitmap of the dentries in use, to place new entry sets         */
+/*  Afterwards lookups only read the entry sets whose hash matches and  */
+/*  a miss hands the first fitting free run to find_empty_entry()       */
+/*  through fid->hint_femp.  exfat_init_ext_entry() and                 */
+/*  exfat_delete_dir_entry() keep the index up to date; whenever that   */
+/*  fails the index is dropped and rebuilt by the next lookup.          */
+/*                                                                      */
+/*  Every function here runs under the volume lock (s_vlock).           */
+/*                                                                      */
+/************************************************************************/
+
+#include <linux/slab.h>
+#include <linux/bitmap.h>
+#include <linux/log2.h>
+#include "sdfat.h"
+#include "core.h"
+
+/* smaller directories are cheap enough to scan */
+#define DINDEX_MIN_DENTRIES	1024
+/* exFAT directories are at most 256MB */
+#define DINDEX_MAX_DENTRIES	((256 << 20) >> DENTRY_SIZE_BITS)
+/* indexed directories per volume */
+#define DINDEX_MAX_DIRS		4
+#define DINDEX_MIN_HASH_BITS	6
+#define DINDEX_MAX_HASH_BITS	12
+
+struct dindex_node {
+	struct hlist_node hnode;
+	s32 eidx;		/* index of the file dentry */
+	u16 name_hash;
+};
+
+struct dir_index {
+	struct list_head lru;
+	u32 dir;		/* first cluster of the directory */
+	u32 nr_slots;		/* dentries covered by used[] */
+	unsigned long *used;	/* bit set for every dentry in use */
+	u32 hash_bits;
+	struct hlist_head *hash;
+};
+
+struct dindex_root {
+	struct list_head lru;	/* most recently used first */
+	s32 nr_dirs;
+};
+
+static struct kmem_cache *dindex_cachep;
+
+s32 dindex_init(void)
+{
+	dindex_cachep = kmem_cache_create("sdfat_dindex_cache",
+				sizeof(struct dindex_node),
+				0, SLAB_RECLAIM_ACCOUNT|SLAB_MEM_SPREAD,
+				NULL);
+	if (!dindex_cachep)
+		return -ENOMEM;
+	return 0;
+}
+
+void dindex_shutdown(void)
+{
+	if (!dindex_cachep)
+		return;
+	kmem_cache_destroy(dindex_cachep);
+}
+
+static inline struct dindex_root *__dindex_root(struct super_block *sb)
+{
+	return (struct dindex_root *)SDFAT_SB(sb)->fsi.dindex;
+}
+
+static inline u32 __dindex_nr_slots(struct super_block *sb, CHAIN_T *p_dir)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	u64 nr_slots;
+
+	nr_slots = (u64)p_dir->size << (fsi->cluster_size_bits - DENTRY_SIZE_BITS);
+	if (nr_slots > DINDEX_MAX_DENTRIES)
+		return 0;
+	return (u32)nr_slots;
+}
+
+static inline struct hlist_head *__dindex_bucket(struct dir_index *di, u16 name_hash)
+{
+	return &di->hash[name_hash & ((1 << di->hash_bits) - 1)];
+}
+
+static s32 __dindex_insert(struct dir_index *di, s32 eidx, u16 name_hash)
+{
+	struct dindex_node *node;
+
+	node = kmem_cache_alloc(dindex_cachep, GFP_NOFS);
+	if (!node)
+		return -ENOMEM;
+
+	node->eidx = eidx;
+	node->name_hash = name_hash;
+	hlist_add_head(&node->hnode, __dindex_bucket(di, name_hash));
+	return 0;
+}
+
+static bool __dindex_remove(struct dir_index *di, s32 eidx, u16 name_hash)
+{
+	struct dindex_node *node;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(node, pos, __dindex_bucket(di, name_hash), hnode) {
+		if (node->eidx == eidx) {
+			hlist_del(&node->hnode);
+			kmem_cache_free(dindex_cachep, node);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void __dindex_free(struct dindex_root *root, struct dir_index *di)
+{
+	struct dindex_node *node;
+	struct hlist_node *pos, *n;
+	u32 i;
+
+	for (i = 0; i < (1 << di->hash_bits); i++) {
+		hlist_for_each_entry_safe(node, pos, n, &di->hash[i], hnode)
+			kmem_cache_free(dindex_cachep, node);
+	}
+
+	list_del(&di->lru);
+	root->nr_dirs--;
+
+	kfree(di->hash);
+	kfree(di->used);
+	kfree(di);
+}
+
+/* slots added to the directory since the scan are all free */
+static s32 __dindex_grow(struct dir_index *di, u32 nr_slots)
+{
+	unsigned long *used;
+	u32 old_longs = BITS_TO_LONGS(di->nr_slots);
+	u32 new_longs = BITS_TO_LONGS(nr_slots);
+
+	if (nr_slots <= di->nr_slots)
+		return 0;
+
+	if (new_longs > old_longs) {
+		used = krealloc(di->used, new_longs * sizeof(unsigned long),
+				GFP_NOFS | __GFP_NOWARN);
+		if (!used)
+			return -ENOMEM;
+
+		memset(used + old_longs, 0,
+			(new_longs - old_longs) * sizeof(unsigned long));
+		di->used = used;
+	}
+
+	di->nr_slots = nr_slots;
+	return 0;
+}
+
+static struct dir_index *__dindex_find(struct super_block *sb, u32 dir)
+{
+	struct dindex_root *root = __dindex_root(sb);
+	struct dir_index *di;
+
+	if (!root)
+		return NULL;
+
+	list_for_each_entry(di, &root->lru, lru) {
+		if (di->dir == dir)
+			return di;
+	}
+	return NULL;
+}
+
+static s32 __dindex_scan(struct super_block *sb, struct dir_index *di, CHAIN_T *p_dir)
+{
+	s32 i, dentry = 0, file_eidx = -1;
+	u32 entry_type;
+	CHAIN_T clu;
+	DENTRY_T *ep;
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+
+	clu.dir = p_dir->dir;
+	clu.size = p_dir->size;
+	clu.flags = p_dir->flags;
+
+	while (!IS_CLUS_EOF(clu.dir) && (dentry < di->nr_slots)) {
+		for (i = 0; i < fsi->dentries_per_clu; i++, dentry++) {
+			ep = get_dentry_in_dir(sb, &clu, i, NULL);
+			if (!ep)
+				return -EIO;
+
+			entry_type = fsi->fs_func->get_entry_type(ep);
+
+			/* nothing follows the first unused dentry */
+			if (entry_type == TYPE_UNUSED)
+				return 0;
+
+			if (entry_type == TYPE_DELETED) {
+				file_eidx = -1;
+				continue;
+			}
+
+			set_bit(dentry, di->used);
+
+			if ((entry_type == TYPE_FILE) || (entry_type == TYPE_DIR)) {
+				file_eidx = dentry;
+				continue;
+			}
+
+			if ((entry_type == TYPE_STREAM) && (file_eidx == dentry - 1)) {
+				STRM_DENTRY_T *strm_ep = (STRM_DENTRY_T *) ep;
+
+				if (__dindex_insert(di, file_eidx,
+						le16_to_cpu(strm_ep->name_hash)))
+					return -ENOMEM;
+			}
+			file_eidx = -1;
+		}
+
+		if (clu.flags == 0x03) {
+			if ((--clu.size) > 0)
+				clu.dir++;
+			else
+				clu.dir = CLUS_EOF;
+		} else {
+			if (get_next_clus_safe(sb, &clu.dir))
+				return -EIO;
+		}
+	}
+
+	return 0;
+}
+
+static struct dir_index *__dindex_build(struct super_block *sb, CHAIN_T *p_dir, u32 nr_slots)
+{
+	struct dindex_root *root = __dindex_root(sb);
+	struct dir_index *di;
+	u32 i;
+	s32 ret;
+
+	if (!root) {
+		root = kzalloc(sizeof(struct dindex_root), GFP_NOFS);
+		if (!root)
+			return ERR_PTR(-ENOMEM);
+		INIT_LIST_HEAD(&root->lru);
+		SDFAT_SB(sb)->fsi.dindex = root;
+	}
+
+	di = kzalloc(sizeof(struct dir_index), GFP_NOFS);
+	if (!di)
+		return ERR_PTR(-ENOMEM);
+
+	di->dir = p_dir->dir;
+	di->nr_slots = nr_slots;
+	/* about three dentries per file */
+	di->hash_bits = clamp_t(u32, ilog2(nr_slots / 3),
+				DINDEX_MIN_HASH_BITS, DINDEX_MAX_HASH_BITS);
+
+	di->hash = kmalloc(sizeof(struct hlist_head) << di->hash_bits, GFP_NOFS);
+	di->used = kzalloc(BITS_TO_LONGS(nr_slots) * sizeof(unsigned long),
+				GFP_NOFS | __GFP_NOWARN);
+	if (!di->hash || !di->used) {
+		kfree(di->hash);
+		kfree(di->used);
+		kfree(di);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	for (i = 0; i < (1 << di->hash_bits); i++)
+		INIT_HLIST_HEAD(&di->hash[i]);
+
+	if (root->nr_dirs >= DINDEX_MAX_DIRS)
+		__dindex_free(root, list_entry(root->lru.prev, struct dir_index, lru));
+
+	list_add(&di->lru, &root->lru);
+	root->nr_dirs++;
+
+	ret = __dindex_scan(sb, di, p_dir);
+	if (ret) {
+		__dindex_free(root, di);
+		return ERR_PTR(ret);
+	}
+
+	MMSG("%s: dir(0x%08x) %u dentries indexed\n", __func__, di->dir, nr_slots);
+	return di;
+}
+
+/*
+ * returns
+ *   1 : the entry set at eidx has the name
+ *   0 : it does not
+ *   -EIO : the entry set could not be read
+ */
+static s32 __dindex_match(struct super_block *sb, CHAIN_T *p_dir, s32 eidx,
+		UNI_NAME_T *p_uniname, u32 type)
+{
+	s32 i, j, name_len = 0, ret = 0;
+	u16 entry_uniname[16], *uniname = p_uniname->name, unichar;
+	u32 entry_type;
+	DENTRY_T *ep;
+	STRM_DENTRY_T *strm_ep;
+	NAME_DENTRY_T *name_ep;
+	ENTRY_SET_CACHE_T *es;
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+
+	es = get_dentry_set_in_dir(sb, p_dir, eidx, ES_ALL_ENTRIES, &ep);
+	if (!es)
+		return -EIO;
+
+	entry_type = fsi->fs_func->get_entry_type(ep);
+	if ((type != TYPE_ALL) && (type != entry_type))
+		goto out;
+
+	strm_ep = (STRM_DENTRY_T *)(ep + 1);
+	if ((le16_to_cpu(strm_ep->name_hash) != p_uniname->name_hash) ||
+			(strm_ep->name_len != p_uniname->name_len))
+		goto out;
+
+	for (i = 2; (i < es->num_entries) && (name_len < p_uniname->name_len); i++) {
+		if (fsi->fs_func->get_entry_type(ep + i) != TYPE_EXTEND)
+			goto out;
+
+		name_ep = (NAME_DENTRY_T *)(ep + i);
+		for (j = 0; j < 15; j++) {
+			entry_uniname[j] = le16_to_cpu(name_ep->unicode_0_14[j]);
+			if (entry_uniname[j] == 0x0)
+				break;
+		}
+		entry_uniname[j] = 0x0;
+
+		unichar = *(uniname + j);
+		*(uniname + j) = 0x0;
+		ret = nls_cmp_uniname(sb, uniname, entry_uniname);
+		*(uniname + j) = unichar;
+		if (ret) {
+			ret = 0;
+			goto out;
+		}
+
+		name_len += j;
+		uniname += 15;
+	}
+
+	ret = (name_len == p_uniname->name_len);
+out:
+	release_dentry_set(es);
+	return ret;
+}
+
+/* point fid->hint_femp at the first free run that fits num_entries */
+static void __dindex_set_hint_femp(struct super_block *sb, struct dir_index *di,
+		FILE_ID_T *fid, CHAIN_T *p_dir, s32 num_entries)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	HINT_FEMP_T *hint_femp = &fid->hint_femp;
+	u32 eidx, clu;
+
+	hint_femp->eidx = -1;
+
+	eidx = bitmap_find_next_zero_area(di->used, di->nr_slots, 0, num_entries, 0);
+	if (eidx + num_entries <= di->nr_slots) {
+		hint_femp->count = num_entries;
+	} else {
+		/*
+		 * The directory has to grow.  Hand over its free tail, or the
+		 * last dentry if there is none, so that search_empty_slot()
+		 * only looks at the end of the directory before extending it.
+		 */
+		eidx = di->nr_slots;
+		while ((eidx > 0) && !test_bit(eidx - 1, di->used))
+			eidx--;
+		hint_femp->count = di->nr_slots - eidx;
+		if (eidx == di->nr_slots)
+			eidx--;
+	}
+
+	if (walk_fat_chain(sb, p_dir, eidx << DENTRY_SIZE_BITS, &clu))
+		return;
+
+	hint_femp->cur.dir = clu;
+	hint_femp->cur.size = p_dir->size;
+	if (p_dir->flags == 0x03)
+		hint_femp->cur.size -= eidx >> (fsi->cluster_size_bits - DENTRY_SIZE_BITS);
+	hint_femp->cur.flags = p_dir->flags;
+	hint_femp->eidx = (s32)eidx;
+}
+
+/* return values of dindex_find_dir_entry()
+ * >= 0    : dir entry position with the name in dir
+ * -ENOENT : entry with the name does not exist, hint_femp is set
+ * -EIO    : I/O error
+ * -EAGAIN : the directory is not indexed, scan it instead
+ */
+s32 dindex_find_dir_entry(struct super_block *sb, FILE_ID_T *fid,
+		CHAIN_T *p_dir, UNI_NAME_T *p_uniname, s32 num_entries, u32 type)
+{
+	struct dir_index *di;
+	struct dindex_node *node;
+	struct hlist_node *pos;
+	u32 nr_slots;
+	s32 ret;
+
+	if (!SDFAT_SB(sb)->options.dir_index)
+		return -EAGAIN;
+
+	nr_slots = __dindex_nr_slots(sb, p_dir);
+	if (nr_slots < DINDEX_MIN_DENTRIES)
+		return -EAGAIN;
+
+	di = __dindex_find(sb, p_dir->dir);
+	if (di) {
+		list_move(&di->lru, &__dindex_root(sb)->lru);
+		if ((nr_slots < di->nr_slots) || __dindex_grow(di, nr_slots)) {
+			__dindex_free(__dindex_root(sb), di);
+			di = NULL;
+		}
+	}
+
+	if (!di) {
+		di = __dindex_build(sb, p_dir, nr_slots);
+		if (IS_ERR(di))
+			return (PTR_ERR(di) == -EIO) ? -EIO : -EAGAIN;
+	}
+
+	hlist_for_each_entry(node, pos, __dindex_bucket(di, p_uniname->name_hash), hnode) {
+		if (node->name_hash != p_uniname->name_hash)
+			continue;
+
+		ret = __dindex_match(sb, p_dir, node->eidx, p_uniname, type);
+		if (ret < 0) {
+			/* stale or unreadable, let the scan sort it out */
+			__dindex_free(__dindex_root(sb), di);
+			return -EAGAIN;
+		}
+		if (ret)
+			return node->eidx;
+	}
+
+	__dindex_set_hint_femp(sb, di, fid, p_dir, num_entries);
+
+	fid->hint_stat.clu = p_dir->dir;
+	fid->hint_stat.eidx = 0;
+	return -ENOENT;
+}
+
+/* an entry set of num_entries dentries was written at entry */
+void dindex_set_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entry,
+		s32 num_entries, u16 old_hash, u16 name_hash)
+{
+	struct dir_index *di = __dindex_find(sb, p_dir->dir);
+
+	if (!di)
+		return;
+
+	if (__dindex_grow(di, __dindex_nr_slots(sb, p_dir)) ||
+			(entry + num_entries > di->nr_slots))
+		goto drop;
+
+	/* renamed in place */
+	if (test_bit(entry, di->used) && !__dindex_remove(di, entry, old_hash))
+		goto drop;
+
+	bitmap_set(di->used, entry, num_entries);
+	if (__dindex_insert(di, entry, name_hash))
+		goto drop;
+	return;
+drop:
+	__dindex_free(__dindex_root(sb), di);
+}
+
+/* dentries [entry + order, entry + num_entries) were deleted */
+void dindex_del_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entry,
+		s32 order, s32 num_entries, u16 name_hash)
+{
+	struct dir_index *di = __dindex_find(sb, p_dir->dir);
+
+	if (!di)
+		return;
+
+	if (entry + num_entries > di->nr_slots)
+		goto drop;
+
+	if (!order && !__dindex_remove(di, entry, name_hash))
+		goto drop;
+
+	bitmap_clear(di->used, entry + order, num_entries - order);
+	return;
+drop:
+	__dindex_free(__dindex_root(sb), di);
+}
+
+/* the directory starting at dir is gone or its dentries are unknown */
+void dindex_forget(struct super_block *sb, u32 dir)
+{
+	struct dir_index *di = __dindex_find(sb, dir);
+
+	if (di)
+		__dindex_free(__dindex_root(sb), di);
+}
+
+void dindex_destroy(struct super_block *sb)
+{
+	struct dindex_root *root = __dindex_root(sb);
+
+	if (!root)
+		return;
+
+	while (!list_empty(&root->lru))
+		__dindex_free(root, list_first_entry(&root->lru, struct dir_index, lru));
+
+	kfree(root);
+	SDFAT_SB(sb)->fsi.dindex = NULL;
+}
+
+/* end of dirindex.c */
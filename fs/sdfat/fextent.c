@@ -0,0 +1,502 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/************************************************************************/
+/*                                                                      */
+/*  PROJECT : exFAT & FAT12/16/32 File System                           */
+/*  FILE    : fextent.c                                                 */
+/*  PURPOSE : Free extent tree for exFAT cluster allocation             */
+/*                                                                      */
+/*----------------------------------------------------------------------*/
+/*  NOTES                                                               */
+/*                                                                      */
+/*  The free runs of the allocation bitmap that are at least min_len    */
+/*  clusters long are kept in two rbtrees, one ordered by start cluster */
+/*  and one by length, built on mount and kept up to date by            */
+/*  set_alloc_bitmap() and clr_alloc_bitmap().  Shorter runs are left   */
+/*  to the first-fit bitmap scan; min_len grows with the volume so that */
+/*  the trees never hold more than about 64K extents.                   */
+/*                                                                      */
+/*  exfat_alloc_cluster() asks fext_alloc_goal() where file data should */
+/*  go.  A new chain starts in the smallest extent that also leaves it  */
+/*  room to grow, and that room is kept as a soft preallocation window  */
+/*  which other placements avoid and which doubles as the chain keeps   */
+/*  growing into it.  The bitmap stays authoritative: the allocator     */
+/*  only uses the goal as the place to start its bitmap search.         */
+/*                                                                      */
+/*  Every function here runs under the volume lock (s_vlock).           */
+/*                                                                      */
+/************************************************************************/
+
+#include <linux/slab.h>
+#include <linux/rbtree.h>
+#include <linux/log2.h>
+#include "sdfat.h"
+#include "core.h"
+
+/* free runs shorter than this are not tracked */
+#define FEXT_MIN_LEN		8
+/* upper bound on tracked extents, min_len is raised to respect it */
+#define FEXT_MAX_EXTENTS_BITS	16
+/* preallocation window of a growing chain, in bytes */
+#define FEXT_PREALLOC_MIN	(1 << 20)
+#define FEXT_PREALLOC_MAX	(64 << 20)
+#define FEXT_NR_WINDOWS		8
+/* extents tried by a best-fit search before giving up */
+#define FEXT_MAX_PROBE		16
+
+struct fext {
+	struct rb_node off_node;	/* ordered by start */
+	struct rb_node len_node;	/* ordered by len, then start */
+	u32 start;			/* first free cluster */
+	u32 len;
+};
+
+struct fext_window {
+	u32 next;	/* cluster the owning chain is expected to take next */
+	u32 end;	/* first cluster after the window */
+	u32 goal;	/* current window size */
+	u32 stamp;	/* for LRU replacement, 0 means unused */
+};
+
+struct fext_root {
+	struct rb_root off_root;
+	struct rb_root len_root;
+	u32 min_len;
+	u32 nr_extents;
+	u32 stamp;
+	struct fext_window win[FEXT_NR_WINDOWS];
+};
+
+static struct kmem_cache *fext_cachep;
+
+s32 fext_init(void)
+{
+	fext_cachep = kmem_cache_create("sdfat_fext_cache",
+				sizeof(struct fext),
+				0, SLAB_RECLAIM_ACCOUNT|SLAB_MEM_SPREAD,
+				NULL);
+	if (!fext_cachep)
+		return -ENOMEM;
+	return 0;
+}
+
+void fext_shutdown(void)
+{
+	if (!fext_cachep)
+		return;
+	kmem_cache_destroy(fext_cachep);
+}
+
+static inline struct fext_root *__fext_root(struct super_block *sb)
+{
+	return (struct fext_root *)SDFAT_SB(sb)->fsi.fext;
+}
+
+/* @clu is a cluster number, the allocation bitmap starts at CLUS_BASE */
+static inline bool __fext_is_free(struct super_block *sb, u32 clu)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	u32 i, b;
+
+	clu -= CLUS_BASE;
+	i = clu >> (sb->s_blocksize_bits + 3);
+	b = clu & (u32)((sb->s_blocksize << 3) - 1);
+
+	return !test_bit(b, (unsigned long *)(fsi->vol_amap[i]->b_data));
+}
+
+/*
+ * First bitmap index >= @idx below @total whose bit is clear (@free) or
+ * set (!@free), @total if there is none.
+ */
+static u32 __fext_find_bit(struct super_block *sb, u32 idx, u32 total, bool free)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	u32 bits = sb->s_blocksize_bits + 3;
+	u32 i, off, nbits, res;
+	unsigned long *map;
+
+	while (idx < total) {
+		i = idx >> bits;
+		off = idx & ((1 << bits) - 1);
+		nbits = min_t(u32, 1 << bits, total - (i << bits));
+		map = (unsigned long *)(fsi->vol_amap[i]->b_data);
+
+		if (free)
+			res = find_next_zero_bit(map, nbits, off);
+		else
+			res = find_next_bit(map, nbits, off);
+
+		if (res < nbits)
+			return (i << bits) + res;
+		idx = (i + 1) << bits;
+	}
+	return total;
+}
+
+static void __fext_insert_len(struct fext_root *root, struct fext *fe)
+{
+	struct rb_node **p = &root->len_root.rb_node, *parent = NULL;
+	struct fext *cur;
+
+	while (*p) {
+		parent = *p;
+		cur = rb_entry(parent, struct fext, len_node);
+		if ((fe->len < cur->len) ||
+			((fe->len == cur->len) && (fe->start < cur->start)))
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&fe->len_node, parent, p);
+	rb_insert_color(&fe->len_node, &root->len_root);
+}
+
+static s32 __fext_insert(struct fext_root *root, u32 start, u32 len)
+{
+	struct rb_node **p = &root->off_root.rb_node, *parent = NULL;
+	struct fext *fe, *cur;
+
+	fe = kmem_cache_alloc(fext_cachep, GFP_NOFS);
+	if (!fe)
+		return -ENOMEM;
+
+	fe->start = start;
+	fe->len = len;
+
+	while (*p) {
+		parent = *p;
+		cur = rb_entry(parent, struct fext, off_node);
+		if (start < cur->start)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&fe->off_node, parent, p);
+	rb_insert_color(&fe->off_node, &root->off_root);
+
+	__fext_insert_len(root, fe);
+	root->nr_extents++;
+	return 0;
+}
+
+static void __fext_erase(struct fext_root *root, struct fext *fe)
+{
+	rb_erase(&fe->off_node, &root->off_root);
+	rb_erase(&fe->len_node, &root->len_root);
+	root->nr_extents--;
+	kmem_cache_free(fext_cachep, fe);
+}
+
+/* the extent with the highest start <= @clu */
+static struct fext *__fext_lookup(struct fext_root *root, u32 clu)
+{
+	struct rb_node *n = root->off_root.rb_node;
+	struct fext *fe, *best = NULL;
+
+	while (n) {
+		fe = rb_entry(n, struct fext, off_node);
+		if (fe->start <= clu) {
+			best = fe;
+			n = n->rb_right;
+		} else {
+			n = n->rb_left;
+		}
+	}
+	return best;
+}
+
+static void __fext_free_all(struct fext_root *root)
+{
+	struct rb_node *n;
+
+	while ((n = rb_first(&root->off_root)))
+		__fext_erase(root, rb_entry(n, struct fext, off_node));
+}
+
+s32 fext_build(struct super_block *sb)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	struct fext_root *root;
+	u32 total = fsi->num_clusters - CLUS_BASE;
+	u32 idx = 0, end;
+
+	root = kzalloc(sizeof(struct fext_root), GFP_KERNEL);
+	if (!root)
+		return -ENOMEM;
+
+	root->off_root = RB_ROOT;
+	root->len_root = RB_ROOT;
+	root->min_len = max_t(u32, FEXT_MIN_LEN,
+				fsi->num_clusters >> FEXT_MAX_EXTENTS_BITS);
+
+	while (idx < total) {
+		idx = __fext_find_bit(sb, idx, total, true);
+		if (idx >= total)
+			break;
+		end = __fext_find_bit(sb, idx, total, false);
+
+		if ((end - idx >= root->min_len) &&
+			__fext_insert(root, idx + CLUS_BASE, end - idx)) {
+			__fext_free_all(root);
+			kfree(root);
+			return -ENOMEM;
+		}
+		idx = end;
+	}
+
+	fsi->fext = root;
+	MMSG("%s: %u free extents of %u+ clusters\n",
+		__func__, root->nr_extents, root->min_len);
+	return 0;
+}
+
+void fext_destroy(struct super_block *sb)
+{
+	struct fext_root *root = __fext_root(sb);
+
+	if (!root)
+		return;
+
+	__fext_free_all(root);
+	kfree(root);
+	SDFAT_SB(sb)->fsi.fext = NULL;
+}
+
+/* cluster @clu was taken out of the bitmap */
+void fext_mark_used(struct super_block *sb, u32 clu)
+{
+	struct fext_root *root = __fext_root(sb);
+	struct fext *fe;
+	u32 end;
+
+	if (!root)
+		return;
+
+	fe = __fext_lookup(root, clu);
+	if (!fe || (clu >= fe->start + fe->len))
+		return;
+
+	end = fe->start + fe->len;
+
+	/* what is left right of @clu becomes an extent of its own */
+	if ((end - (clu + 1) >= root->min_len) && (clu != fe->start))
+		__fext_insert(root, clu + 1, end - (clu + 1));
+
+	rb_erase(&fe->len_node, &root->len_root);
+	if (clu == fe->start) {
+		/* shrinking from the front keeps the order by start */
+		fe->start++;
+		fe->len--;
+	} else {
+		fe->len = clu - fe->start;
+	}
+
+	if (fe->len < root->min_len) {
+		rb_erase(&fe->off_node, &root->off_root);
+		root->nr_extents--;
+		kmem_cache_free(fext_cachep, fe);
+		return;
+	}
+	__fext_insert_len(root, fe);
+}
+
+/* cluster @clu was given back to the bitmap */
+void fext_mark_free(struct super_block *sb, u32 clu)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	struct fext_root *root = __fext_root(sb);
+	struct fext *fe;
+	u32 left = clu, right = clu + 1;
+
+	if (!root)
+		return;
+
+	fe = __fext_lookup(root, clu);
+	if (fe && (clu < fe->start + fe->len))
+		return;
+
+	/* merge with the extents on either side, or count short free runs */
+	if (fe && (fe->start + fe->len == clu)) {
+		left = fe->start;
+		__fext_erase(root, fe);
+	} else {
+		while ((left > CLUS_BASE) && (clu - left < root->min_len) &&
+				__fext_is_free(sb, left - 1))
+			left--;
+	}
+
+	fe = __fext_lookup(root, clu + 1);
+	if (fe && (fe->start == clu + 1)) {
+		right = fe->start + fe->len;
+		__fext_erase(root, fe);
+	} else {
+		while ((right < fsi->num_clusters) &&
+				(right - (clu + 1) < root->min_len) &&
+				__fext_is_free(sb, right))
+			right++;
+	}
+
+	if (right - left >= root->min_len)
+		__fext_insert(root, left, right - left);
+}
+
+/* window the chain ending right before @hint grows into, if any */
+static struct fext_window *__fext_own_window(struct fext_root *root, u32 hint)
+{
+	s32 i;
+
+	for (i = 0; i < FEXT_NR_WINDOWS; i++) {
+		if (root->win[i].stamp && (root->win[i].next == hint))
+			return &root->win[i];
+	}
+	return NULL;
+}
+
+static struct fext_window *__fext_new_window(struct fext_root *root)
+{
+	struct fext_window *w = &root->win[0];
+	s32 i;
+
+	for (i = 1; i < FEXT_NR_WINDOWS; i++) {
+		if (root->win[i].stamp < w->stamp)
+			w = &root->win[i];
+	}
+	return w;
+}
+
+/*
+ * First cluster >= @start where @len clusters fit before @end without
+ * touching the windows of other chains, CLUS_EOF if there is none.
+ */
+static u32 __fext_skip_windows(struct fext_root *root, struct fext_window *own,
+		u32 start, u32 end, u32 len)
+{
+	struct fext_window *w;
+	s32 i, moved;
+
+	do {
+		moved = 0;
+		for (i = 0; i < FEXT_NR_WINDOWS; i++) {
+			w = &root->win[i];
+			if (!w->stamp || (w == own))
+				continue;
+			if ((w->next < start + len) && (start < w->end)) {
+				start = w->end;
+				moved = 1;
+			}
+		}
+	} while (moved && (start + len <= end));
+
+	return (start + len <= end) ? start : CLUS_EOF;
+}
+
+/* smallest extent that holds @len clusters clear of other windows */
+static u32 __fext_best_fit(struct fext_root *root, struct fext_window *own, u32 len)
+{
+	struct rb_node *n = root->len_root.rb_node;
+	struct fext *fe, *best = NULL;
+	u32 clu;
+	s32 probe;
+
+	while (n) {
+		fe = rb_entry(n, struct fext, len_node);
+		if (fe->len >= len) {
+			best = fe;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
+		}
+	}
+
+	for (probe = 0; best && (probe < FEXT_MAX_PROBE); probe++) {
+		clu = __fext_skip_windows(root, own, best->start,
+				best->start + best->len, len);
+		if (!IS_CLUS_EOF(clu))
+			return clu;
+
+		n = rb_next(&best->len_node);
+		best = n ? rb_entry(n, struct fext, len_node) : NULL;
+	}
+	return CLUS_EOF;
+}
+
+/*
+ * Where to start allocating @num_alloc clusters of file data.
+ * @hint is the cluster right after the chain being extended, CLUS_EOF
+ * for a new chain.
+ *
+ * returns CLUS_EOF when the first-fit bitmap scan should decide, and
+ * sets *src to SDFAT_ALLOC_CONTIG or SDFAT_ALLOC_BESTFIT otherwise.
+ */
+u32 fext_alloc_goal(struct super_block *sb, u32 hint, u32 num_alloc, u32 *src)
+{
+	FS_INFO_T *fsi = &(SDFAT_SB(sb)->fsi);
+	struct fext_root *root = __fext_root(sb);
+	struct fext_window *w = NULL;
+	u32 goal, clu, min_goal, max_goal;
+	struct rb_node *n;
+
+	if (!root)
+		return CLUS_EOF;
+
+	min_goal = max_t(u32, FEXT_PREALLOC_MIN >> fsi->cluster_size_bits, 1);
+	max_goal = max_t(u32, FEXT_PREALLOC_MAX >> fsi->cluster_size_bits, 1);
+
+	if (!IS_CLUS_EOF(hint)) {
+		w = __fext_own_window(root, hint);
+
+		/* growing in place beats anything else */
+		if ((hint < fsi->num_clusters) && __fext_is_free(sb, hint)) {
+			if (w) {
+				w->next = hint + num_alloc;
+				w->stamp = ++root->stamp;
+				if (w->end < w->next + (w->goal >> 1)) {
+					w->goal = min(w->goal << 1, max_goal);
+					w->end = w->next + w->goal;
+				}
+			}
+			*src = SDFAT_ALLOC_CONTIG;
+			return hint;
+		}
+	}
+
+	/* a chain that had to move gets twice the room it had */
+	goal = w ? min(w->goal << 1, max_goal) : min_goal;
+	goal = max3(goal, num_alloc, root->min_len);
+
+	clu = __fext_best_fit(root, w, goal);
+	if (IS_CLUS_EOF(clu)) {
+		/* no room to grow, at least keep this allocation in one piece */
+		n = rb_last(&root->len_root);
+		if (!n || (rb_entry(n, struct fext, len_node)->len < num_alloc))
+			return CLUS_EOF;
+		clu = rb_entry(n, struct fext, len_node)->start;
+		goal = num_alloc;
+	}
+
+	if (!w)
+		w = __fext_new_window(root);
+	w->next = clu + num_alloc;
+	w->end = clu + goal;
+	w->goal = goal;
+	w->stamp = ++root->stamp;
+
+	*src = SDFAT_ALLOC_BESTFIT;
+	return clu;
+}
+
+/* end of fextent.c */
@@ -4349,6 +4349,8 @@ static int __sdfat_show_options(struct seq_file *m, struct super_block *sb)
 		seq_puts(m, ",errors=remount-ro");
 	if (opts->discard)
 		seq_puts(m, ",discard");
+	if (!opts->dir_index)
+		seq_puts(m, ",nodirindex");
 
 	return 0;
 }
@@ -4533,6 +4535,7 @@ enum {
 	Opt_discard,
 	Opt_fs,
 	Opt_adj_req,
+	Opt_nodirindex,
 #ifdef CONFIG_SDFAT_USE_FOR_VFAT
 	Opt_shortname_lower,
 	Opt_shortname_win95,
@@ -4567,6 +4570,7 @@ static const match_table_t sdfat_tokens = {
 	{Opt_discard, "discard"},
 	{Opt_fs, "fs=%s"},
 	{Opt_adj_req, "adj_req"},
+	{Opt_nodirindex, "nodirindex"},
 #ifdef CONFIG_SDFAT_USE_FOR_VFAT
 	{Opt_shortname_lower, "shortname=lower"},
 	{Opt_shortname_win95, "shortname=win95"},
@@ -4601,6 +4605,7 @@ static int parse_options(struct super_block *sb, char *options, int silent,
 	opts->symlink = 0;
 	opts->errors = SDFAT_ERRORS_RO;
 	opts->discard = 0;
+	opts->dir_index = 1;
 	*debug = 0;
 
 	if (!options)
@@ -4739,6 +4744,9 @@ static int parse_options(struct super_block *sb, char *options, int silent,
 			IMSG("adjust request config is not enabled. ignore\n");
 #endif
 			break;
+		case Opt_nodirindex:
+			opts->dir_index = 0;
+			break;
 #ifdef CONFIG_SDFAT_USE_FOR_VFAT
 		case Opt_shortname_lower:
 		case Opt_shortname_win95:
@@ -128,6 +128,7 @@ struct sdfat_mount_options {
 	unsigned char discard;      /* flag on if -o dicard specified and device support discard() */
 	unsigned char fs_type;      /* fs_type that user specified */
 	unsigned short adj_req;     /* support aligned mpage write */
+	unsigned char dir_index;    /* index large directories (exFAT) */
 };
 
 #define SDFAT_HASH_BITS    8
@@ -302,6 +303,14 @@ static inline void sdfat_save_attr(struct inode *inode, u32 attr)
 }
 
 /* sdfat/statistics.c */
+/* where exfat_alloc_cluster() placed an allocation */
+enum {
+	SDFAT_ALLOC_CONTIG,	/* right after the chain it extends */
+	SDFAT_ALLOC_BESTFIT,	/* best fit from the free extent tree */
+	SDFAT_ALLOC_SCAN,	/* first fit from the bitmap scan */
+	SDFAT_ALLOC_SRC_MAX
+};
+
 /* bigdata function */
 #ifdef CONFIG_SDFAT_STATISTICS
 extern int sdfat_statistics_init(struct kset *sdfat_kset);
@@ -313,6 +322,7 @@ extern void sdfat_statistics_set_create(u8 flags);
 extern void sdfat_statistics_set_rw(u8 flags, u32 clu_offset, s32 create);
 extern void sdfat_statistics_set_trunc(u8 flags, CHAIN_T *clu);
 extern void sdfat_statistics_set_vol_size(struct super_block *sb);
+extern void sdfat_statistics_set_alloc(u32 src, u32 num_alloc, u32 num_frags, s64 lat_us);
 #else
 static inline int sdfat_statistics_init(struct kset *sdfat_kset)
 {
@@ -326,6 +336,7 @@ static inline void sdfat_statistics_set_create(u8 flags) {};
 static inline void sdfat_statistics_set_rw(u8 flags, u32 clu_offset, s32 create) {};
 static inline void sdfat_statistics_set_trunc(u8 flags, CHAIN_T *clu) {};
 static inline void sdfat_statistics_set_vol_size(struct super_block *sb) {};
+static inline void sdfat_statistics_set_alloc(u32 src, u32 num_alloc, u32 num_frags, s64 lat_us) {};
 #endif
 
 /* sdfat/nls.c */
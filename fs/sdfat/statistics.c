@@ -35,12 +35,26 @@ enum {
 	SDFAT_VOL_MAX
 };
 
+enum {
+	SDFAT_ALAT_10US,
+	SDFAT_ALAT_100US,
+	SDFAT_ALAT_1MS,
+	SDFAT_ALAT_10MS,
+	SDFAT_ALAT_SLOW,
+	SDFAT_ALAT_MAX
+};
+
 static struct sdfat_statistics {
 	u32 clus_vfat[SDFAT_VF_CLUS_MAX];
 	u32 clus_exfat[SDFAT_EF_CLUS_MAX];
 	u32 mnt_cnt[SDFAT_MNT_MAX];
 	u32 nofat_op[SDFAT_OP_MAX];
 	u32 vol_size[SDFAT_VOL_MAX];
+	u32 alloc_src[SDFAT_ALLOC_SRC_MAX];
+	u32 alloc_clus;
+	u32 alloc_frag;
+	u32 alloc_lat[SDFAT_ALAT_MAX];
+	u32 alloc_lat_max;
 } statistics;
 
 static struct kset *sdfat_statistics_kset;
@@ -128,11 +142,41 @@ static ssize_t vol_size_show(struct kobject *kobj,
 			statistics.vol_size[SDFAT_VOL_XTB]);
 }
 
+static ssize_t alloc_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buff)
+{
+	return snprintf(buff, PAGE_SIZE, "\"ALLOC_CONTIG_I\":\"%u\","
+			"\"ALLOC_BESTFIT_I\":\"%u\",\"ALLOC_SCAN_I\":\"%u\","
+			"\"ALLOC_CLUS_I\":\"%u\",\"ALLOC_FRAG_I\":\"%u\"\n",
+			statistics.alloc_src[SDFAT_ALLOC_CONTIG],
+			statistics.alloc_src[SDFAT_ALLOC_BESTFIT],
+			statistics.alloc_src[SDFAT_ALLOC_SCAN],
+			statistics.alloc_clus,
+			statistics.alloc_frag);
+}
+
+static ssize_t alloc_lat_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buff)
+{
+	return snprintf(buff, PAGE_SIZE, "\"ALAT_10US_I\":\"%u\","
+			"\"ALAT_100US_I\":\"%u\",\"ALAT_1MS_I\":\"%u\","
+			"\"ALAT_10MS_I\":\"%u\",\"ALAT_SLOW_I\":\"%u\","
+			"\"ALAT_MAX_US_I\":\"%u\"\n",
+			statistics.alloc_lat[SDFAT_ALAT_10US],
+			statistics.alloc_lat[SDFAT_ALAT_100US],
+			statistics.alloc_lat[SDFAT_ALAT_1MS],
+			statistics.alloc_lat[SDFAT_ALAT_10MS],
+			statistics.alloc_lat[SDFAT_ALAT_SLOW],
+			statistics.alloc_lat_max);
+}
+
 static struct kobj_attribute vfat_cl_attr = __ATTR_RO(vfat_cl);
 static struct kobj_attribute exfat_cl_attr = __ATTR_RO(exfat_cl);
 static struct kobj_attribute mount_attr = __ATTR_RO(mount);
 static struct kobj_attribute nofat_op_attr = __ATTR_RO(nofat_op);
 static struct kobj_attribute vol_size_attr = __ATTR_RO(vol_size);
+static struct kobj_attribute alloc_attr = __ATTR_RO(alloc);
+static struct kobj_attribute alloc_lat_attr = __ATTR_RO(alloc_lat);
 
 static struct attribute *attributes_statistics[] = {
 	&vfat_cl_attr.attr,
@@ -140,6 +184,8 @@ static struct attribute *attributes_statistics[] = {
 	&mount_attr.attr,
 	&nofat_op_attr.attr,
 	&vol_size_attr.attr,
+	&alloc_attr.attr,
+	&alloc_lat_attr.attr,
 	NULL,
 };
 
@@ -279,3 +325,29 @@ void sdfat_statistics_set_vol_size(struct super_block *sb)
 	else
 		statistics.vol_size[SDFAT_VOL_XTB]++;
 }
+
+/* src : SDFAT_ALLOC_* placement of the allocation
+ * num_frags : times the chain had to jump to a non-adjacent cluster
+ * lat_us : time spent in the allocator
+ */
+void sdfat_statistics_set_alloc(u32 src, u32 num_alloc, u32 num_frags, s64 lat_us)
+{
+	if (src < SDFAT_ALLOC_SRC_MAX)
+		statistics.alloc_src[src]++;
+	statistics.alloc_clus += num_alloc;
+	statistics.alloc_frag += num_frags;
+
+	if (lat_us < 10)
+		statistics.alloc_lat[SDFAT_ALAT_10US]++;
+	else if (lat_us < 100)
+		statistics.alloc_lat[SDFAT_ALAT_100US]++;
+	else if (lat_us < 1000)
+		statistics.alloc_lat[SDFAT_ALAT_1MS]++;
+	else if (lat_us < 10000)
+		statistics.alloc_lat[SDFAT_ALAT_10MS]++;
+	else
+		statistics.alloc_lat[SDFAT_ALAT_SLOW]++;
+
+	if (lat_us > statistics.alloc_lat_max)
+		statistics.alloc_lat_max = (u32)lat_us;
+}
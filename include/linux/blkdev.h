@@ -29,6 +29,7 @@ struct request_queue;
 struct elevator_queue;
 struct request_pm_state;
 struct blk_trace;
+struct blk_staging;
 struct request;
 struct sg_io_hdr;
 struct bsg_job;
@@ -303,6 +304,12 @@ struct request_queue {
 	 */
 	struct delayed_work	delay_work;
 
+	/*
+	 * Per-cpu request staging, see blk_staging_add()
+	 */
+	struct blk_staging __percpu *staging;
+	struct delayed_work	staging_work;
+
 	struct backing_dev_info	backing_dev_info;
 
 	/*
@@ -432,6 +439,7 @@ struct request_queue {
 #define QUEUE_FLAG_SAME_FORCE  18	/* force complete on same CPU */
 #define QUEUE_FLAG_SANITIZE    19	/* supports SANITIZE */
 #define QUEUE_FLAG_FAST        23	/* fast block device (e.g. ram based) */
+#define QUEUE_FLAG_STAGING     24	/* stage async requests per cpu */
 
 #define QUEUE_FLAG_DEFAULT	((1 << QUEUE_FLAG_IO_STAT) |		\
 				 (1 << QUEUE_FLAG_STACKABLE)	|	\
@@ -515,6 +523,7 @@ static inline void queue_flag_clear(unsigned int flag, struct request_queue *q)
 #define blk_queue_secdiscard(q)	(blk_queue_discard(q) && \
 	test_bit(QUEUE_FLAG_SECDISCARD, &(q)->queue_flags))
 #define blk_queue_fast(q)	test_bit(QUEUE_FLAG_FAST, &(q)->queue_flags)
+#define blk_queue_staging(q)	test_bit(QUEUE_FLAG_STAGING, &(q)->queue_flags)
 
 #define blk_noretry_request(rq) \
 	((rq)->cmd_flags & (REQ_FAILFAST_DEV|REQ_FAILFAST_TRANSPORT| \
@@ -1201,6 +1201,18 @@ struct ff_effect {
 #include <linux/timer.h>
 #include <linux/mod_devicetable.h>
 
+/**
+ * struct input_value - input event in its in-kernel form
+ * @type: type of value (EV_KEY, EV_ABS, etc)
+ * @code: the value code
+ * @value: the value
+ */
+struct input_value {
+	__u16 type;
+	__u16 code;
+	__s32 value;
+};
+
 /**
  * struct input_dev - represents an input device
  * @name: name of the device
@@ -1278,6 +1290,10 @@ struct ff_effect {
  * @going_away: marks devices that are in a middle of unregistering and
  *	causes input_open_device*() fail with -ENODEV.
  * @sync: set to %true when there were no new events since last EV_SYN
+ * @num_vals: number of events queued in @vals
+ * @max_vals: size of @vals
+ * @vals: events of the frame being collected, handed to the input
+ *	handlers on SYN_REPORT
  * @dev: driver model's view of this device
  * @h_list: list of input handles associated with the device. When
  *	accessing the list dev->mutex must be held
@@ -1347,6 +1363,10 @@ struct input_dev {
 
 	bool sync;
 
+	unsigned int num_vals;
+	unsigned int max_vals;
+	struct input_value *vals;
+
 	struct device dev;
 
 	struct list_head	h_list;
@@ -1411,6 +1431,9 @@ struct input_handle;
  * @event: event handler. This method is being called by input core with
  *	interrupts disabled and dev->event_lock spinlock held and so
  *	it may not sleep
+ * @events: frame event handler. If set, it is called instead of @event
+ *	with all events between two SYN_REPORTs, the SYN_REPORT included.
+ *	Same locking as @event
  * @filter: similar to @event; separates normal event handlers from
  *	"filters".
  * @match: called after comparing device's id with handler's id_table
@@ -1447,6 +1470,8 @@ struct input_handler {
 	void *private;
 
 	void (*event)(struct input_handle *handle, unsigned int type, unsigned int code, int value);
+	void (*events)(struct input_handle *handle,
+		       const struct input_value *vals, unsigned int count);
 	bool (*filter)(struct input_handle *handle, unsigned int type, unsigned int code, int value);
 	bool (*match)(struct input_handler *handler, struct input_dev *dev);
 	int (*connect)(struct input_handler *handler, struct input_dev *dev, const struct input_device_id *id);
@@ -241,7 +241,20 @@ typedef struct journal_superblock_s
 	__be32	s_max_trans_data;	/* Limit of data blocks per trans. */
 
 /* 0x0050 */
-	__u32	s_padding[44];
+	__u32	s_padding[40];
+
+/*
+ * 0x00F0
+ * Fast commit area, valid with JBD2_FEATURE_INCOMPAT_FC_AREA.  This
+ * format is not the upstream fast commit one: the fields are kept clear
+ * of the offsets upstream assigned from 0x0050 on and of its checksum
+ * at 0x00FC.
+ */
+	__be32	s_fc_area_blks;		/* Nr of blocks in fast commit area */
+	__be32	s_fc_replay;		/* Fast commit replay pending */
+	__be32	s_fc_replay_tid;	/* Tid of fast commits to replay */
+/* 0x00FC */
+	__u32	s_padding2;
 
 /* 0x0100 */
 	__u8	s_users[16*48];		/* ids of all fs'es sharing the log */
@@ -263,13 +276,23 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_REVOKE		0x00000001
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
+/*
+ * The fast commit area at the end of the log, see fs/ext4/fast_commit.h
+ * for the record format.  Upstream's FAST_COMMIT (0x20) is a different,
+ * incompatible format and is not supported.
+ */
+#define JBD2_FEATURE_INCOMPAT_FC_AREA		0x00010000
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
 #define JBD2_KNOWN_ROCOMPAT_FEATURES	0
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
-					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)
+					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
+					JBD2_FEATURE_INCOMPAT_FC_AREA)
+
+/* Default size of the fast commit area, in journal blocks */
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS	256
 
 #ifdef __KERNEL__
 
@@ -925,6 +948,23 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/*
+	 * Fast commit area: j_fc_blocks blocks starting at j_fc_first,
+	 * past the end of the circular log (j_last).  Zero j_fc_blocks
+	 * means the journal has no fast commit area.  [j_state_lock]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_blocks;
+
+	/* Wait queue for a fast commit to finish */
+	wait_queue_head_t	j_fc_wait;
+
+	/*
+	 * Transaction the fast commits found in the area belong to, valid
+	 * while JBD2_FC_REPLAY is set.
+	 */
+	tid_t			j_fc_replay_tid;
+
 	/*
 	 * Journal statistics
 	 */
@@ -955,6 +995,9 @@ struct journal_s
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* A fast commit is being
+						 * written */
+#define JBD2_FC_REPLAY	0x200	/* Fast commits are waiting to be replayed */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1103,6 +1146,13 @@ extern int	   jbd2_journal_errno      (journal_t *);
 extern void	   jbd2_journal_ack_err    (journal_t *);
 extern int	   jbd2_journal_clear_err  (journal_t *);
 extern int	   jbd2_journal_bmap(journal_t *, unsigned long, unsigned long long *);
+extern int	   jbd2_fc_init(journal_t *, unsigned long);
+extern int	   jbd2_fc_release(journal_t *);
+extern int	   jbd2_fc_get_buf(journal_t *, unsigned long,
+				   struct buffer_head **);
+extern int	   jbd2_fc_begin_commit(journal_t *, tid_t);
+extern void	   jbd2_fc_end_commit(journal_t *);
+extern int	   jbd2_fc_end_replay(journal_t *);
 extern int	   jbd2_journal_force_commit(journal_t *);
 extern int	   jbd2_journal_file_inode(handle_t *handle, struct jbd2_inode *inode);
 extern int	   jbd2_journal_begin_ordered_truncate(journal_t *journal,
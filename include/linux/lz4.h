@@ -292,6 +292,20 @@ int LZ4_decompress_fast(const char *source, char *dest, int originalSize);
 int LZ4_decompress_safe(const char *source, char *dest, int compressedSize,
 	int maxDecompressedSize);
 
+/*
+ * LZ4_decompress_safe() picks one of these at runtime.  They are exported
+ * for the equivalence and benchmark test in lib/test-lz4.c; the NEON
+ * variant falls back to the scalar one when NEON can't be used.
+ */
+int LZ4_decompress_safe_scalar(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize);
+#ifdef CONFIG_LZ4_DECOMPRESS_NEON
+int LZ4_decompress_safe_neon(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize);
+int LZ4_decompress_safe_neon_core(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize);
+#endif
+
 /**
  * LZ4_decompress_safe_partial() - Decompress a block of size 'compressedSize'
  *	at position 'source' into buffer 'dest'
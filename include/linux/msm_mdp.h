@@ -584,11 +584,13 @@ struct mdp_buf_fence {
 };
 
 #define MDP_DISPLAY_COMMIT_OVERLAY 0x00000001
+#define MDP_DISPLAY_COMMIT_ROI     0x00000002	/* roi holds dirty region */
 
 struct mdp_display_commit {
 	uint32_t flags;
 	uint32_t wait_for_finish;
 	struct fb_var_screeninfo var;
+	struct mdp_rect roi;	/* union of dirty rects, panel coordinates */
 };
 
 struct mdp_page_protection {
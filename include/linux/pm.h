@@ -516,6 +516,7 @@ struct dev_pm_info {
 	struct completion	completion;
 	struct wakeup_source	*wakeup;
 	bool			wakeup_path:1;
+	s64			resume_usecs;	/* last system resume */
 #else
 	unsigned int		should_wakeup:1;
 #endif
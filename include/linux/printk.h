@@ -127,6 +127,7 @@ extern bool printk_timed_ratelimit(unsigned long *caller_jiffies,
 				   unsigned int interval_msec);
 
 extern int printk_delay_msec;
+extern unsigned long printk_max_latency_ns;
 extern int dmesg_restrict;
 extern int kptr_restrict;
 
@@ -0,0 +1,31 @@
+/* include/linux/uid_cputime.h
+ *
+ * Copyright (C) 2014 - 2015 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef _LINUX_UID_CPUTIME_H
+#define _LINUX_UID_CPUTIME_H
+
+#include <linux/types.h>
+#include <asm/cputime.h>
+
+struct task_struct;
+
+#ifdef CONFIG_UID_CPUTIME
+void uid_cputime_account(struct task_struct *p, cputime_t cputime, bool user);
+#else
+static inline void uid_cputime_account(struct task_struct *p,
+				       cputime_t cputime, bool user) {}
+#endif
+
+#endif /* _LINUX_UID_CPUTIME_H */
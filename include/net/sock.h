@@ -253,6 +253,7 @@ struct cg_proto;
   *	@sk_send_head: front of stuff to transmit
   *	@sk_security: used by security modules
   *	@sk_mark: generic packet mark
+  *	@sk_uid_stat: uid_stat entry of the last uid doing TCP I/O on it
   *	@sk_classid: this socket's cgroup classid
   *	@sk_cgrp: this socket's cgroup-specific proto data
   *	@sk_write_pending: a write to stream socket waits to start
@@ -374,6 +375,9 @@ struct sock {
 #endif
 	__u32			sk_mark;
 	kuid_t			sk_uid;
+#ifdef CONFIG_UID_STAT
+	struct uid_stat		*sk_uid_stat;
+#endif
 	u32			sk_classid;
 	struct cg_proto		*sk_cgrp;
 	void			(*sk_state_change)(struct sock *sk);
@@ -62,6 +62,8 @@
 #include <linux/ptrace.h>
 #include <linux/hugetlb.h>
 #include <linux/freezer.h>
+#include <linux/log2.h>
+#include <linux/moduleparam.h>
 
 #include <asm/futex.h>
 
@@ -71,6 +73,22 @@ int __read_mostly futex_cmpxchg_enabled;
 
 #define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
 
+/*
+ * bounds of the per-mm table for PROCESS_PRIVATE futexes; it is sized
+ * once, often while the process is still single threaded (zygote
+ * children), so it is never smaller than the global table
+ */
+#define FUTEX_PRIVATE_MIN_BITS	FUTEX_HASHBITS
+#define FUTEX_PRIVATE_MAX_BITS	10
+
+/*
+ * Hash PROCESS_PRIVATE futexes into a table of their own mm, so that
+ * unrelated processes do not contend on the global bucket locks.  Only
+ * affects processes that have not used a private futex yet.
+ */
+static bool futex_private_hash = !CONFIG_BASE_SMALL;
+core_param(futex_private_hash, futex_private_hash, bool, 0644);
+
 /*
  * Futex flags used to encode options to functions and preserve them across
  * restarts.
@@ -152,15 +170,85 @@ struct futex_hash_bucket {
 
 static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
 
+struct futex_hash {
+	unsigned long mask;
+	struct futex_hash_bucket *queues;
+};
+
+static struct futex_hash futex_global_hash = {
+	.mask	= (1 << FUTEX_HASHBITS) - 1,
+	.queues	= futex_queues,
+};
+
+/*
+ * Set up mm->futex_hash on the first private futex operation of the
+ * process, before any of its private futexes is hashed.  The choice is
+ * final: a mm that falls back to the global table keeps using it, or
+ * waiters and wakers could end up on different tables.
+ */
+static void futex_private_hash_alloc(struct mm_struct *mm)
+{
+	struct futex_hash *fh = &futex_global_hash;
+	unsigned int nr, i;
+
+	if (futex_private_hash) {
+		nr = 4 * max_t(unsigned int, get_nr_threads(current),
+			       num_possible_cpus());
+		nr = clamp_t(unsigned int, roundup_pow_of_two(nr),
+			     1 << FUTEX_PRIVATE_MIN_BITS,
+			     1 << FUTEX_PRIVATE_MAX_BITS);
+
+		fh = kmalloc(sizeof(*fh) + nr * sizeof(*fh->queues),
+			     GFP_KERNEL | __GFP_NOWARN);
+		if (fh) {
+			fh->mask = nr - 1;
+			fh->queues = (struct futex_hash_bucket *)(fh + 1);
+			for (i = 0; i < nr; i++) {
+				plist_head_init(&fh->queues[i].chain);
+				spin_lock_init(&fh->queues[i].lock);
+			}
+		} else {
+			fh = &futex_global_hash;
+		}
+	}
+
+	if (cmpxchg(&mm->futex_hash, NULL, fh) != NULL &&
+	    fh != &futex_global_hash)
+		kfree(fh);
+}
+
+/**
+ * futex_private_hash_free() - Release the private futex table of a mm
+ * @mm:		the mm being freed
+ */
+void futex_private_hash_free(struct mm_struct *mm)
+{
+	if (mm->futex_hash != &futex_global_hash)
+		kfree(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+
 /*
  * We hash on the keys returned from get_futex_key (see below).
+ * PROCESS_PRIVATE keys go to the table of their mm.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_hash *fh = &futex_global_hash;
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+
+	if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED)) &&
+	    key->private.mm) {
+		struct futex_hash *mfh = ACCESS_ONCE(key->private.mm->futex_hash);
+
+		if (mfh) {
+			smp_read_barrier_depends();
+			fh = mfh;
+		}
+	}
+	return &fh->queues[hash & fh->mask];
 }
 
 /*
@@ -263,6 +351,8 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 	 *        but access_ok() should be faster than find_vma()
 	 */
 	if (!fshared) {
+		if (unlikely(mm && !mm->futex_hash))
+			futex_private_hash_alloc(mm);
 		key->private.mm = mm;
 		key->private.address = address;
 		get_futex_key_refs(key);
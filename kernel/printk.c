@@ -43,6 +43,9 @@
 #include <linux/notifier.h>
 #include <linux/rculist.h>
 #include <linux/poll.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/sched.h>
 
 #include <asm/uaccess.h>
 
@@ -222,6 +225,9 @@ struct log {
  */
 static DEFINE_RAW_SPINLOCK(logbuf_lock);
 
+/* drains the log buffer to the consoles in printk.async mode */
+static struct task_struct *printk_kthread;
+
 #ifdef CONFIG_PRINTK
 /* the next printk record to read by syslog(READ) or /proc/kmsg */
 static u64 syslog_seq;
@@ -1370,6 +1376,26 @@ static int console_trylock_for_printk(unsigned int cpu)
 
 int printk_delay_msec __read_mostly;
 
+/*
+ * In async mode printk() only stores the record; console output is left
+ * to printk_kthread.  Output stays synchronous until the thread is
+ * running, outside of SYSTEM_RUNNING and while an oops or panic is in
+ * progress, so that the last messages always make it out.
+ */
+static bool printk_async = IS_ENABLED(CONFIG_PRINTK_ASYNC);
+module_param_named(async, printk_async, bool, S_IRUGO | S_IWUSR);
+
+/* worst time spent in vprintk_emit(), /proc/sys/kernel/printk_max_latency_ns */
+unsigned long printk_max_latency_ns;
+
+static void printk_wake_kthread(void);
+
+static inline bool printk_sync_output(void)
+{
+	return !printk_async || !printk_kthread || oops_in_progress ||
+	       system_state != SYSTEM_RUNNING;
+}
+
 static inline void printk_delay(void)
 {
 	if (unlikely(printk_delay_msec)) {
@@ -1498,10 +1524,14 @@ asmlinkage int vprintk_emit(int facility, int level,
 	unsigned long flags;
 	int this_cpu;
 	int printed_len = 0;
+	unsigned long latency;
+	u64 start;
 
 	boot_delay_msec();
 	printk_delay();
 
+	start = local_clock();
+
 	/* This stops the holder of console_sem just where we want him */
 	local_irq_save(flags);
 	this_cpu = smp_processor_id();
@@ -1610,14 +1640,26 @@ asmlinkage int vprintk_emit(int facility, int level,
 	* users.
 	* The console_trylock_for_printk() function will release 'logbuf_lock'
 	* regardless of whether it actually gets the console semaphore or not.
+	*
+	* In async mode just release 'logbuf_lock' and leave the consoles to
+	* printk_kthread.
 	*/
-	if (console_trylock_for_printk(this_cpu))
+	if (!printk_sync_output()) {
+		logbuf_cpu = UINT_MAX;
+		raw_spin_unlock(&logbuf_lock);
+		printk_wake_kthread();
+	} else if (console_trylock_for_printk(this_cpu)) {
 		console_unlock();
+	}
 
 	lockdep_on();
 out_restore_irqs:
 	local_irq_restore(flags);
 
+	latency = (unsigned long)(local_clock() - start);
+	if (unlikely(latency > printk_max_latency_ns))
+		printk_max_latency_ns = latency;
+
 	return printed_len;
 }
 EXPORT_SYMBOL(vprintk_emit);
@@ -1988,6 +2030,7 @@ int is_console_locked(void)
 
 #define PRINTK_PENDING_WAKEUP	0x01
 #define PRINTK_PENDING_SCHED	0x02
+#define PRINTK_PENDING_OUTPUT	0x04
 
 static DEFINE_PER_CPU(int, printk_pending);
 static DEFINE_PER_CPU(char [PRINTK_BUF_SIZE], printk_sched_buf);
@@ -2002,6 +2045,8 @@ void printk_tick(void)
 		}
 		if (pending & PRINTK_PENDING_WAKEUP)
 			wake_up_interruptible(&log_wait);
+		if (pending & PRINTK_PENDING_OUTPUT)
+			wake_up_process(printk_kthread);
 	}
 }
 
@@ -2018,6 +2063,51 @@ void wake_up_klogd(void)
 		this_cpu_or(printk_pending, PRINTK_PENDING_WAKEUP);
 }
 
+/*
+ * printk() may be called with runqueue locks held, so like klogd the
+ * console thread is woken from the next tick rather than directly.
+ */
+static void printk_wake_kthread(void)
+{
+	this_cpu_or(printk_pending, PRINTK_PENDING_OUTPUT);
+}
+
+static bool printk_output_pending(void)
+{
+	unsigned long flags;
+	bool pending;
+
+	raw_spin_lock_irqsave(&logbuf_lock, flags);
+	pending = console_seq != log_next_seq;
+	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+
+	return pending;
+}
+
+/*
+ * While consoles are suspended console_unlock() prints nothing and
+ * console_seq stays put, so the thread sleeps until it is woken again;
+ * resume_console() flushes what piled up in the meantime.
+ */
+static int printk_kthread_func(void *data)
+{
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_output_pending() || console_suspended)
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		if (try_to_freeze() || console_suspended)
+			continue;
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
 static void console_cont_flush(char *text, size_t size)
 {
 	unsigned long flags;
@@ -2474,6 +2564,15 @@ static int __init printk_late_init(void)
 		}
 	}
 	hotcpu_notifier(console_cpu_notify, 0);
+
+	if (!IS_ENABLED(CONFIG_PRINTK))
+		return 0;
+	printk_kthread = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(printk_kthread)) {
+		pr_err("printk: unable to start the console thread, "
+		       "output stays synchronous\n");
+		printk_kthread = NULL;
+	}
 	return 0;
 }
 late_initcall(printk_late_init);
@@ -60,6 +60,7 @@
 #include <linux/syscalls.h>
 #include <linux/times.h>
 #include <linux/tsacct_kern.h>
+#include <linux/uid_cputime.h>
 #include <linux/kprobes.h>
 #include <linux/delayacct.h>
 #include <linux/unistd.h>
@@ -2950,6 +2951,7 @@ void account_user_time(struct task_struct *p, cputime_t cputime,
 
 	/* Account for user time used */
 	acct_update_integrals(p);
+	uid_cputime_account(p, cputime, true);
 }
 
 /*
@@ -2968,6 +2970,7 @@ static void account_guest_time(struct task_struct *p, cputime_t cputime,
 	p->utimescaled += cputime_scaled;
 	account_group_user_time(p, cputime);
 	p->gtime += cputime;
+	uid_cputime_account(p, cputime, true);
 
 	/* Add guest time to cpustat. */
 	if (TASK_NICE(p) > 0) {
@@ -3000,6 +3003,7 @@ void __account_system_time(struct task_struct *p, cputime_t cputime,
 
 	/* Account for system time used */
 	acct_update_integrals(p);
+	uid_cputime_account(p, cputime, false);
 }
 
 /*
@@ -39,6 +39,11 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <asm/unaligned.h>
+#if defined(CONFIG_LZ4_DECOMPRESS_NEON) && !defined(STATIC)
+#include <linux/moduleparam.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+#endif
 
 /*-*****************************
  *	Decompression functions
@@ -446,7 +451,7 @@ _output_error:
 	return (int) (-(((const char *)ip) - src)) - 1;
 }
 
-int LZ4_decompress_safe(const char *source, char *dest,
+int LZ4_decompress_safe_scalar(const char *source, char *dest,
 	int compressedSize, int maxDecompressedSize)
 {
 	return LZ4_decompress_generic(source, dest,
@@ -455,6 +460,46 @@ int LZ4_decompress_safe(const char *source, char *dest,
 				      noDict, (BYTE *)dest, NULL, 0);
 }
 
+#if defined(CONFIG_LZ4_DECOMPRESS_NEON) && !defined(STATIC)
+/*
+ * The NEON decoder lives in its own compilation unit (built with
+ * -mfpu=neon), this side only picks it at runtime and owns the
+ * kernel_neon_begin()/kernel_neon_end() bracket.
+ */
+static bool lz4_use_neon = true;
+module_param_named(neon, lz4_use_neon, bool, 0644);
+MODULE_PARM_DESC(neon, "Use the NEON decoder for LZ4_decompress_safe()");
+
+int LZ4_decompress_safe_neon(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize)
+{
+	int ret;
+
+	if (!cpu_has_neon() || !may_use_simd())
+		return LZ4_decompress_safe_scalar(source, dest,
+				compressedSize, maxDecompressedSize);
+
+	kernel_neon_begin();
+	ret = LZ4_decompress_safe_neon_core(source, dest,
+			compressedSize, maxDecompressedSize);
+	kernel_neon_end();
+
+	return ret;
+}
+#endif
+
+int LZ4_decompress_safe(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize)
+{
+#if defined(CONFIG_LZ4_DECOMPRESS_NEON) && !defined(STATIC)
+	if (lz4_use_neon)
+		return LZ4_decompress_safe_neon(source, dest,
+				compressedSize, maxDecompressedSize);
+#endif
+	return LZ4_decompress_safe_scalar(source, dest,
+			compressedSize, maxDecompressedSize);
+}
+
 int LZ4_decompress_safe_partial(const char *src, char *dst,
 	int compressedSize, int targetOutputSize, int dstCapacity)
 {
@@ -696,6 +741,10 @@ int LZ4_decompress_fast_usingDict(const char *source, char *dest,
 
 #ifndef STATIC
 EXPORT_SYMBOL(LZ4_decompress_safe);
+EXPORT_SYMBOL(LZ4_decompress_safe_scalar);
+#ifdef CONFIG_LZ4_DECOMPRESS_NEON
+EXPORT_SYMBOL(LZ4_decompress_safe_neon);
+#endif
 EXPORT_SYMBOL(LZ4_decompress_safe_partial);
 EXPORT_SYMBOL(LZ4_decompress_fast);
 EXPORT_SYMBOL(LZ4_setStreamDecode);
@@ -0,0 +1,239 @@
+/*
+ * LZ4 decompressor using ARM NEON 16-byte loads and stores
+ *
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This file is built with -mfpu=neon.  It must only be entered through
+ * LZ4_decompress_safe_neon() in lz4_decompress.c, which brackets the
+ * call with kernel_neon_begin()/kernel_neon_end().
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/lz4.h>
+#include "lz4defs.h"
+
+#include <arm_neon.h>
+
+/* byte i of the first 16 output bytes of a match at offset o is i % o */
+static const BYTE lz4_neon_pattern[16][16] = {
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1 },
+	{ 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+	{ 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0 },
+	{ 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 1, 2, 3, 4 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0, 1, 2 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0, 1 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0 },
+};
+
+/*
+ * Largest multiple of the offset that fits in 16 bytes.  Once the first
+ * 16 bytes of a short-offset match are out, the data repeats with this
+ * period, so it can be replicated with plain non-overlapping 16-byte
+ * copies from the start of the match output.
+ */
+static const BYTE lz4_neon_step[16] = {
+	0, 16, 16, 15, 16, 15, 12, 14, 16, 9, 10, 11, 12, 13, 14, 15
+};
+
+/* Copy literals in 16-byte chunks, may write up to 15 bytes past e. */
+static FORCE_INLINE void lz4_neon_wild_copy(BYTE *d, const BYTE *s, BYTE *e)
+{
+	do {
+		vst1q_u8(d, vld1q_u8(s));
+		d += 16;
+		s += 16;
+	} while (d < e);
+}
+
+/*
+ * Copy a match ending at cpy, may write up to 15 bytes past cpy.
+ * Offsets below 16 overlap the output, so the first 16 bytes are built
+ * with a table lookup from the bytes already decoded.
+ */
+static FORCE_INLINE void lz4_neon_copy_match(BYTE *op, const BYTE *match,
+	size_t offset, BYTE *cpy)
+{
+	const BYTE *s;
+	size_t step;
+	uint8x8x2_t tbl;
+	uint8x16_t idx;
+
+	if (offset >= 16) {
+		do {
+			vst1q_u8(op, vld1q_u8(match));
+			op += 16;
+			match += 16;
+		} while (op < cpy);
+		return;
+	}
+
+	idx = vld1q_u8(lz4_neon_pattern[offset]);
+	tbl.val[0] = vld1_u8(match);
+	tbl.val[1] = vld1_u8(match + 8);
+	vst1_u8(op, vtbl2_u8(tbl, vget_low_u8(idx)));
+	vst1_u8(op + 8, vtbl2_u8(tbl, vget_high_u8(idx)));
+
+	step = lz4_neon_step[offset];
+	for (s = op, op += step; op < cpy; s += step, op += step)
+		vst1q_u8(op, vld1q_u8(s));
+}
+
+/*
+ * Same contract as LZ4_decompress_safe() for a single block without a
+ * dictionary.  Valid input decodes to exactly the same output.  Zero
+ * offsets, which the format does not allow, are rejected.
+ */
+int LZ4_decompress_safe_neon_core(const char *source, char *dest,
+	int compressedSize, int maxDecompressedSize)
+{
+	const BYTE *ip = (const BYTE *)source;
+	const BYTE * const iend = ip + compressedSize;
+	BYTE *op = (BYTE *)dest;
+	BYTE * const oend = op + maxDecompressedSize;
+	BYTE * const lowPrefix = op;
+	BYTE *cpy;
+
+	if (unlikely(maxDecompressedSize == 0))
+		return ((compressedSize == 1) && (*ip == 0)) ? 0 : -1;
+	if (unlikely(compressedSize == 0))
+		return -1;
+
+	while (1) {
+		unsigned int const token = *ip++;
+		size_t length = token >> ML_BITS;
+		size_t offset;
+		const BYTE *match;
+
+		/*
+		 * Short literal run and plenty of room on both sides: one
+		 * 16-byte literal store, then up to 18 match bytes with at
+		 * most two more stores.
+		 */
+		if (length != RUN_MASK &&
+		    likely((size_t)(iend - ip) > 16) &&
+		    likely((size_t)(oend - op) >= 48)) {
+			vst1q_u8(op, vld1q_u8(ip));
+			op += length;
+			ip += length;
+
+			length = token & ML_MASK;
+			offset = LZ4_readLE16(ip);
+			ip += 2;
+			match = op - offset;
+
+			if (length != ML_MASK && offset &&
+			    offset <= (size_t)(op - lowPrefix)) {
+				length += MINMATCH;
+				lz4_neon_copy_match(op, match, offset,
+						    op + length);
+				op += length;
+				continue;
+			}
+			goto _copy_match;
+		}
+
+		/* decode literal length */
+		if (length == RUN_MASK) {
+			unsigned int s;
+
+			if (unlikely(ip >= iend - RUN_MASK))
+				goto _output_error;
+			do {
+				s = *ip++;
+				length += s;
+			} while (likely(ip < iend - RUN_MASK) & (s == 255));
+
+			if (unlikely((uptrval)(op) + length < (uptrval)(op)))
+				goto _output_error;
+			if (unlikely((uptrval)(ip) + length < (uptrval)(ip)))
+				goto _output_error;
+		}
+
+		/* copy literals */
+		cpy = op + length;
+		if ((cpy > oend - MFLIMIT) ||
+		    (ip + length > iend - (2 + 1 + LASTLITERALS))) {
+			/* last literals: input must be consumed exactly */
+			if ((ip + length != iend) || (cpy > oend))
+				goto _output_error;
+			memcpy(op, ip, length);
+			op += length;
+			break;
+		}
+
+		if (likely((size_t)(iend - ip) >= length + 16 &&
+			   (size_t)(oend - cpy) >= 16))
+			lz4_neon_wild_copy(op, ip, cpy);
+		else
+			LZ4_wildCopy(op, ip, cpy);
+		ip += length;
+		op = cpy;
+
+		/* get offset and match length */
+		offset = LZ4_readLE16(ip);
+		ip += 2;
+		match = op - offset;
+		length = token & ML_MASK;
+
+_copy_match:
+		if (unlikely(!offset || offset > (size_t)(op - lowPrefix)))
+			goto _output_error;
+
+		if (length == ML_MASK) {
+			unsigned int s;
+
+			do {
+				s = *ip++;
+				if (ip > iend - LASTLITERALS)
+					goto _output_error;
+				length += s;
+			} while (s == 255);
+
+			if (unlikely((uptrval)(op) + length < (uptrval)op))
+				goto _output_error;
+		}
+		length += MINMATCH;
+
+		/* last LASTLITERALS bytes must be literals */
+		if (unlikely((size_t)(oend - op) < LASTLITERALS ||
+			     length > (size_t)(oend - op) - LASTLITERALS))
+			goto _output_error;
+		cpy = op + length;
+
+		if (likely((size_t)(oend - cpy) >= 16)) {
+			lz4_neon_copy_match(op, match, offset, cpy);
+			op = cpy;
+		} else {
+			while (op < cpy)
+				*op++ = *match++;
+		}
+	}
+
+	return (int) (((char *)op) - dest);
+
+_output_error:
+	return (int) (-(((const char *)ip) - source)) - 1;
+}
+EXPORT_SYMBOL(LZ4_decompress_safe_neon_core);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("LZ4 decompressor, NEON accelerated");
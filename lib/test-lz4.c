@@ -0,0 +1,202 @@
+/*
+ * Equivalence test and benchmark for the LZ4 decoders
+ *
+ * Compresses a few synthetic page patterns, checks that the NEON and the
+ * portable decoder produce identical output (and that neither writes past
+ * the destination on corrupted input), then times both over the same set.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 and
+ * only version 2 as published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>
+#include <linux/lz4.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#define TEST_LZ4_PAGES		64
+#define TEST_LZ4_GUARD		64
+#define TEST_LZ4_PATTERN	0xa5
+
+static unsigned int iterations = 200;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Benchmark passes over the test set");
+
+typedef int (*lz4_decode_fn)(const char *, char *, int, int);
+
+struct test_lz4_buf {
+	char *comp;
+	int comp_len;
+};
+
+static u32 __init test_lz4_rand(u32 *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+/* a mix of what zram sees: noise, text, sparse and run-heavy pages */
+static void __init test_lz4_fill(u8 *p, int kind, u32 *seed)
+{
+	static const char text[] =
+		"the quick brown fox jumps over the lazy dog 0123456789 ";
+	int i;
+
+	switch (kind % 5) {
+	case 0:
+		for (i = 0; i < PAGE_SIZE; i++)
+			p[i] = test_lz4_rand(seed);
+		break;
+	case 1:
+		for (i = 0; i < PAGE_SIZE; i++)
+			p[i] = text[(i + kind) % (sizeof(text) - 1)];
+		break;
+	case 2:
+		memset(p, 0, PAGE_SIZE);
+		for (i = 0; i < PAGE_SIZE; i += 64 + test_lz4_rand(seed) % 256)
+			p[i] = test_lz4_rand(seed);
+		break;
+	case 3:
+		for (i = 0; i < PAGE_SIZE; i++)
+			p[i] = (i && test_lz4_rand(seed) % 8) ?
+				p[i - 1 - test_lz4_rand(seed) % min(i, 15)] :
+				test_lz4_rand(seed) % 4;
+		break;
+	default:
+		for (i = 0; i < PAGE_SIZE; i++)
+			p[i] = (i / (1 + kind % 7)) & 0xff;
+		break;
+	}
+}
+
+static int __init test_lz4_check(lz4_decode_fn decode, const char *name,
+	struct test_lz4_buf *bufs, const u8 *orig, u8 *out, u32 *seed)
+{
+	int i, j, ret, fails = 0;
+
+	for (i = 0; i < TEST_LZ4_PAGES; i++) {
+		memset(out, TEST_LZ4_PATTERN, PAGE_SIZE + TEST_LZ4_GUARD);
+		ret = decode(bufs[i].comp, out, bufs[i].comp_len, PAGE_SIZE);
+		if (ret != PAGE_SIZE ||
+		    memcmp(out, orig + i * PAGE_SIZE, PAGE_SIZE)) {
+			pr_err("test_lz4: %s: page %d mismatch, ret %d\n",
+				name, i, ret);
+			fails++;
+		}
+
+		/* flip a bit, the result may be anything but an overrun */
+		bufs[i].comp[test_lz4_rand(seed) % bufs[i].comp_len] ^=
+			1 << (test_lz4_rand(seed) % 8);
+		memset(out, TEST_LZ4_PATTERN, PAGE_SIZE + TEST_LZ4_GUARD);
+		ret = decode(bufs[i].comp, out, bufs[i].comp_len, PAGE_SIZE);
+		for (j = PAGE_SIZE; j < PAGE_SIZE + TEST_LZ4_GUARD; j++) {
+			if (out[j] != TEST_LZ4_PATTERN) {
+				pr_err("test_lz4: %s: page %d overrun, ret %d\n",
+					name, i, ret);
+				fails++;
+				break;
+			}
+		}
+	}
+
+	return fails;
+}
+
+static void __init test_lz4_bench(lz4_decode_fn decode, const char *name,
+	struct test_lz4_buf *bufs, u8 *out)
+{
+	ktime_t start;
+	s64 ns;
+	unsigned int n;
+	int i;
+
+	start = ktime_get();
+	for (n = 0; n < iterations; n++)
+		for (i = 0; i < TEST_LZ4_PAGES; i++)
+			decode(bufs[i].comp, out, bufs[i].comp_len, PAGE_SIZE);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	pr_info("test_lz4: %-6s %u pages in %lld us, %lld ns/page\n", name,
+		iterations * TEST_LZ4_PAGES, div_s64(ns, NSEC_PER_USEC),
+		div_s64(ns, max(1u, iterations * TEST_LZ4_PAGES)));
+}
+
+static int __init test_lz4_init(void)
+{
+	struct test_lz4_buf bufs[TEST_LZ4_PAGES];
+	u8 *orig, *out, *wrk;
+	u32 seed = 0x4c5a3421;
+	int i, fails = 0;
+	int ret = -ENOMEM;
+
+	memset(bufs, 0, sizeof(bufs));
+	orig = vmalloc(TEST_LZ4_PAGES * PAGE_SIZE);
+	out = vmalloc(PAGE_SIZE + TEST_LZ4_GUARD);
+	wrk = vmalloc(LZ4_MEM_COMPRESS);
+	if (!orig || !out || !wrk)
+		goto out;
+
+	for (i = 0; i < TEST_LZ4_PAGES; i++) {
+		u8 *page = orig + i * PAGE_SIZE;
+
+		test_lz4_fill(page, i, &seed);
+		bufs[i].comp = vmalloc(LZ4_COMPRESSBOUND(PAGE_SIZE));
+		if (!bufs[i].comp)
+			goto out;
+		bufs[i].comp_len = LZ4_compress_default(page, bufs[i].comp,
+				PAGE_SIZE, LZ4_COMPRESSBOUND(PAGE_SIZE), wrk);
+		if (bufs[i].comp_len <= 0) {
+			pr_err("test_lz4: compress failed for page %d\n", i);
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	test_lz4_bench(LZ4_decompress_safe_scalar, "scalar", bufs, out);
+#ifdef CONFIG_LZ4_DECOMPRESS_NEON
+	test_lz4_bench(LZ4_decompress_safe_neon, "neon", bufs, out);
+#endif
+
+	/* the checks corrupt the inputs, so they run after the timing */
+	fails += test_lz4_check(LZ4_decompress_safe_scalar, "scalar",
+			bufs, orig, out, &seed);
+#ifdef CONFIG_LZ4_DECOMPRESS_NEON
+	for (i = 0; i < TEST_LZ4_PAGES; i++)
+		bufs[i].comp_len = LZ4_compress_default(orig + i * PAGE_SIZE,
+				bufs[i].comp, PAGE_SIZE,
+				LZ4_COMPRESSBOUND(PAGE_SIZE), wrk);
+	fails += test_lz4_check(LZ4_decompress_safe_neon, "neon",
+			bufs, orig, out, &seed);
+#endif
+
+	if (fails) {
+		pr_err("test_lz4: %d failures\n", fails);
+		ret = -EINVAL;
+	} else {
+		pr_info("test_lz4: all tests passed\n");
+		ret = 0;
+	}
+out:
+	for (i = 0; i < TEST_LZ4_PAGES; i++)
+		vfree(bufs[i].comp);
+	vfree(wrk);
+	vfree(out);
+	vfree(orig);
+	return ret;
+}
+module_init(test_lz4_init);
+
+static void __exit test_lz4_exit(void)
+{
+}
+module_exit(test_lz4_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("LZ4 decoder equivalence test and benchmark");
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #ifdef CONFIG_COMPACTION
@@ -1006,6 +1008,7 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 				cc->sync ? MIGRATE_SYNC_LIGHT : MIGRATE_ASYNC);
 		update_nr_listpages(cc);
 		nr_remaining = cc->nr_migratepages;
+		cc->nr_migrated += nr_migrate - nr_remaining;
 
 		trace_mm_compaction_migratepages(nr_migrate - nr_remaining,
 						nr_remaining);
@@ -1233,4 +1236,268 @@ void compaction_unregister_node(struct node *node)
 }
 #endif /* CONFIG_SYSFS && CONFIG_NUMA */
 
+/*
+ * kcompactd: per-node background compaction.
+ *
+ * kcompactd is woken by kswapd once it has balanced a node, and by the
+ * allocator slow path for allocations of sysctl_kcompactd_order or
+ * more, so that high-order requests find free blocks instead of having
+ * to compact directly. Independently of that it wakes up every
+ * KCOMPACTD_INTERVAL and compacts while the fragmentation index of a
+ * zone for sysctl_kcompactd_order is above sysctl_kcompactd_frag_target.
+ * The periodic wakeups cost idle power, so this proactive mode is off
+ * (a target of 1000) unless enabled through the sysctl.
+ */
+int sysctl_kcompactd_order = 4;
+int sysctl_kcompactd_frag_target = 1000;
+
+#define KCOMPACTD_INTERVAL	msecs_to_jiffies(500)
+
+static bool kcompactd_proactive_enabled(void)
+{
+	return sysctl_kcompactd_frag_target < 1000;
+}
+
+static bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order > 0 || kthread_should_stop();
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+	struct zone *zone;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_suitable(zone, order) == COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Is any zone of @pgdat fragmented beyond the proactive target, and
+ * would compaction actually run on it?  compaction_suitable() refuses
+ * zones at or below sysctl_extfrag_threshold, so a lower target could
+ * never be reached and would only cause empty wakeups.
+ */
+static bool kcompactd_node_fragmented(pg_data_t *pgdat)
+{
+	int zoneid;
+	struct zone *zone;
+	int target = max(sysctl_kcompactd_frag_target,
+			 sysctl_extfrag_threshold);
+
+	for (zoneid = 0; zoneid < pgdat->nr_zones; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (fragmentation_index(zone, sysctl_kcompactd_order) >
+		    target &&
+		    compaction_suitable(zone, sysctl_kcompactd_order) ==
+		    COMPACT_CONTINUE)
+			return true;
+	}
+
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	int zoneid;
+	struct zone *zone;
+	int status;
+	struct compact_control cc = {
+		.order = order,
+		.sync = true,
+	};
+
+	count_compact_event(COMPACTDAEMON_WAKE);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		if (compaction_deferred(zone, order))
+			continue;
+
+		if (compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		if (kthread_should_stop())
+			return;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.nr_migrated = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		status = compact_zone(zone, &cc);
+		count_compact_events(COMPACTDAEMON_MIGRATED, cc.nr_migrated);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone),
+				      0, 0)) {
+			count_compact_event(COMPACTDAEMON_SUCCESS);
+			if (order >= zone->compact_order_failed)
+				zone->compact_order_failed = order + 1;
+		} else if (status == COMPACT_COMPLETE) {
+			/*
+			 * The whole zone was scanned without success, back
+			 * off like direct compaction would.
+			 */
+			count_compact_event(COMPACTDAEMON_FAIL);
+			defer_compaction(zone, order);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
+/*
+ * The background compaction daemon, started as one kernel thread
+ * per node.
+ */
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	int order, classzone_idx;
+	long timeout;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+
+	while (!kthread_should_stop()) {
+		timeout = kcompactd_proactive_enabled() ?
+			KCOMPACTD_INTERVAL : MAX_SCHEDULE_TIMEOUT;
+		wait_event_freezable_timeout(pgdat->kcompactd_wait,
+				kcompactd_work_requested(pgdat), timeout);
+		if (kthread_should_stop())
+			break;
+
+		order = pgdat->kcompactd_max_order;
+		classzone_idx = pgdat->kcompactd_classzone_idx;
+		if (order) {
+			pgdat->kcompactd_max_order = 0;
+			pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+		} else if (kcompactd_proactive_enabled() &&
+			   kcompactd_node_fragmented(pgdat)) {
+			order = sysctl_kcompactd_order;
+			classzone_idx = pgdat->nr_zones - 1;
+		} else {
+			continue;
+		}
+
+		kcompactd_do_work(pgdat, order, classzone_idx);
+	}
+
+	return 0;
+}
+
+/**
+ * wakeup_kcompactd - ask for background compaction of a node
+ * @pgdat: node to compact
+ * @order: order of the allocation that should succeed afterwards
+ * @classzone_idx: highest zone the allocation may use
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		pr_err("Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined. Caller must
+ * hold lock_memory_hotplug().
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+/* Kick the daemons so that a new proactive target takes effect */
+int sysctl_kcompactd_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		wake_up_interruptible(&NODE_DATA(nid)->kcompactd_wait);
+
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+subsys_initcall(kcompactd_init)
+
 #endif /* CONFIG_COMPACTION */
@@ -5337,17 +5337,21 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
+	page = find_get_entry(mapping, pgoff);
 
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may report page out on swap: account for that too. */
-	if (radix_tree_exceptional_entry(page)) {
+	if (radix_tree_exceptional_entry(page) &&
+	    mapping_cap_swap_backed(mapping)) {
 		swp_entry_t swap = radix_to_swp_entry(page);
 		if (do_swap_account)
 			*entry = swap;
 		page = find_get_page(swap_address_space(swap), swap.val);
 	}
 #endif
+	/* Shadow entries of evicted pages have nothing to move */
+	if (radix_tree_exceptional_entry(page))
+		page = NULL;
 	return page;
 }
 
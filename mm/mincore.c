@@ -8,6 +8,7 @@
  * The mincore() system call.
  */
 #include <linux/pagemap.h>
+#include <linux/backing-dev.h>
 #include <linux/gfp.h>
 #include <linux/mm.h>
 #include <linux/mman.h>
@@ -70,14 +71,18 @@ static unsigned char mincore_page(struct address_space *mapping, pgoff_t pgoff)
 	 * any other file mapping (ie. marked !present and faulted in with
 	 * tmpfs's .fault). So swapped out tmpfs mappings are tested here.
 	 */
-	page = find_get_page(mapping, pgoff);
+	page = find_get_entry(mapping, pgoff);
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may return swap: account for swapcache page too. */
-	if (radix_tree_exceptional_entry(page)) {
+	if (radix_tree_exceptional_entry(page) &&
+	    mapping_cap_swap_backed(mapping)) {
 		swp_entry_t swap = radix_to_swp_entry(page);
 		page = find_get_page(swap_address_space(swap), swap.val);
 	}
 #endif
+	/* A shadow entry of an evicted page is not resident */
+	if (radix_tree_exceptional_entry(page))
+		page = NULL;
 	if (page) {
 		present = PageUptodate(page);
 		page_cache_release(page);
@@ -17,6 +17,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/log2.h>
 
 #include <asm/pgtable.h>
 
@@ -276,37 +277,74 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+/*
+ * Per-VMA swap readahead state, packed into vma->swap_readahead_info:
+ * the page aligned address of the last swap fault, the readahead window
+ * used for it, and the readahead hits seen since.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* Largest window, in pages, whatever page_cluster says */
+#define SWAP_RA_ORDER_CEILING	5
+
+static void swap_ra_hit(struct vm_area_struct *vma, unsigned long addr)
+{
+	unsigned long ra_val, hits;
+
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	hits = SWAP_RA_HITS(ra_val);
+	if (hits < SWAP_RA_HITS_MAX)
+		hits++;
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(addr, SWAP_RA_WIN(ra_val), hits));
+}
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page * lookup_swap_cache(swp_entry_t entry,
+				struct vm_area_struct *vma, unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(swap_address_space(entry), entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma)
+				swap_ra_hit(vma, addr);
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
- * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
- */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry,
+			gfp_t gfp_mask, struct vm_area_struct *vma,
+			unsigned long addr, bool *new_page_allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*new_page_allocated = false;
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -374,6 +412,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 */
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
+			*new_page_allocated = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -391,6 +430,21 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool page_was_allocated;
+
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &page_was_allocated);
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -435,3 +489,146 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size the readahead window from the hits since the previous swap fault
+ * in this VMA: grow it while readahead pages get used, fall back to no
+ * readahead for random faults, but never shrink by more than half at a
+ * time.
+ */
+static unsigned long swap_ra_window(unsigned long prev_pfn, unsigned long pfn,
+				    unsigned long hits, unsigned long max_win,
+				    unsigned long prev_win)
+{
+	unsigned long win;
+
+	win = hits + 2;
+	if (win == 2) {
+		/*
+		 * No hits to judge by: keep a minimal window only for
+		 * sequential faults, so we don't get stuck at one page.
+		 */
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			win = 1;
+	} else {
+		win = roundup_pow_of_two(max(win, 4UL));
+	}
+
+	if (win > max_win)
+		win = max_win;
+	if (win < prev_win / 2)
+		win = prev_win / 2;
+
+	return win;
+}
+
+static pmd_t *swap_ra_pmd(struct vm_area_struct *vma, unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(vma->vm_mm, addr);
+	if (pgd_none(*pgd) || pgd_bad(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none(*pud) || pud_bad(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd) || pmd_bad(*pmd))
+		return NULL;
+	return pmd;
+}
+
+/**
+ * swap_vma_readahead - swap in pages around a fault in virtual space
+ * @fentry: swap entry of the faulting page
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the fault address belongs to
+ * @faddr: the faulting address
+ *
+ * Returns the struct page for @fentry, after queueing swapin.
+ *
+ * Where swap slots end up has little to do with which pages a task
+ * touches together, and on zram the slot cluster of swapin_readahead()
+ * is not even tried.  Instead, read the swap entries found in the PTEs
+ * next to the fault, within the VMA and the page table.  The window
+ * follows the fault direction and is sized from the readahead hits seen
+ * in this VMA since its previous swap fault, capped by page_cluster.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+				struct vm_area_struct *vma, unsigned long faddr)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING];
+	unsigned long ra_val, prev_pfn, pfn, win, max_win, left;
+	unsigned long lo, hi, start, end, addr;
+	bool page_allocated;
+	struct page *page;
+	pte_t *pte, *orig;
+	pmd_t *pmd;
+	int i, nr;
+
+	max_win = 1UL << min_t(unsigned int, ACCESS_ONCE(page_cluster),
+			       SWAP_RA_ORDER_CEILING);
+	faddr &= PAGE_MASK;
+	pfn = faddr >> PAGE_SHIFT;
+
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = SWAP_RA_ADDR(ra_val) >> PAGE_SHIFT;
+	win = 1;
+	if (max_win > 1)
+		win = swap_ra_window(prev_pfn, pfn, SWAP_RA_HITS(ra_val),
+				     max_win, SWAP_RA_WIN(ra_val));
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(faddr, win, 0));
+
+	if (win == 1)
+		goto skip;
+
+	/* Read ahead in the direction of the faults, or around a lone one */
+	if (pfn == prev_pfn + 1)
+		left = 0;
+	else if (pfn == prev_pfn - 1)
+		left = win - 1;
+	else
+		left = (win - 1) / 2;
+
+	/* Stay within the VMA and the page table of the fault */
+	lo = max(vma->vm_start, faddr & PMD_MASK);
+	hi = min(vma->vm_end, (faddr & PMD_MASK) + PMD_SIZE);
+	start = faddr - min(left, (faddr - lo) >> PAGE_SHIFT) * PAGE_SIZE;
+	end = start + min(win, (hi - start) >> PAGE_SHIFT) * PAGE_SIZE;
+
+	pmd = swap_ra_pmd(vma, faddr);
+	if (!pmd)
+		goto skip;
+
+	/* A racy snapshot will do: stale entries are caught below */
+	orig = pte = pte_offset_map(pmd, start);
+	for (nr = 0, addr = start; addr < end; addr += PAGE_SIZE)
+		ptes[nr++] = *pte++;
+	pte_unmap(orig);
+
+	for (i = 0, addr = start; i < nr; i++, addr += PAGE_SIZE) {
+		swp_entry_t entry;
+
+		if (addr == faddr || !is_swap_pte(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+					       &page_allocated);
+		if (!page)
+			continue;
+		if (page_allocated) {
+			SetPageReadahead(page);
+			count_vm_event(SWAP_RA);
+		}
+		page_cache_release(page);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, faddr);
+}
@@ -0,0 +1,311 @@
+/*
+ * linux/mm/workingset.c
+ *
+ * Workingset detection
+ *
+ * Pages are evicted from the tail of the inactive file list without
+ * ever having had a chance to prove themselves on the active list when
+ * the inactive list is too small for the workingset.  To tell apart
+ * pages that are used repeatedly from pages that are used once, a
+ * shadow entry is left in the page cache slot of every evicted page.
+ * It records the zone and a snapshot of the zone's inactive_age
+ * counter, which is bumped on every eviction and every activation.
+ *
+ * When the page faults back in, the difference between the current
+ * inactive_age and the one stored in the shadow is the refault
+ * distance: the minimum number of inactive list slots the page would
+ * have needed to stay resident.  If that distance is no larger than
+ * the active file list, the page could have stayed cached had the
+ * active list yielded those slots to the inactive list, so the
+ * refaulting page is activated right away to compete with the
+ * established workingset.
+ *
+ * Mappings that carry shadow entries are tracked on a list_lru so that
+ * a shrinker can prune them once they clearly outnumber the page cache.
+ */
+
+#include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/list_lru.h>
+#include <linux/shrinker.h>
+#include <linux/atomic.h>
+#include <linux/module.h>
+#include <linux/swap.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+
+/* The eviction counter gets what is left after the zone and node bits */
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+/*
+ * Upper bound of shadows dropped per mapping per shrinker visit.  The
+ * shrinker visits one mapping per IRQ-off stretch, so this also bounds
+ * the time spent with interrupts disabled.
+ */
+#define SHADOW_BATCH	64
+
+static struct list_lru shadow_mappings;
+static atomic_long_t nr_shadows;
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static struct zone *unpack_shadow(void *shadow, unsigned long *eviction)
+{
+	unsigned long entry = (unsigned long)shadow;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+
+	*eviction = entry;
+	return NODE_DATA(nid)->node_zones + zid;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @page->mapping->page_tree in
+ * place of the evicted @page so that a later refault can be detected.
+ * Called under @mapping->tree_lock.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault, eviction, distance;
+	struct zone *zone;
+
+	zone = unpack_shadow(shadow, &eviction);
+	refault = atomic_long_read(&zone->inactive_age);
+	distance = (refault - eviction) & EVICTION_MASK;
+
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+/**
+ * workingset_shadow_added - account a shadow entry stored in @mapping
+ * @mapping: the address space
+ *
+ * Called under @mapping->tree_lock with interrupts disabled.
+ */
+void workingset_shadow_added(struct address_space *mapping)
+{
+	if (!mapping->nrshadows++)
+		list_lru_add(&shadow_mappings, &mapping->shadow_list);
+	atomic_long_inc(&nr_shadows);
+}
+
+/**
+ * workingset_shadow_removed - account a shadow entry dropped from @mapping
+ * @mapping: the address space
+ *
+ * Called under @mapping->tree_lock with interrupts disabled.
+ */
+void workingset_shadow_removed(struct address_space *mapping)
+{
+	if (!--mapping->nrshadows)
+		list_lru_del(&shadow_mappings, &mapping->shadow_list);
+	atomic_long_dec(&nr_shadows);
+}
+
+/*
+ * Drop up to @max shadow entries of @mapping in [@start, @end].  The
+ * caller holds the tree_lock and deals with the shadow_mappings list.
+ */
+static unsigned long __clear_shadows(struct address_space *mapping,
+				     pgoff_t start, pgoff_t end,
+				     unsigned long max, bool reclaim)
+{
+	pgoff_t indices[PAGEVEC_SIZE];
+	struct radix_tree_iter iter;
+	unsigned long cleared = 0;
+	void **slot;
+	int i, nr;
+
+	while (mapping->nrshadows && cleared < max) {
+		nr = 0;
+		radix_tree_for_each_slot(slot, &mapping->page_tree,
+					 &iter, start) {
+			void *entry;
+
+			if (iter.index > end)
+				break;
+			entry = radix_tree_deref_slot_protected(slot,
+						&mapping->tree_lock);
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			if (reclaim) {
+				unsigned long eviction;
+
+				__inc_zone_state(unpack_shadow(entry, &eviction),
+						 WORKINGSET_NODERECLAIM);
+			}
+			indices[nr++] = iter.index;
+			if (nr == PAGEVEC_SIZE || cleared + nr >= max)
+				break;
+		}
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++)
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+		mapping->nrshadows -= nr;
+		atomic_long_sub(nr, &nr_shadows);
+		cleared += nr;
+
+		start = indices[nr - 1] + 1;
+		if (!start || start > end)
+			break;
+	}
+	return cleared;
+}
+
+/**
+ * workingset_clear_shadows - drop shadow entries in a range of a mapping
+ * @mapping: the address space
+ * @start: first page index
+ * @end: last page index (inclusive)
+ *
+ * Used by truncation and inode teardown: shadows describe page cache
+ * state that no longer exists once the backing range is gone.
+ */
+void workingset_clear_shadows(struct address_space *mapping,
+			      pgoff_t start, pgoff_t end)
+{
+	spin_lock_irq(&mapping->tree_lock);
+	if (mapping->nrshadows) {
+		__clear_shadows(mapping, start, end, ULONG_MAX, false);
+		if (!mapping->nrshadows)
+			list_lru_del(&shadow_mappings, &mapping->shadow_list);
+	}
+	spin_unlock_irq(&mapping->tree_lock);
+}
+
+static enum lru_status shadow_lru_isolate(struct list_head *item,
+					  spinlock_t *lru_lock, void *arg)
+{
+	struct address_space *mapping;
+
+	mapping = container_of(item, struct address_space, shadow_list);
+
+	/*
+	 * The lock order is tree_lock -> lru_lock, so we can only
+	 * trylock here.  A mapping that is busy goes to the back of the
+	 * list, the shrinker walks it one mapping at a time.
+	 */
+	if (!spin_trylock(&mapping->tree_lock))
+		return LRU_ROTATE;
+
+	__clear_shadows(mapping, 0, ULONG_MAX, SHADOW_BATCH, true);
+	if (mapping->nrshadows) {
+		spin_unlock(&mapping->tree_lock);
+		return LRU_ROTATE;
+	}
+	list_del_init(item);
+	spin_unlock(&mapping->tree_lock);
+
+	return LRU_REMOVED;
+}
+
+static unsigned long count_shadow_mappings(struct shrinker *shrinker,
+					   struct shrink_control *sc)
+{
+	unsigned long cache, mappings;
+
+	/*
+	 * A shadow only ever activates a page if its refault distance
+	 * fits into the active file list, so shadows are of little use
+	 * once they outnumber the file pages resident in memory.
+	 */
+	cache = global_page_state(NR_ACTIVE_FILE) +
+		global_page_state(NR_INACTIVE_FILE);
+	if (atomic_long_read(&nr_shadows) <= cache)
+		return 0;
+
+	/* The lru lock nests inside the IRQ-safe tree_lock */
+	local_irq_disable();
+	mappings = list_lru_count(&shadow_mappings);
+	local_irq_enable();
+
+	return mappings;
+}
+
+static unsigned long scan_shadow_mappings(struct shrinker *shrinker,
+					  struct shrink_control *sc)
+{
+	unsigned long freed = 0, nr;
+
+	/* The lru lock nests inside the IRQ-safe tree_lock */
+	for (nr = 0; nr < sc->nr_to_scan; nr++) {
+		local_irq_disable();
+		freed += list_lru_walk(&shadow_mappings, shadow_lru_isolate,
+				       NULL, 1);
+		local_irq_enable();
+	}
+
+	return freed;
+}
+
+static struct shrinker workingset_shadow_shrinker = {
+	.count_objects = count_shadow_mappings,
+	.scan_objects = scan_shadow_mappings,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int __init workingset_init(void)
+{
+	int ret;
+
+	ret = list_lru_init(&shadow_mappings);
+	if (ret)
+		return ret;
+	register_shrinker(&workingset_shadow_shrinker);
+	return 0;
+}
+core_initcall(workingset_init);
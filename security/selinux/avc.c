@@ -23,6 +23,10 @@
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
 #include <linux/list.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -34,14 +38,18 @@
 #include "avc_ss.h"
 #include "classmap.h"
 
-#define AVC_CACHE_SLOTS			512
+#define AVC_DEF_CACHE_SLOTS		512
+#define AVC_MAX_CACHE_SLOTS		8192
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
+#define avc_cache_hist_incr(field, n) \
+	this_cpu_inc(avc_cache_stats.field[avc_hist_bucket(n)])
 #else
 #define avc_cache_stats_incr(field)	do {} while (0)
+#define avc_cache_hist_incr(field, n)	do {} while (0)
 #endif
 
 struct avc_entry {
@@ -68,9 +76,18 @@ struct avc_xperms_node {
 	struct list_head xpd_head; /* list head of extended_perms_decision */
 };
 
+/*
+ * The slot array is sized from the policy when it is loaded, see
+ * avc_resize().  Readers pick it up under rcu_read_lock().
+ */
+struct avc_slots {
+	unsigned int		nslots;		/* power of two */
+	struct hlist_head	*slots;		/* head for avc_node->list */
+	spinlock_t		*locks;		/* lock for writes */
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_slots __rcu	*table;
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
 	u32			latest_notif;	/* latest revocation notification */
@@ -90,6 +107,9 @@ struct avc_callback_node {
 
 /* Exported via selinufs */
 unsigned int avc_cache_threshold = AVC_DEF_CACHE_THRESHOLD;
+/* last threshold set by avc_resize(), a value written by the admin sticks */
+static unsigned int avc_auto_threshold = AVC_DEF_CACHE_THRESHOLD;
+static DEFINE_MUTEX(avc_resize_mutex);
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
@@ -102,9 +122,57 @@ static struct kmem_cache *avc_xperms_data_cachep;
 static struct kmem_cache *avc_xperms_decision_cachep;
 static struct kmem_cache *avc_xperms_cachep;
 
-static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
+static inline int avc_hash(struct avc_slots *t, u32 ssid, u32 tsid,
+			   u16 tclass)
+{
+	return jhash_3words(ssid, tsid, tclass, 0) & (t->nslots - 1);
+}
+
+static inline struct avc_slots *avc_slots(void)
+{
+	return rcu_dereference(avc_cache.table);
+}
+
+/* chain length/search depth histogram buckets: 0 1 2 3 4-7 8-15 16+ */
+static inline int avc_hist_bucket(int n)
+{
+	if (n < 4)
+		return n;
+	if (n < 8)
+		return 4;
+	return n < 16 ? 5 : 6;
+}
+
+static struct avc_slots *avc_alloc_slots(unsigned int nslots)
+{
+	struct avc_slots *t;
+	size_t size;
+	int i;
+
+	size = sizeof(*t) + nslots * (sizeof(*t->slots) + sizeof(*t->locks));
+	if (size > PAGE_SIZE)
+		t = vzalloc(size);
+	else
+		t = kzalloc(size, GFP_KERNEL);
+	if (!t)
+		return NULL;
+
+	t->nslots = nslots;
+	t->slots = (struct hlist_head *)(t + 1);
+	t->locks = (spinlock_t *)(t->slots + nslots);
+	for (i = 0; i < nslots; i++) {
+		INIT_HLIST_HEAD(&t->slots[i]);
+		spin_lock_init(&t->locks[i]);
+	}
+	return t;
+}
+
+static void avc_free_slots(struct avc_slots *t)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	if (is_vmalloc_addr(t))
+		vfree(t);
+	else
+		kfree(t);
 }
 
 /**
@@ -181,12 +249,12 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  */
 void __init avc_init(void)
 {
-	int i;
+	struct avc_slots *t;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
-	}
+	t = avc_alloc_slots(AVC_DEF_CACHE_SLOTS);
+	if (!t)
+		panic("SELinux: unable to allocate the AVC slots\n");
+	RCU_INIT_POINTER(avc_cache.table, t);
 	atomic_set(&avc_cache.active_nodes, 0);
 	atomic_set(&avc_cache.lru_hint, 0);
 
@@ -206,25 +274,39 @@ void __init avc_init(void)
 	audit_log(current->audit_context, GFP_KERNEL, AUDIT_KERNEL, "AVC INITIALIZED\n");
 }
 
+static int avc_print_hist(char *page, int len, const char *tag,
+			  unsigned int *hist)
+{
+	return len + scnprintf(page + len, PAGE_SIZE - len,
+			       "%s: %u %u %u %u %u %u %u\n", tag,
+			       hist[0], hist[1], hist[2], hist[3],
+			       hist[4], hist[5], hist[6]);
+}
+
 int avc_get_hash_stats(char *page)
 {
-	int i, chain_len, max_chain_len, slots_used;
+	int i, len, chain_len, max_chain_len, slots_used, nslots;
+	unsigned int chains[AVC_HIST_BUCKETS] = { 0 };
+	struct avc_slots *t;
 	struct avc_node *node;
 	struct hlist_head *head;
 
 	rcu_read_lock();
 
+	t = avc_slots();
+	nslots = t->nslots;
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		if (!hlist_empty(head)) {
-			struct hlist_node *next;
+	for (i = 0; i < nslots; i++) {
+		struct hlist_node *next;
 
+		head = &t->slots[i];
+		chain_len = 0;
+		hlist_for_each_entry_rcu(node, next, head, list)
+			chain_len++;
+		chains[avc_hist_bucket(chain_len)]++;
+		if (chain_len) {
 			slots_used++;
-			chain_len = 0;
-			hlist_for_each_entry_rcu(node, next, head, list)
-				chain_len++;
 			if (chain_len > max_chain_len)
 				max_chain_len = chain_len;
 		}
@@ -232,10 +314,33 @@ int avc_get_hash_stats(char *page)
 
 	rcu_read_unlock();
 
-	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
-			 "longest chain: %d\n",
-			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+	len = scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
+			"longest chain: %d\n",
+			atomic_read(&avc_cache.active_nodes),
+			slots_used, nslots, max_chain_len);
+	len += scnprintf(page + len, PAGE_SIZE - len,
+			 "histogram buckets: 0 1 2 3 4-7 8-15 16+\n");
+	len = avc_print_hist(page, len, "chain length", chains);
+#ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
+	{
+		unsigned int hits[AVC_HIST_BUCKETS] = { 0 };
+		unsigned int misses[AVC_HIST_BUCKETS] = { 0 };
+		int cpu, b;
+
+		for_each_possible_cpu(cpu) {
+			struct avc_cache_stats *st;
+
+			st = &per_cpu(avc_cache_stats, cpu);
+			for (b = 0; b < AVC_HIST_BUCKETS; b++) {
+				hits[b] += st->hit_depth[b];
+				misses[b] += st->miss_depth[b];
+			}
+		}
+		len = avc_print_hist(page, len, "hit depth", hits);
+		len = avc_print_hist(page, len, "miss depth", misses);
+	}
+#endif
+	return len;
 }
 
 /*
@@ -508,33 +613,35 @@ static inline int avc_reclaim_node(void)
 	struct avc_node *node;
 	int hvalue, try, ecx;
 	unsigned long flags;
+	struct avc_slots *t;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	rcu_read_lock();
+	t = avc_slots();
+	for (try = 0, ecx = 0; try < t->nslots; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) &
+			 (t->nslots - 1);
+		head = &t->slots[hvalue];
+		lock = &t->locks[hvalue];
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
 
-		rcu_read_lock();
 		hlist_for_each_entry(node, next, head, list) {
 			avc_node_delete(node);
 			avc_cache_stats_incr(reclaims);
 			ecx++;
 			if (ecx >= AVC_CACHE_RECLAIM) {
-				rcu_read_unlock();
 				spin_unlock_irqrestore(lock, flags);
 				goto out;
 			}
 		}
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flags);
 	}
 out:
+	rcu_read_unlock();
 	return ecx;
 }
 
@@ -567,13 +674,15 @@ static void avc_node_populate(struct avc_node *node, u32 ssid, u32 tsid, u16 tcl
 static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 {
 	struct avc_node *node, *ret = NULL;
-	int hvalue;
+	int hvalue, depth = 0;
+	struct avc_slots *t = avc_slots();
 	struct hlist_head *head;
 	struct hlist_node *next;
 
-	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	hvalue = avc_hash(t, ssid, tsid, tclass);
+	head = &t->slots[hvalue];
 	hlist_for_each_entry_rcu(node, next, head, list) {
+		depth++;
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
 		    tsid == node->ae.tsid) {
@@ -582,6 +691,10 @@ static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 		}
 	}
 
+	if (ret)
+		avc_cache_hist_incr(hit_depth, depth);
+	else
+		avc_cache_hist_incr(miss_depth, depth);
 	return ret;
 }
 
@@ -664,20 +777,23 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass,
 
 	node = avc_alloc_node();
 	if (node) {
+		struct avc_slots *t;
 		struct hlist_head *head;
 		struct hlist_node *next;
 		spinlock_t *lock;
 		int rc = 0;
 
-		hvalue = avc_hash(ssid, tsid, tclass);
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 		rc = avc_xperms_populate(node, xp_node);
 		if (rc) {
 			kmem_cache_free(avc_node_cachep, node);
 			return NULL;
 		}
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		/* called with rcu_read_lock() held, see avc_compute_av() */
+		t = avc_slots();
+		hvalue = avc_hash(t, ssid, tsid, tclass);
+		head = &t->slots[hvalue];
+		lock = &t->locks[hvalue];
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, next, head, list) {
@@ -915,6 +1031,7 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 	int hvalue, rc = 0;
 	unsigned long flag;
 	struct avc_node *pos, *node, *orig = NULL;
+	struct avc_slots *t;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	spinlock_t *lock;
@@ -925,11 +1042,12 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 		goto out;
 	}
 
-	/* Lock the target slot */
-	hvalue = avc_hash(ssid, tsid, tclass);
+	/* Lock the target slot, callers hold rcu_read_lock() */
+	t = avc_slots();
+	hvalue = avc_hash(t, ssid, tsid, tclass);
 
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	head = &t->slots[hvalue];
+	lock = &t->locks[hvalue];
 
 	spin_lock_irqsave(lock, flag);
 
@@ -996,10 +1114,7 @@ out:
 	return rc;
 }
 
-/**
- * avc_flush - Flush the cache
- */
-static void avc_flush(void)
+static void avc_flush_slots(struct avc_slots *t)
 {
 	struct hlist_head *head;
 	struct hlist_node *next;
@@ -1008,9 +1123,9 @@ static void avc_flush(void)
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	for (i = 0; i < t->nslots; i++) {
+		head = &t->slots[i];
+		lock = &t->locks[i];
 
 		spin_lock_irqsave(lock, flag);
 		/*
@@ -1025,6 +1140,61 @@ static void avc_flush(void)
 	}
 }
 
+/**
+ * avc_flush - Flush the cache
+ */
+static void avc_flush(void)
+{
+	mutex_lock(&avc_resize_mutex);
+	avc_flush_slots(rcu_dereference_protected(avc_cache.table,
+			lockdep_is_held(&avc_resize_mutex)));
+	mutex_unlock(&avc_resize_mutex);
+}
+
+/*
+ * Size the slot array for the loaded policy: one slot per type, within
+ * [AVC_DEF_CACHE_SLOTS, AVC_MAX_CACHE_SLOTS].  The reclaim threshold
+ * follows unless it was changed through selinuxfs.  The old array is
+ * emptied once no reader can still be using it; its entries would be
+ * flushed by the reset that follows anyway.
+ */
+static void avc_resize(void)
+{
+	struct avc_slots *old, *new;
+	unsigned int nslots;
+
+	nslots = security_policy_ntypes();
+	if (!nslots)
+		return;
+	nslots = clamp_t(unsigned int, roundup_pow_of_two(nslots),
+			 AVC_DEF_CACHE_SLOTS, AVC_MAX_CACHE_SLOTS);
+
+	mutex_lock(&avc_resize_mutex);
+	old = rcu_dereference_protected(avc_cache.table,
+					lockdep_is_held(&avc_resize_mutex));
+	if (old->nslots == nslots)
+		goto out;
+
+	new = avc_alloc_slots(nslots);
+	if (!new) {
+		printk(KERN_WARNING "SELinux: avc:  unable to resize to %u "
+		       "slots, keeping %u\n", nslots, old->nslots);
+		goto out;
+	}
+	rcu_assign_pointer(avc_cache.table, new);
+	synchronize_rcu();
+	avc_flush_slots(old);
+	avc_free_slots(old);
+
+	if (avc_cache_threshold == avc_auto_threshold)
+		avc_cache_threshold = nslots;
+	avc_auto_threshold = nslots;
+	printk(KERN_DEBUG "SELinux: avc:  %u hash slots, threshold %u\n",
+	       nslots, avc_cache_threshold);
+out:
+	mutex_unlock(&avc_resize_mutex);
+}
+
 /**
  * avc_ss_reset - Flush the cache and revalidate migrated permissions.
  * @seqno: policy sequence number
@@ -1034,6 +1204,7 @@ int avc_ss_reset(u32 seqno)
 	struct avc_callback_node *c;
 	int rc = 0, tmprc;
 
+	avc_resize();
 	avc_flush();
 
 	for (c = avc_callbacks; c; c = c->next) {
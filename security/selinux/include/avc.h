@@ -38,12 +38,17 @@ struct sk_buff;
 /*
  * AVC statistics
  */
+#define AVC_HIST_BUCKETS	7
+
 struct avc_cache_stats {
 	unsigned int lookups;
 	unsigned int misses;
 	unsigned int allocations;
 	unsigned int reclaims;
 	unsigned int frees;
+	/* chain position of hits, chain length walked on misses */
+	unsigned int hit_depth[AVC_HIST_BUCKETS];
+	unsigned int miss_depth[AVC_HIST_BUCKETS];
 };
 
 /*
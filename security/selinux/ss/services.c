@@ -2096,7 +2096,7 @@ int security_load_policy(void *data, size_t len)
 	 */
 	args.oldp = &policydb;
 	args.newp = &newpolicydb;
-	rc = sidtab_map(&newsidtab, convert_context, &args);
+	rc = sidtab_convert(&newsidtab, convert_context, &args);
 	if (rc) {
 		printk(KERN_ERR "SELinux:  unable to convert the internal"
 			" representation of contexts in the new SID"
@@ -2950,6 +2950,18 @@ int security_get_allow_unknown(void)
 	return policydb.allow_unknown;
 }
 
+/**
+ * security_policy_ntypes - Number of types in the loaded policy
+ *
+ * Used to size the AVC.  Returns 0 if no policy has been loaded.
+ */
+u32 security_policy_ntypes(void)
+{
+	if (!ss_initialized)
+		return 0;
+	return policydb.p_types.nprim;
+}
+
 /**
  * security_policycap_supported - Check for a specific policy capability
  * @req_cap: capability
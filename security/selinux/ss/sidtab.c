@@ -7,6 +7,7 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/errno.h>
+#include <linux/jhash.h>
 #include "flask.h"
 #include "security.h"
 #include "sidtab.h"
@@ -14,6 +15,39 @@
 #define SIDTAB_HASH(sid) \
 (sid & SIDTAB_HASH_MASK)
 
+static u32 ebitmap_hash(struct ebitmap *e, u32 hash)
+{
+	struct ebitmap_node *node;
+
+	hash = jhash_1word(e->highbit, hash);
+	for (node = e->node; node; node = node->next) {
+		hash = jhash_1word(node->startbit, hash);
+		hash = jhash(node->maps, sizeof(node->maps), hash);
+	}
+	return hash;
+}
+
+/*
+ * Hash exactly the fields context_cmp() looks at, so that contexts
+ * comparing equal always land in the same chain.
+ */
+static u32 context_hash(struct context *c)
+{
+	u32 hash;
+
+	if (c->len)
+		return jhash(c->str, c->len, 0);
+
+	hash = jhash_3words(c->user, c->role, c->type, 0);
+	hash = jhash_2words(c->range.level[0].sens,
+			    c->range.level[1].sens, hash);
+	hash = ebitmap_hash(&c->range.level[0].cat, hash);
+	return ebitmap_hash(&c->range.level[1].cat, hash);
+}
+
+#define SIDTAB_CTX_HASH(chash) \
+((chash) & (SIDTAB_CTX_SIZE - 1))
+
 int sidtab_init(struct sidtab *s)
 {
 	int i;
@@ -21,8 +55,17 @@ int sidtab_init(struct sidtab *s)
 	s->htable = kmalloc(sizeof(*(s->htable)) * SIDTAB_SIZE, GFP_ATOMIC);
 	if (!s->htable)
 		return -ENOMEM;
+	s->ctable = kmalloc(sizeof(*(s->ctable)) * SIDTAB_CTX_SIZE,
+			    GFP_ATOMIC);
+	if (!s->ctable) {
+		kfree(s->htable);
+		s->htable = NULL;
+		return -ENOMEM;
+	}
 	for (i = 0; i < SIDTAB_SIZE; i++)
 		s->htable[i] = NULL;
+	for (i = 0; i < SIDTAB_CTX_SIZE; i++)
+		s->ctable[i] = NULL;
 	s->nel = 0;
 	s->next_sid = 1;
 	s->shutdown = 0;
@@ -32,7 +75,7 @@ int sidtab_init(struct sidtab *s)
 
 int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 {
-	int hvalue, rc = 0;
+	int hvalue, chvalue, rc = 0;
 	struct sidtab_node *prev, *cur, *newnode;
 
 	if (!s) {
@@ -64,6 +107,9 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 		rc = -ENOMEM;
 		goto out;
 	}
+	newnode->chash = context_hash(&newnode->context);
+	chvalue = SIDTAB_CTX_HASH(newnode->chash);
+	newnode->cnext = s->ctable[chvalue];
 
 	if (prev) {
 		newnode->next = prev->next;
@@ -74,6 +120,7 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 		wmb();
 		s->htable[hvalue] = newnode;
 	}
+	s->ctable[chvalue] = newnode;
 
 	s->nel++;
 	if (sid >= s->next_sid)
@@ -147,6 +194,39 @@ out:
 	return rc;
 }
 
+/*
+ * Apply convert to every context, then rebuild the context index since
+ * the hashes of converted contexts change.  Only used on a table that
+ * is not yet visible to lookups.
+ */
+int sidtab_convert(struct sidtab *s,
+		   int (*convert) (u32 sid,
+				   struct context *context,
+				   void *args),
+		   void *args)
+{
+	int i, rc;
+	struct sidtab_node *cur;
+
+	rc = sidtab_map(s, convert, args);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < SIDTAB_CTX_SIZE; i++)
+		s->ctable[i] = NULL;
+	for (i = 0; i < SIDTAB_SIZE; i++) {
+		for (cur = s->htable[i]; cur; cur = cur->next) {
+			int chvalue;
+
+			cur->chash = context_hash(&cur->context);
+			chvalue = SIDTAB_CTX_HASH(cur->chash);
+			cur->cnext = s->ctable[chvalue];
+			s->ctable[chvalue] = cur;
+		}
+	}
+	return 0;
+}
+
 static void sidtab_update_cache(struct sidtab *s, struct sidtab_node *n, int loc)
 {
 	BUG_ON(loc >= SIDTAB_CACHE_LEN);
@@ -159,19 +239,14 @@ static void sidtab_update_cache(struct sidtab *s, struct sidtab_node *n, int loc
 }
 
 static inline u32 sidtab_search_context(struct sidtab *s,
-						  struct context *context)
+					struct context *context, u32 chash)
 {
-	int i;
 	struct sidtab_node *cur;
 
-	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
-		while (cur) {
-			if (context_cmp(&cur->context, context)) {
-				sidtab_update_cache(s, cur, SIDTAB_CACHE_LEN - 1);
-				return cur->sid;
-			}
-			cur = cur->next;
+	for (cur = s->ctable[SIDTAB_CTX_HASH(chash)]; cur; cur = cur->cnext) {
+		if (cur->chash == chash && context_cmp(&cur->context, context)) {
+			sidtab_update_cache(s, cur, SIDTAB_CACHE_LEN - 1);
+			return cur->sid;
 		}
 	}
 	return 0;
@@ -198,19 +273,22 @@ int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
 			  u32 *out_sid)
 {
-	u32 sid;
+	u32 sid, chash;
 	int ret = 0;
 	unsigned long flags;
 
 	*out_sid = SECSID_NULL;
 
 	sid  = sidtab_search_cache(s, context);
-	if (!sid)
-		sid = sidtab_search_context(s, context);
+	if (sid)
+		goto out;
+
+	chash = context_hash(context);
+	sid = sidtab_search_context(s, context, chash);
 	if (!sid) {
 		spin_lock_irqsave(&s->lock, flags);
 		/* Rescan now that we hold the lock. */
-		sid = sidtab_search_context(s, context);
+		sid = sidtab_search_context(s, context, chash);
 		if (sid)
 			goto unlock_out;
 		/* No SID exists for the context.  Allocate a new one. */
@@ -232,7 +310,7 @@ unlock_out:
 
 	if (ret)
 		return ret;
-
+out:
 	*out_sid = sid;
 	return 0;
 }
@@ -262,6 +340,27 @@ void sidtab_hash_eval(struct sidtab *h, char *tag)
 	printk(KERN_DEBUG "%s:  %d entries and %d/%d buckets used, longest "
 	       "chain length %d\n", tag, h->nel, slots_used, SIDTAB_SIZE,
 	       max_chain_len);
+
+	slots_used = 0;
+	max_chain_len = 0;
+	for (i = 0; i < SIDTAB_CTX_SIZE; i++) {
+		cur = h->ctable[i];
+		if (cur) {
+			slots_used++;
+			chain_len = 0;
+			while (cur) {
+				chain_len++;
+				cur = cur->cnext;
+			}
+
+			if (chain_len > max_chain_len)
+				max_chain_len = chain_len;
+		}
+	}
+
+	printk(KERN_DEBUG "%s:  context index %d/%d buckets used, longest "
+	       "chain length %d\n", tag, slots_used, SIDTAB_CTX_SIZE,
+	       max_chain_len);
 }
 
 void sidtab_destroy(struct sidtab *s)
@@ -284,6 +383,8 @@ void sidtab_destroy(struct sidtab *s)
 	}
 	kfree(s->htable);
 	s->htable = NULL;
+	kfree(s->ctable);
+	s->ctable = NULL;
 	s->nel = 0;
 	s->next_sid = 1;
 }
@@ -295,6 +396,7 @@ void sidtab_set(struct sidtab *dst, struct sidtab *src)
 
 	spin_lock_irqsave(&src->lock, flags);
 	dst->htable = src->htable;
+	dst->ctable = src->ctable;
 	dst->nel = src->nel;
 	dst->next_sid = src->next_sid;
 	dst->shutdown = 0;
@@ -1,6 +1,8 @@
 /*
  * A security identifier table (sidtab) is a hash table
  * of security context structures indexed by SID value.
+ * A second set of chains through the same nodes indexes
+ * them by a hash of the context, for context to SID lookups.
  *
  * Author : Stephen Smalley, <sds@epoch.ncsc.mil>
  */
@@ -11,8 +13,10 @@
 
 struct sidtab_node {
 	u32 sid;		/* security identifier */
+	u32 chash;		/* hash of context */
 	struct context context;	/* security context structure */
 	struct sidtab_node *next;
+	struct sidtab_node *cnext;	/* next node in context chain */
 };
 
 #define SIDTAB_HASH_BITS 7
@@ -21,8 +25,12 @@ struct sidtab_node {
 
 #define SIDTAB_SIZE SIDTAB_HASH_BUCKETS
 
+#define SIDTAB_CTX_HASH_BITS 9
+#define SIDTAB_CTX_SIZE (1 << SIDTAB_CTX_HASH_BITS)
+
 struct sidtab {
 	struct sidtab_node **htable;
+	struct sidtab_node **ctable;	/* indexed by context hash */
 	unsigned int nel;	/* number of elements */
 	unsigned int next_sid;	/* next SID to allocate */
 	unsigned char shutdown;
@@ -42,6 +50,12 @@ int sidtab_map(struct sidtab *s,
 			     void *args),
 	       void *args);
 
+int sidtab_convert(struct sidtab *s,
+		   int (*convert) (u32 sid,
+				   struct context *context,
+				   void *args),
+		   void *args);
+
 int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
 			  u32 *sid);
@@ -19,6 +19,8 @@
 #include <linux/wait.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <sound/core.h>
 #include <sound/soc.h>
 #include <sound/soc-dapm.h>
@@ -34,6 +36,23 @@
 
 static struct audio_locks the_locks;
 
+/*
+ * Ring mode for non-mmap playback: the copy callback fills the contiguous
+ * period buffers in place and several periods are handed to the DSP with
+ * a single ASM write.  This cuts APR commands and write-done interrupts
+ * (and so apps wakeups) by the batch factor.  0 or 1 keeps one write per
+ * period.  Takes effect at the next prepare.
+ */
+static int ring_periods;
+module_param(ring_periods, int, 0644);
+MODULE_PARM_DESC(ring_periods, "Playback periods coalesced per ASM write");
+
+static struct {
+	atomic_t write_cmds;
+	atomic_t write_done;
+	atomic_t periods;
+} pcm_stats;
+
 struct snd_msm {
 	struct snd_card *card;
 	struct snd_pcm *pcm;
@@ -121,6 +140,97 @@ static void msm_pcm_route_event_handler(enum msm_pcm_routing_event event,
 	}
 }
 
+/* Called with ring_lock held. */
+static void msm_pcm_ring_submit(struct msm_audio *prtd)
+{
+	struct snd_pcm_runtime *runtime = prtd->substream->runtime;
+	unsigned int pending, idx, cnt;
+
+	if (!atomic_read(&prtd->start))
+		return;
+
+	while ((pending = prtd->ring_wr - prtd->ring_sub) != 0) {
+		/*
+		 * Hold back a short batch while the DSP still has data
+		 * queued; flush whatever is there once it runs dry so the
+		 * start and the tail of a stream are not stalled.
+		 */
+		if (pending < prtd->ring_batch && prtd->ring_inflight)
+			break;
+		idx = prtd->ring_sub % prtd->periods;
+		cnt = min_t(unsigned int, pending, prtd->ring_batch);
+		cnt = min_t(unsigned int, cnt, prtd->periods - idx);
+		if (q6asm_write_ring(prtd->audio_client, idx, cnt,
+				     cnt * prtd->pcm_count) < 0)
+			break;
+		atomic_inc(&pcm_stats.write_cmds);
+		prtd->ring_len[idx] = cnt;
+		prtd->ring_sub += cnt;
+		prtd->ring_inflight++;
+	}
+
+	/*
+	 * The last write of a stream rarely fills a whole period.  Once
+	 * everything before it has been played and the stream is
+	 * draining, hand it over with its real length.  If the DSP ran dry
+	 * while the stream is still running, look again a period later:
+	 * there is no event of our own when the drain starts.
+	 */
+	if (!prtd->ring_part || prtd->ring_tail || pending ||
+	    prtd->ring_inflight)
+		return;
+	if (runtime->status->state != SNDRV_PCM_STATE_DRAINING) {
+		mod_timer(&prtd->ring_timer, jiffies + prtd->ring_timeout);
+		return;
+	}
+	idx = prtd->ring_sub % prtd->periods;
+	if (q6asm_write_ring(prtd->audio_client, idx, 1,
+			     prtd->ring_part) < 0)
+		return;
+	atomic_inc(&pcm_stats.write_cmds);
+	prtd->ring_tail = prtd->ring_part;
+	prtd->ring_inflight++;
+}
+
+static void msm_pcm_ring_timer(unsigned long data)
+{
+	struct msm_audio *prtd = (struct msm_audio *)data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&prtd->ring_lock, flags);
+	msm_pcm_ring_submit(prtd);
+	spin_unlock_irqrestore(&prtd->ring_lock, flags);
+}
+
+static void msm_pcm_ring_done(struct msm_audio *prtd, uint32_t token)
+{
+	struct snd_pcm_substream *substream = prtd->substream;
+	unsigned long flags;
+	unsigned int cnt = 0, bytes;
+
+	spin_lock_irqsave(&prtd->ring_lock, flags);
+	if (token < MSM_PCM_RING_MAX_PERIODS) {
+		cnt = prtd->ring_len[token];
+		prtd->ring_len[token] = 0;
+	}
+	if (prtd->ring_inflight)
+		prtd->ring_inflight--;
+	bytes = cnt * prtd->pcm_count;
+	if (!cnt && prtd->ring_tail) {
+		/* the partial period sent on drain */
+		bytes = prtd->ring_tail;
+		prtd->ring_tail = 0;
+		prtd->ring_part = 0;
+	}
+	prtd->pcm_irq_pos += bytes;
+	msm_pcm_ring_submit(prtd);
+	spin_unlock_irqrestore(&prtd->ring_lock, flags);
+
+	atomic_add(cnt, &pcm_stats.periods);
+	if (bytes && atomic_read(&prtd->start))
+		snd_pcm_period_elapsed(substream);
+}
+
 static void event_handler(uint32_t opcode,
 		uint32_t token, uint32_t *payload, void *priv)
 {
@@ -136,6 +246,12 @@ static void event_handler(uint32_t opcode,
 	case ASM_DATA_EVENT_WRITE_DONE: {
 		pr_debug("ASM_DATA_EVENT_WRITE_DONE\n");
 		pr_debug("Buffer Consumed = 0x%08x\n", *ptrmem);
+		atomic_inc(&pcm_stats.write_done);
+		if (prtd->ring_batch) {
+			msm_pcm_ring_done(prtd, token);
+			break;
+		}
+		atomic_inc(&pcm_stats.periods);
 		prtd->pcm_irq_pos += prtd->pcm_count;
 		if (atomic_read(&prtd->start))
 			snd_pcm_period_elapsed(substream);
@@ -150,6 +266,7 @@ static void event_handler(uint32_t opcode,
 				&size, &idx)) {
 			pr_debug("%s:writing %d bytes of buffer to dsp 2\n",
 					__func__, prtd->pcm_count);
+			atomic_inc(&pcm_stats.write_cmds);
 			q6asm_write_nolock(prtd->audio_client,
 				prtd->pcm_count, 0, 0, NO_TIMESTAMP);
 		}
@@ -204,11 +321,21 @@ static void event_handler(uint32_t opcode,
 				atomic_set(&prtd->start, 1);
 				break;
 			}
+			if (prtd->ring_batch) {
+				unsigned long flags;
+
+				atomic_set(&prtd->start, 1);
+				spin_lock_irqsave(&prtd->ring_lock, flags);
+				msm_pcm_ring_submit(prtd);
+				spin_unlock_irqrestore(&prtd->ring_lock, flags);
+				break;
+			}
 			if (prtd->mmap_flag) {
 				pr_debug("%s:writing %d bytes"
 					" of buffer to dsp\n",
 					__func__,
 					prtd->pcm_count);
+				atomic_inc(&pcm_stats.write_cmds);
 				q6asm_write_nolock(prtd->audio_client,
 					prtd->pcm_count,
 					0, 0, NO_TIMESTAMP);
@@ -218,6 +345,7 @@ static void event_handler(uint32_t opcode,
 						 " of buffer to dsp\n",
 						__func__,
 						prtd->pcm_count);
+					atomic_inc(&pcm_stats.write_cmds);
 					q6asm_write_nolock(prtd->audio_client,
 						prtd->pcm_count,
 						0, 0, NO_TIMESTAMP);
@@ -251,6 +379,28 @@ static int msm_pcm_playback_prepare(struct snd_pcm_substream *substream)
 	/* rate and channels are sent to audio driver */
 	prtd->samp_rate = runtime->rate;
 	prtd->channel_mode = runtime->channels;
+
+	prtd->periods = runtime->periods;
+	prtd->ring_batch = 0;
+	prtd->ring_inflight = 0;
+	prtd->ring_wr = 0;
+	prtd->ring_part = 0;
+	prtd->ring_sub = 0;
+	prtd->ring_tail = 0;
+	memset(prtd->ring_len, 0, sizeof(prtd->ring_len));
+	prtd->ring_timeout = max(1UL, msecs_to_jiffies(
+		bytes_to_frames(runtime, prtd->pcm_count) * 1000 /
+		runtime->rate));
+	if (ring_periods > 1 && !prtd->mmap_flag &&
+	    runtime->periods <= MSM_PCM_RING_MAX_PERIODS) {
+		/* keep at least two writes queued on the DSP */
+		prtd->ring_batch = min(ring_periods,
+				       (int)runtime->periods / 2);
+		if (prtd->ring_batch < 2)
+			prtd->ring_batch = 0;
+	}
+	pr_debug("%s: ring batch %d periods\n", __func__, prtd->ring_batch);
+
 	if (prtd->enabled)
 		return 0;
 
@@ -323,6 +473,7 @@ static int msm_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 	case SNDRV_PCM_TRIGGER_STOP:
 		pr_debug("SNDRV_PCM_TRIGGER_STOP\n");
 		atomic_set(&prtd->start, 0);
+		del_timer(&prtd->ring_timer);
 		if (substream->stream != SNDRV_PCM_STREAM_PLAYBACK)
 			break;
 		prtd->cmd_ack = 0;
@@ -333,6 +484,7 @@ static int msm_pcm_trigger(struct snd_pcm_substream *substream, int cmd)
 		pr_debug("SNDRV_PCM_TRIGGER_PAUSE\n");
 		q6asm_cmd_nowait(prtd->audio_client, CMD_PAUSE);
 		atomic_set(&prtd->start, 0);
+		del_timer(&prtd->ring_timer);
 		break;
 	default:
 		ret = -EINVAL;
@@ -356,6 +508,9 @@ static int msm_pcm_open(struct snd_pcm_substream *substream)
 		return -ENOMEM;
 	}
 	prtd->substream = substream;
+	spin_lock_init(&prtd->ring_lock);
+	setup_timer(&prtd->ring_timer, msm_pcm_ring_timer,
+		    (unsigned long)prtd);
 	prtd->audio_client = q6asm_audio_client_alloc(
 				(app_cb)event_handler, prtd);
 	if (!prtd->audio_client) {
@@ -441,6 +596,38 @@ static int msm_pcm_open(struct snd_pcm_substream *substream)
 	return 0;
 }
 
+/*
+ * The ALSA core only hands us space the DSP has already consumed (the
+ * pointer only moves on write done), so the data can go straight into
+ * the mapped ring at hwoff.
+ */
+static int msm_pcm_ring_copy(struct snd_pcm_substream *substream,
+	snd_pcm_uframes_t hwoff, void __user *buf, snd_pcm_uframes_t frames)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	struct msm_audio *prtd = runtime->private_data;
+	unsigned int off = frames_to_bytes(runtime, hwoff);
+	unsigned int fbytes = frames_to_bytes(runtime, frames);
+	unsigned long flags;
+
+	if (off + fbytes > prtd->pcm_size) {
+		pr_err("%s: copy past ring end off=%d len=%d\n",
+			__func__, off, fbytes);
+		return -EINVAL;
+	}
+	if (copy_from_user(runtime->dma_area + off, buf, fbytes))
+		return -EFAULT;
+
+	spin_lock_irqsave(&prtd->ring_lock, flags);
+	prtd->ring_part += fbytes;
+	prtd->ring_wr += prtd->ring_part / prtd->pcm_count;
+	prtd->ring_part %= prtd->pcm_count;
+	msm_pcm_ring_submit(prtd);
+	spin_unlock_irqrestore(&prtd->ring_lock, flags);
+
+	return 0;
+}
+
 static int msm_pcm_playback_copy(struct snd_pcm_substream *substream, int a,
 	snd_pcm_uframes_t hwoff, void __user *buf, snd_pcm_uframes_t frames)
 {
@@ -455,6 +642,9 @@ static int msm_pcm_playback_copy(struct snd_pcm_substream *substream, int a,
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct msm_audio *prtd = runtime->private_data;
 
+	if (prtd->ring_batch)
+		return msm_pcm_ring_copy(substream, hwoff, buf, frames);
+
 	fbytes = frames_to_bytes(runtime, frames);
 	pr_debug("%s: prtd->out_count = %d\n",
 				__func__, atomic_read(&prtd->out_count));
@@ -489,6 +679,7 @@ static int msm_pcm_playback_copy(struct snd_pcm_substream *substream, int a,
 		if (atomic_read(&prtd->start)) {
 			pr_debug("%s:writing %d bytes of buffer to dsp\n",
 					__func__, xfer);
+			atomic_inc(&pcm_stats.write_cmds);
 			ret = q6asm_write(prtd->audio_client, xfer,
 						0, 0, NO_TIMESTAMP);
 			if (ret < 0) {
@@ -518,6 +709,7 @@ static int msm_pcm_playback_close(struct snd_pcm_substream *substream)
 				prtd->cmd_ack, 5 * HZ);
 	if (!ret)
 		pr_err("%s: CMD_EOS failed\n", __func__);
+	del_timer_sync(&prtd->ring_timer);
 	q6asm_cmd(prtd->audio_client, CMD_CLOSE);
 	q6asm_audio_client_buf_free_contiguous(dir,
 				prtd->audio_client);
@@ -823,6 +1015,40 @@ static struct platform_driver msm_pcm_driver = {
 	.remove = __devexit_p(msm_pcm_remove),
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int msm_pcm_stats_show(struct seq_file *m, void *unused)
+{
+	seq_printf(m, "write_cmds: %d\n", atomic_read(&pcm_stats.write_cmds));
+	seq_printf(m, "write_done: %d\n", atomic_read(&pcm_stats.write_done));
+	seq_printf(m, "periods: %d\n", atomic_read(&pcm_stats.periods));
+	return 0;
+}
+
+static int msm_pcm_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, msm_pcm_stats_show, NULL);
+}
+
+static ssize_t msm_pcm_stats_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	atomic_set(&pcm_stats.write_cmds, 0);
+	atomic_set(&pcm_stats.write_done, 0);
+	atomic_set(&pcm_stats.periods, 0);
+	return count;
+}
+
+static const struct file_operations msm_pcm_stats_fops = {
+	.open = msm_pcm_stats_open,
+	.read = seq_read,
+	.write = msm_pcm_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static struct dentry *msm_pcm_stats_dentry;
+#endif
+
 static int __init msm_soc_platform_init(void)
 {
 	init_waitqueue_head(&the_locks.enable_wait);
@@ -830,12 +1056,19 @@ static int __init msm_soc_platform_init(void)
 	init_waitqueue_head(&the_locks.write_wait);
 	init_waitqueue_head(&the_locks.read_wait);
 
+#ifdef CONFIG_DEBUG_FS
+	msm_pcm_stats_dentry = debugfs_create_file("msm_pcm_q6_stats",
+			S_IRUGO | S_IWUSR, NULL, NULL, &msm_pcm_stats_fops);
+#endif
 	return platform_driver_register(&msm_pcm_driver);
 }
 module_init(msm_soc_platform_init);
 
 static void __exit msm_soc_platform_exit(void)
 {
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove(msm_pcm_stats_dentry);
+#endif
 	platform_driver_unregister(&msm_pcm_driver);
 }
 module_exit(msm_soc_platform_exit);
@@ -18,6 +18,7 @@
 
 #ifndef _MSM_PCM_H
 #define _MSM_PCM_H
+#include <linux/timer.h>
 #include <sound/apr_audio.h>
 #include <sound/q6asm.h>
 
@@ -28,6 +29,8 @@
 
 extern int copy_count;
 
+#define MSM_PCM_RING_MAX_PERIODS 16
+
 struct buffer {
 	void *data;
 	unsigned size;
@@ -83,6 +86,18 @@ struct msm_audio {
 	atomic_t pending_buffer;
 	int cmd_interrupt;
 	bool meta_data_mode;
+
+	/* ring mode: several periods per ASM write, see msm-pcm-q6.c */
+	spinlock_t ring_lock;
+	int ring_batch;		/* periods per write, 0 when disabled */
+	int ring_inflight;	/* writes queued on the DSP */
+	unsigned int ring_wr;	/* periods filled by the copy path */
+	unsigned int ring_part;	/* bytes filled into the next period */
+	unsigned int ring_sub;	/* periods handed to the DSP */
+	unsigned int ring_tail;	/* bytes of the partial period handed over */
+	uint8_t ring_len[MSM_PCM_RING_MAX_PERIODS];
+	struct timer_list ring_timer;	/* flushes the tail on drain */
+	unsigned long ring_timeout;	/* one period, in jiffies */
 };
 
 struct output_meta_data_st {
@@ -3822,6 +3822,66 @@ fail_cmd:
 	return -EINVAL;
 }
 
+/*
+ * Queue @cnt consecutive buffers of a contiguous allocation, starting at
+ * @idx, as a single ASM write.  The whole region is mapped in one go by
+ * q6asm_audio_client_buf_alloc_contiguous(), so the DSP can consume it
+ * as one chunk and only acks once for all of them.  @len is the number
+ * of bytes to play; only the last buffer may be partially filled.
+ */
+int q6asm_write_ring(struct audio_client *ac, uint32_t idx, uint32_t cnt,
+		     uint32_t len)
+{
+	int rc = 0;
+	struct asm_stream_cmd_write write;
+	struct audio_port_data *port;
+	struct audio_buffer    *ab;
+
+	if (!ac || ac->apr == NULL) {
+		pr_err("APR handle NULL\n");
+		return -EINVAL;
+	}
+	if (!(ac->io_mode & SYNC_IO_MODE))
+		return -EINVAL;
+
+	port = &ac->port[IN];
+	if (port->buf == NULL || !cnt ||
+	    idx + cnt > port->max_buf_cnt) {
+		pr_err("%s: invalid ring write idx=%d cnt=%d\n",
+			__func__, idx, cnt);
+		return -EINVAL;
+	}
+	ab = &port->buf[idx];
+	if (len > ab->size * cnt || len <= ab->size * (cnt - 1)) {
+		pr_err("%s: invalid ring write len=%d cnt=%d\n",
+			__func__, len, cnt);
+		return -EINVAL;
+	}
+
+	q6asm_add_hdr_async(ac, &write.hdr, sizeof(write), FALSE);
+
+	write.hdr.token = idx;
+	write.hdr.opcode = ASM_DATA_CMD_WRITE;
+	write.buf_add = ab->phys;
+	write.avail_bytes = len;
+	write.uid = idx;
+	write.msw_ts = 0;
+	write.lsw_ts = 0;
+	write.uflags = 0x00000000;
+	port->dsp_buf = (idx + cnt) % port->max_buf_cnt;
+
+	pr_debug("%s: session[%d] bufadd[0x%x] len[0x%x] token[0x%x]\n",
+		__func__, ac->session, write.buf_add, write.avail_bytes,
+		write.hdr.token);
+
+	rc = apr_send_pkt(ac->apr, (uint32_t *) &write);
+	if (rc < 0) {
+		pr_err("write op[0x%x]rc[%d]\n", write.hdr.opcode, rc);
+		return -EINVAL;
+	}
+	return 0;
+}
+
 int q6asm_get_session_time(struct audio_client *ac, uint64_t *tstamp)
 {
 	struct apr_hdr hdr;
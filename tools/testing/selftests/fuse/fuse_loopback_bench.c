@@ -0,0 +1,321 @@
+/*
+ * FUSE request queue scaling benchmark.
+ *
+ * Mounts a minimal in-process FUSE filesystem served straight from
+ * /dev/fuse (no libfuse) and has N client threads stat() a file in a
+ * loop while N daemon threads answer.  Entry and attribute timeouts are
+ * zero, so every stat() is a LOOKUP and a GETATTR round trip through the
+ * kernel's request queues.  Client and daemon thread i are both pinned
+ * to CPU i, which binds the daemon thread to that CPU's queue when the
+ * connection has per-CPU queues.  N doubles from 1 up to -t.
+ *
+ * When /sys/module/fuse/parameters/per_cpu_queues is writable the
+ * benchmark is done twice, with a single queue and with per-CPU queues,
+ * and the previous setting is restored afterwards.
+ *
+ * Usage: fuse_loopback_bench [-t threads] [-s seconds]
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fuse.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define PARAM_NODE	"/sys/module/fuse/parameters/per_cpu_queues"
+#define FILE_NAME	"file"
+#define FILE_INO	2
+#define BUF_SIZE	(64 * 1024 + 4096)
+
+static int nr_cpus;
+static int max_threads;
+static int seconds = 2;
+
+static char mnt[] = "/tmp/fuse_bench.XXXXXX";
+static char path[sizeof(mnt) + sizeof(FILE_NAME)];
+static int devfd;
+static volatile int stop;
+
+struct client {
+	pthread_t thread;
+	int cpu;
+	unsigned long ops;
+};
+
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu % nr_cpus, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+}
+
+static int reply(uint64_t unique, int error, const void *arg, size_t size)
+{
+	struct fuse_out_header oh = {
+		.len = sizeof(oh) + (error ? 0 : size),
+		.error = error,
+		.unique = unique,
+	};
+	struct iovec iov[2] = {
+		{ &oh, sizeof(oh) },
+		{ (void *)arg, size },
+	};
+
+	return writev(devfd, iov, error ? 1 : 2) < 0 ? -errno : 0;
+}
+
+static void fill_attr(struct fuse_attr *attr, uint64_t ino)
+{
+	memset(attr, 0, sizeof(*attr));
+	attr->ino = ino;
+	attr->mode = ino == FUSE_ROOT_ID ? S_IFDIR | 0755 : S_IFREG | 0644;
+	attr->nlink = ino == FUSE_ROOT_ID ? 2 : 1;
+	attr->blksize = 4096;
+}
+
+static void handle(struct fuse_in_header *ih, void *arg)
+{
+	switch (ih->opcode) {
+	case FUSE_INIT: {
+		struct fuse_init_in *in = arg;
+		/* reply in the layout all protocol minors >= 7.13 accept */
+		struct {
+			uint32_t major, minor, max_readahead, flags;
+			uint16_t max_background, congestion_threshold;
+			uint32_t max_write;
+		} out = {
+			.major = FUSE_KERNEL_VERSION,
+			.minor = in->minor,
+			.max_background = 64,
+			.congestion_threshold = 48,
+			.max_write = 4096,
+		};
+		reply(ih->unique, 0, &out, sizeof(out));
+		break;
+	}
+	case FUSE_LOOKUP: {
+		struct fuse_entry_out out;
+
+		if (ih->nodeid != FUSE_ROOT_ID || strcmp(arg, FILE_NAME)) {
+			reply(ih->unique, -ENOENT, NULL, 0);
+			break;
+		}
+		memset(&out, 0, sizeof(out));
+		out.nodeid = FILE_INO;
+		fill_attr(&out.attr, FILE_INO);
+		reply(ih->unique, 0, &out, sizeof(out));
+		break;
+	}
+	case FUSE_GETATTR: {
+		struct fuse_attr_out out;
+
+		memset(&out, 0, sizeof(out));
+		fill_attr(&out.attr, ih->nodeid);
+		reply(ih->unique, 0, &out, sizeof(out));
+		break;
+	}
+	case FUSE_FORGET:
+	case FUSE_BATCH_FORGET:
+		break;
+	default:
+		reply(ih->unique, -ENOSYS, NULL, 0);
+		break;
+	}
+}
+
+static void *daemon_thread(void *arg)
+{
+	char *buf = malloc(BUF_SIZE);
+	ssize_t len;
+
+	if (!buf)
+		return NULL;
+	pin((long)arg);
+	for (;;) {
+		len = read(devfd, buf, BUF_SIZE);
+		if (len < 0) {
+			if (errno == EINTR || errno == ENOENT)
+				continue;
+			break;	/* ENODEV once unmounted */
+		}
+		if ((size_t)len < sizeof(struct fuse_in_header))
+			continue;
+		handle((struct fuse_in_header *)buf,
+		       buf + sizeof(struct fuse_in_header));
+	}
+	free(buf);
+	return NULL;
+}
+
+static void *client_thread(void *arg)
+{
+	struct client *c = arg;
+	struct stat st;
+
+	pin(c->cpu);
+	while (!stop) {
+		if (stat(path, &st))
+			break;
+		c->ops++;
+	}
+	return NULL;
+}
+
+static int run(const char *tag, int nr)
+{
+	pthread_t *daemons;
+	struct client *clients;
+	unsigned long total = 0;
+	char opts[128];
+	struct stat st;
+	long i;
+	int ret = -1;
+
+	daemons = calloc(nr, sizeof(*daemons));
+	clients = calloc(nr, sizeof(*clients));
+	if (!daemons || !clients)
+		return -1;
+
+	devfd = open("/dev/fuse", O_RDWR);
+	if (devfd < 0) {
+		perror("/dev/fuse");
+		goto out_free;
+	}
+	snprintf(opts, sizeof(opts),
+		 "fd=%d,rootmode=40000,user_id=0,group_id=0", devfd);
+	if (mount("fuse_bench", mnt, "fuse", MS_NOSUID | MS_NODEV, opts)) {
+		perror("mount");
+		goto out_close;
+	}
+	for (i = 0; i < nr; i++)
+		pthread_create(&daemons[i], NULL, daemon_thread, (void *)i);
+
+	if (stat(path, &st)) {
+		perror(path);
+		goto out_umount;
+	}
+
+	stop = 0;
+	for (i = 0; i < nr; i++) {
+		clients[i].cpu = i;
+		pthread_create(&clients[i].thread, NULL, client_thread,
+			       &clients[i]);
+	}
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < nr; i++) {
+		pthread_join(clients[i].thread, NULL);
+		total += clients[i].ops;
+	}
+	printf("%-8s %3d threads: %9lu ops/s\n", tag, nr, total / seconds);
+	ret = 0;
+
+out_umount:
+	if (umount(mnt))
+		umount2(mnt, MNT_DETACH);
+	for (i = 0; i < nr; i++)
+		pthread_join(daemons[i], NULL);
+out_close:
+	close(devfd);
+out_free:
+	free(daemons);
+	free(clients);
+	return ret;
+}
+
+static int sweep(const char *tag)
+{
+	int nr;
+
+	for (nr = 1; nr < max_threads; nr *= 2)
+		if (run(tag, nr))
+			return -1;
+	return run(tag, max_threads);
+}
+
+static int read_param(void)
+{
+	char c;
+	int fd, ret;
+
+	fd = open(PARAM_NODE, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	ret = read(fd, &c, 1) == 1 ? (c == 'Y' || c == '1') : -1;
+	close(fd);
+	return ret;
+}
+
+static int write_param(int val)
+{
+	int fd, ret;
+
+	fd = open(PARAM_NODE, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, val ? "1" : "0", 1) == 1 ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, old, ret;
+
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	max_threads = nr_cpus;
+	while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-s seconds]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+	if (nr_cpus < 1 || max_threads < 1 || seconds < 1)
+		return 1;
+
+	if (geteuid() || access("/dev/fuse", R_OK | W_OK)) {
+		printf("fuse: needs root and /dev/fuse [SKIP]\n");
+		return 0;
+	}
+	if (!mkdtemp(mnt)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(path, sizeof(path), "%s/%s", mnt, FILE_NAME);
+
+	old = read_param();
+	if (old < 0 || write_param(0)) {
+		printf("%s not writable, single run\n", PARAM_NODE);
+		ret = sweep("current");
+	} else {
+		ret = sweep("single");
+		if (!ret) {
+			write_param(1);
+			ret = sweep("per-cpu");
+		}
+		write_param(old);
+	}
+
+	rmdir(mnt);
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Private futex hash contention benchmark.
+ *
+ * Several processes each run pairs of threads that ping-pong on a
+ * PROCESS_PRIVATE futex of their own.  Nothing is shared between the
+ * processes, so any slowdown as processes are added comes from hash
+ * bucket contention in the kernel.
+ *
+ * When run as root the benchmark is done twice, with
+ * /sys/module/kernel/parameters/futex_private_hash cleared (all private
+ * futexes in the global table) and set (one table per process), and the
+ * previous setting is restored afterwards.
+ *
+ * Usage: futex_hash_bench [-p processes] [-t pairs] [-s seconds]
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PARAM_NODE	"/sys/module/kernel/parameters/futex_private_hash"
+
+static int nr_procs;
+static int nr_pairs = 4;
+static int seconds = 5;
+
+static volatile int stop;
+
+struct pair {
+	int word;
+	unsigned long ops[2];
+};
+
+struct worker {
+	struct pair *pair;
+	int side;
+};
+
+static int futex(int *uaddr, int op, int val, const struct timespec *ts)
+{
+	return syscall(SYS_futex, uaddr, op, val, ts, NULL, 0);
+}
+
+static void *pingpong(void *arg)
+{
+	struct worker *w = arg;
+	struct pair *p = w->pair;
+	struct timespec ts = { 0, 10 * 1000 * 1000 };
+	int me = w->side, other = !w->side;
+
+	while (!stop) {
+		if (__atomic_load_n(&p->word, __ATOMIC_ACQUIRE) != me) {
+			futex(&p->word, FUTEX_WAIT_PRIVATE, other, &ts);
+			continue;
+		}
+		p->ops[me]++;
+		__atomic_store_n(&p->word, other, __ATOMIC_RELEASE);
+		futex(&p->word, FUTEX_WAKE_PRIVATE, 1, NULL);
+	}
+	return NULL;
+}
+
+static void child(unsigned long *result)
+{
+	pthread_t *threads;
+	struct worker *workers;
+	struct pair *pairs;
+	unsigned long total = 0;
+	int i;
+
+	threads = calloc(2 * nr_pairs, sizeof(*threads));
+	workers = calloc(2 * nr_pairs, sizeof(*workers));
+	pairs = calloc(nr_pairs, sizeof(*pairs));
+	if (!threads || !workers || !pairs)
+		exit(1);
+
+	for (i = 0; i < 2 * nr_pairs; i++) {
+		workers[i].pair = &pairs[i / 2];
+		workers[i].side = i & 1;
+		if (pthread_create(&threads[i], NULL, pingpong, &workers[i]))
+			exit(1);
+	}
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < 2 * nr_pairs; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < nr_pairs; i++)
+		total += pairs[i].ops[0] + pairs[i].ops[1];
+	*result = total;
+	exit(0);
+}
+
+static int run(const char *tag)
+{
+	unsigned long *results, total = 0;
+	int i, status, ret = 0;
+
+	results = mmap(NULL, nr_procs * sizeof(*results),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+
+	fflush(stdout);
+	for (i = 0; i < nr_procs; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			return -1;
+		}
+		if (!pid)
+			child(&results[i]);
+	}
+	for (i = 0; i < nr_procs; i++) {
+		if (wait(&status) < 0 || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			ret = -1;
+	}
+
+	for (i = 0; i < nr_procs; i++)
+		total += results[i];
+	printf("%-8s %d procs x %d pairs: %lu handoffs/s, %lu ns/handoff/pair\n",
+	       tag, nr_procs, nr_pairs, total / seconds,
+	       total ? (unsigned long)(seconds * 1000000000ULL *
+				       nr_procs * nr_pairs / total) : 0);
+
+	munmap(results, nr_procs * sizeof(*results));
+	return ret;
+}
+
+static int read_param(void)
+{
+	char c;
+	int fd, ret;
+
+	fd = open(PARAM_NODE, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	ret = read(fd, &c, 1) == 1 ? (c == 'Y' || c == '1') : -1;
+	close(fd);
+	return ret;
+}
+
+static int write_param(int val)
+{
+	int fd, ret;
+
+	fd = open(PARAM_NODE, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	ret = write(fd, val ? "1" : "0", 1) == 1 ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, old, ret;
+
+	nr_procs = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "p:t:s:")) != -1) {
+		switch (opt) {
+		case 'p':
+			nr_procs = atoi(optarg);
+			break;
+		case 't':
+			nr_pairs = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p processes] [-t pairs] "
+				"[-s seconds]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (nr_procs < 1 || nr_pairs < 1 || seconds < 1)
+		return 1;
+
+	old = read_param();
+	if (old < 0 || write_param(0)) {
+		printf("%s not writable, single run\n", PARAM_NODE);
+		return run("current") ? 1 : 0;
+	}
+
+	ret = run("global");
+	if (!ret) {
+		write_param(1);
+		ret = run("per-mm");
+	}
+	write_param(old);
+
+	return ret ? 1 : 0;
+}
@@ -0,0 +1,252 @@
+/*
+ * Multitouch frame delivery through evdev.
+ *
+ * A uinput multitouch device emits frames of N fingers (slot, tracking
+ * id, x, y, pressure per finger, then SYN_REPORT) as fast as it can,
+ * while several readers drain the matching /dev/input/event node.
+ * Reported are the events per second delivered to each reader, the
+ * writer cost per frame (which includes the in-kernel delivery to all
+ * readers) and the number of reader wakeups, i.e. read() calls that
+ * returned data, relative to the number of frames.
+ *
+ * Usage: evdev_frame_bench [-f fingers] [-r readers] [-n frames]
+ *
+ * Needs write access to /dev/uinput.
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEV_NAME	"evdev-frame-bench"
+#define MAX_FINGERS	10
+#define MAX_READERS	16
+
+static int fingers = MAX_FINGERS;
+static int nr_readers = 4;
+static long frames = 100000;
+
+struct reader {
+	pthread_t thread;
+	int fd;
+	unsigned long events;
+	unsigned long wakeups;
+	unsigned long dropped;
+};
+
+static struct reader readers[MAX_READERS];
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int uinput_create(void)
+{
+	struct uinput_user_dev dev;
+	int fd, i;
+	static const int axes[] = {
+		ABS_MT_SLOT, ABS_MT_TRACKING_ID, ABS_MT_POSITION_X,
+		ABS_MT_POSITION_Y, ABS_MT_PRESSURE,
+	};
+
+	fd = open("/dev/uinput", O_WRONLY);
+	if (fd < 0)
+		return -1;
+
+	memset(&dev, 0, sizeof(dev));
+	strncpy(dev.name, DEV_NAME, sizeof(dev.name) - 1);
+	dev.id.bustype = BUS_VIRTUAL;
+	dev.absmax[ABS_MT_SLOT] = MAX_FINGERS - 1;
+	dev.absmax[ABS_MT_TRACKING_ID] = 65535;
+	dev.absmax[ABS_MT_POSITION_X] = 1079;
+	dev.absmax[ABS_MT_POSITION_Y] = 1919;
+	dev.absmax[ABS_MT_PRESSURE] = 255;
+
+	if (ioctl(fd, UI_SET_EVBIT, EV_SYN) || ioctl(fd, UI_SET_EVBIT, EV_ABS))
+		goto err;
+	for (i = 0; i < (int)(sizeof(axes) / sizeof(axes[0])); i++)
+		if (ioctl(fd, UI_SET_ABSBIT, axes[i]))
+			goto err;
+	if (write(fd, &dev, sizeof(dev)) != sizeof(dev) ||
+	    ioctl(fd, UI_DEV_CREATE))
+		goto err;
+	return fd;
+err:
+	close(fd);
+	return -1;
+}
+
+static int open_evdev(void)
+{
+	char path[300], name[128];
+	struct dirent *de;
+	DIR *dir;
+	int fd = -1;
+
+	dir = opendir("/dev/input");
+	if (!dir)
+		return -1;
+	while ((de = readdir(dir))) {
+		if (strncmp(de->d_name, "event", 5))
+			continue;
+		snprintf(path, sizeof(path), "/dev/input/%s", de->d_name);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			continue;
+		if (ioctl(fd, EVIOCGNAME(sizeof(name)), name) > 0 &&
+		    !strcmp(name, DEV_NAME))
+			break;
+		close(fd);
+		fd = -1;
+	}
+	closedir(dir);
+	return fd;
+}
+
+static void *reader_fn(void *arg)
+{
+	struct reader *r = arg;
+	struct input_event ev[256];
+	ssize_t n;
+	int i;
+
+	for (;;) {
+		n = read(r->fd, ev, sizeof(ev));
+		if (n <= 0)
+			break;
+		r->wakeups++;
+		n /= sizeof(ev[0]);
+		for (i = 0; i < n; i++) {
+			if (ev[i].type == EV_SYN && ev[i].code == SYN_DROPPED)
+				r->dropped++;
+			/* writer's end marker */
+			if (ev[i].type == EV_ABS && ev[i].code == ABS_MT_PRESSURE &&
+			    ev[i].value == 0)
+				return NULL;
+		}
+		r->events += n;
+	}
+	return NULL;
+}
+
+static void set_ev(struct input_event *ev, int type, int code, int value)
+{
+	memset(ev, 0, sizeof(*ev));
+	ev->type = type;
+	ev->code = code;
+	ev->value = value;
+}
+
+int main(int argc, char **argv)
+{
+	struct input_event frame[MAX_FINGERS * 5 + 1];
+	unsigned long events = 0, wakeups = 0, dropped = 0;
+	long long start, elapsed;
+	int opt, ufd, i, n;
+	long f;
+
+	while ((opt = getopt(argc, argv, "f:r:n:")) != -1) {
+		switch (opt) {
+		case 'f':
+			fingers = atoi(optarg);
+			break;
+		case 'r':
+			nr_readers = atoi(optarg);
+			break;
+		case 'n':
+			frames = atol(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-f fingers] [-r readers] "
+				"[-n frames]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (fingers < 1 || fingers > MAX_FINGERS ||
+	    nr_readers < 1 || nr_readers > MAX_READERS || frames < 1)
+		return 1;
+
+	ufd = uinput_create();
+	if (ufd < 0) {
+		perror("uinput");
+		return 1;
+	}
+	/* give udev/the core a moment to create the node */
+	usleep(200 * 1000);
+
+	for (i = 0; i < nr_readers; i++) {
+		readers[i].fd = open_evdev();
+		if (readers[i].fd < 0) {
+			fprintf(stderr, "no event node for %s\n", DEV_NAME);
+			return 1;
+		}
+		pthread_create(&readers[i].thread, NULL, reader_fn, &readers[i]);
+	}
+
+	start = now_ns();
+	for (f = 0; f < frames; f++) {
+		n = 0;
+		for (i = 0; i < fingers; i++) {
+			set_ev(&frame[n++], EV_ABS, ABS_MT_SLOT, i);
+			set_ev(&frame[n++], EV_ABS, ABS_MT_TRACKING_ID, i + 1);
+			/* always changing, or the core would drop them */
+			set_ev(&frame[n++], EV_ABS, ABS_MT_POSITION_X,
+			       (f + i * 97) % 1080);
+			set_ev(&frame[n++], EV_ABS, ABS_MT_POSITION_Y,
+			       (f + i * 193) % 1920);
+			set_ev(&frame[n++], EV_ABS, ABS_MT_PRESSURE,
+			       1 + (f + i) % 255);
+		}
+		set_ev(&frame[n++], EV_SYN, SYN_REPORT, 0);
+		if (write(ufd, frame, n * sizeof(frame[0])) < 0) {
+			perror("write");
+			return 1;
+		}
+	}
+	elapsed = now_ns() - start;
+
+	/* end marker: pressure 0 on slot 0 */
+	n = 0;
+	set_ev(&frame[n++], EV_ABS, ABS_MT_SLOT, 0);
+	set_ev(&frame[n++], EV_ABS, ABS_MT_PRESSURE, 0);
+	set_ev(&frame[n++], EV_SYN, SYN_REPORT, 0);
+	if (write(ufd, frame, n * sizeof(frame[0])) < 0)
+		perror("write");
+
+	for (i = 0; i < nr_readers; i++) {
+		pthread_join(readers[i].thread, NULL);
+		events += readers[i].events;
+		wakeups += readers[i].wakeups;
+		dropped += readers[i].dropped;
+		close(readers[i].fd);
+	}
+	ioctl(ufd, UI_DEV_DESTROY);
+	close(ufd);
+
+	printf("%d fingers, %d readers, %ld frames in %lld ms\n",
+	       fingers, nr_readers, frames, elapsed / 1000000);
+	printf("writer:  %lld ns/frame\n", elapsed / frames);
+	printf("readers: %llu events/s each, %.2f wakeups/frame, "
+	       "%.1f events/wakeup, %lu drops\n",
+	       (unsigned long long)events * 1000000000ULL / elapsed / nr_readers,
+	       (double)wakeups / nr_readers / frames,
+	       wakeups ? (double)events / wakeups : 0.0, dropped);
+
+	return 0;
+}
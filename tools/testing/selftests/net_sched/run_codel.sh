@@ -0,0 +1,78 @@
+#!/bin/sh
+#
+# Compare ping latency through a 10mbit bottleneck saturated by a ping
+# flood, with pfifo and with the codel and fq_codel qdiscs.  A standing
+# queue builds up behind pfifo; the AQMs must keep the latency well
+# below that.  The link is a veth pair between two network namespaces,
+# with netem adding the path delay on the return side.
+
+RATE=${RATE:-10mbit}
+DELAY=${DELAY:-20ms}
+DURATION=${DURATION:-10}
+# Requests the flood keeps in flight, enough to overrun $RATE
+PRELOAD=${PRELOAD:-64}
+NS1=codel-test-1
+NS2=codel-test-2
+
+cleanup()
+{
+	ip netns del $NS1 2>/dev/null
+	ip netns del $NS2 2>/dev/null
+}
+
+if [ "$(id -u)" != 0 ] || ! which tc ping >/dev/null 2>&1 ||
+   ! ip netns add $NS1 2>/dev/null || ! ip netns add $NS2 ||
+   ! ip link add veth0 netns $NS1 type veth peer name veth1 netns $NS2 ||
+   ! ip netns exec $NS2 tc qdisc add dev veth1 root netem delay $DELAY; then
+	echo "net_sched: needs root, tc, ping, veth and netem [SKIP]"
+	cleanup
+	exit 0
+fi
+ip -n $NS1 addr add 10.99.0.1/24 dev veth0
+ip -n $NS2 addr add 10.99.0.2/24 dev veth1
+ip -n $NS1 link set veth0 up
+ip -n $NS2 link set veth1 up
+
+# avg_rtt <qdisc>: print the average RTT in ms of a ping measured while
+# a flood from the same host fills the bottleneck queue.
+avg_rtt()
+{
+	ip netns exec $NS1 tc qdisc replace dev veth0 root handle 1: \
+		tbf rate $RATE burst 10k latency 1s || return 1
+	# veth has no tx queue length for pfifo to default to
+	[ $1 = pfifo ] && opts="limit 1000" || opts=
+	ip netns exec $NS1 tc qdisc add dev veth0 parent 1:1 handle 10: \
+		$1 $opts || return 1
+	ip netns exec $NS1 ping -q -f -l $PRELOAD -s 1400 -w $DURATION \
+		10.99.0.2 >/dev/null 2>&1 &
+	ip netns exec $NS1 ping -q -i 0.2 -w $DURATION 10.99.0.2 |
+		sed -n 's|^rtt [^=]*= [^/]*/\([^/]*\)/.*|\1|p'
+	wait
+	ip netns exec $NS1 tc -s qdisc show dev veth0 >&2
+	ip netns exec $NS1 tc qdisc del dev veth0 root
+}
+
+ret=0
+for qdisc in pfifo codel fq_codel; do
+	rtt=$(avg_rtt $qdisc)
+	if [ -z "$rtt" ]; then
+		echo "$qdisc: no result"
+		ret=1
+		continue
+	fi
+	echo "$qdisc: average rtt ${rtt}ms"
+	eval rtt_$qdisc=$rtt
+done
+
+for qdisc in codel fq_codel; do
+	[ $ret = 0 ] || break
+	eval rtt=\$rtt_$qdisc
+	if ! awk "BEGIN { exit !($rtt * 2 < $rtt_pfifo) }"; then
+		echo "$qdisc: latency not below half of pfifo's [FAIL]"
+		ret=1
+	fi
+done
+
+cleanup
+[ $ret = 0 ] && echo "net_sched: codel [PASS]"
+exit $ret
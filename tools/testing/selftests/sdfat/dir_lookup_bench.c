@@ -0,0 +1,160 @@
+/*
+ * sdFAT large directory lookup benchmark.
+ *
+ * Times three kinds of lookups in a directory holding many files, the
+ * way a camera roll on an SD card is used:
+ *  hit    - stat() of existing names, each name once, in scattered order
+ *  miss   - stat() of names that do not exist
+ *  create - creat() of new names (a miss followed by placing the entry)
+ * When run as root the dentry and inode caches are dropped before each
+ * phase so that every lookup reaches the filesystem.
+ *
+ * Usage: dir_lookup_bench [-p] [-n files] [-l lookups] DIR
+ *   -p  populate DIR with the files first (see mkimage.sh)
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* prime, so that i * STRIDE % nr_files visits every file once */
+#define STRIDE	7919
+
+static int nr_files = 20000;
+static int nr_lookups = 2000;
+static const char *dir;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void drop_caches(void)
+{
+	int fd;
+
+	sync();
+	fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+	if (fd < 0)
+		return;
+	if (write(fd, "3", 1) != 1)
+		perror("drop_caches");
+	close(fd);
+}
+
+static void name(char *buf, size_t len, const char *prefix, int i)
+{
+	snprintf(buf, len, "%s/%s_%08d.JPG", dir, prefix, i);
+}
+
+static int populate(void)
+{
+	char path[4096];
+	int i, fd;
+
+	for (i = 0; i < nr_files; i++) {
+		name(path, sizeof(path), "IMG", i);
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0) {
+			perror(path);
+			return -1;
+		}
+		close(fd);
+	}
+	return 0;
+}
+
+static int run(const char *tag)
+{
+	char path[4096];
+	struct stat st;
+	double start, elapsed;
+	int i, fd, idx;
+
+	drop_caches();
+	start = now_us();
+	for (i = 0; i < nr_lookups; i++) {
+		if (!strcmp(tag, "hit")) {
+			idx = (int)(((long long)i * STRIDE) % nr_files);
+			name(path, sizeof(path), "IMG", idx);
+			if (stat(path, &st)) {
+				perror(path);
+				return -1;
+			}
+		} else if (!strcmp(tag, "miss")) {
+			name(path, sizeof(path), "MISS", i);
+			if (!stat(path, &st) || errno != ENOENT) {
+				fprintf(stderr, "%s: unexpected result\n", path);
+				return -1;
+			}
+		} else {
+			name(path, sizeof(path), "NEW", i);
+			fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+			if (fd < 0) {
+				perror(path);
+				return -1;
+			}
+			close(fd);
+		}
+	}
+	elapsed = now_us() - start;
+
+	printf("%-8s %d files, %d lookups: %.1f us/lookup\n",
+	       tag, nr_files, nr_lookups, elapsed / nr_lookups);
+
+	if (!strcmp(tag, "create")) {
+		for (i = 0; i < nr_lookups; i++) {
+			name(path, sizeof(path), "NEW", i);
+			unlink(path);
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int opt, do_populate = 0;
+
+	while ((opt = getopt(argc, argv, "pn:l:")) != -1) {
+		switch (opt) {
+		case 'p':
+			do_populate = 1;
+			break;
+		case 'n':
+			nr_files = atoi(optarg);
+			break;
+		case 'l':
+			nr_lookups = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || nr_files < 1 || nr_lookups < 1)
+		goto usage;
+	dir = argv[optind];
+
+	if (do_populate && populate())
+		return 1;
+
+	if (geteuid())
+		printf("not root, caches are not dropped between phases\n");
+
+	if (run("hit") || run("miss") || run("create"))
+		return 1;
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-p] [-n files] [-l lookups] DIR\n", argv[0]);
+	return 1;
+}
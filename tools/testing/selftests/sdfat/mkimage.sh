@@ -0,0 +1,29 @@
+#!/bin/sh
+#
+# Build an exFAT image with one large directory for dir_lookup_bench.
+#
+# Usage: mkimage.sh IMAGE [NR_FILES] [SIZE_MB]
+#
+# IMAGE gets a DCIM/Camera directory holding NR_FILES empty files named
+# like dir_lookup_bench expects.  Needs root, mkfs.exfat and sdfat.
+
+IMAGE=$1
+NR_FILES=${2:-20000}
+SIZE_MB=${3:-512}
+MNT=$(mktemp -d)
+
+if [ -z "$IMAGE" ]; then
+	echo "usage: $0 IMAGE [NR_FILES] [SIZE_MB]"
+	exit 1
+fi
+
+dd if=/dev/zero of="$IMAGE" bs=1M count=0 seek="$SIZE_MB" 2>/dev/null || exit 1
+mkfs.exfat "$IMAGE" >/dev/null || exit 1
+
+mount -t sdfat -o loop "$IMAGE" "$MNT" || exit 1
+mkdir -p "$MNT/DCIM/Camera"
+./dir_lookup_bench -p -n "$NR_FILES" -l 1 "$MNT/DCIM/Camera" >/dev/null
+ret=$?
+umount "$MNT"
+rmdir "$MNT"
+exit $ret
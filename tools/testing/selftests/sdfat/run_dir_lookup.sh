@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# Compare large directory lookups on sdFAT with and without the
+# directory index (mount option "nodirindex").
+
+NR_FILES=${NR_FILES:-20000}
+IMAGE=$(mktemp)
+MNT=$(mktemp -d)
+
+cleanup()
+{
+	umount "$MNT" 2>/dev/null
+	rmdir "$MNT"
+	rm -f "$IMAGE"
+}
+
+if [ "$(id -u)" != 0 ] || ! which mkfs.exfat >/dev/null 2>&1 ||
+   ! grep -qw sdfat /proc/filesystems; then
+	echo "sdfat: needs root, mkfs.exfat and sdfat [SKIP]"
+	cleanup
+	exit 0
+fi
+
+ret=0
+./mkimage.sh "$IMAGE" "$NR_FILES" || ret=1
+
+for opts in nodirindex defaults; do
+	[ $ret = 0 ] || break
+	echo "mount -o $opts:"
+	mount -t sdfat -o loop,$opts "$IMAGE" "$MNT" || { ret=1; break; }
+	./dir_lookup_bench -n "$NR_FILES" "$MNT/DCIM/Camera" || ret=1
+	umount "$MNT"
+done
+
+cleanup
+exit $ret
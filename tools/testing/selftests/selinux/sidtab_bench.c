@@ -0,0 +1,152 @@
+/*
+ * sidtab context to SID lookup latency against SID table size.
+ *
+ * Each write of a context to /sys/fs/selinux/context goes through
+ * security_context_to_sid(), i.e. sidtab_context_to_sid().  The table is
+ * grown by writing new MLS category variants of our own context, and
+ * after each growth step lookups of existing contexts are timed in an
+ * order that defeats the sidtab MRU cache.
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CONTEXT_NODE	"/sys/fs/selinux/context"
+#define MAX_CONTEXTS	8192
+#define LOOKUPS		4096
+
+static char base[256];
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int write_context(const char *ctx)
+{
+	char buf[256];
+	int fd, ret = 0;
+
+	fd = open(CONTEXT_NODE, O_RDWR);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, ctx, strlen(ctx) + 1) < 0 || read(fd, buf, sizeof(buf)) < 0)
+		ret = -errno;
+	close(fd);
+	return ret;
+}
+
+/* user:role:type of our own context, with the level dropped */
+static int read_base(void)
+{
+	char ctx[256];
+	char *p;
+	int fd, n, fields = 0;
+
+	fd = open("/proc/self/attr/current", O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = read(fd, ctx, sizeof(ctx) - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	ctx[n] = '\0';
+
+	for (p = ctx; *p; p++) {
+		if (*p == ':' && ++fields == 3) {
+			*p = '\0';
+			strcpy(base, ctx);
+			return 0;
+		}
+	}
+	return -1;	/* no MLS level, nothing to vary */
+}
+
+static void make_context(char *buf, size_t len, int i)
+{
+	snprintf(buf, len, "%s:s0:c%d,c%d", base, i % 512, 512 + i / 512);
+}
+
+static long long time_lookups(int n)
+{
+	char ctx[256];
+	long long start;
+	int i, idx;
+
+	start = now_ns();
+	for (i = 0; i < LOOKUPS; i++) {
+		/* stride through the set so the MRU cache never hits */
+		idx = (int)((i * 2654435761u) % (unsigned int)n);
+		make_context(ctx, sizeof(ctx), idx);
+		if (write_context(ctx))
+			return -1;
+	}
+	return (now_ns() - start) / LOOKUPS;
+}
+
+static long long time_cached(void)
+{
+	char ctx[256];
+	long long start;
+	int i;
+
+	make_context(ctx, sizeof(ctx), 0);
+	start = now_ns();
+	for (i = 0; i < LOOKUPS; i++)
+		if (write_context(ctx))
+			return -1;
+	return (now_ns() - start) / LOOKUPS;
+}
+
+int main(void)
+{
+	char ctx[256];
+	long long cached, ns;
+	int i, n = 0, step;
+
+	if (access(CONTEXT_NODE, W_OK) || read_base()) {
+		printf("sidtab_bench: selinuxfs or MLS context not available, skip\n");
+		return 0;
+	}
+
+	make_context(ctx, sizeof(ctx), 0);
+	if (write_context(ctx)) {
+		printf("sidtab_bench: %s rejected by policy, skip\n", ctx);
+		return 0;
+	}
+	n = 1;
+
+	cached = time_cached();
+	printf("sidtab_bench: cached lookup %lld ns (syscall baseline)\n",
+	       cached);
+
+	for (step = 256; step <= MAX_CONTEXTS; step *= 2) {
+		for (i = n; i < step; i++) {
+			make_context(ctx, sizeof(ctx), i);
+			if (write_context(ctx)) {
+				printf("sidtab_bench: failed to add context %d\n", i);
+				return 1;
+			}
+		}
+		n = step;
+		ns = time_lookups(n);
+		if (ns < 0) {
+			printf("sidtab_bench: lookup failed\n");
+			return 1;
+		}
+		printf("sidtab_bench: %5d added contexts: %lld ns/lookup "
+		       "(%lld ns over cached)\n", n, ns, ns - cached);
+	}
+	printf("sidtab_bench: [PASS]\n");
+	return 0;
+}
@@ -0,0 +1,256 @@
+/*
+ * MTP receive with a short packet in the middle of a transfer.
+ *
+ * Needs the MTP function bound to a gadget that is looped back to this
+ * machine (dummy_hcd), so that the test is both the device, through
+ * /dev/mtp_usb, and the host, through usbfs on the "MTP" interface.
+ *
+ * The device side asks for a file of FILE_LEN bytes with pipelined rx
+ * requests.  The host sends only DATA_LEN bytes, ending in a short
+ * packet, and right behind it a 12 byte container.  The transfer must
+ * end at the short packet with exactly DATA_LEN bytes in the file, and
+ * the next read() of /dev/mtp_usb must return the container, even if
+ * it landed in one of the rx requests queued behind the short packet.
+ *
+ * Skips when there is no MTP gadget or no usbfs access.
+ *
+ * Usage: mtp_short_rx
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/usbdevice_fs.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* from include/linux/usb/f_mtp.h */
+struct mtp_file_range {
+	int		fd;
+	int64_t		offset;
+	int64_t		length;
+	uint16_t	command;
+	uint32_t	transaction_id;
+};
+#define MTP_RECEIVE_FILE	_IOW('M', 1, struct mtp_file_range)
+
+#define MTP_DEV		"/dev/mtp_usb"
+#define SYS_USB		"/sys/bus/usb/devices"
+#define FILE_LEN	(4 * 65536)
+#define DATA_LEN	100000		/* not a multiple of any maxpacket */
+#define CHUNK		16384		/* usbfs bulk transfer limit */
+#define CONTAINER_LEN	12
+#define TIMEOUT		5		/* seconds */
+
+static unsigned char data[DATA_LEN], container[CONTAINER_LEN];
+static int usb_fd, ep;
+static int host_ret;
+
+static int read_sysfs(const char *dir, const char *name, char *buf, int len)
+{
+	char path[1024];
+	int fd, n;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+	buf[n] = 0;
+	if (buf[n - 1] == '\n')
+		buf[n - 1] = 0;
+	return 0;
+}
+
+/* find the "MTP" interface: its usbfs node, number and bulk OUT ep */
+static int find_host_side(char *node, int len, int *intf, int *ep)
+{
+	char dir[512], sub[800], buf[64], bus[16], dev[16];
+	struct dirent *de, *ee;
+	DIR *d, *e;
+	int found = 0;
+
+	d = opendir(SYS_USB);
+	if (!d)
+		return -1;
+	while (!found && (de = readdir(d))) {
+		if (!strchr(de->d_name, ':'))
+			continue;
+		snprintf(dir, sizeof(dir), SYS_USB "/%s", de->d_name);
+		if (read_sysfs(dir, "interface", buf, sizeof(buf)) ||
+		    strcmp(buf, "MTP"))
+			continue;
+		if (read_sysfs(dir, "bInterfaceNumber", buf, sizeof(buf)))
+			continue;
+		*intf = strtol(buf, NULL, 16);
+
+		e = opendir(dir);
+		if (!e)
+			continue;
+		while ((ee = readdir(e))) {
+			if (strncmp(ee->d_name, "ep_", 3))
+				continue;
+			snprintf(sub, sizeof(sub), "%s/%s", dir, ee->d_name);
+			if (read_sysfs(sub, "direction", buf, sizeof(buf)) ||
+			    strcmp(buf, "out"))
+				continue;
+			if (read_sysfs(sub, "type", buf, sizeof(buf)) ||
+			    strcmp(buf, "Bulk"))
+				continue;
+			if (read_sysfs(sub, "bEndpointAddress", buf,
+				       sizeof(buf)))
+				continue;
+			*ep = strtol(buf, NULL, 16);
+			found = 1;
+			break;
+		}
+		closedir(e);
+
+		/* the interface's parent is the device */
+		snprintf(sub, sizeof(sub), "%s/..", dir);
+		if (found && (read_sysfs(sub, "busnum", bus, sizeof(bus)) ||
+			      read_sysfs(sub, "devnum", dev, sizeof(dev))))
+			found = 0;
+	}
+	closedir(d);
+	if (!found)
+		return -1;
+
+	snprintf(node, len, "/dev/bus/usb/%03d/%03d", atoi(bus), atoi(dev));
+	return 0;
+}
+
+static int bulk_out(int fd, int ep, unsigned char *data, int len)
+{
+	struct usbdevfs_bulktransfer bulk;
+	int n;
+
+	while (len > 0) {
+		bulk.ep = ep;
+		bulk.len = len > CHUNK ? CHUNK : len;
+		bulk.timeout = TIMEOUT * 1000;
+		bulk.data = data;
+		n = ioctl(fd, USBDEVFS_BULK, &bulk);
+		if (n < 0)
+			return -1;
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * The host side.  Both go out back to back, so that the container
+ * lands in a request pipelined behind the short packet.
+ */
+static void *host_send(void *arg)
+{
+	(void)arg;
+	host_ret = bulk_out(usb_fd, ep, data, DATA_LEN) ||
+		   bulk_out(usb_fd, ep, container, CONTAINER_LEN);
+	if (host_ret)
+		perror("USBDEVFS_BULK");
+	return NULL;
+}
+
+static void on_alarm(int sig)
+{
+	(void)sig;
+}
+
+int main(void)
+{
+	static unsigned char check[DATA_LEN];
+	unsigned char buf[512];
+	char node[64], tmp[] = "/tmp/mtp_short_rx.XXXXXX";
+	struct mtp_file_range mfr;
+	struct sigaction sa;
+	pthread_t thread;
+	int mtp_fd, file_fd, intf, i, n, ret = 1;
+
+	mtp_fd = open(MTP_DEV, O_RDWR);
+	if (mtp_fd < 0) {
+		printf("mtp_short_rx: no %s [SKIP]\n", MTP_DEV);
+		return 0;
+	}
+	if (find_host_side(node, sizeof(node), &intf, &ep)) {
+		printf("mtp_short_rx: no looped back MTP interface [SKIP]\n");
+		return 0;
+	}
+	usb_fd = open(node, O_RDWR);
+	if (usb_fd < 0 || ioctl(usb_fd, USBDEVFS_CLAIMINTERFACE, &intf)) {
+		printf("mtp_short_rx: cannot claim %s [SKIP]\n", node);
+		return 0;
+	}
+
+	file_fd = mkstemp(tmp);
+	if (file_fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	unlink(tmp);
+
+	for (i = 0; i < DATA_LEN; i++)
+		data[i] = i * 7 + (i >> 8);
+	for (i = 0; i < CONTAINER_LEN; i++)
+		container[i] = 0xc0 + i;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_alarm;
+	sigaction(SIGALRM, &sa, NULL);
+
+	pthread_create(&thread, NULL, host_send, NULL);
+
+	memset(&mfr, 0, sizeof(mfr));
+	mfr.fd = file_fd;
+	mfr.length = FILE_LEN;
+	n = ioctl(mtp_fd, MTP_RECEIVE_FILE, &mfr);
+	if (n) {
+		printf("MTP_RECEIVE_FILE: %s [FAIL]\n", strerror(errno));
+		goto out;
+	}
+	n = pread(file_fd, check, DATA_LEN, 0);
+	if (n != DATA_LEN || lseek(file_fd, 0, SEEK_END) != DATA_LEN ||
+	    memcmp(check, data, DATA_LEN)) {
+		printf("file does not hold the %d bytes sent [FAIL]\n",
+		       DATA_LEN);
+		goto out;
+	}
+
+	alarm(TIMEOUT);
+	n = read(mtp_fd, buf, sizeof(buf));
+	alarm(0);
+	if (n != CONTAINER_LEN || memcmp(buf, container, CONTAINER_LEN)) {
+		if (n < 0)
+			printf("read after transfer: %s [FAIL]\n",
+			       strerror(errno));
+		else
+			printf("read after transfer: %d bytes [FAIL]\n", n);
+		goto out;
+	}
+
+	printf("short packet ends the transfer, next container kept [PASS]\n");
+	ret = 0;
+out:
+	pthread_join(thread, NULL);
+	if (host_ret)
+		ret = 1;
+	ioctl(usb_fd, USBDEVFS_RELEASEINTERFACE, &intf);
+	close(usb_fd);
+	close(file_fd);
+	close(mtp_fd);
+	return ret;
+}